@@ -0,0 +1,255 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+/**
+ * Benchmark of all optimizers (BA, PGO, ARAP, IMU) with machine readable output.
+ *
+ * Usage:
+ *   sample_vision_optimizer_benchmark [config.ini]
+ *
+ * The config file is created with default values if it does not exist. The results are written to json and csv.
+ * If a baseline json is given in the config, the results are compared against it and the program returns the number
+ * of regressions.
+ */
+#include "saiga/core/framework/framework.h"
+#include "saiga/core/math/random.h"
+#include "saiga/core/time/timer.h"
+#include "saiga/core/util/fileChecker.h"
+#include "saiga/core/util/tostring.h"
+#include "saiga/vision/ceres/CeresArap.h"
+#include "saiga/vision/ceres/CeresBA.h"
+#include "saiga/vision/ceres/CeresPGO.h"
+#include "saiga/vision/g2o/G2OArap.h"
+#include "saiga/vision/g2o/g2oBA2.h"
+#include "saiga/vision/g2o/g2oPoseGraph.h"
+#include "saiga/vision/imu/all.h"
+#include "saiga/vision/recursive/BARecursive.h"
+#include "saiga/vision/recursive/PGORecursive.h"
+#include "saiga/vision/recursive/RecursiveArap.h"
+#include "saiga/vision/scene/BALDataset.h"
+#include "saiga/vision/scene/SynteticPoseGraph.h"
+#include "saiga/vision/scene/SynteticScene.h"
+#include "saiga/vision/util/OptimizerBenchmark.h"
+
+#ifdef SAIGA_USE_OPENMESH
+#    include "saiga/core/model/model_loader_ply.h"
+#endif
+
+#include <algorithm>
+#include <type_traits>
+
+using namespace Saiga;
+
+static OptimizerBenchmarkParams params;
+static OptimizerBenchmark benchmark;
+
+static bool enabled(const std::vector<std::string>& list, const std::string& name)
+{
+    return std::find(list.begin(), list.end(), name) != list.end();
+}
+
+// Solves with params.threads threads. The BA solvers read the thread count from the BAOptions. The other recursive
+// solvers are only multithreaded with the OMP interface of the LMOptimizer.
+template <typename SolverType>
+static OptimizationResults solveThreaded(SolverType& solver)
+{
+    if constexpr (std::is_base_of_v<BABase, SolverType>)
+    {
+        solver.baOptions.helper_threads = params.threads;
+        solver.baOptions.solver_threads = params.threads;
+    }
+
+    if constexpr (std::is_base_of_v<LMOptimizer, SolverType>)
+    {
+        LMOptimizer& lm = solver;
+        if (params.threads > 1 && lm.supportOMP())
+        {
+            OptimizationResults result;
+            double total_time, init_time;
+            {
+                ScopedTimer<double> timer(total_time);
+                {
+                    ScopedTimer<double> init_timer(init_time);
+                    lm.initOMP();
+                }
+                result = lm.solveOMP();
+            }
+            result.total_time = total_time;
+            result.init_time  = init_time;
+            return result;
+        }
+    }
+    return solver.initAndSolve();
+}
+
+// Runs the optimizer on a fresh copy of the problem
+template <typename SolverType, typename ProblemType>
+static void runSolver(const std::string& problem, const std::string& dataset, const std::string& solver_name,
+                      const ProblemType& p)
+{
+    if (!enabled(params.solvers, solver_name)) return;
+
+    auto options = params.optimizationOptions();
+    benchmark.run(
+        problem, dataset, solver_name, params.repetitions,
+        [&]() {
+            ProblemType cpy = p;
+            SolverType solver;
+            solver.create(cpy);
+            solver.optimizationOptions = options;
+            return solveThreaded(solver);
+        },
+        params.threads);
+}
+
+static Scene loadScene(const std::string& file)
+{
+    Scene scene;
+    if (hasEnding(file, ".scene"))
+    {
+        scene.load(SearchPathes::data(file));
+        scene.normalize();
+        scene.addImagePointNoise(0.001);
+        scene.addWorldPointNoise(0.001);
+    }
+    else
+    {
+        BALDataset bald(SearchPathes::data(file));
+        scene = bald.makeScene();
+        scene.applyErrorToImagePoints();
+        scene.addImagePointNoise(0.001);
+        scene.addWorldPointNoise(0.001);
+
+        scene.globalScale = 1.0 / scene.statistics().median;
+        scene.removeOutliers(10);
+        scene.compress();
+    }
+    SAIGA_ASSERT(scene);
+    return scene;
+}
+
+static void benchmarkBA()
+{
+    std::vector<std::pair<std::string, Scene>> scenes;
+    if (params.ba_datasets.empty())
+    {
+        Scene scene = SynteticScene::CircleSphere(5000, 100, 100);
+        scene.addWorldPointNoise(0.01);
+        scene.addImagePointNoise(1.0);
+        scene.addExtrinsicNoise(0.01);
+        scenes.push_back({"synthetic_5000_100", scene});
+    }
+    for (auto& file : params.ba_datasets)
+    {
+        Random::setSeed(params.seed);
+        scenes.push_back({file, loadScene(file)});
+    }
+
+    for (auto& [name, scene] : scenes)
+    {
+        runSolver<BARec>("ba", name, "recursive", scene);
+        runSolver<CeresBA>("ba", name, "ceres", scene);
+        runSolver<g2oBA2>("ba", name, "g2o", scene);
+    }
+}
+
+static void benchmarkPGO()
+{
+    PoseGraph pg     = SyntheticPoseGraph::CircleWithDrift(5, 1000, 6, 0.01, 0.005);
+    std::string name = "circle_drift_1000";
+    runSolver<PGORec>("pgo", name, "recursive", pg);
+    runSolver<CeresPGO>("pgo", name, "ceres", pg);
+    runSolver<g2oPGO>("pgo", name, "g2o", pg);
+}
+
+static void benchmarkArap()
+{
+#ifdef SAIGA_USE_OPENMESH
+    for (auto& file : params.arap_datasets)
+    {
+        PLYLoader pl(file);
+        TriangleMesh<VertexNC, uint32_t> baseMesh = pl.mesh;
+
+        ArabMesh mesh;
+        triangleMeshToOpenMesh(baseMesh, mesh);
+
+        ArapProblem problem;
+        problem.createFromMesh(mesh);
+        for (int id : {0, 10})
+        {
+            problem.target_indices.push_back(id);
+            problem.target_positions.push_back(problem.vertices[id].translation() + Vec3(0, 0.02, 0));
+        }
+
+        runSolver<RecursiveArap>("arap", file, "recursive", problem);
+        runSolver<CeresArap>("arap", file, "ceres", problem);
+        runSolver<G2OArap>("arap", file, "g2o", problem);
+    }
+#else
+    if (!params.arap_datasets.empty()) std::cout << "ARAP benchmark requires OpenMesh. Skipping." << std::endl;
+#endif
+}
+
+static void benchmarkImu()
+{
+    if (!enabled(params.solvers, "recursive")) return;
+
+    Imu::DecoupledImuScene::SolverOptions imu_options;
+    imu_options.solver_flags = Imu::IMU_SOLVE_BA | Imu::IMU_SOLVE_BG | Imu::IMU_SOLVE_VELOCITY |
+                               Imu::IMU_SOLVE_GRAVITY | Imu::IMU_SOLVE_SCALE;
+    imu_options.max_its      = params.max_iterations;
+
+    Imu::DecoupledImuScene scene;
+    scene.MakeRandom(500, 50, 1.0 / 100.0);
+    for (auto& s : scene.states)
+    {
+        s.velocity_and_bias.acc_bias += Vec3::Random() * 0.1;
+        s.velocity_and_bias.gyro_bias += Vec3::Random() * 0.1;
+        s.velocity_and_bias.velocity += Vec3::Random() * 0.1;
+    }
+    scene.PreintAll();
+
+    auto options = params.optimizationOptions();
+    benchmark.run(
+        "imu", "random_500", "recursive", params.repetitions,
+        [&]() {
+            auto cpy = scene;
+            Imu::DecoupledImuSolver solver;
+            solver.optimizationOptions = options;
+            solver.Create(cpy, imu_options);
+            return solveThreaded(solver);
+        },
+        params.threads);
+}
+
+int main(int argc, char** argv)
+{
+    initSaigaSampleNoWindow();
+
+    std::string config = argc > 1 ? argv[1] : "optimizer_benchmark.ini";
+    params.Load(config);
+    std::cout << "Config: " << config << std::endl;
+    std::cout << params.optimizationOptions() << std::endl;
+
+    Random::setSeed(params.seed);
+    srand(params.seed);
+
+    if (enabled(params.problems, "ba")) benchmarkBA();
+    if (enabled(params.problems, "pgo")) benchmarkPGO();
+    if (enabled(params.problems, "arap")) benchmarkArap();
+    if (enabled(params.problems, "imu")) benchmarkImu();
+
+    benchmark.writeJson(params.output_json);
+    benchmark.writeCsv(params.output_csv);
+    std::cout << "Results written to " << params.output_json << " and " << params.output_csv << std::endl;
+
+    if (!params.baseline.empty())
+    {
+        auto baseline = OptimizerBenchmark::readJson(params.baseline);
+        return benchmark.compare(baseline, params.time_tolerance, params.chi2_tolerance);
+    }
+    return 0;
+}
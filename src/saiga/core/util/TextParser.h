@@ -0,0 +1,225 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/config.h"
+#include "saiga/core/math/Types.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if __has_include(<charconv>)
+#    include <charconv>
+#endif
+
+namespace Saiga
+{
+/**
+ * Parses a floating point number from [begin, end).
+ * Returns a pointer to the first character after the number, or begin if no number could be parsed.
+ *
+ * Numbers with at most 19 significant digits, whose mantissa fits into a double and whose exponent is small,
+ * are converted exactly with a single multiplication or division. All other numbers fall back to the
+ * standard library. The result is therefore always identical to strtod.
+ */
+inline const char* parseDouble(const char* begin, const char* end, double& result)
+{
+    static constexpr double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    const char* p = begin;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+
+    uint64_t mantissa = 0;
+    int digits        = 0;
+    int exponent      = 0;
+    bool exact        = true;
+    bool any_digit    = false;
+
+    for (; p != end && *p >= '0' && *p <= '9'; ++p)
+    {
+        any_digit = true;
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa > 0;
+        }
+        else
+        {
+            exponent++;
+            exact &= *p == '0';
+        }
+    }
+    if (p != end && *p == '.')
+    {
+        ++p;
+        for (; p != end && *p >= '0' && *p <= '9'; ++p)
+        {
+            any_digit = true;
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa > 0;
+                exponent--;
+            }
+            else
+            {
+                exact &= *p == '0';
+            }
+        }
+    }
+
+    if (any_digit && p != end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q     = p + 1;
+        bool negative_exp = false;
+        if (q != end && (*q == '-' || *q == '+'))
+        {
+            negative_exp = *q == '-';
+            ++q;
+        }
+        if (q != end && *q >= '0' && *q <= '9')
+        {
+            int e = 0;
+            for (; q != end && *q >= '0' && *q <= '9'; ++q)
+            {
+                if (e < 100000) e = e * 10 + (*q - '0');
+            }
+            exponent += negative_exp ? -e : e;
+            p = q;
+        }
+    }
+
+    if (any_digit && exact && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+    {
+        double d = double(mantissa);
+        d        = exponent < 0 ? d / powers[-exponent] : d * powers[exponent];
+        result   = negative ? -d : d;
+        return p;
+    }
+
+    // Slow path: too many digits, large exponents, inf or nan
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    {
+        const char* first = begin;
+        if (first != end && *first == '+') ++first;
+        auto [ptr, ec] = std::from_chars(first, end, result);
+        if (ec == std::errc()) return ptr;
+        if (ec == std::errc::invalid_argument) return begin;
+        // out of range -> strtod below returns +-inf or 0
+    }
+#endif
+    char buffer[128];
+    size_t n = std::min<size_t>(end - begin, sizeof(buffer) - 1);
+    std::memcpy(buffer, begin, n);
+    buffer[n] = 0;
+    char* ptr;
+    result = std::strtod(buffer, &ptr);
+    return begin + (ptr - buffer);
+}
+
+/**
+ * Parses whitespace separated numbers from a character buffer.
+ * A replacement for std::istream >> on large text files, where the stream overhead dominates the loading time.
+ *
+ * Usage:
+ *
+ *   TextParser parser(line_begin, line_end);
+ *   int id;
+ *   double x;
+ *   parser >> id >> x;
+ *   SAIGA_ASSERT(parser);
+ */
+struct TextParser
+{
+    TextParser(const char* begin, const char* end) : ptr(begin), end(end) {}
+
+    // false if one of the previous reads failed
+    explicit operator bool() const { return ok; }
+
+    void skipWhitespace()
+    {
+        while (ptr != end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r')) ++ptr;
+    }
+
+    bool atEnd()
+    {
+        skipWhitespace();
+        return ptr == end;
+    }
+
+    void read(double& v)
+    {
+        skipWhitespace();
+        const char* next = parseDouble(ptr, end, v);
+        ok &= next != ptr;
+        ptr = next;
+    }
+
+    void read(float& v)
+    {
+        double d;
+        read(d);
+        v = d;
+    }
+
+    void read(long& v)
+    {
+        skipWhitespace();
+        bool negative = false;
+        if (ptr != end && (*ptr == '-' || *ptr == '+'))
+        {
+            negative = *ptr == '-';
+            ++ptr;
+        }
+        const char* first = ptr;
+        long result       = 0;
+        for (; ptr != end && *ptr >= '0' && *ptr <= '9'; ++ptr) result = result * 10 + (*ptr - '0');
+        ok &= ptr != first;
+        v = negative ? -result : result;
+    }
+
+    void read(int& v)
+    {
+        long l;
+        read(l);
+        v = l;
+    }
+
+    void read(bool& v)
+    {
+        long l;
+        read(l);
+        v = l != 0;
+    }
+
+    template <typename T, int _Rows, int _Cols, int _Options, int _MaxRows, int _MaxCols>
+    void read(Eigen::Matrix<T, _Rows, _Cols, _Options, _MaxRows, _MaxCols>& m)
+    {
+        for (int i = 0; i < m.size(); ++i) read(m.data()[i]);
+    }
+
+    template <typename T>
+    TextParser& operator>>(T& v)
+    {
+        read(v);
+        return *this;
+    }
+
+    const char* ptr;
+    const char* end;
+    bool ok = true;
+};
+
+}  // namespace Saiga
@@ -14,6 +14,13 @@
 #include <fstream>
 #include <iostream>
 
+#ifndef _WIN32
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
 namespace Saiga
 {
 namespace File
@@ -114,6 +121,85 @@ void saveFileBinary(const std::string& file, const void* data, size_t size)
     is.close();
 }
 
+MappedFile::MappedFile(const std::string& file, bool sequential)
+{
+#ifndef _WIN32
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        std::cout << "File not found " << file << std::endl;
+        return;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) == 0)
+    {
+        length  = sb.st_size;
+        is_open = true;
+        if (length > 0)
+        {
+            void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                // Sequential files are read once from front to back
+                madvise(p, length, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+                ptr    = (const char*)p;
+                mapped = true;
+            }
+        }
+    }
+    close(fd);
+    if (mapped || (is_open && length == 0)) return;
+#endif
+
+    std::ifstream is(file, std::ios::binary | std::ios::in);
+    if (!is.is_open())
+    {
+        std::cout << "File not found " << file << std::endl;
+        is_open = false;
+        return;
+    }
+    fallback = loadFileBinary(file);
+    ptr      = fallback.data();
+    length   = fallback.size();
+    is_open  = true;
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+    if (mapped) munmap((void*)ptr, length);
+#endif
+}
+
+std::vector<size_t> lineOffsets(const char* data, size_t size)
+{
+    std::vector<size_t> result;
+    if (size == 0) return result;
+
+    // Split the input into equally sized chunks and collect the line starts of each chunk in parallel.
+    int chunks = size < (1 << 20) ? 1 : 64;
+    std::vector<std::vector<size_t>> local(chunks);
+#pragma omp parallel for if (chunks > 1)
+    for (int c = 0; c < chunks; ++c)
+    {
+        size_t begin = size * c / chunks;
+        size_t end   = size * (c + 1) / chunks;
+        auto& l      = local[c];
+        if (c == 0) l.push_back(0);
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (data[i] == '\n' && i + 1 < size) l.push_back(i + 1);
+        }
+    }
+
+    size_t total = 0;
+    for (auto& l : local) total += l.size();
+    result.reserve(total);
+    for (auto& l : local) result.insert(result.end(), l.begin(), l.end());
+    return result;
+}
+
 void removeWindowsLineEnding(std::string& line)
 {
     line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
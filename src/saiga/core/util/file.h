@@ -9,6 +9,7 @@
 #include "saiga/config.h"
 #include "saiga/core/util/DataStructures/ArrayView.h"
 
+#include <string>
 #include <vector>
 
 namespace Saiga
@@ -27,5 +28,37 @@ SAIGA_CORE_API void removeWindowsLineEnding(std::vector<std::string>& file);
 
 
 SAIGA_CORE_API void saveFileBinary(const std::string& file, const void* data, size_t size);
+
+
+/**
+ * Read only view of the complete content of a file.
+ * The file is memory mapped if the platform supports it. Otherwise it is read into memory.
+ * Set sequential to false for files with random access (the kernel then does not read ahead the whole file).
+ */
+class SAIGA_CORE_API MappedFile
+{
+   public:
+    MappedFile(const std::string& file, bool sequential = true);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return ptr; }
+    size_t size() const { return length; }
+
+    bool valid() const { return is_open; }
+    explicit operator bool() const { return valid(); }
+
+   private:
+    const char* ptr = nullptr;
+    size_t length   = 0;
+    bool is_open    = false;
+    bool mapped     = false;
+    std::vector<char> fallback;
+};
+
+// Offsets of the first character of every line. Large inputs are scanned in parallel.
+SAIGA_CORE_API std::vector<size_t> lineOffsets(const char* data, size_t size);
 }  // namespace File
 }  // namespace Saiga
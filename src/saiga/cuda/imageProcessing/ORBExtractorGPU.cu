@@ -134,19 +134,10 @@ void ORBExtractorGPU::DownloadAndDistribute(int level)
         SAIGA_ASSERT(level_data->N <= level_data->h_keypoints.size());
         auto h_keypoints = Saiga::ArrayView<Saiga::KeyPoint<float>>(level_data->h_keypoints).head(level_data->N);
 
-        auto level_keypoints = level_data->dis.Distribute(
+        level_data->N = level_data->dis.Distribute(
             h_keypoints, Saiga::vec2(level_data->fast_min_x, level_data->fast_min_y),
-            Saiga::vec2(level_data->fast_max_x, level_data->fast_max_y), pyramid.Features(level));
-
-        SAIGA_ASSERT(level_keypoints.size() <= h_keypoints.size());
-
-        level_data->N = level_keypoints.size();
-        h_keypoints  = h_keypoints.head(level_data->N);
-
-        for (int i = 0; i < level_data->N; ++i)
-        {
-            h_keypoints[i] = level_keypoints[i];
-        }
+            Saiga::vec2(level_data->fast_max_x, level_data->fast_max_y), pyramid.Features(level),
+            level_data->dis_buffer);
     }
 
     {
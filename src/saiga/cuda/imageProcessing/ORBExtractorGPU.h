@@ -81,6 +81,7 @@ class SAIGA_CUDA_API ORBExtractorGPU
         SaigaNppStreamContext context;
 
         Saiga::QuadtreeFeatureDistributor dis;
+        Saiga::QuadtreeFeatureDistributor::Buffer dis_buffer;
 
         void download() { N = fast->Download(h_keypoints, stream); }
 
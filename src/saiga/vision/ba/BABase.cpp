@@ -14,6 +14,8 @@ void BAOptions::imgui()
 {
     ImGui::InputFloat("huberMono", &huberMono);
     ImGui::InputFloat("huberStereo", &huberStereo);
+    ImGui::InputFloat("supernodalDensity", &supernodalDensity);
+    ImGui::InputInt("mixedPrecisionRefinement", &mixedPrecisionRefinement);
 }
 
 
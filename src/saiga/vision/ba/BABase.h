@@ -22,6 +22,13 @@ struct SAIGA_VISION_API BAOptions
     int helper_threads = 1;
     int solver_threads = 1;
 
+    // The direct solver switches to the supernodal factorization if the density of the schur complement
+    // (see Scene::getSchurDensity) is above this value.
+    float supernodalDensity = 0.1;
+
+    // Number of iterative refinement steps of the single precision direct solver (BARecf).
+    int mixedPrecisionRefinement = 1;
+
     void imgui();
 };
 
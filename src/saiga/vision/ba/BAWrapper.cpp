@@ -35,6 +35,12 @@ BAWrapper::BAWrapper(const Framework& _fw) : fw(_fw)
     {
 #ifdef SAIGA_USE_EIGENRECURSIVE
         ba = std::unique_ptr<BABase>(new BARec);
+#endif
+    }
+    else if (fw == Framework::RecursiveFloat)
+    {
+#ifdef SAIGA_USE_EIGENRECURSIVE
+        ba = std::unique_ptr<BABase>(new BARecf);
 #endif
     }
     else if (fw == Framework::Ceres)
@@ -76,6 +82,10 @@ OptimizationResults BAWrapper::initAndSolve(const OptimizationOptions& optimizat
 Optimizer* BAWrapper::opt()
 {
     if (fw == Framework::Recursive) return static_cast<BARec*>(ba.get());
+#ifdef SAIGA_USE_EIGENRECURSIVE
+    else if (fw == Framework::RecursiveFloat)
+        return static_cast<BARecf*>(ba.get());
+#endif
 #ifdef SAIGA_USE_CERES
     else if (fw == Framework::Ceres)
         return static_cast<CeresBA*>(ba.get());
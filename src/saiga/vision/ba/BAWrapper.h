@@ -18,6 +18,8 @@ class SAIGA_VISION_API BAWrapper
     {
         Best,
         Recursive,
+        // Recursive solver with a single precision linear system
+        RecursiveFloat,
         Ceres,
         G2O
     };
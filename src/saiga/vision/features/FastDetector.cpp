@@ -0,0 +1,270 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "FastDetector.h"
+
+#include "saiga/core/util/assert.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#    include <immintrin.h>
+#endif
+
+namespace Saiga
+{
+// Bresenham circle with radius 3 (dx, dy)
+static constexpr int circle_x[16] = {0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3, -3, -3, -2, -1};
+static constexpr int circle_y[16] = {-3, -3, -2, -1, 0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3};
+
+// Rows per band in Detect
+static constexpr int band_size = 32;
+
+#if defined(__AVX2__)
+struct FastVecAVX2
+{
+    using V                    = __m256i;
+    static constexpr int width = 32;
+    static V load(const unsigned char* p) { return _mm256_loadu_si256((const V*)p); }
+    static V set1(int v) { return _mm256_set1_epi8((char)v); }
+    static V adds(V a, V b) { return _mm256_adds_epu8(a, b); }
+    static V subs(V a, V b) { return _mm256_subs_epu8(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_epi8(a, b); }
+    static V and_(V a, V b) { return _mm256_and_si256(a, b); }
+    static V or_(V a, V b) { return _mm256_or_si256(a, b); }
+    static V xor_(V a, V b) { return _mm256_xor_si256(a, b); }
+    static V max(V a, V b) { return _mm256_max_epu8(a, b); }
+    static V cmpeq(V a, V b) { return _mm256_cmpeq_epi8(a, b); }
+    static V zero() { return _mm256_setzero_si256(); }
+    static uint32_t movemask(V a) { return (uint32_t)_mm256_movemask_epi8(a); }
+};
+using FastVec = FastVecAVX2;
+#elif defined(__SSE2__)
+struct FastVecSSE2
+{
+    using V                    = __m128i;
+    static constexpr int width = 16;
+    static V load(const unsigned char* p) { return _mm_loadu_si128((const V*)p); }
+    static V set1(int v) { return _mm_set1_epi8((char)v); }
+    static V adds(V a, V b) { return _mm_adds_epu8(a, b); }
+    static V subs(V a, V b) { return _mm_subs_epu8(a, b); }
+    static V sub(V a, V b) { return _mm_sub_epi8(a, b); }
+    static V and_(V a, V b) { return _mm_and_si128(a, b); }
+    static V or_(V a, V b) { return _mm_or_si128(a, b); }
+    static V xor_(V a, V b) { return _mm_xor_si128(a, b); }
+    static V max(V a, V b) { return _mm_max_epu8(a, b); }
+    static V cmpeq(V a, V b) { return _mm_cmpeq_epi8(a, b); }
+    static V zero() { return _mm_setzero_si128(); }
+    static uint32_t movemask(V a) { return (uint32_t)_mm_movemask_epi8(a); }
+};
+using FastVec = FastVecSSE2;
+#endif
+
+#if defined(__SSE2__) || defined(__AVX2__)
+// Bit i is set if pixel x+i is a corner for the given threshold
+template <typename T>
+static uint32_t cornerMask(const unsigned char* center, const int* offsets, int threshold, int arc_length)
+{
+    using V = typename T::V;
+
+    V p       = T::load(center);
+    V t       = T::set1(threshold);
+    V bright  = T::adds(p, t);
+    V dark    = T::subs(p, t);
+    V zero    = T::zero();
+    V all_one = T::cmpeq(zero, zero);
+
+    // 0xFF if the circle pixel is brighter/darker than the threshold
+    V is_bright[16], is_dark[16];
+    auto compare = [&](int k) {
+        V c          = T::load(center + offsets[k]);
+        is_bright[k] = T::xor_(all_one, T::cmpeq(T::subs(c, bright), zero));
+        is_dark[k]   = T::xor_(all_one, T::cmpeq(T::subs(dark, c), zero));
+    };
+
+    // Any arc of 9 or more pixels contains two neighbouring pixels of {0, 4, 8, 12}
+    for (int k : {0, 4, 8, 12}) compare(k);
+    V candidates_bright = T::and_(T::or_(is_bright[0], is_bright[8]), T::or_(is_bright[4], is_bright[12]));
+    V candidates_dark   = T::and_(T::or_(is_dark[0], is_dark[8]), T::or_(is_dark[4], is_dark[12]));
+    if (T::movemask(T::or_(candidates_bright, candidates_dark)) == 0) return 0;
+
+    for (int k = 0; k < 16; ++k)
+    {
+        if (k % 4 != 0) compare(k);
+    }
+
+    // Length of the longest run of bright and dark pixels on the circle (wrapping around).
+    // run = (run + 1) & is_bright, with run - (-1) = run + 1
+    V run_bright = zero, run_dark = zero;
+    V max_bright = zero, max_dark = zero;
+    for (int k = 0; k < 16 + arc_length - 1; ++k)
+    {
+        run_bright = T::and_(T::sub(run_bright, all_one), is_bright[k % 16]);
+        run_dark   = T::and_(T::sub(run_dark, all_one), is_dark[k % 16]);
+        max_bright = T::max(max_bright, run_bright);
+        max_dark   = T::max(max_dark, run_dark);
+    }
+
+    // max >= arc_length <=> max(max, arc_length) == max
+    V n         = T::set1(arc_length);
+    V is_corner = T::or_(T::cmpeq(T::max(max_bright, n), max_bright), T::cmpeq(T::max(max_dark, n), max_dark));
+    return T::movemask(is_corner);
+}
+#endif
+
+FastDetector::FastDetector(int arc_length, bool nonmax_suppression)
+    : arc_length(arc_length), nonmax_suppression(nonmax_suppression)
+{
+    SAIGA_ASSERT(arc_length == 9 || arc_length == 12, "Only FAST-9 and FAST-12 are supported.");
+}
+
+int FastDetector::Score(ImageView<unsigned char> image, int x, int y) const
+{
+    int center = image(y, x);
+    std::array<int, 16> d;
+    for (int k = 0; k < 16; ++k)
+    {
+        d[k] = image(y + circle_y[k], x + circle_x[k]) - center;
+    }
+
+    // The largest minimum difference over all arcs
+    int best = std::numeric_limits<int>::min();
+    for (int start = 0; start < 16; ++start)
+    {
+        int min_bright = std::numeric_limits<int>::max();
+        int min_dark   = std::numeric_limits<int>::max();
+        for (int k = 0; k < arc_length; ++k)
+        {
+            int v      = d[(start + k) % 16];
+            min_bright = std::min(min_bright, v);
+            min_dark   = std::min(min_dark, -v);
+        }
+        best = std::max(best, std::max(min_bright, min_dark));
+    }
+
+    // corner <=> all differences > threshold
+    return best - 1;
+}
+
+void FastDetector::DetectRows(ImageView<unsigned char> image, int threshold, int row_begin, int row_end,
+                              std::vector<KeypointType>& keypoints, std::vector<int>& scratch) const
+{
+    SAIGA_ASSERT(threshold >= 0 && threshold < 255);
+    const int border = 3;
+    const int rows   = image.rows;
+    const int cols   = image.cols;
+
+    row_begin = std::max(row_begin, border);
+    row_end   = std::min(row_end, rows - border);
+    if (row_begin >= row_end || cols <= 2 * border) return;
+
+    std::array<int, 16> offsets;
+    for (int k = 0; k < 16; ++k)
+    {
+        offsets[k] = circle_y[k] * image.pitchBytes + circle_x[k];
+    }
+
+    // score + 1 of the last three rows (0 = no corner)
+    if ((int)scratch.size() < 3 * cols) scratch.resize(3 * cols);
+    std::fill(scratch.begin(), scratch.begin() + 3 * cols, 0);
+    int* scores[3] = {scratch.data(), scratch.data() + cols, scratch.data() + 2 * cols};
+
+    auto score_row = [&](int y, int* out) {
+        std::fill(out, out + cols, 0);
+        const unsigned char* row = image.rowPtr(y);
+
+        int x = border;
+#if defined(__SSE2__) || defined(__AVX2__)
+        for (; x + FastVec::width + border <= cols; x += FastVec::width)
+        {
+            uint32_t mask = cornerMask<FastVec>(row + x, offsets.data(), threshold, arc_length);
+            if (mask == 0) continue;
+            for (int i = 0; i < FastVec::width; ++i)
+            {
+                if ((mask >> i) & 1) out[x + i] = Score(image, x + i, y) + 1;
+            }
+        }
+#endif
+        for (; x < cols - border; ++x)
+        {
+            int score = Score(image, x, y);
+            if (score >= threshold) out[x] = score + 1;
+        }
+    };
+
+    auto emit = [&](int x, int y, int score_plus_one) {
+        keypoints.emplace_back(float(x), float(y), keypoint_size, -1.f, float(score_plus_one - 1));
+    };
+
+    if (!nonmax_suppression)
+    {
+        for (int y = row_begin; y < row_end; ++y)
+        {
+            score_row(y, scores[0]);
+            for (int x = border; x < cols - border; ++x)
+            {
+                if (scores[0][x]) emit(x, y, scores[0][x]);
+            }
+        }
+        return;
+    }
+
+    // The neighbouring rows of the band are also scored, so that the suppression at the band borders is the same as
+    // for the full image.
+    int first = std::max(row_begin - 1, border);
+    int last  = std::min(row_end + 1, rows - border);
+
+    for (int y = first; y <= last; ++y)
+    {
+        if (y < last)
+            score_row(y, scores[y % 3]);
+        else
+            std::fill(scores[y % 3], scores[y % 3] + cols, 0);
+
+        // Non maximum suppression of the previous row
+        int ny = y - 1;
+        if (ny < row_begin || ny >= row_end) continue;
+
+        // The row before 'first' has not been written yet and is still zero
+        const int* prev = scores[(ny + 2) % 3];
+        const int* curr = scores[ny % 3];
+        const int* next = scores[y % 3];
+        for (int x = border; x < cols - border; ++x)
+        {
+            int s = curr[x];
+            if (s == 0) continue;
+            if (s > curr[x - 1] && s > curr[x + 1] && s > prev[x - 1] && s > prev[x] && s > prev[x + 1] &&
+                s > next[x - 1] && s > next[x] && s > next[x + 1])
+            {
+                emit(x, ny, s);
+            }
+        }
+    }
+}
+
+void FastDetector::Detect(ImageView<unsigned char> image, int threshold, std::vector<KeypointType>& keypoints,
+                          int num_threads) const
+{
+    keypoints.clear();
+    int num_bands = iDivUp(image.rows, band_size);
+
+    std::vector<std::vector<KeypointType>> band_keypoints(num_bands);
+#pragma omp parallel num_threads(num_threads)
+    {
+        std::vector<int> scratch;
+#pragma omp for schedule(dynamic)
+        for (int b = 0; b < num_bands; ++b)
+        {
+            DetectRows(image, threshold, b * band_size, (b + 1) * band_size, band_keypoints[b], scratch);
+        }
+    }
+
+    for (auto& k : band_keypoints) keypoints.insert(keypoints.end(), k.begin(), k.end());
+}
+
+}  // namespace Saiga
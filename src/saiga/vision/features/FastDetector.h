@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/config.h"
+#include "saiga/core/image/imageView.h"
+#include "saiga/vision/features/Features.h"
+
+#include <vector>
+
+namespace Saiga
+{
+/**
+ * FAST corner detector (Rosten and Drummond, "Machine learning for high-speed corner detection", ECCV 2006).
+ *
+ * A pixel p is a corner for threshold t, if 'arc_length' contiguous pixels of the 16 pixel circle around p are all
+ * brighter than I(p) + t or all darker than I(p) - t.
+ *
+ * The response of a corner is its score: the largest threshold for which it is still a corner.
+ * A single detection with a low threshold therefore also contains the corners of all higher thresholds
+ * (response >= threshold). This also holds for the non-maximum suppression, because a corner is only suppressed by
+ * a neighbour with a higher score.
+ *
+ * The ring comparisons are computed for 32 (AVX2) or 16 (SSE2) pixels at once. The score and the 3x3 non-maximum
+ * suppression are computed in the same pass over the image with a 3 row ring buffer.
+ *
+ * Usage:
+ *
+ *   FastDetector fast(9);
+ *   std::vector<KeyPoint<float>> corners;
+ *   fast.Detect(image, 7, corners);
+ *   // corners with threshold 20: response >= 20
+ */
+class SAIGA_VISION_API FastDetector
+{
+   public:
+    using KeypointType = KeyPoint<float>;
+
+    // arc_length = 9 (FAST-9) or 12 (FAST-12)
+    FastDetector(int arc_length = 9, bool nonmax_suppression = true);
+
+    // All corners with a score >= threshold. The image rows are split into bands, which are processed by
+    // num_threads threads.
+    void Detect(ImageView<unsigned char> image, int threshold, std::vector<KeypointType>& keypoints,
+                int num_threads = 1) const;
+
+    // Corners in the rows [row_begin, row_end). The result is the same as the corresponding rows of Detect.
+    // The keypoints are appended.
+    // Use this function to distribute the tiles of multiple images (for example a pyramid) to threads.
+    // scratch holds the scores of 3 rows. Reuse it (one per thread) to avoid allocations.
+    void DetectRows(ImageView<unsigned char> image, int threshold, int row_begin, int row_end,
+                    std::vector<KeypointType>& keypoints, std::vector<int>& scratch) const;
+
+    // Largest threshold for which the pixel is a corner. Negative if it is not a corner for any threshold.
+    // The pixel must have a distance of at least 3 to the image border.
+    int Score(ImageView<unsigned char> image, int x, int y) const;
+
+    // Size of the returned keypoints (diameter of the circle, same as OpenCV)
+    static constexpr float keypoint_size = 7;
+
+   private:
+    int arc_length;
+    bool nonmax_suppression;
+};
+
+}  // namespace Saiga
@@ -9,183 +9,102 @@
 #include "saiga/core/time/all.h"
 #include "saiga/core/util/assert.h"
 
+#include <algorithm>
+
 
 namespace Saiga
 {
-std::array<QuadtreeFeatureDistributor::QuadtreeNode, 4> QuadtreeFeatureDistributor::QuadtreeNode::splitAndSort(
-    ArrayView<KeyPoint<float>> keypoints, std::array<std::vector<KeyPoint<float>>, 4>& local_kps)
+int QuadtreeFeatureDistributor::Distribute(ArrayView<KeyPoint<float>> keypoints, const vec2& min_position,
+                                           const vec2& max_position, int target_n, Buffer& buffer) const
 {
-    SAIGA_ASSERT(from <= to);
-    vec2 new_size = size * 0.5f;
-    vec2 center   = corner + new_size;
-
+    int n = keypoints.size();
+    if (n <= target_n) return n;
+    if (target_n <= 0) return 0;
 
-    for (auto& kps : local_kps)
-    {
-        kps.clear();
-    }
+    vec2 size  = (max_position - min_position).cwiseMax(vec2(1, 1));
+    auto& best = buffer.cell_best;
 
-    for (auto i : Range<int>(from, to))
+    // Initial cell size for target_n cells
+    float cell_size = std::sqrt(size.x() * size.y() / target_n);
+    int num_candidates;
+    while (true)
     {
-        auto& kp = keypoints[i];
-
-        int less_x = kp.point.x() > center.x();
-        int less_y = kp.point.y() > center.y();
+        int grid_w = std::max(1, iCeil(size.x() / cell_size));
+        int grid_h = std::max(1, iCeil(size.y() / cell_size));
+        best.assign(grid_w * grid_h, -1);
 
-
-        int idx = (less_y << 1) + less_x;
-        SAIGA_ASSERT(idx >= 0 && idx < 4);
-        local_kps[idx].push_back(kp);
-    }
-
-
-    std::array<QuadtreeNode, 4> result;
-
-
-    int count          = 0;
-    int previous_count = 0;
-    for (int k : Range<int>(0, 4))
-    {
-        for (auto& kp : local_kps[k])
+        num_candidates = 0;
+        for (int i = 0; i < n; ++i)
         {
-            keypoints[from + count] = kp;
-            count++;
+            vec2 p = (keypoints[i].point - min_position) / cell_size;
+            int x  = std::clamp(int(p.x()), 0, grid_w - 1);
+            int y  = std::clamp(int(p.y()), 0, grid_h - 1);
+            int& b = best[y * grid_w + x];
+            if (b == -1)
+            {
+                num_candidates++;
+                b = i;
+            }
+            else if (keypoints[i].response > keypoints[b].response)
+            {
+                b = i;
+            }
         }
 
-        result[k].from = from + previous_count;
-        result[k].to   = from + count;
-        previous_count = count;
+        if (num_candidates >= target_n || cell_size <= 1) break;
 
-        result[k].size = new_size;
+        // Refine so that the expected number of non-empty cells reaches target_n, but at least split each cell into 4.
+        cell_size *= std::clamp(std::sqrt(float(num_candidates) / target_n), 0.5f, 0.9f);
     }
 
-    SAIGA_ASSERT(count == to - from);
-
-    result[0].corner = vec2(corner(0), corner(1));
-    result[1].corner = vec2(center(0), corner(1));
-    result[2].corner = vec2(corner(0), center(1));
-    result[3].corner = vec2(center(0), center(1));
-
-    return result;
-}
-
-std::vector<KeyPoint<float>> QuadtreeFeatureDistributor::Distribute(ArrayView<KeyPoint<float>> keypoints,
-                                                                    const vec2& min_position, const vec2& max_position,
-                                                                    int target_n)
-{
-    inner_nodes.clear();
-    new_inner_nodes.clear();
-    leaf_nodes.clear();
-    new_inner_nodes.reserve(target_n * 4);
-    inner_nodes.reserve(target_n * 4);
-    leaf_nodes.reserve(target_n * 4);
-
-    if ((int)keypoints.size() <= target_n)
+    auto& candidates = buffer.candidates;
+    candidates.clear();
+    for (auto b : best)
     {
-        return {keypoints.begin(), keypoints.end()};
+        if (b != -1) candidates.push_back(b);
     }
 
+    auto by_response = [&](int i1, int i2) { return keypoints[i1].response > keypoints[i2].response; };
 
-    for (auto& v : local_kps)
+    auto& selected = buffer.selected;
+    selected.assign(n, 0);
+    if ((int)candidates.size() >= target_n)
     {
-        v.clear();
-        v.reserve(keypoints.size());
+        std::nth_element(candidates.begin(), candidates.begin() + target_n, candidates.end(), by_response);
+        candidates.resize(target_n);
+        for (auto c : candidates) selected[c] = 1;
     }
-
-    //    SAIGA_BLOCK_TIMER();
-    vec2 center       = (min_position + max_position) * 0.5f;
-    vec2 size         = max_position - min_position;
-    float max_size    = std::max(size(0), size(1));
-    vec2 start_corner = center - vec2(max_size, max_size) * 0.5f;
-
-
-
-    new_inner_nodes.emplace_back(QuadtreeNode(start_corner, vec2(max_size, max_size), 0, keypoints.size()));
-    //    inner_nodes.emplace_back(QuadtreeNode(vec2(0, 0), vec2(size), 0, keypoints.size()));
-    //    inner_nodes.emplace_back(QuadtreeNode(vec2(0, 0), vec2(size(0), size(1) * 2), 0, keypoints.size()));
-    int last_node_count = 0;
-
-    int last_processed_inner = -1;
-    bool bFinish             = false;
-
-    while (!bFinish && !new_inner_nodes.empty())
+    else
     {
-        inner_nodes.swap(new_inner_nodes);
-        new_inner_nodes.clear();
-
-        int node_count = leaf_nodes.size() + inner_nodes.size();
-        if (node_count == last_node_count)
-        {
-            break;
-        }
-        last_node_count = node_count;
-
-        // sort inner nodes by size
-        std::sort(inner_nodes.begin(), inner_nodes.end(),
-                  [](const auto& n1, const auto& n2) { return n1.NumKeypoints() > n2.NumKeypoints(); });
-
-        // split until we have enough
-        for (int i = 0; i < (int)inner_nodes.size(); ++i)
+        // Only possible if many keypoints have the same position. Fill with the best remaining keypoints.
+        for (auto c : candidates) selected[c] = 1;
+        int missing = target_n - candidates.size();
+        candidates.clear();
+        for (int i = 0; i < n; ++i)
         {
-            auto& node = inner_nodes[i];
-
-            SAIGA_ASSERT(node.NumKeypoints() > 1);
-            auto result = node.splitAndSort(keypoints, local_kps);
-
-            for (auto& r : result)
-            {
-                auto size = r.NumKeypoints();
-                if (size == 0)
-                {
-                    continue;
-                }
-                else if (size == 1)
-                {
-                    leaf_nodes.push_back(r);
-                }
-                else
-                {
-                    new_inner_nodes.push_back(r);
-                }
-            }
-
-            int remaining_inner_nodes = inner_nodes.size() - i - 1;
-            if ((int)leaf_nodes.size() + (int)new_inner_nodes.size() + remaining_inner_nodes >= target_n)
-            {
-                last_processed_inner = i;
-                bFinish              = true;
-                break;
-            }
+            if (!selected[i]) candidates.push_back(i);
         }
+        std::nth_element(candidates.begin(), candidates.begin() + missing, candidates.end(), by_response);
+        for (int i = 0; i < missing; ++i) selected[candidates[i]] = 1;
     }
 
-
-    std::vector<KeyPoint<float>> result;
-    result.reserve(leaf_nodes.size() + inner_nodes.size());
-
-    auto add_best_to_result = [&](const auto& node) {
-        auto best = std::max_element(keypoints.begin() + node.from, keypoints.begin() + node.to,
-                                     [](const auto& kp1, const auto& kp2) { return kp1.response < kp2.response; });
-        result.push_back(*best);
-    };
-
-    for (auto& node : leaf_nodes)
-    {
-        add_best_to_result(node);
-    }
-
-    for (auto& node : new_inner_nodes)
-    {
-        add_best_to_result(node);
-    }
-
-
-    for (size_t i = last_processed_inner; i < inner_nodes.size(); ++i)
+    // Move the selected keypoints to the front
+    int num_selected = 0;
+    for (int i = 0; i < n; ++i)
     {
-        add_best_to_result(inner_nodes[i]);
+        if (selected[i]) std::swap(keypoints[num_selected++], keypoints[i]);
     }
+    SAIGA_ASSERT(num_selected == target_n);
+    return num_selected;
+}
 
-    return result;
+std::vector<KeyPoint<float>> QuadtreeFeatureDistributor::Distribute(ArrayView<KeyPoint<float>> keypoints,
+                                                                    const vec2& min_position, const vec2& max_position,
+                                                                    int target_n) const
+{
+    Buffer buffer;
+    int n = Distribute(keypoints, min_position, max_position, target_n, buffer);
+    return {keypoints.begin(), keypoints.begin() + n};
 }
 
 int TemporalKeypointFilter::Filter(int image_height, int image_width, ArrayView<KeyPoint<float>> keypoints)
@@ -15,42 +15,36 @@ namespace Saiga
 {
 // Selects N keypoints from an input array of M keypoints with M >> N.
 // The keypoints are selected so that they are evenly distributed over the image and keypoints with a high response are
-// preferred. This class implements a quadtree-based algorithm similar to the algorithm found in ORB-SLAM2. Differences
-// are in the way how the remaining keypoints are selected and the impolementation itself. This implemenation is around
-// 2x more efficient than the reference impl. of ORB-SLAM2.
+// preferred.
 //
-// This class is not thread safe, because it uses local variables during execution!!!
-// Use one object of this class for each thread!
+// The keypoints are sorted into a regular grid with about N cells in O(M). The best keypoint of each non-empty cell
+// is a candidate. If there are less than N candidates (for example if the keypoints are concentrated in a small
+// region), the grid is refined, similar to the splitting of the quadtree in ORB-SLAM2. Finally, the N candidates with
+// the highest response are selected with nth_element.
+//
+// Distribute is const and all temporary memory is in the caller provided Buffer. It can therefore be called in parallel
+// (for example for each pyramid level) with one Buffer per thread. The Buffer only allocates memory if a larger input
+// is processed.
 class SAIGA_VISION_API QuadtreeFeatureDistributor
 {
    public:
-    QuadtreeFeatureDistributor() = default;
-    std::vector<Saiga::KeyPoint<float>> Distribute(ArrayView<KeyPoint<float>> keypoints, const vec2& min_position,
-                                                   const vec2& max_position, int target_n);
-
-   private:
-    class QuadtreeNode
+    struct Buffer
     {
-       public:
-        QuadtreeNode() {}
-        QuadtreeNode(const vec2& corner, const vec2& size, int from = -1, int to = -1)
-            : corner(corner), size(size), from(from), to(to)
-        {
-        }
-        std::array<QuadtreeNode, 4> splitAndSort(ArrayView<KeyPoint<float>> keypoints,
-                                                 std::array<std::vector<KeyPoint<float>>, 4>& local_kps);
-        int NumKeypoints() const { return to - from; }
-
-        // The other opposite corner is at (corner.x + size, corner.y + size)
-        vec2 corner;
-        vec2 size;
-        int from, to;
+        std::vector<int> cell_best;
+        std::vector<int> candidates;
+        std::vector<char> selected;
     };
 
-    std::vector<QuadtreeNode> leaf_nodes;
-    std::vector<QuadtreeNode> inner_nodes;
-    std::vector<QuadtreeNode> new_inner_nodes;
-    std::array<std::vector<KeyPoint<float>>, 4> local_kps;
+    QuadtreeFeatureDistributor() = default;
+
+    // The selected keypoints are moved to the front of the array (in their original order) and the number of selected
+    // keypoints is returned.
+    int Distribute(ArrayView<KeyPoint<float>> keypoints, const vec2& min_position, const vec2& max_position,
+                   int target_n, Buffer& buffer) const;
+
+    // Returns a copy of the selected keypoints.
+    std::vector<Saiga::KeyPoint<float>> Distribute(ArrayView<KeyPoint<float>> keypoints, const vec2& min_position,
+                                                   const vec2& max_position, int target_n) const;
 };
 
 // Temporal keypoint filter to remove keypoints at the exact same image coordinates over multiple frames. Such keypoints
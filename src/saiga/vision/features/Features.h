@@ -127,10 +127,7 @@ inline int distance(const DescriptorORB& a, const DescriptorORB& b)
     for (int i = 0; i < (int)a.size(); i++)
     {
         auto v = a[i] ^ b[i];
-        // TODO: if this is really a bottleneck we can also use AVX-2
-        // to gain around 25% more performance
-        // according to this source:
-        // https://github.com/kimwalisch/libpopcnt
+        // For many descriptors use the SIMD version hammingDistances() in HammingMatcher.h
         dist += popcnt(v);
     }
 
@@ -153,6 +150,81 @@ inline float distance(const DescriptorSIFT& a, const DescriptorSIFT& b)
 
 
 
+/**
+ * Counts the set bits of each bit position over a set of ORB descriptors.
+ * The counters are stored bit-sliced: plane p contains bit p of all 256 counters. Adding a descriptor is a ripple
+ * carry addition over the planes, which processes 64 counters per instruction (amortized 2 planes per add).
+ */
+struct DescriptorBitCounter
+{
+    void add(const DescriptorORB& d)
+    {
+        DescriptorORB carry = d;
+        for (int p = 0; p < max_planes; ++p)
+        {
+            if (p == num_planes) planes[num_planes++] = {0, 0, 0, 0};
+
+            uint64_t any = 0;
+            for (int w = 0; w < 4; ++w)
+            {
+                uint64_t c   = planes[p][w] & carry[w];
+                planes[p][w] = planes[p][w] ^ carry[w];
+                carry[w]     = c;
+                any |= c;
+            }
+            if (any == 0) break;
+        }
+        count++;
+    }
+
+    /**
+     * A descriptor with all bits set, which are set in at least ceil(count/2) descriptors.
+     * Same result as MeanMatcher::MeanDescriptor.
+     */
+    DescriptorORB majority() const
+    {
+        DescriptorORB result = {0, 0, 0, 0};
+        if (count == 0) return result;
+
+        // Bit-sliced comparison (counter >= threshold) from the most significant plane
+        uint32_t threshold = count / 2 + count % 2;
+
+        // All counters are smaller than 2^num_planes
+        if (num_planes < 32 && (threshold >> num_planes) != 0) return result;
+        for (int w = 0; w < 4; ++w)
+        {
+            uint64_t greater = 0;
+            uint64_t equal   = ~uint64_t(0);
+            for (int p = num_planes - 1; p >= 0; --p)
+            {
+                uint64_t c = planes[p][w];
+                if ((threshold >> p) & 1)
+                {
+                    equal &= c;
+                }
+                else
+                {
+                    greater |= equal & c;
+                    equal &= ~c;
+                }
+            }
+            result[w] = greater | equal;
+        }
+        return result;
+    }
+
+    void clear()
+    {
+        num_planes = 0;
+        count      = 0;
+    }
+
+    static constexpr int max_planes = 32;
+    std::array<DescriptorORB, max_planes> planes;
+    int num_planes = 0;
+    uint32_t count = 0;
+};
+
 template <typename T>
 struct MeanMatcher
 {
@@ -208,39 +280,9 @@ struct MeanMatcher
         }
         else
         {
-            std::vector<int> sum(32 * 8, 0);
-
-            for (size_t i = 0; i < descriptors.size(); ++i)
-            {
-                const auto& d          = descriptors[i];
-                const unsigned char* p = (const unsigned char*)d.data();
-                for (int j = 0; j < 32; ++j, ++p)
-                {
-                    if (*p & (1 << 7)) ++sum[j * 8];
-                    if (*p & (1 << 6)) ++sum[j * 8 + 1];
-                    if (*p & (1 << 5)) ++sum[j * 8 + 2];
-                    if (*p & (1 << 4)) ++sum[j * 8 + 3];
-                    if (*p & (1 << 3)) ++sum[j * 8 + 4];
-                    if (*p & (1 << 2)) ++sum[j * 8 + 5];
-                    if (*p & (1 << 1)) ++sum[j * 8 + 6];
-                    if (*p & (1)) ++sum[j * 8 + 7];
-                }
-            }
-
-            T mean;
-            std::fill(mean.begin(), mean.end(), 0);
-            unsigned char* p = (unsigned char*)mean.data();
-            const int N2     = (int)descriptors.size() / 2 + descriptors.size() % 2;
-            for (size_t i = 0; i < sum.size(); ++i)
-            {
-                if (sum[i] >= N2)
-                {
-                    // set bit
-                    *p |= 1 << (7 - (i % 8));
-                }
-                if (i % 8 == 7) ++p;
-            }
-            return mean;
+            DescriptorBitCounter counter;
+            for (auto& d : descriptors) counter.add(d);
+            return counter.majority();
         }
     }
 
@@ -258,39 +300,9 @@ struct MeanMatcher
         }
         else
         {
-            std::vector<int> sum(32 * 8, 0);
-
-            for (size_t i = 0; i < descriptors.size(); ++i)
-            {
-                const auto& d          = *descriptors[i];
-                const unsigned char* p = (const unsigned char*)d.data();
-                for (int j = 0; j < 32; ++j, ++p)
-                {
-                    if (*p & (1 << 7)) ++sum[j * 8];
-                    if (*p & (1 << 6)) ++sum[j * 8 + 1];
-                    if (*p & (1 << 5)) ++sum[j * 8 + 2];
-                    if (*p & (1 << 4)) ++sum[j * 8 + 3];
-                    if (*p & (1 << 3)) ++sum[j * 8 + 4];
-                    if (*p & (1 << 2)) ++sum[j * 8 + 5];
-                    if (*p & (1 << 1)) ++sum[j * 8 + 6];
-                    if (*p & (1)) ++sum[j * 8 + 7];
-                }
-            }
-
-            T mean;
-            std::fill(mean.begin(), mean.end(), 0);
-            unsigned char* p = (unsigned char*)mean.data();
-            const int N2     = (int)descriptors.size() / 2 + descriptors.size() % 2;
-            for (size_t i = 0; i < sum.size(); ++i)
-            {
-                if (sum[i] >= N2)
-                {
-                    // set bit
-                    *p |= 1 << (7 - (i % 8));
-                }
-                if (i % 8 == 7) ++p;
-            }
-            return mean;
+            DescriptorBitCounter counter;
+            for (auto d : descriptors) counter.add(*d);
+            return counter.majority();
         }
     }
 };
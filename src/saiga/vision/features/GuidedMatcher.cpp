@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "GuidedMatcher.h"
+
+#include "saiga/core/util/Thread/omp.h"
+#include "saiga/core/util/assert.h"
+#include "saiga/vision/features/HammingMatcher.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace Saiga
+{
+int GuidedMatcher::MatchCells(const FeatureGrid2& grid, ArrayView<const KeyPoint<float>> keypoints,
+                              ArrayView<const DescriptorORB> descriptors, ArrayView<const Prediction> predictions,
+                              int threads)
+{
+    SAIGA_ASSERT(keypoints.size() == descriptors.size());
+    int N = predictions.size();
+
+    // Best match of each prediction (-1 = no match)
+    std::vector<Result> best(N);
+
+#pragma omp parallel num_threads(threads)
+    {
+        std::vector<int> distances;
+
+#pragma omp for schedule(dynamic, 16)
+        for (int i = 0; i < N; ++i)
+        {
+            auto& p                   = predictions[i];
+            auto [cell_min, cell_max] = cell_ranges[i];
+            float r2                  = p.radius * p.radius;
+
+            int best_dist = std::numeric_limits<int>::max(), second_dist = std::numeric_limits<int>::max();
+            int best_id = -1;
+
+            for (int y = cell_min.second; y <= cell_max.second; ++y)
+            {
+                auto range = grid.rowIt(y, cell_min.first, cell_max.first);
+                int first  = range.from, n = range.to - range.from;
+                if (n <= 0) continue;
+
+                distances.resize(n);
+                hammingDistances(p.descriptor, descriptors.data() + first, n, distances.data());
+
+                for (int k = 0; k < n; ++k)
+                {
+                    int dis = distances[k];
+                    if (dis >= second_dist) continue;
+
+                    auto& kp = keypoints[first + k];
+                    if ((kp.point - p.point).squaredNorm() > r2) continue;
+                    if (p.reference_distance > 0 &&
+                        !pyramid.CheckScaleConsistencyOfObservation(p.reference_distance, p.reference_level, p.distance,
+                                                                    kp.octave))
+                    {
+                        continue;
+                    }
+
+                    if (dis < best_dist)
+                    {
+                        second_dist = best_dist;
+                        best_dist   = dis;
+                        best_id     = first + k;
+                    }
+                    else
+                    {
+                        second_dist = dis;
+                    }
+                }
+            }
+
+            best[i] = {i, -1, best_dist};
+            if (best_id == -1 || best_dist > params.threshold) continue;
+            if (second_dist != std::numeric_limits<int>::max() && best_dist > params.ratio * second_dist) continue;
+            best[i].keypoint = best_id;
+        }
+    }
+
+    if (params.unique_keypoints)
+    {
+        // The best prediction of each keypoint
+        std::vector<int> keypoint_best(keypoints.size(), -1);
+        for (auto& m : best)
+        {
+            if (m.keypoint == -1) continue;
+            int& kb = keypoint_best[m.keypoint];
+            if (kb == -1 || m.distance < best[kb].distance) kb = m.prediction;
+        }
+        for (auto& m : best)
+        {
+            if (m.keypoint != -1 && keypoint_best[m.keypoint] != m.prediction) m.keypoint = -1;
+        }
+    }
+
+    matches.clear();
+    for (auto& m : best)
+    {
+        if (m.keypoint != -1) matches.push_back(m);
+    }
+
+    if (params.check_orientation) FilterOrientation(keypoints, predictions);
+    return matches.size();
+}
+
+void GuidedMatcher::FilterOrientation(ArrayView<const KeyPoint<float>> keypoints,
+                                      ArrayView<const Prediction> predictions)
+{
+    const int bins = params.orientation_bins;
+    std::vector<int> histogram(bins, 0);
+
+    auto bin_of = [&](const Result& m) {
+        float rot = predictions[m.prediction].angle - keypoints[m.keypoint].angle;
+        if (rot < 0) rot += 360;
+        return std::min(int(rot * bins / 360), bins - 1);
+    };
+    auto has_angle = [&](const Result& m) {
+        return predictions[m.prediction].angle >= 0 && keypoints[m.keypoint].angle >= 0;
+    };
+
+    for (auto& m : matches)
+    {
+        if (has_angle(m)) histogram[bin_of(m)]++;
+    }
+
+    // The three largest bins. The second and third are only used if they have at least 10% of the largest.
+    std::vector<int> order(bins);
+    for (int i = 0; i < bins; ++i) order[i] = i;
+    std::partial_sort(order.begin(), order.begin() + std::min(3, bins), order.end(),
+                      [&](int a, int b) { return histogram[a] > histogram[b]; });
+
+    std::vector<char> valid_bin(bins, 0);
+    for (int i = 0; i < std::min(3, bins); ++i)
+    {
+        if (histogram[order[i]] > 0 && histogram[order[i]] >= 0.1 * histogram[order[0]]) valid_bin[order[i]] = 1;
+    }
+
+    matches.erase(std::remove_if(matches.begin(), matches.end(),
+                                 [&](const Result& m) { return has_angle(m) && !valid_bin[bin_of(m)]; }),
+                  matches.end());
+}
+
+}  // namespace Saiga
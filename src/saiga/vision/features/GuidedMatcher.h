@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/core/util/DataStructures/ArrayView.h"
+#include "saiga/vision/features/Features.h"
+#include "saiga/vision/util/FeatureGrid2.h"
+#include "saiga/vision/util/ScalePyramid.h"
+
+#include <vector>
+
+namespace Saiga
+{
+/**
+ * Guided matching of predictions (for example projected map points) to the keypoints of an image.
+ *
+ * The candidates of a prediction are all keypoints within its search radius. They are found with a FeatureGrid2 and
+ * the distances of all candidates in one grid row are computed with a single call of hammingDistances.
+ * A match is accepted if
+ *  - the level of the keypoint is consistent with the prediction (ScalePyramid::CheckScaleConsistencyOfObservation),
+ *  - the distance is below 'threshold' and passes the ratio test with the second best candidate,
+ *  - the rotation between the reference and the matched keypoint is in one of the three largest bins of the
+ *    rotation histogram (same as ORB-SLAM2).
+ * If multiple predictions match the same keypoint, only the best one is kept.
+ *
+ * The keypoints and descriptors must be sorted by the permutation of FeatureGrid2::create.
+ * The predictions are distributed to 'threads' omp threads.
+ *
+ * Usage:
+ *
+ *   FeatureGridBounds2<double, 20> bounds;
+ *   FeatureGrid2 grid;
+ *   // bounds.computeFromIntrinsicsDist(...), grid.create(bounds, keypoints) and apply the permutation
+ *
+ *   GuidedMatcher matcher(pyramid);
+ *   matcher.Match(bounds, grid, keypoints, descriptors, predictions, 4);
+ *   for (auto& m : matcher.matches) ...
+ */
+class SAIGA_VISION_API GuidedMatcher
+{
+   public:
+    struct Prediction
+    {
+        // Predicted position in the image and search radius in pixels
+        vec2 point;
+        float radius;
+
+        DescriptorORB descriptor;
+
+        // Angle of the reference keypoint in degrees. Set to < 0 to exclude it from the rotation histogram.
+        float angle = -1;
+
+        // Scale consistency: the reference observation was made on 'reference_level' from 'reference_distance' and
+        // the point has now the distance 'distance' to the camera. Set reference_distance <= 0 to disable the check.
+        double reference_distance = -1;
+        int reference_level       = 0;
+        double distance           = 0;
+    };
+
+    struct Result
+    {
+        int prediction;
+        int keypoint;
+        int distance;
+    };
+
+    struct Parameters
+    {
+        int threshold          = 50;
+        float ratio            = 0.8;
+        bool check_orientation = true;
+        int orientation_bins   = 30;
+        bool unique_keypoints  = true;
+    };
+
+    GuidedMatcher(const ScalePyramid& pyramid) : pyramid(pyramid) {}
+
+    // Returns the number of matches.
+    template <typename T, int cell_size>
+    int Match(const FeatureGridBounds2<T, cell_size>& bounds, const FeatureGrid2& grid,
+              ArrayView<const KeyPoint<float>> keypoints, ArrayView<const DescriptorORB> descriptors,
+              ArrayView<const Prediction> predictions, int threads = 1)
+    {
+        using Vec2 = typename FeatureGridBounds2<T, cell_size>::Vec2;
+        cell_ranges.resize(predictions.size());
+        for (int i = 0; i < (int)predictions.size(); ++i)
+        {
+            auto& p    = predictions[i];
+            Vec2 point = p.point.template cast<T>();
+            if (point.x() + p.radius < bounds.bmin.x() || point.y() + p.radius < bounds.bmin.y() ||
+                point.x() - p.radius >= bounds.bmax.x() || point.y() - p.radius >= bounds.bmax.y())
+            {
+                // The search area is outside of the grid
+                cell_ranges[i] = {{0, 0}, {-1, -1}};
+                continue;
+            }
+            cell_ranges[i] = bounds.minMaxCellWithRadius(point, p.radius);
+        }
+        return MatchCells(grid, keypoints, descriptors, predictions, threads);
+    }
+
+    Parameters params;
+
+    // Sorted by prediction
+    std::vector<Result> matches;
+
+   private:
+    ScalePyramid pyramid;
+
+    // Cells of the search area of each prediction (min, max)
+    std::vector<std::pair<FeatureGrid2::CellId, FeatureGrid2::CellId>> cell_ranges;
+
+    int MatchCells(const FeatureGrid2& grid, ArrayView<const KeyPoint<float>> keypoints,
+                   ArrayView<const DescriptorORB> descriptors, ArrayView<const Prediction> predictions, int threads);
+    void FilterOrientation(ArrayView<const KeyPoint<float>> keypoints, ArrayView<const Prediction> predictions);
+};
+
+}  // namespace Saiga
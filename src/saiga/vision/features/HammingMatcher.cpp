@@ -0,0 +1,230 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "HammingMatcher.h"
+
+#include "saiga/core/util/Thread/omp.h"
+#include "saiga/core/util/assert.h"
+
+#if defined(__AVX2__)
+#    include <immintrin.h>
+#endif
+
+namespace Saiga
+{
+// Distance of a query to a train descriptor which has not been matched yet.
+// Same value as in BruteForceMatcher.
+static constexpr int unmatched_distance = 1000;
+
+// Number of train descriptors that are processed together (16KB)
+static constexpr int train_tile_size = 512;
+
+// Number of queries that share one train tile
+static constexpr int query_block_size = 8;
+
+#if defined(__AVX2__)
+// Number of set bits in each 64-bit lane
+inline __m256i popcount64(__m256i v)
+{
+#    if defined(__AVX512VPOPCNTDQ__) && defined(__AVX512VL__)
+    return _mm256_popcnt_epi64(v);
+#    else
+    // Nibble lookup (Mula et al., "Faster Population Counts Using AVX2 Instructions")
+    const __m256i lut      = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1,
+                                         2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+
+    __m256i lo  = _mm256_and_si256(v, low_mask);
+    __m256i hi  = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+    return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+#    endif
+}
+
+// Distances of the query to 4 consecutive train descriptors
+inline void hammingDistances4(__m256i query, const DescriptorORB* train, int* distances)
+{
+    __m256i s0 = popcount64(_mm256_xor_si256(query, _mm256_loadu_si256((const __m256i*)train[0].data())));
+    __m256i s1 = popcount64(_mm256_xor_si256(query, _mm256_loadu_si256((const __m256i*)train[1].data())));
+    __m256i s2 = popcount64(_mm256_xor_si256(query, _mm256_loadu_si256((const __m256i*)train[2].data())));
+    __m256i s3 = popcount64(_mm256_xor_si256(query, _mm256_loadu_si256((const __m256i*)train[3].data())));
+
+    // Pack two descriptors into each 64-bit lane: (s0, s1) and (s2, s3)
+    __m256i r0 = _mm256_or_si256(s0, _mm256_slli_epi64(s1, 32));
+    __m256i r1 = _mm256_or_si256(s2, _mm256_slli_epi64(s3, 32));
+
+    // Horizontal sum of the 4 lanes
+    __m256i a = _mm256_add_epi64(_mm256_permute2x128_si256(r0, r1, 0x20), _mm256_permute2x128_si256(r0, r1, 0x31));
+    a         = _mm256_add_epi64(a, _mm256_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    __m128i result = _mm_unpacklo_epi64(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+    _mm_storeu_si128((__m128i*)distances, result);
+}
+#endif
+
+void hammingDistances(const DescriptorORB& query, const DescriptorORB* train, int n, int* distances)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    __m256i q = _mm256_loadu_si256((const __m256i*)query.data());
+    for (; i + 4 <= n; i += 4)
+    {
+        hammingDistances4(q, train + i, distances + i);
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        distances[i] = distance(query, train[i]);
+    }
+}
+
+template <bool CrossCheck>
+static void matchTile(const DescriptorORB& query, int query_id, const DescriptorORB* train, int train_offset, int n,
+                      int* distances, HammingMatcher::Neighbours& nb, int* reverse_distance, int* reverse_index)
+{
+    hammingDistances(query, train + train_offset, n, distances);
+
+    for (int k = 0; k < n; ++k)
+    {
+        int dis = distances[k];
+        if (dis < nb.distance[1])
+        {
+            int j = train_offset + k;
+            if (dis < nb.distance[0])
+            {
+                // set second best to old best
+                nb.distance[1] = nb.distance[0];
+                nb.index[1]    = nb.index[0];
+                nb.distance[0] = dis;
+                nb.index[0]    = j;
+            }
+            else
+            {
+                nb.distance[1] = dis;
+                nb.index[1]    = j;
+            }
+        }
+    }
+
+    if constexpr (CrossCheck)
+    {
+        // Branch free, so that the compiler can vectorize it
+        reverse_distance += train_offset;
+        reverse_index += train_offset;
+        for (int k = 0; k < n; ++k)
+        {
+            bool better         = distances[k] < reverse_distance[k];
+            reverse_distance[k] = better ? distances[k] : reverse_distance[k];
+            reverse_index[k]    = better ? query_id : reverse_index[k];
+        }
+    }
+}
+
+void HammingMatcher::matchKnn2(ArrayView<const DescriptorORB> query, ArrayView<const DescriptorORB> train, int threads,
+                               bool cross_check)
+{
+    SAIGA_ASSERT(threads >= 1);
+    int n = query.size();
+    int m = train.size();
+
+    knn2.resize(n);
+    if (cross_check)
+    {
+        reverse_best.resize(m);
+        local_reverse_distance.resize(threads);
+        local_reverse_index.resize(threads);
+    }
+    else
+    {
+        reverse_best.clear();
+    }
+
+    // OpenMP can start fewer threads than requested. Only the buffers of the started threads are merged.
+    int team_size = 1;
+#pragma omp parallel num_threads(threads)
+    {
+        int tid = OMP::getThreadNum();
+#pragma omp single nowait
+        team_size = OMP::getNumThreads();
+
+        if (cross_check)
+        {
+            local_reverse_distance[tid].assign(m, unmatched_distance);
+            local_reverse_index[tid].assign(m, -1);
+        }
+
+        std::array<int, train_tile_size> distances;
+
+#pragma omp for schedule(static)
+        for (int query_begin = 0; query_begin < n; query_begin += query_block_size)
+        {
+            int query_end = std::min(n, query_begin + query_block_size);
+            for (int i = query_begin; i < query_end; ++i)
+            {
+                knn2[i] = {{unmatched_distance, unmatched_distance}, {-1, -1}};
+            }
+
+            for (int train_begin = 0; train_begin < m; train_begin += train_tile_size)
+            {
+                int tile_size = std::min(m - train_begin, train_tile_size);
+                for (int i = query_begin; i < query_end; ++i)
+                {
+                    if (cross_check)
+                    {
+                        matchTile<true>(query[i], i, train.data(), train_begin, tile_size, distances.data(), knn2[i],
+                                        local_reverse_distance[tid].data(), local_reverse_index[tid].data());
+                    }
+                    else
+                    {
+                        matchTile<false>(query[i], i, train.data(), train_begin, tile_size, distances.data(), knn2[i],
+                                         nullptr, nullptr);
+                    }
+                }
+            }
+        }
+
+        if (cross_check)
+        {
+            // Merge the thread local results. On equal distance the smaller query index wins.
+#pragma omp for
+            for (int j = 0; j < m; ++j)
+            {
+                std::pair<int, int> best = {local_reverse_distance[0][j], local_reverse_index[0][j]};
+                for (int t = 1; t < team_size; ++t)
+                {
+                    std::pair<int, int> other = {local_reverse_distance[t][j], local_reverse_index[t][j]};
+                    if (other.first < best.first || (other.first == best.first && other.second < best.second))
+                    {
+                        best = other;
+                    }
+                }
+                reverse_best[j] = best;
+            }
+        }
+    }
+}
+
+int HammingMatcher::filterMatches(DistanceType threshold, float ratioThreshold, bool cross_check)
+{
+    SAIGA_ASSERT(!cross_check || reverse_best.size() > 0, "matchKnn2 must be called with cross_check");
+    matches.clear();
+    matches.reserve(knn2.size());
+
+    for (int i = 0; i < (int)knn2.size(); ++i)
+    {
+        auto& nb = knn2[i];
+
+        // the best distance is still larger than the threshold
+        if (nb.distance[0] > threshold) continue;
+        if (float(nb.distance[0]) > float(nb.distance[1]) * ratioThreshold) continue;
+        if (cross_check && reverse_best[nb.index[0]].second != i) continue;
+
+        matches.push_back({i, nb.index[0]});
+    }
+    return matches.size();
+}
+
+}  // namespace Saiga
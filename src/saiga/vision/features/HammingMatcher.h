@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/core/util/DataStructures/ArrayView.h"
+#include "saiga/vision/features/Features.h"
+
+#include <vector>
+
+namespace Saiga
+{
+/**
+ * Hamming distances between one query descriptor and n train descriptors.
+ * distances[i] = distance(query, train[i])
+ *
+ * Uses AVX512-VPOPCNTDQ or AVX2 (nibble lookup with vpshufb) if available.
+ */
+SAIGA_VISION_API void hammingDistances(const DescriptorORB& query, const DescriptorORB* train, int n, int* distances);
+
+/**
+ * Brute force kNN (k=2) matcher for ORB descriptors.
+ *
+ * The result is identical to BruteForceMatcher<DescriptorORB>::matchKnn2, but
+ *  - the distance matrix is not stored. Only the best two neighbours of each query are kept.
+ *  - the train descriptors are processed in cache sized tiles, which are shared by a block of queries.
+ *  - the distances are computed with SIMD instructions (see hammingDistances).
+ *  - the query rows are distributed to 'threads' omp threads.
+ *
+ * Usage:
+ *
+ *   HammingMatcher matcher;
+ *   matcher.matchKnn2(descriptors1, descriptors2, 4, true);
+ *   matcher.filterMatches(50, 0.8, true);
+ *   for (auto [i, j] : matcher.matches) ...
+ */
+class SAIGA_VISION_API HammingMatcher
+{
+   public:
+    using DistanceType = int;
+
+    struct Neighbours
+    {
+        DistanceType distance[2];
+        int index[2];
+    };
+
+    // Computes the two nearest neighbours in 'train' for each descriptor in 'query'.
+    // If cross_check is set, the nearest query of each train descriptor is also computed.
+    void matchKnn2(ArrayView<const DescriptorORB> query, ArrayView<const DescriptorORB> train, int threads = 1,
+                   bool cross_check = false);
+
+    /**
+     * Filter matches by ratio test and threshold.
+     * With cross check, a match (i,j) is only accepted if i is also the nearest query of j.
+     * You must have used matchKnn2 (with cross_check for the cross check) before!
+     */
+    int filterMatches(DistanceType threshold, float ratioThreshold, bool cross_check = false);
+
+    // The best two neighbours of each query. The index is -1 if there is no neighbour.
+    std::vector<Neighbours> knn2;
+
+    // The nearest query of each train descriptor (distance, index). Only computed with cross check.
+    std::vector<std::pair<DistanceType, int>> reverse_best;
+
+    // Result of filterMatches (query index, train index)
+    std::vector<std::pair<int, int>> matches;
+
+   private:
+    // Per thread nearest query of each train descriptor
+    std::vector<std::vector<DistanceType>> local_reverse_distance;
+    std::vector<std::vector<int>> local_reverse_index;
+};
+
+}  // namespace Saiga
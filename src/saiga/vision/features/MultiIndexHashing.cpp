@@ -0,0 +1,214 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "MultiIndexHashing.h"
+
+#include "saiga/core/util/assert.h"
+
+#include <algorithm>
+#include <array>
+
+namespace Saiga
+{
+MultiIndexHashing::MultiIndexHashing(int num_substrings) : num_substrings(num_substrings)
+{
+    SAIGA_ASSERT(num_substrings == 8 || num_substrings == 16 || num_substrings == 32,
+                 "The substrings must not cross a 64-bit word.");
+    substring_bits = 256 / num_substrings;
+    substring_mask = substring_bits == 32 ? 0xFFFFFFFF : (1u << substring_bits) - 1;
+    tables.resize(num_substrings);
+}
+
+void MultiIndexHashing::build(ArrayView<const DescriptorORB> new_descriptors, int threads)
+{
+    descriptors.assign(new_descriptors.begin(), new_descriptors.end());
+    alive.assign(descriptors.size(), true);
+    num_alive = descriptors.size();
+
+    // The tables are independent
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+    for (int t = 0; t < num_substrings; ++t)
+    {
+        auto& table = tables[t];
+        table.clear();
+        table.reserve(descriptors.size());
+        for (int i = 0; i < (int)descriptors.size(); ++i)
+        {
+            table[substring(descriptors[i], t)].push_back(i);
+        }
+    }
+}
+
+int MultiIndexHashing::insert(const DescriptorORB& descriptor)
+{
+    int id = descriptors.size();
+    descriptors.push_back(descriptor);
+    alive.push_back(true);
+    num_alive++;
+
+    for (int t = 0; t < num_substrings; ++t)
+    {
+        tables[t][substring(descriptor, t)].push_back(id);
+    }
+    return id;
+}
+
+void MultiIndexHashing::remove(int id)
+{
+    SAIGA_ASSERT(id >= 0 && id < (int)descriptors.size() && alive[id], "Invalid id.");
+    alive[id] = false;
+    num_alive--;
+
+    for (int t = 0; t < num_substrings; ++t)
+    {
+        auto it      = tables[t].find(substring(descriptors[id], t));
+        auto& bucket = it->second;
+        auto pos     = std::find(bucket.begin(), bucket.end(), id);
+        *pos         = bucket.back();
+        bucket.pop_back();
+        if (bucket.empty()) tables[t].erase(it);
+    }
+}
+
+template <typename CandidateFunction, typename DoneFunction>
+void MultiIndexHashing::search(const DescriptorORB& query, int max_substring_radius, Scratch& scratch,
+                               CandidateFunction f, DoneFunction done) const
+{
+    if (num_alive == 0) return;
+
+    if (scratch.stamp.size() < descriptors.size())
+    {
+        scratch.stamp.resize(descriptors.size(), scratch.current);
+    }
+    int current = ++scratch.current;
+
+    int max_radius = max_substring_radius < 0 ? substring_bits : std::min(max_substring_radius, substring_bits);
+    int visited    = 0;
+
+    // Bit positions that are flipped in the current probe
+    std::array<int, 32> flip;
+
+    for (int s = 0; s <= max_radius; ++s)
+    {
+        for (int t = 0; t < num_substrings; ++t)
+        {
+            auto& table    = tables[t];
+            uint32_t key_q = substring(query, t);
+
+            // Enumerate all keys with exactly s different bits
+            for (int i = 0; i < s; ++i) flip[i] = i;
+            while (true)
+            {
+                uint32_t key = key_q;
+                for (int i = 0; i < s; ++i) key ^= 1u << flip[i];
+
+                auto it = table.find(key);
+                if (it != table.end())
+                {
+                    for (auto id : it->second)
+                    {
+                        if (scratch.stamp[id] == current) continue;
+                        scratch.stamp[id] = current;
+                        visited++;
+                        f(distance(query, descriptors[id]), id);
+                    }
+                }
+
+                // Next combination
+                int i = s - 1;
+                while (i >= 0 && flip[i] == substring_bits - s + i) --i;
+                if (i < 0) break;
+                flip[i]++;
+                for (int j = i + 1; j < s; ++j) flip[j] = flip[j - 1] + 1;
+            }
+
+            // The tables 0..t have been searched with radius s and the remaining with radius s-1.
+            // Any descriptor that has not been found has a distance of at least num_substrings * s + t + 1.
+            if (visited == num_alive || done(num_substrings * s + t)) return;
+        }
+    }
+}
+
+std::vector<MultiIndexHashing::Result> MultiIndexHashing::knn(const DescriptorORB& query, int k,
+                                                              int max_substring_radius, Scratch& scratch) const
+{
+    SAIGA_ASSERT(k > 0);
+    std::vector<Result> result;
+    result.reserve(k + 1);
+
+    search(
+        query, max_substring_radius, scratch,
+        [&](int dis, int id) {
+            if ((int)result.size() == k && dis >= result.back().first) return;
+            Result r = {dis, id};
+            result.insert(std::upper_bound(result.begin(), result.end(), r), r);
+            if ((int)result.size() > k) result.pop_back();
+        },
+        [&](int guaranteed_radius) { return (int)result.size() == k && result.back().first <= guaranteed_radius; });
+    return result;
+}
+
+std::vector<MultiIndexHashing::Result> MultiIndexHashing::radiusSearch(const DescriptorORB& query, int radius,
+                                                                       int max_substring_radius,
+                                                                       Scratch& scratch) const
+{
+    std::vector<Result> result;
+    search(
+        query, max_substring_radius, scratch,
+        [&](int dis, int id) {
+            if (dis <= radius) result.push_back({dis, id});
+        },
+        [&](int guaranteed_radius) { return guaranteed_radius >= radius; });
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::vector<MultiIndexHashing::Result> MultiIndexHashing::knn(const DescriptorORB& query, int k,
+                                                              int max_substring_radius) const
+{
+    Scratch scratch;
+    return knn(query, k, max_substring_radius, scratch);
+}
+
+std::vector<MultiIndexHashing::Result> MultiIndexHashing::radiusSearch(const DescriptorORB& query, int radius,
+                                                                       int max_substring_radius) const
+{
+    Scratch scratch;
+    return radiusSearch(query, radius, max_substring_radius, scratch);
+}
+
+void MultiIndexHashing::knn(ArrayView<const DescriptorORB> queries, int k, std::vector<std::vector<Result>>& results,
+                            int threads, int max_substring_radius) const
+{
+    results.resize(queries.size());
+#pragma omp parallel num_threads(threads)
+    {
+        Scratch scratch;
+#pragma omp for schedule(dynamic, 16)
+        for (int i = 0; i < (int)queries.size(); ++i)
+        {
+            results[i] = knn(queries[i], k, max_substring_radius, scratch);
+        }
+    }
+}
+
+void MultiIndexHashing::radiusSearch(ArrayView<const DescriptorORB> queries, int radius,
+                                     std::vector<std::vector<Result>>& results, int threads,
+                                     int max_substring_radius) const
+{
+    results.resize(queries.size());
+#pragma omp parallel num_threads(threads)
+    {
+        Scratch scratch;
+#pragma omp for schedule(dynamic, 16)
+        for (int i = 0; i < (int)queries.size(); ++i)
+        {
+            results[i] = radiusSearch(queries[i], radius, max_substring_radius, scratch);
+        }
+    }
+}
+
+}  // namespace Saiga
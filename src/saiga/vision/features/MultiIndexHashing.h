@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/core/util/DataStructures/ArrayView.h"
+#include "saiga/vision/features/Features.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace Saiga
+{
+/**
+ * Nearest neighbour index for ORB descriptors using multi-index hashing.
+ * Norouzi et al., "Fast Search in Hamming Space with Multi-Index Hashing", CVPR 2012.
+ *
+ * The 256 bit descriptors are split into 'num_substrings' disjoint substrings. Each substring is the key of a hash
+ * table. Two descriptors with a distance of d have at least one substring with a distance of floor(d/num_substrings).
+ * A query therefore probes all keys around the query substrings with an increasing radius. The search is exact unless
+ * 'max_substring_radius' is reached. A small value of max_substring_radius trades recall for speed.
+ *
+ * Queries are thread safe with respect to each other, but not to insert/remove.
+ *
+ * Usage:
+ *
+ *   MultiIndexHashing index;
+ *   index.build(map_descriptors);
+ *   auto nn = index.knn(query, 2);
+ *   // nn[0].first = distance, nn[0].second = id
+ */
+class SAIGA_VISION_API MultiIndexHashing
+{
+   public:
+    // (distance, id) sorted by distance
+    using Result = std::pair<int, int>;
+
+    // num_substrings must be 8, 16, or 32 (32, 16, or 8 bit keys)
+    MultiIndexHashing(int num_substrings = 16);
+
+    // Removes all descriptors and inserts the new ones. The id of a descriptor is its index in the array.
+    void build(ArrayView<const DescriptorORB> descriptors, int threads = 1);
+
+    // Returns the id of the new descriptor.
+    int insert(const DescriptorORB& descriptor);
+
+    // The id is not reused for new descriptors.
+    void remove(int id);
+
+    // Number of descriptors in the index (excluding removed ones)
+    int size() const { return num_alive; }
+
+    const DescriptorORB& descriptor(int id) const { return descriptors[id]; }
+
+    // The k nearest neighbours. max_substring_radius = -1 for an exact search.
+    std::vector<Result> knn(const DescriptorORB& query, int k, int max_substring_radius = -1) const;
+
+    // All descriptors with a distance <= radius.
+    std::vector<Result> radiusSearch(const DescriptorORB& query, int radius, int max_substring_radius = -1) const;
+
+    // Batched versions. The queries are distributed to 'threads' threads.
+    void knn(ArrayView<const DescriptorORB> queries, int k, std::vector<std::vector<Result>>& results, int threads = 1,
+             int max_substring_radius = -1) const;
+    void radiusSearch(ArrayView<const DescriptorORB> queries, int radius, std::vector<std::vector<Result>>& results,
+                      int threads = 1, int max_substring_radius = -1) const;
+
+   private:
+    int num_substrings;
+    int substring_bits;
+    uint32_t substring_mask;
+
+    std::vector<DescriptorORB> descriptors;
+    std::vector<char> alive;
+    int num_alive = 0;
+
+    using Table = std::unordered_map<uint32_t, std::vector<int>>;
+    std::vector<Table> tables;
+
+    uint32_t substring(const DescriptorORB& d, int i) const
+    {
+        int offset = i * substring_bits;
+        return uint32_t(d[offset / 64] >> (offset % 64)) & substring_mask;
+    }
+
+    // Marks the already visited descriptors of one query
+    struct Scratch
+    {
+        std::vector<int> stamp;
+        int current = 0;
+    };
+
+    // Probes the tables with increasing radius. 'f(distance, id)' is called for each new candidate.
+    // After each table 'done(guaranteed_radius)' is called. The search stops if it returns true.
+    template <typename CandidateFunction, typename DoneFunction>
+    void search(const DescriptorORB& query, int max_substring_radius, Scratch& scratch, CandidateFunction f,
+                DoneFunction done) const;
+
+    std::vector<Result> knn(const DescriptorORB& query, int k, int max_substring_radius, Scratch& scratch) const;
+    std::vector<Result> radiusSearch(const DescriptorORB& query, int radius, int max_substring_radius,
+                                     Scratch& scratch) const;
+};
+
+}  // namespace Saiga
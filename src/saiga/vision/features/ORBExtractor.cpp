@@ -77,6 +77,7 @@ namespace Saiga
 {
 const int PATCH_SIZE     = 31;
 const int EDGE_THRESHOLD = 19;
+const int FAST_TILE_ROWS = 64;
 
 
 ORBExtractor::ORBExtractor(int _nfeatures, float _scaleFactor, int _nlevels, int _iniThFAST, int _minThFAST,
@@ -84,19 +85,69 @@ ORBExtractor::ORBExtractor(int _nfeatures, float _scaleFactor, int _nlevels, int
     : num_levels(_nlevels), th_fast(_iniThFAST), th_fast_min(_minThFAST), num_threads(threads)
 {
     pyramid = Saiga::ScalePyramid(_nlevels, _scaleFactor, _nfeatures);
-    levels.resize(num_levels);
+    frames.resize(1);
+    frames.front().levels.resize(num_levels);
 }
 
-void ORBExtractor::DetectKeypoints()
+void ORBExtractor::DetectKeypoints(ArrayView<Frame*> batch)
 {
     const float W = 30;
+
+    // The FAST corners of all frames and levels are computed in one parallel loop over row tiles.
+    // The tiles of one (frame, level) are consecutive.
+    struct LevelItem
+    {
+        Frame* frame;
+        int level;
+        int tile_begin, tile_end;
+    };
+    std::vector<LevelItem> level_items;
+
+    int num_tiles = 0;
+    for (auto frame : batch)
+    {
+        for (int level = 0; level < num_levels; ++level)
+        {
+            LevelItem item = {frame, level, num_tiles, num_tiles};
+            int rows       = frame->levels[level].image.rows - 2 * (EDGE_THRESHOLD - 3);
+            for (int y = 0; y < rows; y += FAST_TILE_ROWS)
+            {
+                if (num_tiles == (int)tiles.size()) tiles.emplace_back();
+                auto& tile     = tiles[num_tiles++];
+                tile.frame     = frame;
+                tile.level     = level;
+                tile.row_begin = y;
+                tile.keypoints.clear();
+            }
+            item.tile_end = num_tiles;
+            level_items.push_back(item);
+        }
+    }
+
+    fast_scratch.resize(num_threads);
 #    pragma omp parallel for num_threads(num_threads) schedule(dynamic)
-    for (int level = 0; level < num_levels; ++level)
+    for (int t = 0; t < num_tiles; ++t)
     {
-        auto& level_data = levels[level];
-        level_data.keypoints_tmp.clear();
+        auto& tile       = tiles[t];
+        auto& level_data = tile.frame->levels[tile.level];
+
+        const int minBorder = EDGE_THRESHOLD - 3;
+        const int rows      = level_data.image.rows - 2 * minBorder;
+        const int cols      = level_data.image.cols - 2 * minBorder;
+        auto image          = level_data.image.subImageView(minBorder, minBorder, rows, cols);
 
-        auto image = Saiga::ImageViewToMat(level_data.image);
+        // A single scan with the lower threshold. The corners of th_fast are the ones with response >= th_fast.
+        fast.DetectRows(image, th_fast_min, tile.row_begin, tile.row_begin + FAST_TILE_ROWS, tile.keypoints,
+                       fast_scratch[OMP::getThreadNum()]);
+    }
+
+#    pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+    for (int l = 0; l < (int)level_items.size(); ++l)
+    {
+        auto& item       = level_items[l];
+        int level        = item.level;
+        auto& level_data = item.frame->levels[level];
+        level_data.keypoints_tmp.clear();
 
         const int minBorderX = EDGE_THRESHOLD - 3;
         const int minBorderY = minBorderX;
@@ -112,53 +163,39 @@ void ORBExtractor::DetectKeypoints()
         const int wCell = ceil(width / nCols);
         const int hCell = ceil(height / nRows);
 
-        for (int i = 0; i < nRows; i++)
-        {
-            const float iniY = minBorderY + i * hCell;
-            float maxY       = iniY + hCell + 6;
-
-            if (iniY >= maxBorderY - 3) continue;
-            if (maxY > maxBorderY) maxY = maxBorderY;
+        // Cell (i,j) contains the corners in [3 + i * hCell, 3 + (i+1) * hCell) x [3 + j * wCell, 3 + (j+1) * wCell).
+        // If a cell has no corner with th_fast, the corners with th_fast_min are used.
+        std::vector<int> cell_has_strong(nRows * nCols, 0);
+        auto cell_index = [&](const KeypointType& kp) {
+            int i = std::min(int(kp.point.y() - 3) / hCell, nRows - 1);
+            int j = std::min(int(kp.point.x() - 3) / wCell, nCols - 1);
+            return i * nCols + j;
+        };
 
-            for (int j = 0; j < nCols; j++)
+        for (int t = item.tile_begin; t < item.tile_end; ++t)
+        {
+            for (auto& kp : tiles[t].keypoints)
             {
-                const float iniX = minBorderX + j * wCell;
-                float maxX       = iniX + wCell + 6;
-                if (iniX >= maxBorderX - 6) continue;
-                if (maxX > maxBorderX) maxX = maxBorderX;
-
-
-                std::vector<cv::KeyPoint> cv_KeysCell;
-
-                FAST(image.rowRange(iniY, maxY).colRange(iniX, maxX), cv_KeysCell, th_fast, true);
-                int dis_before = cv_KeysCell.size();
-
-                if (cv_KeysCell.empty())
-                {
-                    FAST(image.rowRange(iniY, maxY).colRange(iniX, maxX), cv_KeysCell, th_fast_min, true);
-                    dis_before = cv_KeysCell.size();
-                }
+                if (kp.response >= th_fast) cell_has_strong[cell_index(kp)] = 1;
+            }
+        }
 
-                for (auto& cvkp : cv_KeysCell)
+        for (int t = item.tile_begin; t < item.tile_end; ++t)
+        {
+            for (auto& kp : tiles[t].keypoints)
+            {
+                if (kp.response >= th_fast || !cell_has_strong[cell_index(kp)])
                 {
-                    KeypointType kp;
-                    kp.point    = Saiga::vec2(cvkp.pt.x, cvkp.pt.y);
-                    kp.size     = cvkp.size;
-                    kp.angle    = cvkp.angle;
-                    kp.response = cvkp.response;
-                    kp.octave   = cvkp.octave;
-
-
-                    kp.point.x() += j * wCell;
-                    kp.point.y() += i * hCell;
                     level_data.keypoints_tmp.push_back(kp);
                 }
             }
         }
 
-        level_data.keypoints_tmp =
-            level_data.distributor.Distribute(level_data.keypoints_tmp, Saiga::vec2(minBorderX, minBorderY),
-                                              Saiga::vec2(maxBorderX, maxBorderY), pyramid.Features(level));
+        // The keypoints are still relative to the FAST sub image [minBorder, maxBorder).
+        int num_selected = distributor.Distribute(level_data.keypoints_tmp, Saiga::vec2(0, 0),
+                                                  Saiga::vec2(width, height), pyramid.Features(level),
+                                                  level_data.distribution_buffer);
+        level_data.keypoints_tmp.resize(num_selected);
 
         const int scaledPatchSize = PATCH_SIZE * pyramid.Scale(level);
 
@@ -168,40 +205,39 @@ void ORBExtractor::DetectKeypoints()
             kp.point.y() += minBorderY;
             kp.octave = level;
             kp.size   = scaledPatchSize;
-            kp.angle  = orb.ComputeAngle(level_data.image, kp.point);
         }
+        orb.ComputeAngles(level_data.image, level_data.keypoints_tmp);
     }
 }
 
-
-
-void ORBExtractor::Detect(Saiga::ImageView<unsigned char> inputImage, std::vector<KeypointType>& _keypoints,
-                          std::vector<Saiga::DescriptorORB>& outputDescriptors)
+void ORBExtractor::ComputeDescriptors(ArrayView<Frame*> batch)
 {
-    cv::setNumThreads(1);
-    if (inputImage.empty()) return;
-
-
-    outputDescriptors.clear();
-    ComputePyramid(inputImage);
-    DetectKeypoints();
-
+    for (auto frame : batch)
+    {
+        int nkeypoints = 0;
+        for (int level = 0; level < num_levels; ++level)
+        {
+            frame->levels[level].offset = nkeypoints;
+            int n                       = (int)frame->levels[level].keypoints_tmp.size();
+            nkeypoints += n;
+        }
+        frame->descriptors.resize(nkeypoints);
+        frame->keypoints.resize(nkeypoints);
+    }
 
-    int nkeypoints = 0;
+    // The large levels of all frames first
+    std::vector<std::pair<Frame*, int>> level_items;
     for (int level = 0; level < num_levels; ++level)
     {
-        levels[level].offset = nkeypoints;
-        int n                = (int)levels[level].keypoints_tmp.size();
-        nkeypoints += n;
+        for (auto frame : batch) level_items.emplace_back(frame, level);
     }
 
-    outputDescriptors.resize(nkeypoints);
-    _keypoints.resize(nkeypoints);
-
 #    pragma omp parallel for num_threads(num_threads) schedule(dynamic)
-    for (int level = 0; level < num_levels; ++level)
+    for (int l = 0; l < (int)level_items.size(); ++l)
     {
-        auto& level_data    = levels[level];
+        auto frame          = level_items[l].first;
+        int level           = level_items[l].second;
+        auto& level_data    = frame->levels[level];
         auto& keypoints     = level_data.keypoints_tmp;
         int nkeypointsLevel = (int)keypoints.size();
 
@@ -213,11 +249,8 @@ void ORBExtractor::Detect(Saiga::ImageView<unsigned char> inputImage, std::vecto
         cv::GaussianBlur(image, image_gauss, cv::Size(7, 7), 2, 2, cv::BORDER_REFLECT_101);
 
         int offset = level_data.offset;
-        for (size_t i = 0; i < keypoints.size(); i++)
-        {
-            outputDescriptors[offset + i] =
-                orb.ComputeDescriptor(level_data.image_gauss.getImageView(), keypoints[i].point, keypoints[i].angle);
-        }
+        orb.ComputeDescriptors(level_data.image_gauss.getImageView(), keypoints,
+                               ArrayView<DescriptorORB>(frame->descriptors.data() + offset, nkeypointsLevel));
 
         // Scale keypoint coordinates
         if (level != 0)
@@ -228,15 +261,90 @@ void ORBExtractor::Detect(Saiga::ImageView<unsigned char> inputImage, std::vecto
         // And add the keypoints to the output
         for (int i = 0; i < nkeypointsLevel; ++i)
         {
-            _keypoints[offset + i] = keypoints[i];
+            frame->keypoints[offset + i] = keypoints[i];
+        }
+    }
+}
+
+
+void ORBExtractor::Detect(Saiga::ImageView<unsigned char> inputImage, std::vector<KeypointType>& _keypoints,
+                          std::vector<Saiga::DescriptorORB>& outputDescriptors)
+{
+    cv::setNumThreads(1);
+    if (inputImage.empty()) return;
+
+    auto& frame = frames.front();
+    ComputePyramid(frame, inputImage);
+
+    Frame* batch = &frame;
+    DetectKeypoints(batch);
+    ComputeDescriptors(batch);
+
+    // The previous output vectors are reused in the next call
+    std::swap(_keypoints, frame.keypoints);
+    std::swap(outputDescriptors, frame.descriptors);
+}
+
+void ORBExtractor::DetectBatch(int num_images, const BatchImageFunction& get_image, const BatchCallback& callback,
+                               int batch_size)
+{
+    cv::setNumThreads(1);
+    if (batch_size <= 0) batch_size = num_threads;
+    if ((int)frames.size() < batch_size) frames.resize(batch_size);
+    for (auto& frame : frames) frame.levels.resize(num_levels);
+
+    std::vector<Frame*> batch;
+    for (int first_image = 0; first_image < num_images; first_image += batch_size)
+    {
+        int n = std::min(batch_size, num_images - first_image);
+
+        // Each pyramid level depends on the previous one, therefore the pyramids are computed in parallel per image.
+        std::vector<char> valid(n);
+#    pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+        for (int i = 0; i < n; ++i)
+        {
+            auto& frame = frames[i];
+            auto image  = get_image(first_image + i, frame.input_buffer);
+            valid[i]    = !image.empty();
+            if (valid[i])
+            {
+                ComputePyramid(frame, image);
+            }
+            else
+            {
+                frame.keypoints.clear();
+                frame.descriptors.clear();
+            }
+        }
+
+        batch.clear();
+        for (int i = 0; i < n; ++i)
+        {
+            if (valid[i]) batch.push_back(&frames[i]);
+        }
+        DetectKeypoints(batch);
+        ComputeDescriptors(batch);
+
+        for (int i = 0; i < n; ++i)
+        {
+            callback(first_image + i, frames[i].keypoints, frames[i].descriptors);
         }
     }
 }
 
-void ORBExtractor::AllocatePyramid(int rows, int cols)
+void ORBExtractor::DetectBatch(ArrayView<const Saiga::ImageView<unsigned char>> images, const BatchCallback& callback,
+                               int batch_size)
+{
+    DetectBatch(
+        images.size(), [&](int image_id, Saiga::TemplatedImage<unsigned char>&) { return images[image_id]; },
+        callback, batch_size);
+}
+
+void ORBExtractor::AllocatePyramid(Frame& frame, int rows, int cols)
 {
+    auto& levels = frame.levels;
     SAIGA_ASSERT(!levels.empty());
-    if (levels.front().image.valid()) return;
+    if (levels.front().image.rows == rows && levels.front().image.cols == cols) return;
 
     for (int level = 0; level < num_levels; ++level)
     {
@@ -258,9 +366,10 @@ void ORBExtractor::AllocatePyramid(int rows, int cols)
     }
 }
 
-void ORBExtractor::ComputePyramid(Saiga::ImageView<unsigned char> image)
+void ORBExtractor::ComputePyramid(Frame& frame, Saiga::ImageView<unsigned char> image)
 {
-    AllocatePyramid(image.rows, image.cols);
+    AllocatePyramid(frame, image.rows, image.cols);
+    auto& levels = frame.levels;
 
     cv::Mat cv_image = Saiga::ImageViewToMat(image);
     assert(cv_image.type() == CV_8UC1);
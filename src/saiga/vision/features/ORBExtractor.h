@@ -30,11 +30,13 @@
 #include "saiga/config.h"
 #include "saiga/core/image/imageView.h"
 #include "saiga/core/image/templatedImage.h"
+#include "saiga/vision/features/FastDetector.h"
 #include "saiga/vision/features/FeatureDistribution.h"
 #include "saiga/vision/features/Features.h"
 #include "saiga/vision/features/OrbDescriptors.h"
 #include "saiga/vision/util/ScalePyramid.h"
 
+#include <functional>
 #include <vector>
 
 #ifdef SAIGA_USE_OPENCV
@@ -46,16 +48,36 @@ class SAIGA_VISION_API ORBExtractor
    public:
     using KeypointType = Saiga::KeyPoint<float>;
 
+    // Returns the image with the given id. The image can be loaded into 'buffer', which is reused for later images.
+    using BatchImageFunction =
+        std::function<Saiga::ImageView<unsigned char>(int image_id, Saiga::TemplatedImage<unsigned char>& buffer)>;
+
+    // Receives the features of one image. The vectors can be moved out.
+    using BatchCallback = std::function<void(int image_id, std::vector<KeypointType>& keypoints,
+                                             std::vector<Saiga::DescriptorORB>& descriptors)>;
+
     ORBExtractor(int nfeatures, float scaleFactor, int num_levels, int th_fast, int th_fast_min, int num_threads);
     ~ORBExtractor() {}
 
     void Detect(Saiga::ImageView<unsigned char> inputImage, std::vector<KeypointType>& keypoints,
                 std::vector<Saiga::DescriptorORB>& outputDescriptors);
 
+    // Offline mode for large datasets.
+    // 'batch_size' images are processed at the same time and the work items (image, level, tile) of all of them are
+    // distributed to the threads. This scales much better than Detect, which only parallelizes over the levels of a
+    // single image. The pyramids of a batch are reused for the next one.
+    //
+    // 'get_image' is called in parallel and must be thread safe. 'callback' is called in the order of the images.
+    // batch_size = 0 uses one image per thread.
+    void DetectBatch(int num_images, const BatchImageFunction& get_image, const BatchCallback& callback,
+                     int batch_size = 0);
+    void DetectBatch(ArrayView<const Saiga::ImageView<unsigned char>> images, const BatchCallback& callback,
+                     int batch_size = 0);
+
     // Can be called after 'Detect' to return the scaled image on the given level.
     // The imageview is invalidated after calling detect again.
     ImageView<unsigned char> GetImage(int level){
-        return levels[level].image;
+        return frames.front().levels[level].image;
     }
 
     ScalePyramid getPyramid(){
@@ -63,19 +85,6 @@ class SAIGA_VISION_API ORBExtractor
     }
 
    protected:
-    void AllocatePyramid(int rows, int cols);
-    void ComputePyramid(Saiga::ImageView<unsigned char> image);
-    void DetectKeypoints();
-
-    int num_levels;
-    int th_fast;
-    int th_fast_min;
-    int num_threads;
-
-    Saiga::ORB orb;
-    Saiga::ScalePyramid pyramid;
-
-
     struct Level
     {
         int N;
@@ -84,9 +93,49 @@ class SAIGA_VISION_API ORBExtractor
         Saiga::TemplatedImage<unsigned char> image_gauss;
         Saiga::ImageView<unsigned char> image;
         std::vector<KeypointType> keypoints_tmp;
-        Saiga::QuadtreeFeatureDistributor distributor;
+        Saiga::QuadtreeFeatureDistributor::Buffer distribution_buffer;
+    };
+
+    // The pyramid and the result of one image
+    struct Frame
+    {
+        std::vector<Level> levels;
+        Saiga::TemplatedImage<unsigned char> input_buffer;
+        std::vector<KeypointType> keypoints;
+        std::vector<Saiga::DescriptorORB> descriptors;
+    };
+
+    // FAST corners in some rows of one level
+    struct Tile
+    {
+        Frame* frame;
+        int level;
+        int row_begin;
+        std::vector<KeypointType> keypoints;
     };
-    std::vector<Level> levels;
+
+    void AllocatePyramid(Frame& frame, int rows, int cols);
+    void ComputePyramid(Frame& frame, Saiga::ImageView<unsigned char> image);
+
+    // The work items of all frames are processed in the same parallel loops.
+    void DetectKeypoints(ArrayView<Frame*> batch);
+    void ComputeDescriptors(ArrayView<Frame*> batch);
+
+    int num_levels;
+    int th_fast;
+    int th_fast_min;
+    int num_threads;
+
+    Saiga::ORB orb;
+    Saiga::FastDetector fast;
+    Saiga::QuadtreeFeatureDistributor distributor;
+    Saiga::ScalePyramid pyramid;
+
+    // frames[0] is used by Detect
+    std::vector<Frame> frames;
+    std::vector<Tile> tiles;
+    // FastDetector::DetectRows scratch buffer of each thread
+    std::vector<std::vector<int>> fast_scratch;
 };
 
 }  // namespace Saiga
@@ -7,6 +7,10 @@
 #include "OrbPattern.h"
 
 #include <vector>
+
+#if defined(__AVX2__)
+#    include <immintrin.h>
+#endif
 using namespace std;
 
 namespace Saiga
@@ -21,9 +25,52 @@ ORB::ORB()
     u_max = ORBPattern::AngleUmax();
     descriptor_pattern =
         std::vector<ivec2>(ORBPattern::DescriptorPattern().begin(), ORBPattern::DescriptorPattern().end());
+    SAIGA_ASSERT(descriptor_pattern.size() == 512);
+
+    // Rotate the pattern the same way as ComputeDescriptor
+    rotated_patterns.resize(num_angle_bins);
+    for (int bin = 0; bin < num_angle_bins; ++bin)
+    {
+        float angle = Saiga::radians(float(bin * 360 / num_angle_bins));
+        float a = (float)cos(angle), b = (float)sin(angle);
+
+        auto& rp = rotated_patterns[bin];
+        for (int i = 0; i < 256; ++i)
+        {
+            auto p0 = descriptor_pattern[2 * i];
+            auto p1 = descriptor_pattern[2 * i + 1];
+            rp.x0[i] = iRound(p0.x() * a - p0.y() * b);
+            rp.y0[i] = iRound(p0.x() * b + p0.y() * a);
+            rp.x1[i] = iRound(p1.x() * a - p1.y() * b);
+            rp.y1[i] = iRound(p1.x() * b + p1.y() * a);
+
+            for (int r : {rp.x0[i], rp.y0[i], rp.x1[i], rp.y1[i]})
+            {
+                rotated_pattern_radius = std::max(rotated_pattern_radius, std::abs(r));
+            }
+        }
+    }
+
+    for (int v = 0; v <= HALF_PATCH_SIZE; ++v)
+    {
+        int d = u_max[v];
+        for (int k = 0; k < 32; ++k)
+        {
+            int u                 = k - HALF_PATCH_SIZE;
+            bool inside           = std::abs(u) <= d;
+            angle_weights_u[v][k] = inside ? u : 0;
+            angle_weights_v[v][k] = inside ? v : 0;
+        }
+    }
+}
+
+static float MomentAngle(int m_01, int m_10)
+{
+    float angle = Saiga::degrees(atan2((float)m_01, (float)m_10));
+    return (angle < 0) * 360 + angle;
 }
 
-float ORB::ComputeAngle(Saiga::ImageView<unsigned char> image, const Saiga::vec2& pt)
+float ORB::ComputeAngle(Saiga::ImageView<unsigned char> image, const Saiga::vec2& pt) const
 {
     int m_01 = 0, m_10 = 0;
 
@@ -49,13 +96,13 @@ float ORB::ComputeAngle(Saiga::ImageView<unsigned char> image, const Saiga::vec2
         }
         m_01 += v * v_sum;
     }
-    float angle = Saiga::degrees(atan2((float)m_01, (float)m_10));
-    return (angle < 0) * 360 + angle;
+    return MomentAngle(m_01, m_10);
 }
 
 
 
-DescriptorORB ORB::ComputeDescriptor(Saiga::ImageView<unsigned char> image, const vec2& point, float angle_degrees)
+DescriptorORB ORB::ComputeDescriptor(Saiga::ImageView<unsigned char> image, const vec2& point,
+                                     float angle_degrees) const
 {
     DescriptorORB result;
     auto desc = (unsigned char*)&result;
@@ -123,4 +170,124 @@ DescriptorORB ORB::ComputeDescriptor(Saiga::ImageView<unsigned char> image, cons
     }
     return result;
 }
+
+float ORB::ComputeAngleSIMD(Saiga::ImageView<unsigned char> image, int x, int y) const
+{
+#if defined(__AVX2__)
+    // The 32 byte loads cover u in [-15, 16]
+    if (x + HALF_PATCH_SIZE + 1 < image.cols)
+    {
+        const unsigned char* center = &image(y, x);
+        const int step              = (int)image.pitchBytes;
+        const __m256i ones          = _mm256_set1_epi16(1);
+
+        // Weighted sum of 32 pixels in 8 integers
+        auto weighted_sum = [&](const unsigned char* row, const std::array<signed char, 32>& weights) {
+            __m256i pixels = _mm256_loadu_si256((const __m256i*)(row - HALF_PATCH_SIZE));
+            __m256i w      = _mm256_loadu_si256((const __m256i*)weights.data());
+            return _mm256_madd_epi16(_mm256_maddubs_epi16(pixels, w), ones);
+        };
+
+        __m256i m_10 = weighted_sum(center, angle_weights_u[0]);
+        __m256i m_01 = _mm256_setzero_si256();
+        for (int v = 1; v <= HALF_PATCH_SIZE; ++v)
+        {
+            const unsigned char* plus  = center + v * step;
+            const unsigned char* minus = center - v * step;
+            m_10 = _mm256_add_epi32(m_10, _mm256_add_epi32(weighted_sum(plus, angle_weights_u[v]),
+                                                           weighted_sum(minus, angle_weights_u[v])));
+            m_01 = _mm256_add_epi32(m_01, _mm256_sub_epi32(weighted_sum(plus, angle_weights_v[v]),
+                                                           weighted_sum(minus, angle_weights_v[v])));
+        }
+
+        alignas(32) std::array<int, 8> s10, s01;
+        _mm256_store_si256((__m256i*)s10.data(), m_10);
+        _mm256_store_si256((__m256i*)s01.data(), m_01);
+        int sum_10 = 0, sum_01 = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            sum_10 += s10[i];
+            sum_01 += s01[i];
+        }
+        return MomentAngle(sum_01, sum_10);
+    }
+#endif
+    return ComputeAngle(image, vec2(x, y));
+}
+
+DescriptorORB ORB::ComputeDescriptorRotated(Saiga::ImageView<unsigned char> image, int x, int y,
+                                            const RotatedPattern& pattern) const
+{
+    DescriptorORB result;
+    auto desc = (unsigned char*)&result;
+
+    const unsigned char* center = &image(y, x);
+    const int step              = (int)image.pitchBytes;
+
+#if defined(__AVX2__)
+    // The gather loads 4 bytes per pixel, which must not read past the end of the image.
+    if (y + rotated_pattern_radius + 1 < image.rows || x + rotated_pattern_radius + 3 < image.cols)
+    {
+        const __m256i v_step = _mm256_set1_epi32(step);
+        const __m256i mask   = _mm256_set1_epi32(0xFF);
+
+        auto gather = [&](const int* px, const int* py) {
+            __m256i dx     = _mm256_loadu_si256((const __m256i*)px);
+            __m256i dy     = _mm256_loadu_si256((const __m256i*)py);
+            __m256i offset = _mm256_add_epi32(_mm256_mullo_epi32(dy, v_step), dx);
+            return _mm256_and_si256(_mm256_i32gather_epi32((const int*)center, offset, 1), mask);
+        };
+
+        for (int i = 0; i < 32; ++i)
+        {
+            __m256i t0 = gather(pattern.x0.data() + 8 * i, pattern.y0.data() + 8 * i);
+            __m256i t1 = gather(pattern.x1.data() + 8 * i, pattern.y1.data() + 8 * i);
+            desc[i]    = (unsigned char)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(t1, t0)));
+        }
+        return result;
+    }
+#endif
+
+    for (int i = 0; i < 32; ++i)
+    {
+        int val = 0;
+        for (int j = 0; j < 8; ++j)
+        {
+            int k  = 8 * i + j;
+            int t0 = center[pattern.y0[k] * step + pattern.x0[k]];
+            int t1 = center[pattern.y1[k] * step + pattern.x1[k]];
+            val |= (t0 < t1) << j;
+        }
+        desc[i] = (unsigned char)val;
+    }
+    return result;
+}
+
+void ORB::ComputeAngles(Saiga::ImageView<unsigned char> image, ArrayView<KeyPoint<float>> keypoints,
+                        int num_threads) const
+{
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int i = 0; i < (int)keypoints.size(); ++i)
+    {
+        auto& kp = keypoints[i];
+        kp.angle = ComputeAngleSIMD(image, iRound(kp.point.x()), iRound(kp.point.y()));
+    }
+}
+
+void ORB::ComputeDescriptors(Saiga::ImageView<unsigned char> image, ArrayView<const KeyPoint<float>> keypoints,
+                             ArrayView<DescriptorORB> descriptors, int num_threads) const
+{
+    SAIGA_ASSERT(keypoints.size() == descriptors.size());
+    const float bin_size = 360.f / num_angle_bins;
+
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (int i = 0; i < (int)keypoints.size(); ++i)
+    {
+        auto& kp = keypoints[i];
+        int bin  = iRound(kp.angle / bin_size) % num_angle_bins;
+        if (bin < 0) bin += num_angle_bins;
+        descriptors[i] =
+            ComputeDescriptorRotated(image, iRound(kp.point.x()), iRound(kp.point.y()), rotated_patterns[bin]);
+    }
+}
 }  // namespace Saiga
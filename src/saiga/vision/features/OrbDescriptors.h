@@ -23,6 +23,7 @@
 #include "saiga/vision/features/Features.h"
 //#include "FeatureDistribution2.h"
 
+#include <array>
 #include <list>
 #include <vector>
 
@@ -31,14 +32,48 @@ namespace Saiga
 class SAIGA_VISION_API ORB
 {
    public:
+    // Number of precomputed rotations of the descriptor pattern (12 degree steps)
+    static constexpr int num_angle_bins = 30;
+
     ORB();
-    float ComputeAngle(Saiga::ImageView<unsigned char> image, const vec2& pt);
-    DescriptorORB ComputeDescriptor(Saiga::ImageView<unsigned char> image, const vec2& point, float angle_degrees);
+    float ComputeAngle(Saiga::ImageView<unsigned char> image, const vec2& pt) const;
+    DescriptorORB ComputeDescriptor(Saiga::ImageView<unsigned char> image, const vec2& point,
+                                    float angle_degrees) const;
 
+    // Batched versions for many keypoints of the same image.
+    //
+    // ComputeAngles writes the orientation to keypoints[i].angle. The result is identical to ComputeAngle.
+    //
+    // ComputeDescriptors uses the pattern rotated by the nearest of the 'num_angle_bins' precomputed angles. The
+    // keypoint positions are rounded to the nearest pixel. For integer positions and angles that are multiples of
+    // 12 degrees, the result is the same as ComputeDescriptor, except for a few pattern points which are half way
+    // between two pixels and might be rounded differently.
+    void ComputeAngles(Saiga::ImageView<unsigned char> image, ArrayView<KeyPoint<float>> keypoints,
+                       int num_threads = 1) const;
+    void ComputeDescriptors(Saiga::ImageView<unsigned char> image, ArrayView<const KeyPoint<float>> keypoints,
+                            ArrayView<DescriptorORB> descriptors, int num_threads = 1) const;
 
    private:
     std::vector<int> u_max;
     std::vector<ivec2> descriptor_pattern;
+
+    // The 256 point pairs of the descriptor pattern rotated by bin * 12 degrees.
+    // Bit i of the descriptor is I(x0[i], y0[i]) < I(x1[i], y1[i]).
+    struct RotatedPattern
+    {
+        std::array<int, 256> x0, y0, x1, y1;
+    };
+    std::vector<RotatedPattern> rotated_patterns;
+
+    // Maximum distance of a rotated pattern point to the center
+    int rotated_pattern_radius = 0;
+
+    // Per row v of the circular patch and byte k = u + 15: u and v if |u| <= u_max[v], otherwise 0.
+    std::array<std::array<signed char, 32>, 16> angle_weights_u, angle_weights_v;
+
+    float ComputeAngleSIMD(Saiga::ImageView<unsigned char> image, int x, int y) const;
+    DescriptorORB ComputeDescriptorRotated(Saiga::ImageView<unsigned char> image, int x, int y,
+                                           const RotatedPattern& pattern) const;
 };
 
 
@@ -0,0 +1,229 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/vision/VisionTypes.h"
+#include "saiga/vision/kernels/Robust.h"
+
+namespace Saiga
+{
+/**
+ * Batched version of the BundleAdjustment and BundleAdjustmentStereo kernels in BA.h.
+ *
+ * A batch contains N observations of the same image (same pose and camera). All per observation values are
+ * stored as structure of arrays in Eigen::Array lanes. Each arithmetic operation of the kernel is therefore
+ * evaluated on all N observations with a few packet instructions (SSE, AVX2 or AVX-512 depending on the
+ * compile flags). Choose N as a multiple of the packet size, for example 8 for double and 16 for float.
+ *
+ * Mono and stereo observations can be mixed in one batch. Mono observations are added with weight_depth = 0,
+ * which zeros the third row of the residual and the jacobians.
+ *
+ * Usage:
+ *
+ *   BABatch<double, 8> batch;
+ *   batch.clear();
+ *   for (...) batch.add(observation, stereo_point, point, weight, weight_depth, loss_threshold);
+ *   BundleAdjustmentBatch(camera, pose, batch);
+ *   // batch.chi2.sum() is the robust cost of the batch.
+ *   // batch.JPose(i), batch.JPoint(i), batch.Residual(i) and batch.loss_weight(i) are the values of lane i.
+ */
+template <typename T, int N>
+struct BABatch
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    using Lane = Eigen::Array<T, N, 1>;
+
+    // ==== Input ====
+    Lane obs_x, obs_y, obs_stereo;
+    Lane point_x, point_y, point_z;
+    Lane weight, weight_depth;
+    // Threshold of the robust loss function. A value <= 0 disables the robust loss for this lane.
+    Lane loss_threshold;
+
+    // ==== Output ====
+    Lane residual[3];
+    Lane depth;
+    Lane jacobian_pose[3][6];
+    Lane jacobian_point[3][3];
+
+    // Robust squared residual and the weight of the observation in the gauss newton system.
+    // Both are zero for unused lanes.
+    Lane chi2, loss_weight;
+
+    int count = 0;
+
+    void clear() { count = 0; }
+    bool full() const { return count == N; }
+
+    void add(const Vector<T, 2>& observation, T stereo_point, const Vector<T, 3>& point, T _weight,
+             T _weight_depth, T _loss_threshold)
+    {
+        int i             = count++;
+        obs_x(i)          = observation(0);
+        obs_y(i)          = observation(1);
+        obs_stereo(i)     = stereo_point;
+        point_x(i)        = point(0);
+        point_y(i)        = point(1);
+        point_z(i)        = point(2);
+        weight(i)         = _weight;
+        weight_depth(i)   = _weight_depth;
+        loss_threshold(i) = _loss_threshold;
+    }
+
+    // Copies the first lane to the unused lanes so the kernel only operates on valid numbers.
+    void pad()
+    {
+        for (int i = count; i < N; ++i)
+        {
+            obs_x(i)          = obs_x(0);
+            obs_y(i)          = obs_y(0);
+            obs_stereo(i)     = obs_stereo(0);
+            point_x(i)        = point_x(0);
+            point_y(i)        = point_y(0);
+            point_z(i)        = point_z(0);
+            weight(i)         = weight(0);
+            weight_depth(i)   = weight_depth(0);
+            loss_threshold(i) = loss_threshold(0);
+        }
+    }
+
+    Vector<T, 3> Residual(int i) const { return {residual[0](i), residual[1](i), residual[2](i)}; }
+
+    Matrix<T, 3, 6> JPose(int i) const
+    {
+        Matrix<T, 3, 6> J;
+        for (int r = 0; r < 3; ++r)
+            for (int c = 0; c < 6; ++c) J(r, c) = jacobian_pose[r][c](i);
+        return J;
+    }
+
+    Matrix<T, 3, 3> JPoint(int i) const
+    {
+        Matrix<T, 3, 3> J;
+        for (int r = 0; r < 3; ++r)
+            for (int c = 0; c < 3; ++c) J(r, c) = jacobian_point[r][c](i);
+        return J;
+    }
+
+    // Sum over all lanes of loss_weight * J_pose^T * J_pose and loss_weight * J_pose^T * residual.
+    void PoseBlock(Matrix<T, 6, 6>& JtJ, Vector<T, 6>& Jtr) const
+    {
+        for (int r = 0; r < 6; ++r)
+        {
+            for (int c = r; c < 6; ++c)
+            {
+                Lane sum = jacobian_pose[0][r] * jacobian_pose[0][c] + jacobian_pose[1][r] * jacobian_pose[1][c] +
+                           jacobian_pose[2][r] * jacobian_pose[2][c];
+                JtJ(r, c) = JtJ(c, r) = (loss_weight * sum).sum();
+            }
+            Lane sum = jacobian_pose[0][r] * residual[0] + jacobian_pose[1][r] * residual[1] +
+                       jacobian_pose[2][r] * residual[2];
+            Jtr(r) = (loss_weight * sum).sum();
+        }
+    }
+};
+
+
+/**
+ * Evaluates the residuals (and optionally the jacobians) of all observations in the batch.
+ * Afterwards the robust loss is applied, see BABatch::chi2 and BABatch::loss_weight.
+ */
+template <typename T, int N>
+inline void BundleAdjustmentBatch(const StereoCamera4Base<T>& camera, const Sophus::SE3<T>& pose,
+                                  BABatch<T, N>& batch, bool compute_jacobians = true,
+                                  Kernel::LossFunction loss_function = Kernel::LossFunction::Huber)
+{
+    using Lane = typename BABatch<T, N>::Lane;
+    SAIGA_ASSERT(batch.count > 0);
+    batch.pad();
+
+    const Matrix<T, 3, 3> R = pose.so3().matrix();
+    const Vector<T, 3> t    = pose.translation();
+
+    Lane x = R(0, 0) * batch.point_x + R(0, 1) * batch.point_y + R(0, 2) * batch.point_z + t(0);
+    Lane y = R(1, 0) * batch.point_x + R(1, 1) * batch.point_y + R(1, 2) * batch.point_z + t(1);
+    Lane z = R(2, 0) * batch.point_x + R(2, 1) * batch.point_y + R(2, 2) * batch.point_z + t(2);
+
+    Lane zinv   = z.inverse();
+    Lane zzinv  = zinv * zinv;
+    Lane p_by_x = x * zinv;
+    Lane p_by_y = y * zinv;
+
+    Lane projected_x = camera.fx * p_by_x + camera.s * p_by_y + camera.cx;
+    Lane projected_y = camera.fy * p_by_y + camera.cy;
+
+    batch.residual[0] = (projected_x - batch.obs_x) * batch.weight;
+    batch.residual[1] = (projected_y - batch.obs_y) * batch.weight;
+    batch.residual[2] = (batch.obs_stereo - (projected_x - camera.bf * zinv)) * batch.weight_depth;
+    batch.depth       = z;
+
+    Lane residualSquared = batch.residual[0].square() + batch.residual[1].square() + batch.residual[2].square();
+    Kernel::Loss(loss_function, batch.loss_threshold, residualSquared, batch.chi2, batch.loss_weight);
+    for (int i = batch.count; i < N; ++i)
+    {
+        batch.chi2(i)        = 0;
+        batch.loss_weight(i) = 0;
+    }
+
+    if (!compute_jacobians) return;
+
+    {
+        auto& J = batch.jacobian_pose;
+
+        // 1. Translation and 2. Rotation (division by z)
+        Lane d0[6] = {zinv, Lane::Zero(), -x * zzinv, -y * x * zzinv, 1 + x * x * zzinv, -y * zinv};
+        Lane d1[6] = {Lane::Zero(), zinv, -y * zzinv, -1 - y * y * zzinv, x * y * zzinv, x * zinv};
+
+        // multiplication by K
+        for (int c = 0; c < 6; ++c)
+        {
+            J[0][c] = d0[c] * camera.fx + d1[c] * camera.s;
+            J[1][c] = d1[c] * camera.fy;
+        }
+
+        // depth
+        J[2][0] = -J[0][0];
+        J[2][1] = -J[0][1];
+        J[2][2] = -J[0][2] - camera.bf * zzinv;
+        J[2][3] = -J[0][3] - camera.bf * y * zzinv;
+        J[2][4] = -J[0][4] + camera.bf * x * zzinv;
+        J[2][5] = -J[0][5];
+
+        // weight
+        for (int c = 0; c < 6; ++c)
+        {
+            J[0][c] *= batch.weight;
+            J[1][c] *= batch.weight;
+            J[2][c] *= batch.weight_depth;
+        }
+    }
+
+    {
+        auto& J = batch.jacobian_point;
+        for (int c = 0; c < 3; ++c)
+        {
+            // division by z
+            Lane d0 = (R(0, c) - p_by_x * R(2, c)) * zinv;
+            Lane d1 = (R(1, c) - p_by_y * R(2, c)) * zinv;
+
+            // multiplication by K
+            J[0][c] = d0 * camera.fx + d1 * camera.s;
+            J[1][c] = d1 * camera.fy;
+
+            // stereo projection
+            J[2][c] = -J[0][c] - camera.bf * R(2, c) * zzinv;
+
+            // weight
+            J[0][c] *= batch.weight;
+            J[1][c] *= batch.weight;
+            J[2][c] *= batch.weight_depth;
+        }
+    }
+}
+
+}  // namespace Saiga
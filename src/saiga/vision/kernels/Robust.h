@@ -73,7 +73,8 @@ inline Eigen::Matrix<T, 2, 1> CauchyLoss(T _deltaChi1, T residualSquared)
 
     // 'sum' and 'inv' are always positive, assuming that 's' is.
     result(0) = b_ * log(sum);
-    result(1) = std::max(std::numeric_limits<double>::min(), result(0) / residualSquared);
+    // The limit of the weight for residualSquared -> 0 is 1.
+    result(1) = residualSquared > 0 ? std::max(std::numeric_limits<double>::min(), result(0) / residualSquared) : 1;
     //    result(2) = -c_ * (inv * inv);
     return result;
 }
@@ -112,5 +113,60 @@ inline Eigen::Matrix<T, 2, 1> Loss(LossFunction function, T _deltaChi1, T residu
 }
 
 
+// ==== Batched versions ====
+// The loss and weight of N residuals are computed at once. Lanes with a threshold <= 0 use the squared loss.
+
+template <typename T, int N>
+inline void HuberLoss(const Eigen::Array<T, N, 1>& _deltaChi1, const Eigen::Array<T, N, 1>& residualSquared,
+                      Eigen::Array<T, N, 1>& loss, Eigen::Array<T, N, 1>& weight)
+{
+    using Lane = Eigen::Array<T, N, 1>;
+
+    Lane thresholdChi2 = _deltaChi1 * _deltaChi1;
+    Lane outlierLoss   = 2 * residualSquared.sqrt() * _deltaChi1 - thresholdChi2;
+    auto inlier        = (_deltaChi1 <= T(0)) || (residualSquared <= thresholdChi2);
+
+    loss   = inlier.select(residualSquared, outlierLoss);
+    weight = inlier.select(Lane::Ones(), (outlierLoss / residualSquared).max(std::numeric_limits<T>::min()));
+}
+
+template <typename T, int N>
+inline void CauchyLoss(const Eigen::Array<T, N, 1>& _deltaChi1, const Eigen::Array<T, N, 1>& residualSquared,
+                       Eigen::Array<T, N, 1>& loss, Eigen::Array<T, N, 1>& weight)
+{
+    using Lane = Eigen::Array<T, N, 1>;
+
+    Lane b_          = _deltaChi1 * _deltaChi1;
+    Lane cauchyLoss  = b_ * (residualSquared / b_).log1p();
+    auto squaredLoss = _deltaChi1 <= T(0);
+
+    // The limit of the weight for residualSquared -> 0 is 1. The division would give 0/0 = NaN.
+    Lane cauchyWeight =
+        (residualSquared > T(0)).select((cauchyLoss / residualSquared).max(std::numeric_limits<T>::min()), T(1));
+
+    loss   = squaredLoss.select(residualSquared, cauchyLoss);
+    weight = squaredLoss.select(Lane::Ones(), cauchyWeight);
+}
+
+template <typename T, int N>
+inline void Loss(LossFunction function, const Eigen::Array<T, N, 1>& _deltaChi1,
+                 const Eigen::Array<T, N, 1>& residualSquared, Eigen::Array<T, N, 1>& loss,
+                 Eigen::Array<T, N, 1>& weight)
+{
+    switch (function)
+    {
+        case LossFunction::Identity:
+            loss = residualSquared;
+            weight.setOnes();
+            break;
+        case LossFunction::Huber:
+            HuberLoss(_deltaChi1, residualSquared, loss, weight);
+            break;
+        case LossFunction::Cauchy:
+            CauchyLoss(_deltaChi1, residualSquared, loss, weight);
+            break;
+    }
+}
+
 }  // namespace Kernel
 }  // namespace Saiga
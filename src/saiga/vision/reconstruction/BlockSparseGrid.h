@@ -12,6 +12,9 @@
 #include "saiga/core/util/Thread/SpinLock.h"
 #include "saiga/core/util/Thread/omp.h"
 
+#include <atomic>
+#include <memory>
+
 
 namespace Saiga
 {
@@ -28,13 +31,11 @@ struct SAIGA_TEMPLATE BlockSparseGrid
     // Given a VOXEL_BLOCK_SIZE of 8 a voxel blocks consists of 8*8*8=512 voxels.
     //
     // Due to the sparse storage, each voxel block has to known it's own index.
-    // The next_index points to the next voxel block in the same hash bucket.
     struct VoxelBlock
     {
         //        Voxel data[VOXEL_BLOCK_SIZE][VOXEL_BLOCK_SIZE][VOXEL_BLOCK_SIZE];
         std::array<std::array<std::array<Voxel, 8>, 8>, 8> data;
         VoxelBlockIndex index = VoxelBlockIndex(-973454, -973454, -973454);
-        int next_index        = -1;
 
         // the weight of all voxels is 0
         bool Empty()
@@ -53,160 +54,293 @@ struct SAIGA_TEMPLATE BlockSparseGrid
         }
     };
 
+    // Append-only array of voxel blocks.
+    //
+    // The blocks are stored in segments, where segment k has (first_segment_size << k) blocks. A segment is never
+    // moved, therefore pointers to blocks stay valid while other threads insert new blocks. Missing segments are
+    // allocated lock-free by the first thread that needs them.
+    class BlockStorage
+    {
+       public:
+        static constexpr int max_segments = 32;
 
-    BlockSparseGrid(float voxel_size = 0.01, int reserve_blocks = 1000, int hash_size = 100000)
-        : voxel_size(voxel_size),
-          voxel_size_inv(1.0 / voxel_size),
-          hash_size(hash_size),
-          blocks(reserve_blocks),
-          first_hashed_block(hash_size, -1),
-          hash_locks(hash_size)
+        BlockStorage(int first_segment_size = 1024)
+        {
+            while ((1 << log2_first_segment) < first_segment_size) log2_first_segment++;
+        }
+
+        BlockStorage(const BlockStorage& other) { *this = other; }
+
+        BlockStorage& operator=(const BlockStorage& other)
+        {
+            if (this == &other) return *this;
+            Shrink(0);
+            log2_first_segment = other.log2_first_segment;
+            for (int k = 0; k < max_segments; ++k)
+            {
+                auto* src = other.segments[k].load();
+                if (!src) continue;
+                auto* dst = new VoxelBlock[SegmentSize(k)];
+                std::copy(src, src + SegmentSize(k), dst);
+                segments[k] = dst;
+            }
+            return *this;
+        }
+
+        ~BlockStorage() { Shrink(0); }
+
+        VoxelBlock& operator[](int i)
+        {
+            auto [k, offset] = Locate(i);
+            return segments[k].load(std::memory_order_acquire)[offset];
+        }
+
+        const VoxelBlock& operator[](int i) const
+        {
+            auto [k, offset] = Locate(i);
+            return segments[k].load(std::memory_order_acquire)[offset];
+        }
+
+        // Makes sure that the segment of block i exists. Thread-safe.
+        void Allocate(int i)
+        {
+            int k = Locate(i).first;
+            if (segments[k].load(std::memory_order_acquire)) return;
+
+            VoxelBlock* expected = nullptr;
+            auto* segment        = new VoxelBlock[SegmentSize(k)];
+            if (!segments[k].compare_exchange_strong(expected, segment, std::memory_order_acq_rel))
+            {
+                // Another thread was faster
+                delete[] segment;
+            }
+        }
+
+        // Allocates the segments of the blocks [0, n).
+        void Reserve(int n)
+        {
+            if (n <= 0) return;
+            for (int k = 0; k <= Locate(n - 1).first; ++k)
+            {
+                if (!segments[k].load()) segments[k] = new VoxelBlock[SegmentSize(k)];
+            }
+        }
+
+        // Frees all segments after the one of block n-1. Not thread-safe.
+        void Shrink(int n)
+        {
+            int first_unused = n <= 0 ? 0 : Locate(n - 1).first + 1;
+            for (int k = first_unused; k < max_segments; ++k)
+            {
+                delete[] segments[k].exchange(nullptr);
+            }
+        }
+
+        // Number of allocated blocks
+        size_t size() const
+        {
+            size_t n = 0;
+            for (int k = 0; k < max_segments; ++k)
+            {
+                if (segments[k].load()) n += SegmentSize(k);
+            }
+            return n;
+        }
+
+       private:
+        int log2_first_segment = 0;
+        std::array<std::atomic<VoxelBlock*>, max_segments> segments{};
+
+        size_t SegmentSize(int k) const { return size_t(1) << (log2_first_segment + k); }
+
+        // Segment k contains the blocks [B * (2^k - 1), B * (2^(k+1) - 1)) with B = first segment size.
+        // Returns (segment, offset in segment).
+        std::pair<int, int> Locate(int i) const
+        {
+            unsigned int u = unsigned(i) + (1u << log2_first_segment);
+            int k          = Log2(u) - log2_first_segment;
+            return {k, int(u - (1u << (log2_first_segment + k)))};
+        }
+
+        static int Log2(unsigned int v)
+        {
+#if defined(__GNUC__)
+            return 31 - __builtin_clz(v);
+#else
+            int r = 0;
+            while (v >>= 1) r++;
+            return r;
+#endif
+        }
+    };
 
+    // Marks an unused slot of the hash map.
+    static constexpr uint64_t empty_key = ~uint64_t(0);
+
+    // One slot of the open addressing hash map.
+    // 'key' is the packed block index (see Key()) and 'id' the position of the block in 'blocks'.
+    // id == -1 means the slot has been claimed by InsertBlockConcurrent, but the block is not created yet.
+    struct HashSlot
+    {
+        std::atomic<uint64_t> key{empty_key};
+        std::atomic_int id{-1};
+    };
+
+
+    BlockSparseGrid(float voxel_size = 0.01, int reserve_blocks = 1000, int hash_size = 100000)
+        : voxel_size(voxel_size), voxel_size_inv(1.0 / voxel_size), blocks(reserve_blocks)
     {
         block_size_inv = 1.0 / (voxel_size * VOXEL_BLOCK_SIZE);
+        AllocateHash(hash_size);
     }
 
     BlockSparseGrid(const BlockSparseGrid& other)
+        : voxel_size(other.voxel_size),
+          voxel_size_inv(other.voxel_size_inv),
+          block_size_inv(other.block_size_inv),
+          blocks(other.blocks)
     {
-        voxel_size         = other.voxel_size;
-        voxel_size_inv     = other.voxel_size_inv;
-        hash_size          = other.hash_size;
-        blocks             = other.blocks;
-        first_hashed_block = other.first_hashed_block;
-        hash_locks         = std::vector<SpinLock>(hash_size);
-        current_blocks     = other.current_blocks.load();
+        AllocateHash(other.hash_size);
+        for (unsigned int s = 0; s < hash_size; ++s)
+        {
+            hash_table[s].key = other.hash_table[s].key.load();
+            hash_table[s].id  = other.hash_table[s].id.load();
+        }
+        current_blocks = other.current_blocks.load();
     }
 
-    size_t Memory()
+    size_t Memory() const
     {
         size_t mem_blocks = blocks.size() * sizeof(VoxelBlock);
-        size_t mem_hash   = first_hashed_block.size() * sizeof(int);
+        size_t mem_hash   = hash_size * sizeof(HashSlot);
         return mem_blocks + mem_hash + sizeof(*this);
     }
 
     // Returns the voxel block or 0 if it doesn't exist.
+    // Can be called in parallel to InsertBlockConcurrent.
     VoxelBlock* GetBlock(const VoxelBlockIndex& i) { return GetBlock(i, H(i)); }
 
 
     // Insert a new block into the TSDF and returns a pointer to it.
     // If the block already exists, nothing is inserted.
+    //
+    // The hash map is grown if more than half of the slots are used. Therefore this function is not thread-safe. Use
+    // InsertBlockConcurrent for parallel insertion.
     VoxelBlock* InsertBlock(const VoxelBlockIndex& i)
     {
-        int h      = H(i);
-        auto block = GetBlock(i, h);
-
-        if (block)
-        {
-            // block already exists
-            return block;
-        }
-
-        // Create block and insert as the first element.
-        int new_index = current_blocks.fetch_add(1);
-
-        if (new_index >= (int)blocks.size())
+        if (2 * (current_blocks + 1) > (int)hash_size)
         {
-            blocks.resize(blocks.size() * 2);
+            Rehash(2 * hash_size);
         }
-
-        int hash                 = H(i);
-        auto* new_block          = &blocks[new_index];
-        new_block->index         = i;
-        new_block->next_index    = first_hashed_block[hash];
-        first_hashed_block[hash] = new_index;
-        return new_block;
+        return InsertBlockConcurrent(i);
     }
 
-    bool EraseBlock(const VoxelBlockIndex& i)
+    // Lock-free insertion, which can be called in parallel to other InsertBlockConcurrent and GetBlock calls.
+    //
+    // The hash slot is claimed with a CAS on its key, then the block is created and its id is published. Threads
+    // which find the same key in the meantime wait for the id. The hash map is not grown here, use Reserve() to
+    // make sure it has enough slots.
+    VoxelBlock* InsertBlockConcurrent(const VoxelBlockIndex& i)
     {
-        int block_id = GetBlockId(i);
-        //        if (block_id < 0) return false;
-        SAIGA_ASSERT(block_id >= 0);
+        uint64_t key = Key(i);
+        for (unsigned int s = Slot(key);; s = (s + 1) & (hash_size - 1))
+        {
+            auto& slot = hash_table[s];
+            uint64_t k = slot.key.load(std::memory_order_acquire);
+            if (k == empty_key && slot.key.compare_exchange_strong(k, key, std::memory_order_acq_rel))
+            {
+                int new_index = current_blocks.fetch_add(1);
+                if (2 * new_index >= (int)hash_size)
+                {
+                    SAIGA_EXIT_ERROR("Hash map full during parallel insertion! Call Reserve() before.");
+                }
 
-        int h = H(i);
-        if (!EraseBlockWithHole(i, h)) return false;
+                blocks.Allocate(new_index);
+                auto* new_block  = &blocks[new_index];
+                *new_block       = VoxelBlock();
+                new_block->index = i;
+                slot.id.store(new_index, std::memory_order_release);
+                return new_block;
+            }
 
-        if (block_id == current_blocks - 1)
-        {
-            // The removed block is at the end of the array -> just remove
-            //            std::cout << "remove end" << std::endl;
-            current_blocks--;
-            return true;
+            // If the CAS failed, k is now the key inserted by the other thread
+            if (k == key)
+            {
+                return &blocks[WaitForId(slot)];
+            }
         }
-        else
+    }
+
+    // Prepares the grid for the parallel insertion of up to num_blocks blocks (in total).
+    void Reserve(int num_blocks)
+    {
+        if (2 * num_blocks > (int)hash_size)
         {
-            SAIGA_ASSERT(current_blocks >= 2);
-            // The removed block is somewhere in the middle
-            // -> Remove last
-            auto last_b = blocks[current_blocks - 1];
-            SAIGA_ASSERT(last_b.index != i);
-
-            int last_h = H(last_b.index);
-            SAIGA_ASSERT(GetBlockId(last_b.index) == current_blocks - 1);
-
-            EraseBlockWithHole(last_b.index, last_h);
-            auto* new_block = &blocks[block_id];
-
-            *new_block                 = last_b;
-            new_block->next_index      = first_hashed_block[last_h];
-            first_hashed_block[last_h] = block_id;
-            current_blocks--;
-            return true;
+            Rehash(2 * num_blocks);
         }
+        blocks.Reserve(num_blocks);
     }
 
-    bool EraseBlockWithHole(const VoxelBlockIndex& i, int hash)
+    // Erases all blocks for which erase(block) returns true in a single pass over the block array.
+    //
+    // The remaining blocks are moved to the front of the array (in their original order) and their hash slot is
+    // updated. Blocks that have been removed from the hash map with EraseBlockWithHole are dropped as well.
+    // Returns the number of erased blocks. Not thread-safe.
+    template <typename Predicate>
+    int EraseBlocks(Predicate erase)
     {
-        int* block_id_ptr = &first_hashed_block[hash];
-
-        bool found = false;
-
-        while (*block_id_ptr != -1)
+        int n      = current_blocks;
+        int m      = 0;
+        int erased = 0;
+        for (int i = 0; i < n; ++i)
         {
-            auto& b = blocks[*block_id_ptr];
+            auto& b = blocks[i];
+            int s   = FindSlot(Key(b.index), H(b.index));
+            if (s < 0 || hash_table[s].id != i)
+            {
+                // hole
+                continue;
+            }
 
-            if (b.index == i)
+            if (erase(b))
             {
-                found = true;
-                break;
+                EraseSlot(s);
+                erased++;
+                continue;
             }
 
-            block_id_ptr = &b.next_index;
+            if (m != i)
+            {
+                blocks[m]        = b;
+                hash_table[s].id = m;
+            }
+            m++;
         }
-        if (!found) return false;
-
-        *block_id_ptr = blocks[*block_id_ptr].next_index;
-        return true;
+        current_blocks = m;
+        return erased;
     }
 
-    VoxelBlock* InsertBlockLock(const VoxelBlockIndex& i)
+    bool EraseBlock(const VoxelBlockIndex& i)
     {
-        int h = H(i);
-
-        std::unique_lock lock(hash_locks[h]);
-
-        auto block = GetBlock(i, h);
-
-        if (block)
-        {
-            // block already exists
-            return block;
-        }
-
-        // Create block and insert as the first element.
-        int new_index = current_blocks.fetch_add(1);
+        return EraseBlocks([&i](const VoxelBlock& b) { return b.index == i; }) > 0;
+    }
 
-        if (new_index >= (int)blocks.size())
-        {
-            SAIGA_EXIT_ERROR("Resizing not allowed during parallel insertion!");
-        }
+    // False for blocks in [0, current_blocks) that have been removed with EraseBlockWithHole.
+    bool IsLiveBlock(int id) const
+    {
+        auto& b = blocks[id];
+        int s   = FindSlot(Key(b.index), H(b.index));
+        return s >= 0 && hash_table[s].id == id;
+    }
 
-        int hash                 = H(i);
-        auto* new_block          = &blocks[new_index];
-        new_block->index         = i;
-        new_block->next_index    = first_hashed_block[hash];
-        first_hashed_block[hash] = new_index;
-        return new_block;
+    // Removes the block from the hash map, but keeps it in the block array.
+    // The hole is removed by the next EraseBlocks.
+    bool EraseBlockWithHole(const VoxelBlockIndex& i, int hash)
+    {
+        int s = FindSlot(Key(i), hash);
+        if (s < 0) return false;
+        EraseSlot(s);
+        return true;
     }
 
     void AllocateAroundPoint(const vec3& position, int r = 1)
@@ -295,7 +429,7 @@ struct SAIGA_TEMPLATE BlockSparseGrid
     {
         if (current_blocks == 0) return {};
 
-        iRect<3> result(blocks.front().index);
+        iRect<3> result(blocks[0].index);
 
         for (int i = 0; i < current_blocks; ++i)
         {
@@ -320,15 +454,7 @@ struct SAIGA_TEMPLATE BlockSparseGrid
     // Erase all blocks not included in rect
     void CropToRect(const iRect<3>& rect)
     {
-        for (int i = 0; i < current_blocks; ++i)
-        {
-            auto& b = blocks[i];
-            if (!rect.Contains(b.index))
-            {
-                EraseBlock(b.index);
-                i--;
-            }
-        }
+        EraseBlocks([&rect](const VoxelBlock& b) { return !rect.Contains(b.index); });
     }
 
 
@@ -351,7 +477,8 @@ struct SAIGA_TEMPLATE BlockSparseGrid
     }
 
 
-    void Compact() { blocks.resize(current_blocks); }
+    // Frees the unused block segments
+    void Compact() { blocks.Shrink(current_blocks); }
 
     int Size() { return current_blocks; }
 
@@ -362,55 +489,77 @@ struct SAIGA_TEMPLATE BlockSparseGrid
     float block_size_inv;
 
 
+    // Number of hash slots (a power of two)
     unsigned int hash_size;
     std::atomic_int current_blocks = 0;
-    std::vector<VoxelBlock> blocks;
-    std::vector<int> first_hashed_block;
-    std::vector<SpinLock> hash_locks;
+    BlockStorage blocks;
+    std::unique_ptr<HashSlot[]> hash_table;
 
 
     void Clear()
     {
         current_blocks = 0;
-        for (auto& b : blocks)
+        for (unsigned int s = 0; s < hash_size; ++s)
         {
-            b = VoxelBlock();
+            hash_table[s].key = empty_key;
+            hash_table[s].id  = -1;
         }
-        for (auto& i : first_hashed_block)
+    }
+
+    // Replaces all blocks, for example after loading them from a file. Not thread-safe.
+    void SetBlocks(const std::vector<VoxelBlock>& new_blocks, unsigned int new_hash_size)
+    {
+        AllocateHash(std::max<size_t>(new_hash_size, 2 * new_blocks.size()));
+        current_blocks = 0;
+        blocks.Reserve(new_blocks.size());
+        for (auto& b : new_blocks)
         {
-            i = -1;
+            *InsertBlockConcurrent(b.index) = b;
         }
     }
 
+    // Resizes the hash map to at least new_hash_size slots. Not thread-safe.
+    void Rehash(unsigned int new_hash_size)
+    {
+        auto old_table = std::move(hash_table);
+        auto old_size  = hash_size;
+        AllocateHash(new_hash_size);
+
+        for (unsigned int s = 0; s < old_size; ++s)
+        {
+            uint64_t key = old_table[s].key;
+            if (key == empty_key) continue;
+
+            unsigned int d = Slot(key);
+            while (hash_table[d].key != empty_key) d = (d + 1) & (hash_size - 1);
+            hash_table[d].key = key;
+            hash_table[d].id  = old_table[s].id.load();
+        }
+    }
 
-    int H(const VoxelBlockIndex& i)
+    // Packs the block index into 63 bits (21 bits per coordinate)
+    static uint64_t Key(const VoxelBlockIndex& i)
     {
-        unsigned int u = i.x() + i.y() * 1000 + i.z() * 1000 * 1000;
-        int result     = u % hash_size;
-        SAIGA_ASSERT(result >= 0 && result < (int)hash_size);
-        return result;
+        constexpr int offset = 1 << 20;
+        SAIGA_ASSERT((i.array() >= -offset).all() && (i.array() < offset).all(), "Block index out of range.");
+        return uint64_t(i.x() + offset) | (uint64_t(i.y() + offset) << 21) | (uint64_t(i.z() + offset) << 42);
     }
 
+    // The first slot, where the block is searched.
+    int H(const VoxelBlockIndex& i) const { return Slot(Key(i)); }
+
+    // Fibonacci hashing: the upper bits of the product depend on all bits of the key.
+    int Slot(uint64_t key) const { return int((key * 0x9E3779B97F4A7C15ull) >> (64 - hash_bits)); }
+
 
-    int GetBlockId(const VoxelBlockIndex& i) { return GetBlockId(i, H(i)); }
+    int GetBlockId(const VoxelBlockIndex& i) const { return GetBlockId(i, H(i)); }
 
     // Returns the actual (memory) block id
     // returns -1 if it does not exist
-    int GetBlockId(const VoxelBlockIndex& i, int hash)
+    int GetBlockId(const VoxelBlockIndex& i, int hash) const
     {
-        int block_id = first_hashed_block[hash];
-
-        while (block_id != -1)
-        {
-            auto* block = &blocks[block_id];
-            if (block->index == i)
-            {
-                break;
-            }
-
-            block_id = block->next_index;
-        }
-        return block_id;
+        int s = FindSlot(Key(i), hash);
+        return s >= 0 ? WaitForId(hash_table[s]) : -1;
     }
 
     VoxelBlock* GetBlock(const VoxelBlockIndex& i, int hash)
@@ -425,6 +574,62 @@ struct SAIGA_TEMPLATE BlockSparseGrid
             return nullptr;
         }
     }
+
+   private:
+    int hash_bits = 0;
+
+    void AllocateHash(unsigned int min_size)
+    {
+        hash_bits = 4;
+        while ((1u << hash_bits) < min_size) hash_bits++;
+        hash_size  = 1u << hash_bits;
+        hash_table = std::make_unique<HashSlot[]>(hash_size);
+    }
+
+    // Linear probing from 'hash' until the key or an empty slot is found.
+    // Returns the slot of the key or -1.
+    int FindSlot(uint64_t key, int hash) const
+    {
+        for (unsigned int s = hash;; s = (s + 1) & (hash_size - 1))
+        {
+            uint64_t k = hash_table[s].key.load(std::memory_order_acquire);
+            if (k == key) return s;
+            if (k == empty_key) return -1;
+        }
+    }
+
+    // Backward shift deletion. The following entries of the probe sequence are moved into the free slot, if this
+    // doesn't move them before their first slot. Not thread-safe.
+    void EraseSlot(unsigned int hole)
+    {
+        const unsigned int mask = hash_size - 1;
+        for (unsigned int s = (hole + 1) & mask;; s = (s + 1) & mask)
+        {
+            uint64_t key = hash_table[s].key;
+            if (key == empty_key) break;
+
+            unsigned int home = Slot(key);
+            if (((s - home) & mask) >= ((s - hole) & mask))
+            {
+                hash_table[hole].key = key;
+                hash_table[hole].id  = hash_table[s].id.load();
+                hole                 = s;
+            }
+        }
+        hash_table[hole].key = empty_key;
+        hash_table[hole].id  = -1;
+    }
+
+    // Waits until the inserting thread has published the block id.
+    static int WaitForId(const HashSlot& slot)
+    {
+        int id;
+        for (unsigned int k = 0; (id = slot.id.load(std::memory_order_acquire)) < 0; ++k)
+        {
+            yield(k);
+        }
+        return id;
+    }
 };
 
 
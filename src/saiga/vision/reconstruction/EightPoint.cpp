@@ -83,6 +83,52 @@ Mat3 FundamentalMatrixEightPointNormalized(const Vec2* points1, const Vec2* poin
     return F;
 }
 
+Mat3 NormalizationMatrix(const Vec2* points, ArrayView<const int> indices)
+{
+    Vec2 center = Vec2::Zero();
+    for (auto i : indices) center += points[i];
+    center /= indices.size();
+
+    double averageDistance = 0;
+    for (auto i : indices) averageDistance += (points[i] - center).norm();
+    averageDistance /= indices.size();
+
+    double scale = std::sqrt(2.0) / averageDistance;
+
+    Mat3 T  = Mat3::Identity() * scale;
+    T(0, 2) = -center.x() * scale;
+    T(1, 2) = -center.y() * scale;
+    T(2, 2) = 1;
+    return T;
+}
+
+Mat3 FundamentalMatrixLeastSquares(const Vec2* points1, const Vec2* points2, ArrayView<const int> indices)
+{
+    SAIGA_ASSERT(indices.size() >= 8);
+    Mat3 T1 = NormalizationMatrix(points1, indices);
+    Mat3 T2 = NormalizationMatrix(points2, indices);
+
+    // Normal equations A^T A of the 8-point system
+    Eigen::Matrix<double, 9, 9> AtA = Eigen::Matrix<double, 9, 9>::Zero();
+    for (auto i : indices)
+    {
+        Vec2 p = (T1 * points1[i].homogeneous()).head<2>();
+        Vec2 q = (T2 * points2[i].homogeneous()).head<2>();
+        Vec9 a;
+        a << p(0) * q(0), p(0) * q(1), p(0), p(1) * q(0), p(1) * q(1), p(1), q(0), q(1), 1;
+        AtA.selfadjointView<Eigen::Upper>().rankUpdate(a);
+    }
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 9, 9>> eig(AtA.selfadjointView<Eigen::Upper>());
+    Vec9 f = eig.eigenvectors().col(0);
+
+    Mat3 F;
+    F << f(0), f(3), f(6), f(1), f(4), f(7), f(2), f(5), f(8);
+    F = enforceRank2(F);
+    F = T2.transpose() * F * T1;
+    return NormalizeEpipolarMatrix(F);
+}
+
 int EightPointRansac::solve(ArrayView<const Vec2> _points1, ArrayView<const Vec2> _points2, Mat3& bestE,
                             std::vector<int>& bestInlierMatches, std::vector<char>& inlierMask)
 {
@@ -95,29 +141,27 @@ int EightPointRansac::solve(ArrayView<const Vec2> _points1, ArrayView<const Vec2
 
 
 
-    int idx;
-    idx = compute(points1.size());
+    int num_inliers = compute(points1.size());
 
 
 
 #pragma omp single
     {
-        //            std::cout << "best idx " << idx << std::endl;
-        bestE = models[idx];
+        bestE = bestModel;
 
 
         bestInlierMatches.clear();
-        bestInlierMatches.reserve(numInliers[idx]);
+        bestInlierMatches.reserve(num_inliers);
         for (int i = 0; i < N; ++i)
         {
-            if (inliers[idx][i]) bestInlierMatches.push_back(i);
+            if (bestInlierMask[i]) bestInlierMatches.push_back(i);
         }
 
-        inlierMask = inliers[idx];
+        inlierMask = bestInlierMask;
     }
 
 
-    return numInliers[idx];
+    return num_inliers;
 }
 
 bool EightPointRansac::computeModel(const RansacBase::Subset& set, EightPointRansac::Model& model)
@@ -139,6 +183,18 @@ double EightPointRansac::computeResidual(const EightPointRansac::Model& model, i
     return EpipolarDistanceSquared(points1[i], points2[i], model);
 }
 
+void EightPointRansac::computeResiduals(const Model& model, int begin, int end, double* residuals)
+{
+    EpipolarDistanceSquared(points1.data() + begin, points2.data() + begin, model, end - begin, residuals);
+}
+
+bool EightPointRansac::computeModelNonMinimal(ArrayView<const int> indices, Model& model)
+{
+    if (indices.size() < 8) return false;
+    model = FundamentalMatrixLeastSquares(points1.data(), points2.data(), indices);
+    return true;
+}
+
 
 
 }  // namespace Saiga
@@ -21,6 +21,15 @@ SAIGA_VISION_API Mat3 FundamentalMatrixEightPoint(const Vec2* points0, const Vec
 SAIGA_VISION_API Mat3 NormalizePoints(const Vec2* src_points, Vec2* dst_points, int N);
 SAIGA_VISION_API Mat3 FundamentalMatrixEightPointNormalized(const Vec2* points0, const Vec2* points1);
 
+// Similarity transformation T, so that the points T*p[indices[i]] have their centroid at the origin and an average
+// distance of sqrt(2).
+SAIGA_VISION_API Mat3 NormalizationMatrix(const Vec2* points, ArrayView<const int> indices);
+
+// Least squares fundamental matrix of the correspondences (points0[indices[i]], points1[indices[i]]) with the
+// normalized 8-point algorithm. Requires at least 8 correspondences.
+SAIGA_VISION_API Mat3 FundamentalMatrixLeastSquares(const Vec2* points0, const Vec2* points1,
+                                                    ArrayView<const int> indices);
+
 
 class SAIGA_VISION_API EightPointRansac : public RansacBase<EightPointRansac, Mat3, 8>
 {
@@ -38,6 +47,10 @@ class SAIGA_VISION_API EightPointRansac : public RansacBase<EightPointRansac, Ma
 
     double computeResidual(const Model& model, int i);
 
+    void computeResiduals(const Model& model, int begin, int end, double* residuals);
+
+    bool computeModelNonMinimal(ArrayView<const int> indices, Model& model);
+
     ArrayView<const Vec2> points1;
     ArrayView<const Vec2> points2;
 };
@@ -55,6 +55,27 @@ double EpipolarDistanceSquared(const Vec2& p1, const Vec2& p2, const Mat3& F)
     return disSqr;
 }
 
+void EpipolarDistanceSquared(const Vec2* points1, const Vec2* points2, const Mat3& F, int N, double* distances)
+{
+    const double f00 = F(0, 0), f01 = F(0, 1), f02 = F(0, 2);
+    const double f10 = F(1, 0), f11 = F(1, 1), f12 = F(1, 2);
+    const double f20 = F(2, 0), f21 = F(2, 1), f22 = F(2, 2);
+
+#pragma omp simd
+    for (int i = 0; i < N; ++i)
+    {
+        double x1 = points1[i](0), y1 = points1[i](1);
+        double x2 = points2[i](0), y2 = points2[i](1);
+
+        double l0 = f00 * x1 + f01 * y1 + f02;
+        double l1 = f10 * x1 + f11 * y1 + f12;
+        double l2 = f20 * x1 + f21 * y1 + f22;
+
+        double d     = x2 * l0 + y2 * l1 + l2;
+        distances[i] = d * d / (l0 * l0 + l1 * l1);
+    }
+}
+
 void decomposeEssentialMatrix(const Mat3& E, Mat3& R1, Mat3& R2, Vec3& t1, Vec3& t2)
 {
     auto svdE = E.jacobiSvd(Eigen::ComputeFullU | Eigen::ComputeFullV);
@@ -65,6 +65,13 @@ SAIGA_VISION_API Mat3 NormalizeEpipolarMatrix(const Mat3& EorF);
  */
 SAIGA_VISION_API double EpipolarDistanceSquared(const Vec2& p1, const Vec2& p2, const Mat3& F);
 
+/**
+ * Batched version of the function above for N point pairs.
+ * distances[i] = EpipolarDistanceSquared(points1[i], points2[i], F)
+ */
+SAIGA_VISION_API void EpipolarDistanceSquared(const Vec2* points1, const Vec2* points2, const Mat3& F, int N,
+                                              double* distances);
+
 
 
 // estimate the rotation and translation of the camera given the essential matrix E
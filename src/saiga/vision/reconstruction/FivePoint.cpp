@@ -6,6 +6,8 @@
 
 #include "FivePoint.h"
 
+#include "EightPoint.h"
+
 namespace Saiga
 {
 void constructFivePointMatrix(double* e, double* A)
@@ -499,29 +501,27 @@ int FivePointRansac::solve(ArrayView<const Vec2> _points1, ArrayView<const Vec2>
 
 
 
-    int idx;
-    idx = compute(points1.size());
+    int num_inliers = compute(points1.size());
 
 
 
 #pragma omp single
     {
-        //            std::cout << "best idx " << idx << std::endl;
-        bestE = models[idx].first;
-        bestT = models[idx].second;
+        bestE = bestModel.first;
+        bestT = bestModel.second;
 
         bestInlierMatches.clear();
-        bestInlierMatches.reserve(numInliers[idx]);
+        bestInlierMatches.reserve(num_inliers);
         for (int i = 0; i < N; ++i)
         {
-            if (inliers[idx][i]) bestInlierMatches.push_back(i);
+            if (bestInlierMask[i]) bestInlierMatches.push_back(i);
         }
 
-        inlierMask = inliers[idx];
+        inlierMask = bestInlierMask;
     }
 
 
-    return numInliers[idx];
+    return num_inliers;
 }
 
 bool FivePointRansac::computeModel(const RansacBase::Subset& set, FivePointRansac::Model& model)
@@ -559,4 +559,41 @@ double FivePointRansac::computeResidual(const FivePointRansac::Model& model, int
     return EpipolarDistanceSquared(points1[i], points2[i], model.first);
 }
 
+void FivePointRansac::computeResiduals(const Model& model, int begin, int end, double* residuals)
+{
+    EpipolarDistanceSquared(points1.data() + begin, points2.data() + begin, model.first, end - begin, residuals);
+}
+
+bool FivePointRansac::computeModelNonMinimal(ArrayView<const int> indices, Model& model)
+{
+    if (indices.size() < 8) return false;
+
+    // Linear estimate followed by a projection onto the essential manifold (two equal singular values)
+    Mat3 E   = FundamentalMatrixLeastSquares(points1.data(), points2.data(), indices);
+    auto svd = E.jacobiSvd(Eigen::ComputeFullU | Eigen::ComputeFullV);
+    Vec3 s   = svd.singularValues();
+    double a = (s(0) + s(1)) * 0.5;
+    E        = NormalizeEpipolarMatrix(svd.matrixU() * Vec3(a, a, 0).asDiagonal() * svd.matrixV().transpose());
+
+    // The decomposition with the most points in front of both cameras
+    auto Ts       = decomposeEssentialMatrix2(E);
+    int bestCount = 0;
+    for (auto& T : Ts)
+    {
+        int count = 0;
+        for (auto i : indices)
+        {
+            auto wp     = TriangulateHomogeneous<double, false>(SE3(), T, points1[i], points2[i]);
+            Vec3 otherP = T * wp;
+            count += wp.z() > 0 && otherP.z() > 0;
+        }
+        if (count > bestCount)
+        {
+            bestCount = count;
+            model     = {E, T};
+        }
+    }
+    return bestCount > 0;
+}
+
 }  // namespace Saiga
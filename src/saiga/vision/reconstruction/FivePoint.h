@@ -73,6 +73,10 @@ class SAIGA_VISION_API FivePointRansac : public RansacBase<FivePointRansac, std:
 
     double computeResidual(const Model& model, int i);
 
+    void computeResiduals(const Model& model, int begin, int end, double* residuals);
+
+    bool computeModelNonMinimal(ArrayView<const int> indices, Model& model);
+
     ArrayView<const Vec2> points1;
     ArrayView<const Vec2> points2;
 };
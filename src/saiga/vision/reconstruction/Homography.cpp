@@ -1,5 +1,7 @@
 #include "Homography.h"
 
+#include "EightPoint.h"
+
 namespace Saiga
 {
 Mat3 homography(ArrayView<const Vec2> points1, ArrayView<const Vec2> points2)
@@ -55,6 +57,37 @@ Mat3 homography(ArrayView<const Vec2> points1, ArrayView<const Vec2> points2)
     return H * s;
 }
 
+Mat3 homography(ArrayView<const Vec2> points1, ArrayView<const Vec2> points2, ArrayView<const int> indices)
+{
+    SAIGA_ASSERT(points1.size() == points2.size());
+    SAIGA_ASSERT(indices.size() >= 4);
+
+    Mat3 T1 = NormalizationMatrix(points1.data(), indices);
+    Mat3 T2 = NormalizationMatrix(points2.data(), indices);
+
+    // Normal equations A^T A of the DLT. The rows are the same as in the function above.
+    Eigen::Matrix<double, 9, 9> AtA = Eigen::Matrix<double, 9, 9>::Zero();
+    for (auto i : indices)
+    {
+        Vec2 s = (T1 * points1[i].homogeneous()).head<2>();
+        Vec2 d = (T2 * points2[i].homogeneous()).head<2>();
+
+        Vec9 a1, a2;
+        a1 << -s(0), -s(1), -1, 0, 0, 0, s(0) * d(0), s(1) * d(0), d(0);
+        a2 << 0, 0, 0, -s(0), -s(1), -1, s(0) * d(1), s(1) * d(1), d(1);
+        AtA.selfadjointView<Eigen::Upper>().rankUpdate(a1);
+        AtA.selfadjointView<Eigen::Upper>().rankUpdate(a2);
+    }
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 9, 9>> eig(AtA.selfadjointView<Eigen::Upper>());
+    Vec9 h = eig.eigenvectors().col(0);
+
+    Mat3 H;
+    H << h(0), h(1), h(2), h(3), h(4), h(5), h(6), h(7), h(8);
+    H = T2.inverse() * H * T1;
+    return H * (1.0 / H(2, 2));
+}
+
 double homographyResidual(const Vec2& p1, const Vec2& p2, const Mat3& H)
 {
     Vec3 p      = H * p1.homogeneous();
@@ -68,20 +101,12 @@ int HomographyRansac::solve(ArrayView<const Vec2> _points1, ArrayView<const Vec2
     points1 = _points1;
     points2 = _points2;
 
-    int idx = 0;
-
 #pragma omp parallel num_threads(params.threads)
     {
-        int l_idx = compute(points1.size());
-
-        if (OMP::getThreadNum() == 0)
-        {
-            // fix write/write face condition
-            idx = l_idx;
-        }
+        compute(points1.size());
     }
-    bestH = models[idx];
-    return numInliers[idx];
+    bestH = bestModel;
+    return bestNumInliers;
 }
 
 bool HomographyRansac::computeModel(const RansacBase::Subset& set, HomographyRansac::Model& model)
@@ -102,6 +127,32 @@ double HomographyRansac::computeResidual(const HomographyRansac::Model& model, i
     return homographyResidual(points1[i], points2[i], model);
 }
 
+void HomographyRansac::computeResiduals(const Model& model, int begin, int end, double* residuals)
+{
+    const double h00 = model(0, 0), h01 = model(0, 1), h02 = model(0, 2);
+    const double h10 = model(1, 0), h11 = model(1, 1), h12 = model(1, 2);
+    const double h20 = model(2, 0), h21 = model(2, 1), h22 = model(2, 2);
+
+#pragma omp simd
+    for (int i = begin; i < end; ++i)
+    {
+        double x1 = points1[i](0), y1 = points1[i](1);
+
+        double invz = 1.0 / (h20 * x1 + h21 * y1 + h22);
+        double dx   = points2[i](0) - (h00 * x1 + h01 * y1 + h02) * invz;
+        double dy   = points2[i](1) - (h10 * x1 + h11 * y1 + h12) * invz;
+
+        residuals[i - begin] = dx * dx + dy * dy;
+    }
+}
+
+bool HomographyRansac::computeModelNonMinimal(ArrayView<const int> indices, Model& model)
+{
+    if (indices.size() < 4) return false;
+    model = homography(points1, points2, indices);
+    return true;
+}
+
 
 
 }  // namespace Saiga
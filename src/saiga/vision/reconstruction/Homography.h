@@ -22,6 +22,13 @@ SAIGA_VISION_API Mat3 homography(ArrayView<const Vec2> points1, ArrayView<const
  */
 SAIGA_VISION_API double homographyResidual(const Vec2& p1, const Vec2& p2, const Mat3& H);
 
+/**
+ * Least squares homography of the correspondences (points1[indices[i]], points2[indices[i]]).
+ * The points are normalized before the DLT. Requires at least 4 correspondences.
+ */
+SAIGA_VISION_API Mat3 homography(ArrayView<const Vec2> points1, ArrayView<const Vec2> points2,
+                                 ArrayView<const int> indices);
+
 #if 0
 // solves H = aK * [R|t] for [R|t]
 CameraExtrinsics getExtrinsicsFromHomography(const CameraIntrinsics& camera, const mat3d_t& H);
@@ -50,6 +57,10 @@ class SAIGA_VISION_API HomographyRansac : public RansacBase<HomographyRansac, Ma
 
     double computeResidual(const Model& model, int i);
 
+    void computeResiduals(const Model& model, int begin, int end, double* residuals);
+
+    bool computeModelNonMinimal(ArrayView<const int> indices, Model& model);
+
     ArrayView<const Vec2> points1;
     ArrayView<const Vec2> points2;
 };
@@ -200,23 +200,22 @@ int P3PRansac::solve(ArrayView<const Vec3> _worldPoints, ArrayView<const Vec2> _
     }
 
 
-    int idx;
-    idx = compute(_worldPoints.size());
+    int num_inliers = compute(_worldPoints.size());
 
 #pragma omp single
     {
-        bestT      = models[idx];
-        inlierMask = inliers[idx];
+        bestT      = bestModel;
+        inlierMask = bestInlierMask;
 
         bestInlierMatches.clear();
-        bestInlierMatches.reserve(numInliers[idx]);
+        bestInlierMatches.reserve(num_inliers);
         for (int i = 0; i < N; ++i)
         {
-            if (inliers[idx][i]) bestInlierMatches.push_back(i);
+            if (bestInlierMask[i]) bestInlierMatches.push_back(i);
         }
     }
 
-    return numInliers[idx];
+    return num_inliers;
 }
 
 bool P3PRansac::computeModel(const RansacBase::Subset& set, P3PRansac::Model& model)
@@ -248,6 +247,27 @@ double P3PRansac::computeResidual(const P3PRansac::Model& model, int i)
     return (ip - normalizedImagePoints[i]).squaredNorm();
 }
 
+void P3PRansac::computeResiduals(const Model& model, int begin, int end, double* residuals)
+{
+    const Mat3 R = model.rotationMatrix();
+    const Vec3 t = model.translation();
+
+#pragma omp simd
+    for (int i = begin; i < end; ++i)
+    {
+        const Vec3& wp = worldPoints[i];
+
+        double x    = R(0, 0) * wp(0) + R(0, 1) * wp(1) + R(0, 2) * wp(2) + t(0);
+        double y    = R(1, 0) * wp(0) + R(1, 1) * wp(1) + R(1, 2) * wp(2) + t(1);
+        double z    = R(2, 0) * wp(0) + R(2, 1) * wp(1) + R(2, 2) * wp(2) + t(2);
+        double invz = 1.0 / z;
+        double dx   = x * invz - normalizedImagePoints[i](0);
+        double dy   = y * invz - normalizedImagePoints[i](1);
+
+        residuals[i - begin] = dx * dx + dy * dy;
+    }
+}
+
 
 #if 0
 SE3 refinePose(const SE3& pose, const Vec3* worldPoints, const Vec2* normalizedImagePoints, int N, int iterations)
@@ -79,6 +79,8 @@ class SAIGA_VISION_API P3PRansac : public RansacBase<P3PRansac, SE3, 4>
 
     double computeResidual(const Model& model, int i);
 
+    void computeResiduals(const Model& model, int begin, int end, double* residuals);
+
    private:
     ArrayView<const Vec3> worldPoints;
     ArrayView<const Vec2> normalizedImagePoints;
@@ -10,6 +10,7 @@
 #include "saiga/core/util/Thread/omp.h"
 #include "saiga/vision/VisionTypes.h"
 #include "saiga/vision/kernels/BA.h"
+#include "saiga/vision/kernels/BABatched.h"
 #include "saiga/vision/kernels/Robust.h"
 
 #include "PoseOptimizationScene.h"
@@ -123,82 +124,67 @@ struct SAIGA_ALIGN_CACHE RobustPoseOptimization
                 for (auto innerIt : Range(0, maxInnerIts))
                 {
                     {
-                        StereoJ JrowS;
-                        MonoJ JrowM;
-
-
-
                         auto& local = locals[OMP::getThreadNum()];
                         local.JtJ.setZero();
                         local.Jtb.setZero();
                         local.chi2    = 0;
                         local.inliers = 0;
 
-                        //#pragma omp for
-                        for (int i = 0; i < N; ++i)
+                        // The observations are evaluated in batches with the vectorized kernel.
+                        bool removeOutliers = outerIt > 0 && innerIt == 0;
+                        for (int i = 0; i < N;)
                         {
-                            if (outlier[i]) continue;
-
-                            auto& o  = obs[i];
-                            auto& wp = wps[i];
-
-                            if (o.stereo())
+                            batch.clear();
+                            for (; i < N && !batch.full(); ++i)
                             {
-                                auto stereo_point = o.ip(0) - camera.bf / o.depth;
-                                auto [res, depth] = BundleAdjustmentStereo<T>(camera, o.ip, stereo_point, guess, wp,
-                                                                           o.weight, o.weight, &JrowS, nullptr);
-                                auto res_2        = res.squaredNorm();
-
+                                if (outlier[i]) continue;
 
-                                // Remove outliers
-                                if (outerIt > 0 && innerIt == 0)
+                                auto& o               = obs[i];
+                                batchIds[batch.count] = i;
+                                if (o.stereo())
                                 {
-                                    if (res_2 > chi2s || depth < 0)
-                                    {
-                                        outlier[i] = true;
-                                        continue;
-                                    }
+                                    auto stereo_point = o.ip(0) - camera.bf / o.depth;
+                                    batch.add(o.ip, stereo_point, wps[i], o.weight, o.weight,
+                                              robust ? chi1Stereo : T(0));
                                 }
-                                T loss_weight = 1.0;
-                                if (robust)
+                                else
                                 {
-                                    auto rw     = Kernel::Loss(loss_function, chi1Stereo, res_2);
-                                    res_2       = rw(0);
-                                    loss_weight = rw(1);
+                                    batch.add(o.ip, 0, wps[i], o.weight, 0, robust ? chi1Mono : T(0));
                                 }
-                                local.chi2 += res_2;
-                                local.JtJ += loss_weight * (JrowS.transpose() * JrowS);
-                                local.Jtb -= loss_weight * JrowS.transpose() * res;
-                                local.inliers++;
                             }
-                            else
+                            if (batch.count == 0) break;
+
+                            BundleAdjustmentBatch(camera, guess, batch, true, loss_function);
+
+                            // Remove outliers
+                            if (removeOutliers)
                             {
-                                auto [res, depth] =
-                                    BundleAdjustment<T>(camera, o.ip, guess, wp, o.weight, &JrowM, nullptr);
-                                auto res_2 = res.squaredNorm();
-                                // Remove outliers
-                                if (outerIt > 0 && innerIt == 0)
+                                for (int l = 0; l < batch.count; ++l)
                                 {
-                                    if (res_2 > chi2m || depth < 0)
+                                    int id     = batchIds[l];
+                                    auto res_2 = batch.Residual(l).squaredNorm();
+                                    auto th    = obs[id].stereo() ? chi2s : chi2m;
+                                    if (res_2 > th || batch.depth(l) < 0)
                                     {
-                                        outlier[i] = true;
+                                        outlier[id]          = true;
+                                        batch.chi2(l)        = 0;
+                                        batch.loss_weight(l) = 0;
                                         continue;
                                     }
+                                    local.inliers++;
                                 }
-
-                                T loss_weight = 1.0;
-                                if (robust)
-                                {
-                                    auto rw     = Kernel::Loss(loss_function, chi1Mono, res_2);
-                                    res_2       = rw(0);
-                                    loss_weight = rw(1);
-                                }
-
-                                local.chi2 += res_2;
-                                local.JtJ += loss_weight * (JrowM.transpose() * JrowM);
-                                local.Jtb -= loss_weight * JrowM.transpose() * res;
-                                local.inliers++;
                             }
+                            else
+                            {
+                                local.inliers += batch.count;
+                            }
+
+                            JType JtJ;
+                            BType Jtb;
+                            batch.PoseBlock(JtJ, Jtb);
+                            local.chi2 += batch.chi2.sum();
+                            local.JtJ += JtJ;
+                            local.Jtb -= Jtb;
                         }
                     }
 
@@ -271,6 +257,10 @@ struct SAIGA_ALIGN_CACHE RobustPoseOptimization
     int maxOuterIts;
     int maxInnerIts;
 
+    static constexpr int batchSize = 8;
+    BABatch<T, batchSize> batch;
+    std::array<int, batchSize> batchIds;
+
     // Tmp variables for OMP implementation
     AlignedVector<ThreadLocalData, SAIGA_CACHE_LINE_SIZE> locals;
     int N;
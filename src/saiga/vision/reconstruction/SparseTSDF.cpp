@@ -12,16 +12,7 @@ namespace Saiga
 {
 void SparseTSDF::EraseEmptyBlocks()
 {
-    for (int i = 0; i < current_blocks; ++i)
-    {
-        auto& b = blocks[i];
-        if (b.Empty())
-        {
-            // std::cout << "erase empty " << b.index.transpose() << std::endl;
-            EraseBlock(b.index);
-            i--;
-        }
-    }
+    EraseBlocks([](VoxelBlock& b) { return b.Empty(); });
 }
 
 std::vector<std::vector<SparseTSDF::Triangle>> SparseTSDF::ExtractSurface(double iso, float outlier_factor,
@@ -161,30 +152,66 @@ UnifiedMesh SparseTSDF::CreateMesh(const std::vector<std::vector<SparseTSDF::Tri
 }
 
 
+// "TSDF" followed by the version of the file layout. Version 2 stores only the blocks and no hash map.
+// Files of version 1 (the chained hash map) start directly with the voxel size.
+static constexpr uint32_t tsdf_file_magic   = 0x46445354;
+static constexpr uint32_t tsdf_file_version = 2;
+
+template <typename Stream>
+static void WriteTSDF(const SparseTSDF& tsdf, Stream& strm)
+{
+    // Blocks removed with EraseBlockWithHole are still in the block array and are skipped.
+    std::vector<int> live;
+    live.reserve(tsdf.current_blocks);
+    for (int i = 0; i < tsdf.current_blocks; ++i)
+    {
+        if (tsdf.IsLiveBlock(i)) live.push_back(i);
+    }
+
+    strm << tsdf_file_magic << tsdf_file_version;
+    strm << tsdf.voxel_size << tsdf.voxel_size_inv << tsdf.block_size_inv << tsdf.hash_size << (int)live.size();
+    // Same layout as std::vector<VoxelBlock>. The hash map is rebuilt on loading.
+    strm << (size_t)live.size();
+    for (auto i : live) strm << tsdf.blocks[i];
+}
+
+template <typename Stream>
+static void ReadTSDF(SparseTSDF& tsdf, Stream& strm)
+{
+    uint32_t magic = 0, version = 0;
+    strm >> magic >> version;
+    SAIGA_ASSERT(magic == tsdf_file_magic && version == tsdf_file_version,
+                 "Unsupported SparseTSDF file. Only files of version " + std::to_string(tsdf_file_version) +
+                     " can be loaded. Files saved before the open addressing hash map have to be recreated.");
+
+    unsigned int new_hash_size;
+    int num_blocks;
+    std::vector<SparseTSDF::VoxelBlock> new_blocks;
+    strm >> tsdf.voxel_size >> tsdf.voxel_size_inv >> tsdf.block_size_inv >> new_hash_size >> num_blocks;
+    strm >> new_blocks;
+    SAIGA_ASSERT(num_blocks == (int)new_blocks.size());
+    tsdf.SetBlocks(new_blocks, new_hash_size);
+    SAIGA_ASSERT(tsdf.current_blocks == num_blocks);
+}
+
 void SparseTSDF::Save(const std::string& file)
 {
     BinaryFile strm(file, std::ios_base::out);
-    strm << voxel_size << voxel_size_inv << block_size_inv << hash_size << current_blocks;
-    strm << blocks;
-    strm << first_hashed_block;
+    WriteTSDF(*this, strm);
 }
 
 void SparseTSDF::Load(const std::string& file)
 {
     BinaryFile strm(file, std::ios_base::in);
     SAIGA_ASSERT(strm.strm.is_open());
-    strm >> voxel_size >> voxel_size_inv >> block_size_inv >> hash_size >> current_blocks;
-    strm >> blocks;
-    strm >> first_hashed_block;
+    ReadTSDF(*this, strm);
 }
 
 void SparseTSDF::SaveCompressed(const std::string& file)
 {
 #ifdef SAIGA_USE_ZLIB
     BinaryOutputVector strm;
-    strm << voxel_size << voxel_size_inv << block_size_inv << hash_size << current_blocks;
-    strm << blocks;
-    strm << first_hashed_block;
+    WriteTSDF(*this, strm);
     auto compressed = compress(strm.data.data(), strm.data.size());
     File::saveFileBinary(file, compressed.data(), compressed.size());
 #else
@@ -198,9 +225,7 @@ void SparseTSDF::LoadCompressed(const std::string& file)
     auto compressed_data = File::loadFileBinary(file);
     auto data            = uncompress(compressed_data.data());
     BinaryInputVector strm(data.data(), data.size());
-    strm >> voxel_size >> voxel_size_inv >> block_size_inv >> hash_size >> current_blocks;
-    strm >> blocks;
-    strm >> first_hashed_block;
+    ReadTSDF(*this, strm);
 #else
     SAIGA_EXIT_ERROR("zlib not found.");
 #endif
@@ -210,14 +235,12 @@ bool SparseTSDF::operator==(const SparseTSDF& other) const
 {
     if (voxel_size != other.voxel_size || voxel_size_inv != other.voxel_size_inv ||
         block_size_inv != other.block_size_inv || hash_size != other.hash_size ||
-        current_blocks != other.current_blocks || first_hashed_block != other.first_hashed_block)
+        current_blocks != other.current_blocks)
     {
         return false;
     }
 
-    if (blocks.size() != other.blocks.size()) return false;
-
-    for (int i = 0; i < (int)std::min(blocks.size(), other.blocks.size()); ++i)
+    for (int i = 0; i < current_blocks; ++i)
     {
         auto& b1 = blocks[i];
         auto& b2 = other.blocks[i];
@@ -342,7 +365,7 @@ void SparseTSDF::SetForAll(float distance, float weight)
 std::ostream& operator<<(std::ostream& strm, const SparseTSDF& tsdf)
 {
     size_t mem_blocks = tsdf.blocks.size() * sizeof(SparseTSDF::VoxelBlock);
-    size_t mem_hash   = tsdf.first_hashed_block.size() * sizeof(int);
+    size_t mem_hash   = tsdf.hash_size * sizeof(SparseTSDF::HashSlot);
 
     // Compute some statistics
     std::vector<double> distances;
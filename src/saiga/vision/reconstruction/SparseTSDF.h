@@ -30,8 +30,8 @@ struct TSDFVoxel
 //
 // The size in meters is given in the constructor.
 //
-// The voxel blocks are stored sparse using a hashmap. For each hashbucket,
-// we store a linked-list with all blocks inside this bucket.
+// The voxel blocks are stored sparse using a lock-free open addressing hashmap
+// (see BlockSparseGrid).
 struct SAIGA_VISION_API SparseTSDF : public BlockSparseGrid<TSDFVoxel, 8>
 {
     static constexpr int VOXEL_BLOCK_SIZE = 8;
@@ -51,16 +51,7 @@ struct SAIGA_VISION_API SparseTSDF : public BlockSparseGrid<TSDFVoxel, 8>
     SparseTSDF(const std::string& file) { Load(file); }
 
 
-    SparseTSDF(const SparseTSDF& other)
-    {
-        voxel_size         = other.voxel_size;
-        voxel_size_inv     = other.voxel_size_inv;
-        hash_size          = other.hash_size;
-        blocks             = other.blocks;
-        first_hashed_block = other.first_hashed_block;
-        hash_locks         = std::vector<SpinLock>(hash_size);
-        current_blocks     = other.current_blocks.load();
-    }
+    SparseTSDF(const SparseTSDF& other) : BlockSparseGrid(other) {}
 
     SAIGA_VISION_API friend std::ostream& operator<<(std::ostream& os, const SparseTSDF& tsdf);
 
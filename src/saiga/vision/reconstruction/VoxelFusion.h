@@ -53,7 +53,7 @@ struct SAIGA_VISION_API FusionParams
     float newWeight              = 0.1;
     float maxWeight              = 250;
 
-    int hash_size          = 5 * 1000 * 1000;
+    int hash_size          = 1000 * 1000;
     int block_count        = 25 * 1000;
     bool post_process_mesh = true;
 
@@ -5,6 +5,7 @@
 #include "saiga/core/util/Thread/omp.h"
 #include "saiga/vision/VisionIncludes.h"
 #include "saiga/vision/kernels/BA.h"
+#include "saiga/vision/kernels/BABatched.h"
 #include "saiga/vision/util/LM.h"
 
 #include "Eigen/Sparse"
@@ -37,7 +38,7 @@ double BAPoseOnly::computeQuadraticForm()
 
     double chi2 = 0;
 
-
+    Batch batch;
     for (int i = 0; i < (int)scene.images.size(); ++i)
     {
         auto& img   = scene.images[i];
@@ -50,41 +51,23 @@ double BAPoseOnly::computeQuadraticForm()
         targetJ.setZero();
         targetRes.setZero();
 
-        for (auto& ip : img.stereoPoints)
+        for (auto ip = img.stereoPoints.begin(); ip != img.stereoPoints.end();)
         {
-            if (!ip) continue;
-            auto wp   = scene.worldPoints[ip.wp].p;
-            auto extr = x_v[i];
-            auto w    = ip.weight * scene.scale();
-
-            if (ip.IsStereoOrDepth())
+            batch.clear();
+            for (; ip != img.stereoPoints.end() && !batch.full(); ++ip)
             {
-                auto stereo_point = ip.GetStereoPoint(scene.bf);
-
-                Matrix<double, 3, 6> JrowPose;
-                auto [res, depth] = BundleAdjustmentStereo(scam, ip.point, stereo_point, extr, wp, w,
-                                                           w * scene.stereo_weight, &JrowPose, nullptr);
-
-
-                auto c = res.squaredNorm();
-                chi2 += c;
-
-                targetJ += JrowPose.transpose() * JrowPose;
-                targetRes += JrowPose.transpose() * res;
+                if (*ip) addToBatch(batch, *ip);
             }
-            else
-            {
-                Matrix<double, 2, 6> JrowPose;
-                auto [res, depth] = BundleAdjustment<double>(camera, ip.point, extr, wp, w, &JrowPose, nullptr);
-
-
+            if (batch.count == 0) break;
 
-                auto c = res.squaredNorm();
-                chi2 += c;
+            BundleAdjustmentBatch(scam, x_v[i], batch);
+            chi2 += batch.chi2.sum();
 
-                targetJ += JrowPose.transpose() * JrowPose;
-                targetRes += JrowPose.transpose() * res;
-            }
+            Matrix<double, 6, 6> JtJ;
+            Vec6 Jtr;
+            batch.PoseBlock(JtJ, Jtr);
+            targetJ += JtJ;
+            targetRes += Jtr;
         }
     }
     return chi2;
@@ -96,40 +79,45 @@ double BAPoseOnly::computeCost()
 
     double chi2 = 0;
 
-
+    Batch batch;
     for (int i = 0; i < (int)scene.images.size(); ++i)
     {
         auto& img   = scene.images[i];
         auto camera = scene.intrinsics[img.intr];
         StereoCamera4 scam(camera, scene.bf);
 
-        for (auto& ip : img.stereoPoints)
+        for (auto ip = img.stereoPoints.begin(); ip != img.stereoPoints.end();)
         {
-            if (!ip) continue;
-            auto wp   = scene.worldPoints[ip.wp].p;
-            auto extr = x_v[i];
-            auto w    = ip.weight * scene.scale();
-            if (ip.IsStereoOrDepth())
+            batch.clear();
+            for (; ip != img.stereoPoints.end() && !batch.full(); ++ip)
             {
-                auto stereo_point = ip.GetStereoPoint(scene.bf);
-                auto [res, depth] =
-                    BundleAdjustmentStereo(scam, ip.point, stereo_point, extr, wp, w, w * scene.stereo_weight);
-
-                auto c = res.squaredNorm();
-                chi2 += c;
+                if (*ip) addToBatch(batch, *ip);
             }
-            else
-            {
-                auto [res, depth] = BundleAdjustment(scam, ip.point, extr, wp, w);
+            if (batch.count == 0) break;
 
-                auto c = res.squaredNorm();
-                chi2 += c;
-            }
+            BundleAdjustmentBatch(scam, x_v[i], batch, false);
+            chi2 += batch.chi2.sum();
         }
     }
     return chi2;
 }
 
+void BAPoseOnly::addToBatch(Batch& batch, StereoImagePoint& ip)
+{
+    Scene& scene = *_scene;
+
+    auto& wp = scene.worldPoints[ip.wp].p;
+    auto w   = ip.weight * scene.scale();
+    if (ip.IsStereoOrDepth())
+    {
+        batch.add(ip.point, ip.GetStereoPoint(scene.bf), wp, w, w * scene.stereo_weight, 0);
+    }
+    else
+    {
+        batch.add(ip.point, 0, wp, w, 0, 0);
+    }
+}
+
 bool BAPoseOnly::addDelta()
 {
     for (int i = 0; i < n; ++i)
@@ -2,6 +2,7 @@
 
 
 #include "saiga/vision/ba/BABase.h"
+#include "saiga/vision/kernels/BABatched.h"
 #include "saiga/vision/scene/Scene.h"
 
 #include "Recursive.h"
@@ -37,6 +38,10 @@ class SAIGA_VISION_API BAPoseOnly : public BABase, public LMOptimizer
     AlignedVector<SE3> x_v, oldx_v;
     AlignedVector<ResType> delta_x;
 
+    // The residuals are evaluated in batches of 8 observations
+    using Batch = BABatch<T, 8>;
+    void addToBatch(Batch& batch, StereoImagePoint& ip);
+
     // ============== LM Functions ==============
 
     virtual void init() override;
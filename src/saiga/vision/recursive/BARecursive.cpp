@@ -14,6 +14,7 @@
 #include "saiga/vision/util/HistogramImage.h"
 #include "saiga/vision/util/LM.h"
 
+#include <algorithm>
 #include <fstream>
 #include <numeric>
 
@@ -23,11 +24,12 @@
 
 namespace Saiga
 {
-void BARec::reserve(int n, int m)
+template <typename BlockScalar>
+void BARecBase<BlockScalar>::reserve(int n, int m)
 {
     validImages.reserve(n);
     validPoints.reserve(m);
-    pointToValidMap.resize(m);
+    pointToValidMap.resize(m, -1);
     cameraPointCounts.reserve(n);
     cameraPointCountsScan.reserve(n);
     pointCameraCounts.reserve(m);
@@ -35,6 +37,7 @@ void BARec::reserve(int n, int m)
 
     pointDiagTemp.reserve(m);
     pointResTemp.reserve(m);
+    refinementPointResTemp.reserve(m);
 
     localChi2.reserve(64);
 
@@ -44,7 +47,8 @@ void BARec::reserve(int n, int m)
     oldx_v.reserve(n);
 }
 
-void BARec::init()
+template <typename BlockScalar>
+void BARecBase<BlockScalar>::init()
 {
     //    OMP::setWaitPolicy(OMP::WaitPolicy::Active);
     //    threads = 4;
@@ -79,20 +83,43 @@ void BARec::init()
 
 
 
+    if (windowMode && !structureChanged)
+    {
+        // The window has not changed since the last call.
+        // -> The index sets, the sparsity pattern and the analyzed linear solver can be reused.
+        loadParameters();
+        sceneObs.updateValues(scene);
+        return;
+    }
+    structureChanged = false;
+
     // Check how many valid and cameras exist and construct the compact index sets
+    if (windowMode)
+    {
+        // Only reset the entries of the previous structure. This keeps the cost independent of the scene size.
+        for (auto i : validPoints)
+        {
+            if (i < (int)pointToValidMap.size()) pointToValidMap[i] = -1;
+        }
+        pointToValidMap.resize(scene.worldPoints.size(), -1);
+    }
+    else
+    {
+        pointToValidMap.clear();
+        pointToValidMap.resize(scene.worldPoints.size());
+        validImages.reserve(scene.images.size());
+        validPoints.reserve(scene.worldPoints.size());
+    }
     validPoints.clear();
     validImages.clear();
-    pointToValidMap.clear();
-    validImages.reserve(scene.images.size());
-    validPoints.reserve(scene.worldPoints.size());
-    pointToValidMap.resize(scene.worldPoints.size());
 
     totalN    = 0;
     constantN = 0;
 
-
-    for (int i = 0, validId = 0, nonConstantN = 0; i < (int)scene.images.size(); ++i)
+    int numImages = windowMode ? window.size() : scene.images.size();
+    for (int k = 0, validId = 0, nonConstantN = 0; k < numImages; ++k)
     {
+        int i     = windowMode ? window[k] : k;
         auto& img = scene.images[i];
         if (!img)
         {
@@ -121,17 +148,71 @@ void BARec::init()
 
     SAIGA_ASSERT(totalN == (int)validImages.size());
 
-    for (int i = 0; i < (int)scene.worldPoints.size(); ++i)
     {
-        auto& wp           = scene.worldPoints[i];
-        pointToValidMap[i] = -1;
-        if (!wp) continue;
-        int validId        = validPoints.size();
-        pointToValidMap[i] = validId;
-        validPoints.push_back(i);
+        // Flattened observations in the order of validImages
+        std::vector<int> sceneImageIds;
+        sceneImageIds.reserve(validImages.size());
+        for (auto&& info : validImages) sceneImageIds.push_back(info.sceneImageId);
+        sceneObs.build(scene, sceneImageIds);
+    }
+
+    if (windowMode)
+    {
+        // All points observed by the window
+        for (auto&& info : validImages)
+        {
+            for (auto& ip : scene.images[info.sceneImageId].stereoPoints)
+            {
+                if (ip.wp == -1 || pointToValidMap[ip.wp] != -1) continue;
+                SAIGA_ASSERT(scene.worldPoints[ip.wp]);
+                pointToValidMap[ip.wp] = validPoints.size();
+                validPoints.push_back(ip.wp);
+            }
+        }
+    }
+    else
+    {
+        for (int i = 0; i < (int)scene.worldPoints.size(); ++i)
+        {
+            auto& wp           = scene.worldPoints[i];
+            pointToValidMap[i] = -1;
+            if (!wp) continue;
+            int validId        = validPoints.size();
+            pointToValidMap[i] = validId;
+            validPoints.push_back(i);
+        }
+    }
+
+    // The prior factors of the valid points. Their pose variables are appended to the image variables.
+    activeFactors.clear();
+    if (!pointFactors.empty())
+    {
+        std::vector<int> factorIds;
+        for (auto wp : validPoints)
+        {
+            auto it = pointFactors.find(wp);
+            if (it != pointFactors.end()) factorIds.insert(factorIds.end(), it->second.begin(), it->second.end());
+        }
+        std::sort(factorIds.begin(), factorIds.end());
+        factorIds.erase(std::unique(factorIds.begin(), factorIds.end()), factorIds.end());
+
+        int variableId = totalN - constantN;
+        for (auto id : factorIds)
+        {
+            ActiveFactor af;
+            af.factor     = &priorFactors.at(id);
+            af.variableId = af.factor->hasPose ? variableId++ : -1;
+            for (auto& obs : af.factor->observations)
+            {
+                af.validPoint.push_back(pointToValidMap[obs.wp]);
+            }
+            af.wIndex.resize(af.validPoint.size(), -1);
+            activeFactors.push_back(std::move(af));
+        }
     }
 
     n = totalN - constantN;
+    for (auto& af : activeFactors) n += af.variableId != -1;
     m = validPoints.size();
 
     //    std::cout << n << " " << totalN << " " << constantN << std::endl;
@@ -146,24 +227,21 @@ void BARec::init()
     delta_x.resize(n, m);
     b.resize(n, m);
 
+    if (mixedPrecision)
+    {
+        deltaU.resize(n);
+        deltaV.resize(m);
+        refinementRhs.resize(n, m);
+        refinementDelta.resize(n, m);
+        refinementPointResTemp.resize(m);
+    }
+
     x_u.resize(totalN);
     oldx_u.resize(totalN);
     x_v.resize(m);
     oldx_v.resize(m);
 
-
-    // Make a copy of the initial parameters
-    for (auto&& info : validImages)
-    {
-        auto& img         = scene.images[info.sceneImageId];
-        x_u[info.validId] = img.se3;
-    }
-
-    for (int i = 0; i < (int)validPoints.size(); ++i)
-    {
-        auto& wp = scene.worldPoints[validPoints[i]];
-        x_v[i]   = wp.p;
-    }
+    loadParameters();
 
     cameraPointCounts.clear();
     cameraPointCounts.resize(n, 0);
@@ -176,18 +254,12 @@ void BARec::init()
     std::vector<int> innerElements;
     for (auto&& info : validImages)
     {
-        auto imgId  = info.sceneImageId;
         auto offset = info.variableId;
-        //        std::cout << imgId << " " << offset << std::endl;
         if (offset == -1) continue;
 
-        auto& img = scene.images[imgId];
-
-        for (auto& ip : img.stereoPoints)
+        for (int o = sceneObs.imageOffsets[info.validId]; o < sceneObs.imageOffsets[info.validId + 1]; ++o)
         {
-            if (ip.wp == -1) continue;
-
-            int j = pointToValidMap[ip.wp];
+            int j = pointToValidMap[sceneObs.pointId[o]];
             cameraPointCounts[offset]++;
             pointCameraCounts[j]++;
             innerElements.push_back(j);
@@ -195,6 +267,21 @@ void BARec::init()
         }
     }
 
+    // The rows of the prior factors
+    for (auto& af : activeFactors)
+    {
+        if (af.variableId == -1) continue;
+        for (int k = 0; k < (int)af.validPoint.size(); ++k)
+        {
+            int j = af.validPoint[k];
+            if (j == -1) continue;
+            cameraPointCounts[af.variableId]++;
+            pointCameraCounts[j]++;
+            innerElements.push_back(j);
+            af.wIndex[k] = observations++;
+        }
+    }
+
     auto test1 =
         Saiga::exclusive_scan(cameraPointCounts.begin(), cameraPointCounts.end(), cameraPointCountsScan.begin(), 0);
     auto test2 =
@@ -237,6 +324,13 @@ void BARec::init()
                               ? Eigen::Recursive::LinearSolverOptions::SolverType::Direct
                               : Eigen::Recursive::LinearSolverOptions::SolverType::Iterative;
     loptions.buildExplizitSchur = optimizationOptions.buildExplizitSchur;
+    loptions.ordering           = (Eigen::Recursive::LinearSolverOptions::Ordering)optimizationOptions.ordering;
+    loptions.preconditioner =
+        (Eigen::Recursive::LinearSolverOptions::Preconditioner)optimizationOptions.preconditioner;
+    loptions.clusterSize   = optimizationOptions.clusterSize;
+    loptions.inexactNewton = optimizationOptions.inexactNewton;
+    loptions.supernodal    = loptions.solverType == Eigen::Recursive::LinearSolverOptions::SolverType::Direct &&
+                             schurDensity(innerElements) > baOptions.supernodalDensity;
 
     if (baOptions.solver_threads == 1)
     {
@@ -339,13 +433,275 @@ void BARec::init()
     }
 }
 
-double BARec::computeQuadraticForm()
+template <typename BlockScalar>
+void BARecBase<BlockScalar>::loadParameters()
+{
+    Scene& scene = *_scene;
+
+    // Make a copy of the initial parameters
+    for (auto&& info : validImages)
+    {
+        auto& img         = scene.images[info.sceneImageId];
+        x_u[info.validId] = img.se3;
+    }
+
+    for (int i = 0; i < (int)validPoints.size(); ++i)
+    {
+        auto& wp = scene.worldPoints[validPoints[i]];
+        x_v[i]   = wp.p;
+    }
+}
+
+template <typename BlockScalar>
+void BARecBase<BlockScalar>::addWindowImage(int sceneImageId)
+{
+    SAIGA_ASSERT(std::find(window.begin(), window.end(), sceneImageId) == window.end());
+
+    // The observations of the image are optimized again and replace the ones linearized in its prior factor.
+    for (auto fit = priorFactors.begin(); fit != priorFactors.end(); ++fit)
+    {
+        if (fit->second.sceneImageId != sceneImageId) continue;
+        int id = fit->first;
+        for (auto& obs : fit->second.observations)
+        {
+            auto& ids = pointFactors[obs.wp];
+            ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+            if (ids.empty()) pointFactors.erase(obs.wp);
+        }
+        priorFactors.erase(fit);
+        break;
+    }
+
+    window.push_back(sceneImageId);
+    windowMode       = true;
+    structureChanged = true;
+}
+
+template <typename BlockScalar>
+void BARecBase<BlockScalar>::removeWindowImage(int sceneImageId, bool marginalize)
+{
+    auto it = std::find(window.begin(), window.end(), sceneImageId);
+    SAIGA_ASSERT(it != window.end());
+    window.erase(it);
+    structureChanged = true;
+
+    if (!marginalize) return;
+
+    // Linearize all observations of this image at the current estimate. The pose stays a (linear) variable of
+    // the factor, therefore the correlations between the points of the image are kept. See PriorFactor.
+    Scene& scene = *_scene;
+    auto& img    = scene.images[sceneImageId];
+    auto& extr   = img.se3;
+    auto& camera = scene.intrinsics[img.intr];
+    StereoCamera4 scam(camera, scene.bf);
+
+    PriorFactor factor;
+    factor.sceneImageId = sceneImageId;
+    factor.hasPose      = !img.constant;
+
+    for (auto& ip : img.stereoPoints)
+    {
+        if (!ip) continue;
+        double w = ip.weight * scene.scale();
+        auto& wp = scene.worldPoints[ip.wp].p;
+
+        PriorObservation obs;
+        obs.wp = ip.wp;
+        obs.x0 = wp;
+        if (ip.IsStereoOrDepth())
+        {
+            auto stereo_point = ip.GetStereoPoint(scene.bf);
+            Matrix<double, 3, 6> JrowPose;
+            Matrix<double, 3, 3> JrowPoint;
+            auto [res, depth] = BundleAdjustmentStereo(scam, ip.point, stereo_point, extr, wp, w,
+                                                       w * scene.stereo_weight, &JrowPose, &JrowPoint);
+            double loss_weight = 1.0;
+            if (baOptions.huberStereo > 0)
+            {
+                loss_weight = Kernel::HuberLoss<double>(baOptions.huberStereo, res.squaredNorm())(1);
+            }
+
+            obs.U  = loss_weight * JrowPose.transpose() * JrowPose;
+            obs.W  = loss_weight * JrowPose.transpose() * JrowPoint;
+            obs.V  = loss_weight * JrowPoint.transpose() * JrowPoint;
+            obs.gu = -loss_weight * JrowPose.transpose() * res;
+            obs.gv = -loss_weight * JrowPoint.transpose() * res;
+        }
+        else
+        {
+            Matrix<double, 2, 6> JrowPose;
+            Matrix<double, 2, 3> JrowPoint;
+            auto [res, depth] = BundleAdjustment(camera, ip.point, extr, wp, w, &JrowPose, &JrowPoint);
+            double loss_weight = 1.0;
+            if (baOptions.huberMono > 0)
+            {
+                loss_weight = Kernel::HuberLoss<double>(baOptions.huberMono, res.squaredNorm())(1);
+            }
+
+            obs.U  = loss_weight * JrowPose.transpose() * JrowPose;
+            obs.W  = loss_weight * JrowPose.transpose() * JrowPoint;
+            obs.V  = loss_weight * JrowPoint.transpose() * JrowPoint;
+            obs.gu = -loss_weight * JrowPose.transpose() * res;
+            obs.gv = -loss_weight * JrowPoint.transpose() * res;
+        }
+        factor.observations.push_back(obs);
+    }
+
+    if (factor.observations.empty()) return;
+
+    int id = nextPriorFactorId++;
+    for (auto& obs : factor.observations) pointFactors[obs.wp].push_back(id);
+    priorFactors.emplace(id, std::move(factor));
+}
+
+template <typename BlockScalar>
+void BARecBase<BlockScalar>::removePointPrior(int worldPointId)
+{
+    auto it = pointFactors.find(worldPointId);
+    if (it == pointFactors.end()) return;
+
+    // Removing all observations of the point keeps the factor consistent, because U and gu are stored per
+    // observation.
+    for (auto id : it->second)
+    {
+        auto fit  = priorFactors.find(id);
+        auto& obs = fit->second.observations;
+        obs.erase(std::remove_if(obs.begin(), obs.end(),
+                                 [worldPointId](const PriorObservation& o) { return o.wp == worldPointId; }),
+                  obs.end());
+        if (obs.empty()) priorFactors.erase(fit);
+    }
+    pointFactors.erase(it);
+    structureChanged = true;
+}
+
+template <typename BlockScalar>
+double BARecBase<BlockScalar>::evaluatePriorFactor(const ActiveFactor& af, BDiag* bdiagArray, BRes* bresArray)
+{
+    Scene& scene = *_scene;
+    using S      = BlockBAScalar;
+
+    auto& f        = *af.factor;
+    bool linearize = bdiagArray != nullptr;
+    Vec6 p         = f.hasPose ? f.pose : Vec6::Zero();
+
+    double chi2 = 0;
+    Eigen::Matrix<double, 6, 6> U;
+    U.setZero();
+    Vec6 ru = Vec6::Zero();
+
+    for (int k = 0; k < (int)f.observations.size(); ++k)
+    {
+        auto& obs = f.observations[k];
+        int j     = af.validPoint[k];
+
+        // Points outside of the structure are fixed at their current position
+        Vec3 d = (j == -1 ? scene.worldPoints[obs.wp].p : x_v[j]) - obs.x0;
+
+        chi2 += d.dot(obs.V * d) - 2 * obs.gv.dot(d);
+        if (f.hasPose)
+        {
+            chi2 += p.dot(obs.U * p) + 2 * p.dot(obs.W * d) - 2 * obs.gu.dot(p);
+        }
+
+        if (!linearize) continue;
+        if (f.hasPose)
+        {
+            U += obs.U;
+            ru += obs.gu - obs.U * p - obs.W * d;
+        }
+        if (j == -1) continue;
+
+        bdiagArray[j] += obs.V.template cast<S>();
+        bresArray[j] += (obs.gv - obs.V * d - obs.W.transpose() * p).template cast<S>();
+        if (af.variableId != -1)
+        {
+            A.w.valuePtr()[af.wIndex[k]].get() = obs.W.template cast<S>();
+        }
+    }
+
+    if (linearize && af.variableId != -1)
+    {
+        A.u.diagonal()(af.variableId).get() = U.template cast<S>();
+        b.u(af.variableId).get()            = ru.template cast<S>();
+    }
+    return chi2;
+}
+
+template <typename BlockScalar>
+double BARecBase<BlockScalar>::schurDensity(const std::vector<int>& innerElements)
+{
+    // The block (i,k) of the schur complement is non-zero if the variables i and k share a point.
+    // Only the pattern of A.w is used, therefore the cost depends on the optimized structure and not on the scene.
+    if (n == 0) return 0;
+
+    // The variables of each point
+    std::vector<int> pointCameras(observations);
+    std::vector<int> next = pointCameraCountsScan;
+    for (int i = 0; i < n; ++i)
+    {
+        for (int k = A.w.outerIndexPtr()[i]; k < A.w.outerIndexPtr()[i + 1]; ++k)
+        {
+            pointCameras[next[innerElements[k]]++] = i;
+        }
+    }
+
+    std::vector<int> marker(n, -1);
+    long edges = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        for (int k = A.w.outerIndexPtr()[i]; k < A.w.outerIndexPtr()[i + 1]; ++k)
+        {
+            int j = innerElements[k];
+            for (int l = pointCameraCountsScan[j]; l < pointCameraCountsScan[j] + pointCameraCounts[j]; ++l)
+            {
+                int i2 = pointCameras[l];
+                if (marker[i2] != i)
+                {
+                    marker[i2] = i;
+                    edges++;
+                }
+            }
+        }
+    }
+    return double(edges) / (double(n) * n);
+}
+
+template <typename BlockScalar>
+OptimizationResults BARecBase<BlockScalar>::solveWindow()
+{
+    SAIGA_ASSERT(windowMode);
+
+    // Warm start: The damping of the last call is reused. It is bounded by the initial lambda, because the
+    // last iterations of a converged solve are usually rejected, which increases lambda a lot.
+    if (!lambdaInitialized)
+    {
+        lambda            = optimizationOptions.initialLambda;
+        lambdaInitialized = true;
+    }
+    lambda = std::min(lambda, optimizationOptions.initialLambda);
+    v      = 2;
+
+    OptimizationResults result;
+    {
+        Saiga::ScopedTimer<double> timer(result.total_time);
+        init();
+        result = solve();
+    }
+    return result;
+}
+
+template <typename BlockScalar>
+double BARecBase<BlockScalar>::computeQuadraticForm()
 {
     Scene& scene = *_scene;
 
     //    SAIGA_OPTIONAL_BLOCK_TIMER(RECURSIVE_BA_USE_TIMERS && optimizationOptions.debugOutput);
 
-    using T = BlockBAScalar;
+    // Residuals, jacobians and the robust kernels are evaluated in double precision.
+    // Only the products for the Hessian are computed in the (possibly lower) precision of the linear system.
+    using T = double;
+    using S = BlockBAScalar;
     //    using KernelType = Saiga::Kernel::BAPosePointMono<T>;
 
 
@@ -392,6 +748,9 @@ double BARec::computeQuadraticForm()
             bresArray[i].setZero();
         }
 
+        Batch batch;
+        std::array<int, batchSize> batchObs;
+
 #pragma omp for
         for (auto valid_id = 0; valid_id < (int)validImages.size(); ++valid_id)
         {
@@ -400,11 +759,7 @@ double BARec::computeQuadraticForm()
             // int imgid        = info.sceneImageId;
             int actualOffset = info.variableId;
 
-            int k = A.w.outerIndexPtr()[actualOffset];
-
             bool constant = actualOffset == -1;
-            //            std::cout << "img " << imgid << " " << actualOffset << " " << k << " const " << constant <<
-            //            std::endl; SAIGA_ASSERT(k == A.w.outerIndexPtr()[i]);
 
 
 
@@ -425,101 +780,67 @@ double BARec::computeQuadraticForm()
                 targetPoseRes.setZero();
             }
 
-            for (auto& ip : img.stereoPoints)
+            // The observations of this image are evaluated in batches of 'batchSize'.
+            // Outliers don't enter the batch, but their entry in W is set to zero.
+            int begin  = sceneObs.imageOffsets[valid_id];
+            int end    = sceneObs.imageOffsets[valid_id + 1];
+            int wBegin = constant ? -1 : A.w.outerIndexPtr()[actualOffset] - begin;
+            for (int o = begin; o < end;)
             {
-                if (ip.wp == -1) continue;
-                if (ip.outlier)
+                batch.clear();
+                for (; o < end && !batch.full(); ++o)
                 {
-                    if (!constant)
+                    if (sceneObs.outlier[o])
                     {
-                        A.w.valuePtr()[k].get().setZero();
-                        ++k;
+                        if (!constant) A.w.valuePtr()[wBegin + o].get().setZero();
+                        continue;
                     }
-                    continue;
+                    batchObs[batch.count] = o;
+                    addToBatch(batch, o);
                 }
-                BlockBAScalar w = ip.weight * scene.scale();
-                int j           = pointToValidMap[ip.wp];
-
+                if (batch.count == 0) break;
 
-                auto& wp = x_v[j];
+                BundleAdjustmentBatch(scam, extr, batch);
+                newChi2 += batch.chi2.sum();
 
-                WElem& targetPosePoint = A.w.valuePtr()[k].get();
-
-                BDiag& targetPointPoint = bdiagArray[j];
-                BRes& targetPointRes    = bresArray[j];
-
-                if (ip.IsStereoOrDepth())
+                if (!constant)
                 {
-                    auto stereo_point = ip.GetStereoPoint(scene.bf);
-
-                    Matrix<double, 3, 6> JrowPose;
-                    Matrix<double, 3, 3> JrowPoint;
-                    auto [res, depth] = BundleAdjustmentStereo(scam, ip.point, stereo_point, extr, wp, w,
-                                                               w * scene.stereo_weight, &JrowPose, &JrowPoint);
-
-                    T loss_weight = 1.0;
-                    auto res_2    = res.squaredNorm();
-                    if (baOptions.huberStereo > 0)
-                    {
-                        auto rw = Kernel::HuberLoss<T>(baOptions.huberStereo, res_2);
-                        //                        auto rw     = Kernel::CauchyLoss<T>(baOptions.huberStereo, res_2);
-                        res_2       = rw(0);
-                        loss_weight = rw(1);
-                    }
-                    //                    if (!valid_depth) loss_weight = 0;
-
-
-                    newChi2 += res_2;
-
-                    if (!constant)
-                    {
-                        auto& targetPosePose = A.u.diagonal()(actualOffset).get();
-                        auto& targetPoseRes  = b.u(actualOffset).get();
-                        targetPosePose += loss_weight * JrowPose.transpose() * JrowPose;
-                        targetPosePoint = loss_weight * JrowPose.transpose() * JrowPoint;
-                        targetPoseRes -= loss_weight * JrowPose.transpose() * res;
-                    }
-                    targetPointPoint += loss_weight * JrowPoint.transpose() * JrowPoint;
-                    targetPointRes -= loss_weight * JrowPoint.transpose() * res;
+                    Matrix<T, 6, 6> JtJ;
+                    Vector<T, 6> Jtr;
+                    batch.PoseBlock(JtJ, Jtr);
+                    A.u.diagonal()(actualOffset).get() += JtJ.template cast<S>();
+                    b.u(actualOffset).get() -= Jtr.template cast<S>();
                 }
-                else
-                {
-                    Matrix<double, 2, 6> JrowPose;
-                    Matrix<double, 2, 3> JrowPoint;
-                    auto [res, depth] = BundleAdjustment(camera, ip.point, extr, wp, w, &JrowPose, &JrowPoint);
 
-                    T loss_weight = 1.0;
-                    auto res_2    = res.squaredNorm();
-                    if (baOptions.huberMono > 0)
-                    {
-                        auto rw = Kernel::HuberLoss<T>(baOptions.huberMono, res_2);
-                        //                        auto rw     = Kernel::CauchyLoss<T>(baOptions.huberMono, res_2);
-                        res_2       = rw(0);
-                        loss_weight = rw(1);
-                    }
-                    newChi2 += res_2;
+                for (int l = 0; l < batch.count; ++l)
+                {
+                    int o2 = batchObs[l];
+                    int j  = pointToValidMap[sceneObs.pointId[o2]];
 
-                    //                    if (!valid_depth) loss_weight = 0;
+                    S lw                   = batch.loss_weight(l);
+                    Matrix<S, 3, 3> JPoint = batch.JPoint(l).template cast<S>();
+                    Vector<S, 3> r         = batch.Residual(l).template cast<S>();
                     if (!constant)
                     {
-                        auto& targetPosePose = A.u.diagonal()(actualOffset).get();
-                        auto& targetPoseRes  = b.u(actualOffset).get();
-                        targetPosePose += loss_weight * JrowPose.transpose() * JrowPose;
-                        targetPosePoint = loss_weight * JrowPose.transpose() * JrowPoint;
-                        targetPoseRes -= loss_weight * JrowPose.transpose() * res;
+                        int k = wBegin + o2;
+                        SAIGA_ASSERT(A.w.innerIndexPtr()[k] == j);
+                        Matrix<S, 3, 6> JPose   = batch.JPose(l).template cast<S>();
+                        A.w.valuePtr()[k].get() = lw * JPose.transpose() * JPoint;
                     }
-                    targetPointPoint += loss_weight * JrowPoint.transpose() * JrowPoint;
-                    targetPointRes -= loss_weight * JrowPoint.transpose() * res;
-                }
-
-                if (!constant)
-                {
-                    SAIGA_ASSERT(A.w.innerIndexPtr()[k] == j);
-                    ++k;
+                    bdiagArray[j] += lw * JPoint.transpose() * JPoint;
+                    bresArray[j] -= lw * JPoint.transpose() * r;
                 }
             }
         }
 
+        // Marginalization prior factors. The point blocks go into the thread local arrays, because different
+        // factors can share a point.
+#pragma omp for
+        for (int k = 0; k < (int)activeFactors.size(); ++k)
+        {
+            newChi2 += evaluatePriorFactor(activeFactors[k], bdiagArray, bresArray);
+        }
+
 #pragma omp for
         for (int i = 0; i < m; ++i)
         {
@@ -542,7 +863,8 @@ double BARec::computeQuadraticForm()
     return chi2_sum;
 }
 
-bool BARec::addDelta()
+template <typename BlockScalar>
+bool BARecBase<BlockScalar>::addDelta()
 {
     //#pragma omp parallel num_threads(baOptions.helper_threads)
     {
@@ -558,7 +880,11 @@ bool BARec::addDelta()
 
 
 
-            auto t = delta_x.u(offset).get();
+            Vec6 t;
+            if constexpr (mixedPrecision)
+                t = deltaU[offset];
+            else
+                t = delta_x.u(offset).get();
 
             x_u[id] = Sophus::se3_expd(t) * x_u[id];
 
@@ -567,18 +893,35 @@ bool BARec::addDelta()
             //        x_u[id].so3() = Sophus::SO3d::exp(t.tail<3>()) * x_u[id].so3();
         }
 
+        // The pose of a prior factor is linear
+#pragma omp for nowait
+        for (int k = 0; k < (int)activeFactors.size(); ++k)
+        {
+            auto& af = activeFactors[k];
+            if (af.variableId == -1) continue;
+            auto& f   = *af.factor;
+            f.oldPose = f.pose;
+            if constexpr (mixedPrecision)
+                f.pose += deltaU[af.variableId];
+            else
+                f.pose += delta_x.u(af.variableId).get().template cast<double>();
+        }
+
 #pragma omp for
         for (int i = 0; i < m; ++i)
         {
             oldx_v[i] = x_v[i];
-            auto t    = delta_x.v(i).get();
-            x_v[i] += t;
+            if constexpr (mixedPrecision)
+                x_v[i] += deltaV[i];
+            else
+                x_v[i] += delta_x.v(i).get();
         }
     }
     return true;
 }
 
-void BARec::revertDelta()
+template <typename BlockScalar>
+void BARecBase<BlockScalar>::revertDelta()
 {
     //#pragma omp parallel num_threads(threads)
     //#pragma omp parallel num_threads(baOptions.helper_threads)
@@ -593,6 +936,12 @@ void BARec::revertDelta()
 
             x_u[info.validId] = oldx_u[info.validId];
         }
+#pragma omp for nowait
+        for (int k = 0; k < (int)activeFactors.size(); ++k)
+        {
+            auto& f = *activeFactors[k].factor;
+            f.pose  = f.oldPose;
+        }
 #pragma omp for nowait
         for (int i = 0; i < (int)x_v.size(); ++i)
         {
@@ -602,7 +951,8 @@ void BARec::revertDelta()
     //    x_u = oldx_u;
     //    x_v = oldx_v;
 }
-void BARec::finalize()
+template <typename BlockScalar>
+void BARecBase<BlockScalar>::finalize()
 {
     Scene& scene = *_scene;
 
@@ -623,7 +973,6 @@ void BARec::finalize()
 #pragma omp for
         for (int i = 0; i < (int)validPoints.size(); ++i)
         {
-            Eigen::Matrix<BlockBAScalar, 3, 1> t;
             auto id = validPoints[i];
             auto& p = scene.worldPoints[id].p;
             p       = x_v[i];
@@ -632,7 +981,8 @@ void BARec::finalize()
 }
 
 
-void BARec::addLambda(double lambda)
+template <typename BlockScalar>
+void BARecBase<BlockScalar>::addLambda(double lambda)
 {
     //    if (1 == 1)
     //    {
@@ -652,7 +1002,8 @@ void BARec::addLambda(double lambda)
 
 
 
-void BARec::solveLinearSystem()
+template <typename BlockScalar>
+void BARecBase<BlockScalar>::solveLinearSystem()
 {
     SAIGA_OPTIONAL_BLOCK_TIMER(RECURSIVE_BA_USE_TIMERS && optimizationOptions.debugOutput);
 
@@ -668,15 +1019,84 @@ void BARec::solveLinearSystem()
         }
     }
     //#pragma omp single
+
+    if constexpr (mixedPrecision)
+    {
+        for (int i = 0; i < n; ++i) deltaU[i] = delta_x.u(i).get().template cast<double>();
+        for (int i = 0; i < m; ++i) deltaV[i] = delta_x.v(i).get().template cast<double>();
+
+        // Iterative refinement: The residual is computed in double precision and the correction is solved
+        // with the already factorized single precision system.
+        // The iterative solver is only solved up to a relative tolerance anyways and a refinement step would be
+        // as expensive as the solve itself.
+        int refinementSteps = loptions.solverType == Eigen::Recursive::LinearSolverOptions::SolverType::Direct
+                                  ? baOptions.mixedPrecisionRefinement
+                                  : 0;
+        for (int it = 0; it < refinementSteps; ++it)
+        {
+            computeRefinementResidual();
+            solver.resolve(A, refinementDelta, refinementRhs, loptions);
+            for (int i = 0; i < n; ++i) deltaU[i] += refinementDelta.u(i).get().template cast<double>();
+            for (int i = 0; i < m; ++i) deltaV[i] += refinementDelta.v(i).get().template cast<double>();
+        }
+    }
 }
 
-double BARec::computeCost()
+template <typename BlockScalar>
+void BARecBase<BlockScalar>::computeRefinementResidual()
+{
+    // rhs = b - A * delta
+    //   rhs_u = b_u - U * du - W * dv
+    //   rhs_v = b_v - V * dv - W^T * du
+    // The matrix elements are converted to double before the products.
+    auto& rv = refinementPointResTemp;
+    for (auto& r : rv) r.setZero();
+    for (int i = 0; i < n; ++i)
+    {
+        Vec6 ru = b.u(i).get().template cast<double>() - A.u.diagonal()(i).get().template cast<double>() * deltaU[i];
+        for (int k = A.w.outerIndexPtr()[i]; k < A.w.outerIndexPtr()[i + 1]; ++k)
+        {
+            int j                  = A.w.innerIndexPtr()[k];
+            Matrix<double, 6, 3> w = A.w.valuePtr()[k].get().template cast<double>();
+            ru -= w * deltaV[j];
+            rv[j] -= w.transpose() * deltaU[i];
+        }
+        refinementRhs.u(i).get() = ru.template cast<BlockBAScalar>();
+    }
+    for (int j = 0; j < m; ++j)
+    {
+        Vec3 r = rv[j] + b.v(j).get().template cast<double>() -
+                 A.v.diagonal()(j).get().template cast<double>() * deltaV[j];
+        refinementRhs.v(j).get() = r.template cast<BlockBAScalar>();
+    }
+}
+
+template <typename BlockScalar>
+void BARecBase<BlockScalar>::addToBatch(Batch& batch, int o)
+{
+    Scene& scene = *_scene;
+
+    double w = sceneObs.weight[o] * scene.scale();
+    auto& wp = x_v[pointToValidMap[sceneObs.pointId[o]]];
+    if (sceneObs.IsStereoOrDepth(o))
+    {
+        batch.add(sceneObs.point[o], sceneObs.GetStereoPoint(o, scene.bf), wp, w, w * scene.stereo_weight,
+                  baOptions.huberStereo);
+    }
+    else
+    {
+        batch.add(sceneObs.point[o], 0, wp, w, 0, baOptions.huberMono);
+    }
+}
+
+template <typename BlockScalar>
+double BARecBase<BlockScalar>::computeCost()
 {
     Scene& scene = *_scene;
 
     SAIGA_OPTIONAL_BLOCK_TIMER(RECURSIVE_BA_USE_TIMERS && optimizationOptions.debugOutput);
 
-    using T = BlockBAScalar;
+    // The cost is always evaluated in double precision
 
 #pragma omp parallel num_threads(baOptions.helper_threads)
     {
@@ -684,56 +1104,38 @@ double BARec::computeCost()
 
         double& newChi2 = localChi2[tid];
         newChi2         = 0;
+
+        Batch batch;
 #pragma omp for
         for (auto valid_id = 0; valid_id < (int)validImages.size(); ++valid_id)
         {
             auto info = validImages[valid_id];
             SAIGA_ASSERT(info);
-            auto& img  = scene.images[info.sceneImageId];
-            auto& extr = x_u[info.validId];
-            //            auto& extr2  = scene.extrinsics[img.extr];
-            //            auto& extr   = extr2.se3;
+            auto& img    = scene.images[info.sceneImageId];
+            auto& extr   = x_u[info.validId];
             auto& camera = scene.intrinsics[img.intr];
 
             StereoCamera4 scam(camera, scene.bf);
 
-            for (auto& ip : img.stereoPoints)
+            int end = sceneObs.imageOffsets[valid_id + 1];
+            for (int o = sceneObs.imageOffsets[valid_id]; o < end;)
             {
-                if (!ip) continue;
-                BlockBAScalar w = ip.weight * scene.scale();
-                int j           = pointToValidMap[ip.wp];
-                SAIGA_ASSERT(j >= 0);
-                auto& wp = x_v[j];
-
-                if (ip.IsStereoOrDepth())
+                batch.clear();
+                for (; o < end && !batch.full(); ++o)
                 {
-                    auto stereo_point = ip.GetStereoPoint(scene.bf);
-                    auto [res, depth] =
-                        BundleAdjustmentStereo(scam, ip.point, stereo_point, extr, wp, w, w * scene.stereo_weight);
-                    auto res_2 = res.squaredNorm();
-                    if (baOptions.huberStereo > 0)
-                    {
-                        auto rw = Kernel::HuberLoss<T>(baOptions.huberStereo, res_2);
-                        //                        auto rw = Kernel::CauchyLoss<T>(baOptions.huberStereo, res_2);
-                        res_2 = rw(0);
-                    }
-                    newChi2 += res_2;
-                }
-                else
-                {
-                    auto [res, depth] = BundleAdjustment(scam, ip.point, extr, wp, w);
-
-                    auto res_2 = res.squaredNorm();
-                    if (baOptions.huberMono > 0)
-                    {
-                        auto rw = Kernel::HuberLoss<T>(baOptions.huberMono, res_2);
-                        //                        auto rw = Kernel::CauchyLoss<T>(baOptions.huberMono, res_2);
-                        res_2 = rw(0);
-                    }
-                    newChi2 += res_2;
+                    if (!sceneObs.outlier[o]) addToBatch(batch, o);
                 }
+                if (batch.count == 0) break;
+                BundleAdjustmentBatch(scam, extr, batch, false);
+                newChi2 += batch.chi2.sum();
             }
         }
+
+#pragma omp for
+        for (int k = 0; k < (int)activeFactors.size(); ++k)
+        {
+            newChi2 += evaluatePriorFactor(activeFactors[k]);
+        }
     }
 
 
@@ -746,4 +1148,7 @@ double BARec::computeCost()
 
     return chi2_sum;
 }
+template class BARecBase<double>;
+template class BARecBase<float>;
+
 }  // namespace Saiga
@@ -7,19 +7,35 @@
 
 #pragma once
 #include "saiga/vision/ba/BABase.h"
+#include "saiga/vision/kernels/BABatched.h"
 #include "saiga/vision/scene/Scene.h"
+#include "saiga/vision/scene/SceneObservations.h"
 
 #include "Recursive.h"
 
+#include <unordered_map>
+
 namespace Saiga
 {
-class SAIGA_VISION_API BARec : public BABase, public LMOptimizer
+/**
+ * Bundle adjustment with the recursive schur solver.
+ *
+ * The template parameter is the scalar type of the linear system (Hessian blocks and linear solver).
+ * The parameters, residuals and the cost are always evaluated and accumulated in double precision.
+ *
+ * With float (BARecf) the memory bandwidth of the Hessian is halved. The solution of the direct solver is
+ * improved with a few steps of iterative refinement, where the residual of the linear system is computed
+ * in double precision (see BAOptions::mixedPrecisionRefinement).
+ */
+template <typename _BlockBAScalar>
+class SAIGA_VISION_API BARecBase : public BABase, public LMOptimizer
 {
    public:
     // ============== Recusrive Matrix Types ==============
     static constexpr int blockSizeCamera = 6;
     static constexpr int blockSizePoint  = 3;
-    using BlockBAScalar                  = double;
+    using BlockBAScalar                  = _BlockBAScalar;
+    static constexpr bool mixedPrecision = !std::is_same<BlockBAScalar, double>::value;
 
     using ADiag  = Eigen::Matrix<BlockBAScalar, blockSizeCamera, blockSizeCamera, Eigen::RowMajor>;
     using BDiag  = Eigen::Matrix<BlockBAScalar, blockSizePoint, blockSizePoint, Eigen::RowMajor>;
@@ -49,13 +65,50 @@ class SAIGA_VISION_API BARec : public BABase, public LMOptimizer
    public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-    BARec() : BABase("Recursive BA") {}
-    virtual ~BARec() {}
-    virtual void create(Scene& scene) override { _scene = &scene; }
+    BARecBase() : BABase(mixedPrecision ? "Recursive BA (float)" : "Recursive BA") {}
+    virtual ~BARecBase() {}
+    virtual void create(Scene& scene) override
+    {
+        _scene           = &scene;
+        structureChanged = true;
+    }
 
     // resserve space for n cameras and m points
     void reserve(int n, int m);
 
+    // ============== Sliding Window ==============
+    //
+    // In window mode only the images of the window and the points observed by them are optimized.
+    // The structure (index sets, sparsity pattern and the analyzed linear solver) is reused by all
+    // following calls of solveWindow() until the window changes. The cost of a call therefore depends on the
+    // size of the window and not on the size of the scene.
+    //
+    // A marginalized image is converted into a prior factor, which stores the observations of the image linearized
+    // at the current estimate. The pose of the image is kept as an additional linear variable of the factor
+    // (a row of W). Eliminating it in the schur complement gives the dense prior over all points of the image,
+    // including the correlations between the points, without destroying the block diagonal structure of V.
+    // A factor is used as long as one of its points is part of the window. Its other points are fixed.
+    //
+    // Only observations of window images are optimized. Observations of window points by images outside of the
+    // window are ignored, unless the image has been marginalized (they are then part of its prior factor).
+    // To use them, add these images as constant images to the window.
+    //
+    // Adding a marginalized image again removes its prior factor. Otherwise its observations would be counted twice.
+    void addWindowImage(int sceneImageId);
+    void removeWindowImage(int sceneImageId, bool marginalize = true);
+
+    // Removes the observations of this point from all prior factors (for example if the point is deleted).
+    void removePointPrior(int worldPointId);
+
+    // Must be called after observations of window images have been added or removed.
+    void markStructureChanged() { structureChanged = true; }
+
+    const std::vector<int>& windowImages() const { return window; }
+    int numPriorFactors() const { return priorFactors.size(); }
+
+    // Optimizes the current window. The LM damping of the previous call is reused (warm start).
+    OptimizationResults solveWindow();
+
    private:
     Scene* _scene;
 
@@ -69,6 +122,72 @@ class SAIGA_VISION_API BARec : public BABase, public LMOptimizer
     BAVector x, b, delta_x;
     BASolver solver;
 
+    // ============== Mixed Precision ==============
+    // The refined solution in double precision and the temporary vectors of the refinement
+    AlignedVector<Vec6> deltaU;
+    AlignedVector<Vec3> deltaV;
+    BAVector refinementRhs, refinementDelta;
+    // - W^T * du of the refinement residual
+    AlignedVector<Vec3> refinementPointResTemp;
+
+    // rhs = b - A * delta in double precision
+    void computeRefinementResidual();
+
+    // ============== Sliding Window ==============
+    bool windowMode        = false;
+    bool structureChanged  = true;
+    bool lambdaInitialized = false;
+    std::vector<int> window;
+
+    // One linearized observation of a marginalized image. With the pose delta p and d = x - x0:
+    //   cost = p^T U p + 2 p^T W d + d^T V d - 2 gu^T p - 2 gv^T d
+    struct PriorObservation
+    {
+        int wp;
+        Vec3 x0;
+        Eigen::Matrix<double, 6, 6> U;
+        Eigen::Matrix<double, 6, 3> W;
+        Mat3 V;
+        Vec6 gu;
+        Vec3 gv;
+    };
+
+    struct PriorFactor
+    {
+        // The marginalized image
+        int sceneImageId = -1;
+        // false for constant images. The factor then only has the point blocks V and gv.
+        bool hasPose = true;
+        // Current estimate of the pose delta
+        Vec6 pose = Vec6::Zero(), oldPose = Vec6::Zero();
+        AlignedVector<PriorObservation> observations;
+    };
+
+    std::unordered_map<int, PriorFactor> priorFactors;
+    int nextPriorFactorId = 0;
+    // world point -> prior factors with an observation of it
+    std::unordered_map<int, std::vector<int>> pointFactors;
+
+    // The prior factors with at least one point in the current structure
+    struct ActiveFactor
+    {
+        PriorFactor* factor;
+        // index into delta_x, A matrices (-1 without pose)
+        int variableId;
+        // for each observation: valid point id (-1 for fixed points) and index into A.w.valuePtr()
+        std::vector<int> validPoint, wIndex;
+    };
+    std::vector<ActiveFactor> activeFactors;
+
+    // Returns the cost of the factor. The blocks of the factor are added to the linear system if bdiagArray and
+    // bresArray are given.
+    double evaluatePriorFactor(const ActiveFactor& af, BDiag* bdiagArray = nullptr, BRes* bresArray = nullptr);
+
+    // Density of the schur complement computed from the pattern of A.w (inner indices in innerElements)
+    double schurDensity(const std::vector<int>& innerElements);
+
+    void loadParameters();
+
     AlignedVector<SE3> x_u, oldx_u;
     AlignedVector<Vec3> x_v, oldx_v;
 
@@ -105,6 +224,16 @@ class SAIGA_VISION_API BARec : public BABase, public LMOptimizer
     std::vector<int> validPoints;
     std::vector<int> pointToValidMap;
 
+    // Observations of all valid images. The observations of validImages[i] are in the range
+    // sceneObs.imageOffsets[i] ... sceneObs.imageOffsets[i+1]-1.
+    SceneObservations sceneObs;
+
+    // Number of observations evaluated by one call of the batched kernel.
+    // Residuals and jacobians are always computed in double precision.
+    static constexpr int batchSize = 8;
+    using Batch                    = BABatch<double, batchSize>;
+    void addToBatch(Batch& batch, int o);
+
 
 
     bool explizitSchur = false;
@@ -132,5 +261,7 @@ class SAIGA_VISION_API BARec : public BABase, public LMOptimizer
     virtual void finalize() override;
 };
 
+using BARec  = BARecBase<double>;
+using BARecf = BARecBase<float>;
 
 }  // namespace Saiga
@@ -354,6 +354,13 @@ void BARecRel::init()
                               ? Eigen::Recursive::LinearSolverOptions::SolverType::Direct
                               : Eigen::Recursive::LinearSolverOptions::SolverType::Iterative;
     loptions.buildExplizitSchur = optimizationOptions.buildExplizitSchur;
+    loptions.ordering           = (Eigen::Recursive::LinearSolverOptions::Ordering)optimizationOptions.ordering;
+    loptions.preconditioner =
+        (Eigen::Recursive::LinearSolverOptions::Preconditioner)optimizationOptions.preconditioner;
+    loptions.clusterSize   = optimizationOptions.clusterSize;
+    loptions.inexactNewton = optimizationOptions.inexactNewton;
+    loptions.supernodal         = loptions.solverType == Eigen::Recursive::LinearSolverOptions::SolverType::Direct &&
+                          scene.getSchurDensity() > baOptions.supernodalDensity;
 
     if (baOptions.solver_threads == 1)
     {
@@ -9,9 +9,12 @@
 #pragma once
 
 
+#include "Cholesky/BlockOrdering.h"
 #include "Cholesky/CG.h"
+#include "Cholesky/ClusterJacobi.h"
 #include "Cholesky/Cholesky.h"
 #include "Cholesky/RecursiveSimplicialCholesky.h"
 #include "Cholesky/RecursiveSimplicialCholesky2.h"
 #include "Cholesky/SparseCholesky.h"
+#include "Cholesky/SupernodalCholesky.h"
 #include "Cholesky/SparseTriangular.h"
@@ -0,0 +1,319 @@
+/**
+ * This file is part of the Eigen Recursive Matrix Extension (ERME).
+ *
+ * Copyright (c) 2019 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "../Core.h"
+#include "../Mixed/MixedSolver.h"
+#include "Eigen/OrderingMethods"
+
+#include <algorithm>
+#include <vector>
+
+namespace Eigen::Recursive
+{
+/**
+ * Fill reducing orderings for the recursive sparse cholesky solvers.
+ *
+ * All orderings are computed on the block structure of the matrix. A block matrix with n blocks
+ * per row only needs a permutation of size n, which is much cheaper than ordering the expanded
+ * scalar matrix. The values of the matrix are never touched.
+ *
+ * The result is the inverse permutation 'Pinv' (new index -> old index), which is the format used by
+ * Eigen's ordering methods and by RecursiveSimplicialLDLT::m_Pinv.
+ */
+struct BlockAdjacency
+{
+    int n = 0;
+    // CSR-like adjacency of the symmetric block graph A + A^T without the diagonal.
+    std::vector<int> outer;
+    std::vector<int> inner;
+};
+
+/**
+ * Extracts the symmetric block graph of A. Only the stored entries are used, so an upper (or lower)
+ * triangular matrix produces the same graph as the full symmetric matrix.
+ */
+template <typename MatrixType>
+inline void blockAdjacency(const MatrixType& A, BlockAdjacency& graph)
+{
+    eigen_assert(A.rows() == A.cols());
+    int n   = A.rows();
+    graph.n = n;
+
+    std::vector<int> degree(n, 0);
+    for (int k = 0; k < A.outerSize(); ++k)
+    {
+        for (typename MatrixType::InnerIterator it(A, k); it; ++it)
+        {
+            int i = it.row();
+            int j = it.col();
+            if (i == j) continue;
+            degree[i]++;
+            degree[j]++;
+        }
+    }
+
+    graph.outer.resize(n + 1);
+    graph.outer[0] = 0;
+    for (int i = 0; i < n; ++i) graph.outer[i + 1] = graph.outer[i] + degree[i];
+    graph.inner.resize(graph.outer[n]);
+
+    std::vector<int> pos(graph.outer.begin(), graph.outer.end() - 1);
+    for (int k = 0; k < A.outerSize(); ++k)
+    {
+        for (typename MatrixType::InnerIterator it(A, k); it; ++it)
+        {
+            int i = it.row();
+            int j = it.col();
+            if (i == j) continue;
+            graph.inner[pos[i]++] = j;
+            graph.inner[pos[j]++] = i;
+        }
+    }
+
+    // If both triangles are stored, every edge was inserted twice.
+    int nnz = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        auto begin = graph.inner.begin() + graph.outer[i];
+        auto end   = graph.inner.begin() + graph.outer[i + 1];
+        std::sort(begin, end);
+        end            = std::unique(begin, end);
+        graph.outer[i] = nnz;
+        for (auto it = begin; it != end; ++it) graph.inner[nnz++] = *it;
+    }
+    graph.outer[n] = nnz;
+    graph.inner.resize(nnz);
+}
+
+/**
+ * Approximate minimum degree ordering of the subgraph induced by 'nodes'.
+ * The ordered node ids are appended to 'order'.
+ *
+ * 'local' is a work array of size graph.n that must be filled with -1. It is restored on return.
+ */
+inline void blockAMDOrdering(const BlockAdjacency& graph, const std::vector<int>& nodes, std::vector<int>& local,
+                             std::vector<int>& order)
+{
+    int n = nodes.size();
+    if (n <= 2)
+    {
+        order.insert(order.end(), nodes.begin(), nodes.end());
+        return;
+    }
+
+    for (int i = 0; i < n; ++i) local[nodes[i]] = i;
+
+    // Build the (symmetric) pattern of the induced subgraph including the diagonal.
+    // Eigen's AMD only looks at the structure, the values are left uninitialized.
+    Eigen::SparseMatrix<double, Eigen::ColMajor, int> C(n, n);
+    std::vector<int> outer(n + 1);
+    std::vector<int> inner;
+    inner.reserve(n * 5);
+    outer[0] = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        int v = nodes[i];
+        inner.push_back(i);
+        for (int k = graph.outer[v]; k < graph.outer[v + 1]; ++k)
+        {
+            int j = local[graph.inner[k]];
+            if (j >= 0) inner.push_back(j);
+        }
+        outer[i + 1] = inner.size();
+    }
+
+    C.resizeNonZeros(inner.size());
+    std::copy(outer.begin(), outer.end(), C.outerIndexPtr());
+    std::copy(inner.begin(), inner.end(), C.innerIndexPtr());
+
+    Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> perm;
+    Eigen::internal::minimum_degree_ordering(C, perm);
+
+    for (int i = 0; i < n; ++i)
+    {
+        order.push_back(nodes[perm.indices()[i]]);
+    }
+    for (int i = 0; i < n; ++i) local[nodes[i]] = -1;
+}
+
+/**
+ * Nested dissection ordering on the block graph.
+ *
+ * The graph is recursivly split by a level set separator of a BFS starting at a pseudo peripheral
+ * node. Both halves are ordered first and the separator last, which confines the fill-in of the
+ * factorization to the separator blocks. Small subgraphs are ordered with AMD.
+ * Disconnected components are ordered independently.
+ */
+class BlockNestedDissection
+{
+   public:
+    BlockNestedDissection(const BlockAdjacency& graph, int leafSize = 64) : graph(graph), leafSize(leafSize) {}
+
+    void compute(std::vector<int>& order)
+    {
+        int n = graph.n;
+        order.clear();
+        order.reserve(n);
+        mark.assign(n, -1);
+        local.assign(n, -1);
+        level.assign(n, -1);
+        currentTag = 0;
+
+        std::vector<int> nodes(n);
+        for (int i = 0; i < n; ++i) nodes[i] = i;
+        dissect(nodes, order);
+    }
+
+   private:
+    const BlockAdjacency& graph;
+    int leafSize;
+
+    std::vector<int> mark;
+    std::vector<int> local;
+    std::vector<int> level;
+    std::vector<int> queue;
+    int currentTag = 0;
+
+    // BFS restricted to the nodes marked with 'tag'. Returns the number of reached nodes. The nodes
+    // are stored in BFS order in 'queue' and the BFS depth in 'level'.
+    int bfs(int start, int tag)
+    {
+        queue.clear();
+        queue.push_back(start);
+        level[start] = 0;
+        mark[start]  = tag + 1;
+        for (int q = 0; q < (int)queue.size(); ++q)
+        {
+            int v = queue[q];
+            for (int k = graph.outer[v]; k < graph.outer[v + 1]; ++k)
+            {
+                int w = graph.inner[k];
+                if (mark[w] != tag) continue;
+                mark[w]  = tag + 1;
+                level[w] = level[v] + 1;
+                queue.push_back(w);
+            }
+        }
+        // reset the marks of the visited nodes
+        for (auto v : queue) mark[v] = tag;
+        return queue.size();
+    }
+
+    void dissect(const std::vector<int>& nodes, std::vector<int>& order)
+    {
+        if ((int)nodes.size() <= leafSize)
+        {
+            blockAMDOrdering(graph, nodes, local, order);
+            return;
+        }
+
+        // Two fresh tags: 'tag' marks the current subgraph, 'tag+1' the visited nodes during the bfs.
+        int tag = currentTag;
+        currentTag += 2;
+        for (auto v : nodes) mark[v] = tag;
+
+        // Check connectivity with a first sweep
+        int count = bfs(nodes.front(), tag);
+        if (count < (int)nodes.size())
+        {
+            // Disconnected: The components are independent and ordered one after another.
+            std::vector<std::vector<int>> components;
+            for (auto v : nodes)
+            {
+                if (mark[v] != tag) continue;
+                bfs(v, tag);
+                for (auto w : queue) mark[w] = -1;
+                components.push_back(queue);
+            }
+            for (auto& c : components) dissect(c, order);
+            return;
+        }
+
+        // Pseudo peripheral node: the last node of the first sweep
+        bfs(queue.back(), tag);
+
+        int maxLevel = level[queue.back()];
+
+        // Choose the level which splits the nodes in two halves.
+        std::vector<int> levelCount(maxLevel + 1, 0);
+        for (auto v : nodes) levelCount[level[v]]++;
+        int half = nodes.size() / 2;
+        int sum  = 0;
+        int sep  = 0;
+        for (; sep <= maxLevel; ++sep)
+        {
+            sum += levelCount[sep];
+            if (sum >= half) break;
+        }
+
+        if (sep == 0 || sep >= maxLevel)
+        {
+            // Very dense subgraph (small diameter) -> no useful separator
+            blockAMDOrdering(graph, nodes, local, order);
+            return;
+        }
+
+        std::vector<int> a, b, s;
+        for (auto v : nodes)
+        {
+            int l = level[v];
+            if (l < sep)
+                a.push_back(v);
+            else if (l > sep)
+                b.push_back(v);
+            else
+                s.push_back(v);
+        }
+
+        dissect(a, order);
+        dissect(b, order);
+        blockAMDOrdering(graph, s, local, order);
+    }
+};
+
+/**
+ * Computes the fill reducing ordering of A as an inverse permutation (new -> old).
+ */
+template <typename MatrixType, typename StorageIndex>
+inline void computeBlockOrdering(const MatrixType& A, LinearSolverOptions::Ordering method,
+                                 Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, StorageIndex>& Pinv)
+{
+    int n = A.rows();
+    Pinv.resize(n);
+
+    if (method == LinearSolverOptions::Ordering::Natural)
+    {
+        Pinv.setIdentity();
+        return;
+    }
+
+    BlockAdjacency graph;
+    blockAdjacency(A, graph);
+
+    std::vector<int> order;
+    order.reserve(n);
+    if (method == LinearSolverOptions::Ordering::AMD)
+    {
+        std::vector<int> nodes(n);
+        std::vector<int> local(n, -1);
+        for (int i = 0; i < n; ++i) nodes[i] = i;
+        blockAMDOrdering(graph, nodes, local, order);
+    }
+    else
+    {
+        BlockNestedDissection nd(graph);
+        nd.compute(order);
+    }
+
+    eigen_assert((int)order.size() == n);
+    for (int i = 0; i < n; ++i) Pinv.indices()[i] = order[i];
+}
+
+}  // namespace Eigen::Recursive
@@ -80,6 +80,28 @@ class RecursiveDiagonalPreconditioner
         return *this;
     }
 
+    // Multi threaded version of the sparse initialization above.
+    // Must be called from inside a parallel region. The preconditioner must be resized to the correct size
+    // before.
+    template <typename Scalar, int options>
+    RecursiveDiagonalPreconditioner& factorize_omp(const SparseMatrix<Scalar, options>& mat)
+    {
+        using MatType = SparseMatrix<Scalar, options>;
+        eigen_assert(m_invdiag.rows() == mat.cols());
+#pragma omp for
+        for (int j = 0; j < mat.outerSize(); ++j)
+        {
+            typename MatType::InnerIterator it(mat, j);
+            while (it && it.index() != j) ++it;
+            if (it && it.index() == j)
+                removeMatrixScalar(m_invdiag(j)) = removeMatrixScalar(inverseCholesky(it.value()));
+            else
+                removeMatrixScalar(m_invdiag(j)) = removeMatrixScalar(MultiplicativeNeutral<Scalar>::get());
+        }
+        m_isInitialized = true;
+        return *this;
+    }
+
     // Dense Matrix Initialization
     template <typename MatType>
     RecursiveDiagonalPreconditioner& factorize(const MatType& mat)
@@ -112,6 +134,20 @@ class RecursiveDiagonalPreconditioner
         return *this;
     }
 
+    // Multi threaded version of the diagonal initialization above.
+    template <typename T>
+    RecursiveDiagonalPreconditioner& factorize_omp(const Eigen::DiagonalMatrix<T, -1>& mat)
+    {
+        eigen_assert(m_invdiag.rows() == mat.rows());
+#pragma omp for
+        for (int j = 0; j < mat.rows(); ++j)
+        {
+            m_invdiag(j) = inverseCholesky(mat.diagonal()(j));
+        }
+        m_isInitialized = true;
+        return *this;
+    }
+
     template <typename MatType>
     RecursiveDiagonalPreconditioner& compute(const MatType& mat)
     {
@@ -130,6 +166,17 @@ class RecursiveDiagonalPreconditioner
         }
     }
 
+    // x = M^-1 * b. Must be called from inside a parallel region.
+    template <typename Rhs, typename Dest>
+    void solve_omp(const Rhs& b, Dest& x) const
+    {
+#pragma omp for
+        for (int i = 0; i < b.rows(); ++i)
+        {
+            x(i) = m_invdiag(i) * b(i);
+        }
+    }
+
     template <typename Rhs>
     inline const Eigen::Solve<RecursiveDiagonalPreconditioner, Rhs> solve(const Eigen::MatrixBase<Rhs>& b) const
     {
@@ -149,6 +196,61 @@ class RecursiveDiagonalPreconditioner
     bool m_isInitialized;
 };
 
+/**
+ * Inexact Newton forcing sequence (Eisenstat and Walker, choice 2) for the relative tolerance of the
+ * iterative solver inside a nonlinear optimization.
+ *
+ * Far away from the solution the linear system only has to be solved roughly. The tolerance is decreased
+ * with the convergence of the gradient norm (the right hand side of the normal equations):
+ *
+ *      eta_k = gamma * (|g_k| / |g_k-1|)^2
+ *
+ * The result is clamped to [minTolerance, maxTolerance].
+ */
+struct InexactNewtonForcing
+{
+    double gamma        = 0.9;
+    double maxTolerance = 0.1;
+
+    void reset()
+    {
+        lastNorm = -1;
+        lastEta  = maxTolerance;
+    }
+
+    double compute(double rhsNorm, double minTolerance)
+    {
+        using std::max;
+        using std::min;
+
+        double eta = maxTolerance;
+        if (lastNorm > 0)
+        {
+            if (rhsNorm == lastNorm)
+            {
+                // The previous step was rejected -> same system with a different lambda
+                eta = lastEta;
+            }
+            else
+            {
+                double ratio = rhsNorm / lastNorm;
+                eta          = gamma * ratio * ratio;
+                // Safeguard: don't decrease the tolerance too fast
+                double safe = gamma * lastEta * lastEta;
+                if (safe > 0.1) eta = max(eta, safe);
+            }
+        }
+        eta      = min(max(eta, minTolerance), maxTolerance);
+        lastNorm = rhsNorm;
+        lastEta  = eta;
+        return eta;
+    }
+
+   private:
+    double lastNorm = -1;
+    double lastEta  = 0.1;
+};
+
 //#define RM_CG_DEBUG_OUTPUT
 
 /**
@@ -382,7 +484,9 @@ EIGEN_DONT_INLINE void recursive_conjugate_gradient_OMP(const MultFunction& appl
         maxIters  = 0;
     }
 
-    p = precond.solve(residual);  // initial search direction
+    // The preconditioner is applied in parallel. The implicit barrier at the end also guarantees that all
+    // threads have finished reading the tmpResults of the previous reduction.
+    precond.solve_omp(residual, p);  // initial search direction
 
     dot_omp_local(residual, p, tmpResults[tid].data);
     RealScalar absNew = accumulate(tmpResults);
@@ -410,7 +514,7 @@ EIGEN_DONT_INLINE void recursive_conjugate_gradient_OMP(const MultFunction& appl
         residualNorm2 = accumulate(tmpResults);
 
         if (residualNorm2 < threshold) break;
-        z = precond.solve(residual);  // approximately solve for "A z = residual"
+        precond.solve_omp(residual, z);  // approximately solve for "A z = residual"
 
         RealScalar absOld = absNew;
         dot_omp_local(residual, z, tmpResults[tid].data);
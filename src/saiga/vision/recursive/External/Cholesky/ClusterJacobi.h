@@ -0,0 +1,236 @@
+/**
+ * This file is part of the Eigen Recursive Matrix Extension (ERME).
+ *
+ * Copyright (c) 2019 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "../Core.h"
+#include "BlockOrdering.h"
+
+#include <vector>
+
+namespace Eigen::Recursive
+{
+/**
+ * Cluster Jacobi preconditioner for symmetric sparse block matrices (upper triangle stored).
+ *
+ * The block rows are grouped into small clusters of strongly connected blocks (neighbors in the block
+ * graph, for example covisible cameras of the schur complement). The preconditioner is the inverse of the
+ * block diagonal matrix, which contains the dense submatrices of all clusters. Compared to the
+ * RecursiveDiagonalPreconditioner it also captures the coupling inside a cluster, but the application
+ * is still embarrassingly parallel.
+ *
+ * The clustering is computed once in analyzePattern. The matrix structure must not change afterwards.
+ */
+template <typename _Scalar>
+class RecursiveClusterJacobiPreconditioner
+{
+    using Block  = typename _Scalar::M;
+    using Scalar = typename Block::Scalar;
+
+    static constexpr int blockSize = Block::RowsAtCompileTime;
+    static_assert(blockSize != Eigen::Dynamic && blockSize == Block::ColsAtCompileTime,
+                  "Only fixed size square blocks are supported.");
+
+    using DenseMatrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+    using DenseVector = Eigen::Matrix<Scalar, Eigen::Dynamic, 1>;
+
+   public:
+    typedef int StorageIndex;
+    enum
+    {
+        ColsAtCompileTime    = Eigen::Dynamic,
+        MaxColsAtCompileTime = Eigen::Dynamic
+    };
+
+    RecursiveClusterJacobiPreconditioner(int clusterSize = 4) : clusterSize(clusterSize) {}
+
+    void setClusterSize(int s)
+    {
+        clusterSize = s;
+        n           = -1;
+    }
+
+    Eigen::Index rows() const { return n; }
+    Eigen::Index cols() const { return n; }
+
+    template <int options>
+    RecursiveClusterJacobiPreconditioner& analyzePattern(const SparseMatrix<_Scalar, options>& mat)
+    {
+        using MatType = SparseMatrix<_Scalar, options>;
+        n             = mat.rows();
+
+        // Greedy clustering with a bfs on the block graph
+        BlockAdjacency graph;
+        blockAdjacency(mat, graph);
+
+        nodeToCluster.assign(n, -1);
+        localIndex.resize(n);
+        clusterOffsets.clear();
+        clusterNodes.clear();
+        clusterOffsets.push_back(0);
+        std::vector<int> queue;
+        for (int i = 0; i < n; ++i)
+        {
+            if (nodeToCluster[i] != -1) continue;
+            int cluster = clusterOffsets.size() - 1;
+            int size    = 0;
+
+            queue.clear();
+            queue.push_back(i);
+            nodeToCluster[i] = cluster;
+            for (int q = 0; q < (int)queue.size() && size < clusterSize; ++q)
+            {
+                int v = queue[q];
+                clusterNodes.push_back(v);
+                localIndex[v] = size++;
+                for (int k = graph.outer[v]; k < graph.outer[v + 1]; ++k)
+                {
+                    int w = graph.inner[k];
+                    if (nodeToCluster[w] != -1) continue;
+                    nodeToCluster[w] = cluster;
+                    queue.push_back(w);
+                }
+            }
+            // Queued nodes which didn't fit into the cluster are released again
+            for (int q = size; q < (int)queue.size(); ++q) nodeToCluster[queue[q]] = -1;
+            clusterOffsets.push_back(clusterNodes.size());
+        }
+
+        // All matrix entries inside a cluster
+        entryOffsets.assign(numClusters() + 1, 0);
+        for (int j = 0; j < mat.outerSize(); ++j)
+        {
+            for (typename MatType::InnerIterator it(mat, j); it; ++it)
+            {
+                int c = nodeToCluster[it.row()];
+                if (c == nodeToCluster[it.col()]) entryOffsets[c + 1]++;
+            }
+        }
+        for (int c = 0; c < numClusters(); ++c) entryOffsets[c + 1] += entryOffsets[c];
+        entryValue.resize(entryOffsets.back());
+        entryRow.resize(entryOffsets.back());
+        entryCol.resize(entryOffsets.back());
+        std::vector<int> pos(entryOffsets.begin(), entryOffsets.end() - 1);
+        for (int j = 0; j < mat.outerSize(); ++j)
+        {
+            for (typename MatType::InnerIterator it(mat, j); it; ++it)
+            {
+                int c = nodeToCluster[it.row()];
+                if (c != nodeToCluster[it.col()]) continue;
+                int p         = pos[c]++;
+                entryValue[p] = &it.value() - mat.valuePtr();
+                entryRow[p]   = localIndex[it.row()];
+                entryCol[p]   = localIndex[it.col()];
+            }
+        }
+
+        llts.resize(numClusters());
+        return *this;
+    }
+
+    template <int options>
+    RecursiveClusterJacobiPreconditioner& factorize(const SparseMatrix<_Scalar, options>& mat)
+    {
+        for (int c = 0; c < numClusters(); ++c) factorizeCluster(mat, c);
+        m_isInitialized = true;
+        return *this;
+    }
+
+    // Multi threaded version of factorize. Must be called from inside a parallel region after analyzePattern.
+    template <int options>
+    RecursiveClusterJacobiPreconditioner& factorize_omp(const SparseMatrix<_Scalar, options>& mat)
+    {
+#pragma omp for
+        for (int c = 0; c < numClusters(); ++c) factorizeCluster(mat, c);
+        m_isInitialized = true;
+        return *this;
+    }
+
+    template <int options>
+    RecursiveClusterJacobiPreconditioner& compute(const SparseMatrix<_Scalar, options>& mat)
+    {
+        if (n != mat.rows()) analyzePattern(mat);
+        return factorize(mat);
+    }
+
+    /** \internal */
+    template <typename Rhs, typename Dest>
+    void _solve_impl(const Rhs& b, Dest& x) const
+    {
+        for (int c = 0; c < numClusters(); ++c) solveCluster(b, x, c);
+    }
+
+    // x = M^-1 * b. Must be called from inside a parallel region.
+    template <typename Rhs, typename Dest>
+    void solve_omp(const Rhs& b, Dest& x) const
+    {
+#pragma omp for
+        for (int c = 0; c < numClusters(); ++c) solveCluster(b, x, c);
+    }
+
+    template <typename Rhs>
+    inline const Eigen::Solve<RecursiveClusterJacobiPreconditioner, Rhs> solve(const Eigen::MatrixBase<Rhs>& b) const
+    {
+        eigen_assert(m_isInitialized && "ClusterJacobiPreconditioner is not initialized.");
+        eigen_assert(n == b.rows() && "ClusterJacobiPreconditioner::solve(): invalid number of rows");
+        return Eigen::Solve<RecursiveClusterJacobiPreconditioner, Rhs>(*this, b.derived());
+    }
+
+    Eigen::ComputationInfo info() { return Eigen::Success; }
+
+    int numClusters() const { return int(clusterOffsets.size()) - 1; }
+
+   private:
+    int clusterSize;
+    int n                = -1;
+    bool m_isInitialized = false;
+
+    // The nodes of cluster c are clusterNodes[clusterOffsets[c]] ... clusterNodes[clusterOffsets[c+1]-1]
+    std::vector<int> clusterOffsets, clusterNodes;
+    std::vector<int> nodeToCluster, localIndex;
+
+    // Index into mat.valuePtr() and the local block position of all entries inside a cluster
+    std::vector<int> entryOffsets, entryValue, entryRow, entryCol;
+
+    std::vector<Eigen::LLT<DenseMatrix>> llts;
+
+    template <int options>
+    void factorizeCluster(const SparseMatrix<_Scalar, options>& mat, int c)
+    {
+        int size = (clusterOffsets[c + 1] - clusterOffsets[c]) * blockSize;
+        DenseMatrix D(size, size);
+        D.setZero();
+        for (int p = entryOffsets[c]; p < entryOffsets[c + 1]; ++p)
+        {
+            const Block& value = mat.valuePtr()[entryValue[p]].get();
+            int r              = entryRow[p] * blockSize;
+            int col            = entryCol[p] * blockSize;
+            // Only the upper triangle is stored -> mirror the off diagonal blocks
+            D.template block<blockSize, blockSize>(r, col) = value;
+            if (r != col) D.template block<blockSize, blockSize>(col, r) = value.transpose();
+        }
+        llts[c].compute(D);
+    }
+
+    template <typename Rhs, typename Dest>
+    void solveCluster(const Rhs& b, Dest& x, int c) const
+    {
+        // Reuse the temporary vector so the preconditioner doesn't allocate memory in every cg iteration
+        static thread_local DenseVector tmp;
+        int first = clusterOffsets[c];
+        int size  = clusterOffsets[c + 1] - first;
+        if (tmp.rows() < size * blockSize) tmp.resize(size * blockSize);
+
+        auto t = tmp.head(size * blockSize);
+        for (int k = 0; k < size; ++k) t.template segment<blockSize>(k * blockSize) = b(clusterNodes[first + k]).get();
+        llts[c].solveInPlace(t);
+        for (int k = 0; k < size; ++k) x(clusterNodes[first + k]).get() = t.template segment<blockSize>(k * blockSize);
+    }
+};
+
+}  // namespace Eigen::Recursive
@@ -0,0 +1,354 @@
+/**
+ * This file is part of the Eigen Recursive Matrix Extension (ERME).
+ *
+ * Copyright (c) 2019 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "../Core.h"
+#include "BlockOrdering.h"
+
+#include <vector>
+
+namespace Eigen::Recursive
+{
+/**
+ * Supernodal cholesky factorization (LLT) of a symmetric positive definite sparse block matrix.
+ * Only the upper triangle of the input matrix is used.
+ *
+ * Block columns of L with identical structure are grouped into supernodes. Each supernode is stored as
+ * one dense column major panel. The factorization (right looking) then only consists of dense operations
+ * on these panels (LLT of the diagonal part, triangular solve and a rank update). This is much faster
+ * than the simplicial recursive LDLT if the matrix is dense-ish, for example the schur complement of a
+ * bundle adjustment problem with high camera covisibility.
+ *
+ * The analysis (ordering, symbolic factorization and supernode detection) is done only once in
+ * analyzePattern. factorize() can be called repeatedly for matrices with the same structure.
+ *
+ * Usage:
+ *      RecursiveSupernodalLLT<SparseMatrix<MatrixScalar<Matrix<double, 6, 6>>, RowMajor>> llt;
+ *      llt.compute(A);
+ *      llt.solve(b, x);
+ */
+template <typename _MatrixType>
+class RecursiveSupernodalLLT
+{
+   public:
+    using MatrixType  = _MatrixType;
+    using BlockScalar = typename MatrixType::Scalar;
+    using Block       = typename BlockScalar::M;
+    using Scalar      = typename Block::Scalar;
+
+    static constexpr int blockSize = Block::RowsAtCompileTime;
+    static_assert(blockSize != Eigen::Dynamic && blockSize == Block::ColsAtCompileTime,
+                  "Only fixed size square blocks are supported.");
+
+    using Panel       = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+    using DenseVector = Eigen::Matrix<Scalar, Eigen::Dynamic, 1>;
+
+    RecursiveSupernodalLLT(LinearSolverOptions::Ordering ordering = LinearSolverOptions::Ordering::AMD)
+        : orderingMethod(ordering)
+    {
+    }
+
+    void compute(const MatrixType& A)
+    {
+        analyzePattern(A);
+        factorize(A);
+    }
+
+    void analyzePattern(const MatrixType& A);
+    void factorize(const MatrixType& A);
+
+    /**
+     * Solves A * x = b.
+     * VectorType must be a block vector, for example Matrix<MatrixScalar<Matrix<double, 6, 1>>, -1, 1>.
+     */
+    template <typename VectorType>
+    void solve(const VectorType& b, VectorType& x) const;
+
+    ComputationInfo info() const { return m_info; }
+
+    int numSupernodes() const { return supernodes.size(); }
+    const Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int>& permutationPinv() const { return m_Pinv; }
+
+   private:
+    struct Supernode
+    {
+        // Block columns [firstCol, lastCol) of the permuted matrix
+        int firstCol, lastCol;
+        // All block rows of this supernode. Starts with the diagonal rows [firstCol, lastCol).
+        std::vector<int> rows;
+        Panel L;
+
+        int cols() const { return lastCol - firstCol; }
+    };
+
+    LinearSolverOptions::Ordering orderingMethod;
+    ComputationInfo m_info = Success;
+    int n                  = 0;
+
+    // new -> old
+    Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> m_Pinv;
+
+    std::vector<Supernode> supernodes;
+    // block column -> supernode
+    std::vector<int> colToSupernode;
+
+    // The entries of the (permuted) lower triangle of A per column.
+    // 'entryValue' is the index into A.valuePtr(). If 'entryTransposed' is set, the transposed block is used.
+    std::vector<int> entryOuter, entryRow, entryValue;
+    std::vector<char> entryTransposed;
+
+    // Work arrays of the factorization
+    std::vector<int> relativeRow;
+    Panel update;
+};
+
+template <typename _MatrixType>
+void RecursiveSupernodalLLT<_MatrixType>::analyzePattern(const MatrixType& A)
+{
+    eigen_assert(A.rows() == A.cols());
+    n = A.rows();
+
+    computeBlockOrdering(A, orderingMethod, m_Pinv);
+    std::vector<int> perm(n);
+    for (int i = 0; i < n; ++i) perm[m_Pinv.indices()[i]] = i;
+
+    // ==== Lower triangle of the permuted matrix (column wise) ====
+    std::vector<int> count(n + 1, 0);
+    for (int k = 0; k < A.outerSize(); ++k)
+    {
+        for (typename MatrixType::InnerIterator it(A, k); it; ++it)
+        {
+            if (it.row() > it.col()) continue;
+            int r = perm[it.row()];
+            int c = perm[it.col()];
+            count[std::min(r, c)]++;
+        }
+    }
+    entryOuter.resize(n + 1);
+    entryOuter[0] = 0;
+    for (int i = 0; i < n; ++i) entryOuter[i + 1] = entryOuter[i] + count[i];
+    entryRow.resize(entryOuter[n]);
+    entryValue.resize(entryOuter[n]);
+    entryTransposed.resize(entryOuter[n]);
+
+    std::vector<int> pos(entryOuter.begin(), entryOuter.end() - 1);
+    for (int k = 0; k < A.outerSize(); ++k)
+    {
+        for (typename MatrixType::InnerIterator it(A, k); it; ++it)
+        {
+            if (it.row() > it.col()) continue;
+            int r   = perm[it.row()];
+            int c   = perm[it.col()];
+            int col = std::min(r, c);
+            int p   = pos[col]++;
+
+            entryRow[p] = std::max(r, c);
+            // A.valuePtr() index of this entry
+            entryValue[p] = &it.value() - A.valuePtr();
+            // The stored block is (row, col) of the upper triangle. In the lower triangle it is transposed.
+            entryTransposed[p] = r < c;
+        }
+    }
+
+    // ==== Symbolic factorization ====
+    // The structure of column j of L is the union of column j of A and the structures of all children in
+    // the elimination tree.
+    std::vector<std::vector<int>> structure(n);
+    std::vector<int> parent(n, -1);
+    std::vector<std::vector<int>> children(n);
+    std::vector<int> marker(n, -1);
+    for (int j = 0; j < n; ++j)
+    {
+        auto& s   = structure[j];
+        marker[j] = j;
+        for (int p = entryOuter[j]; p < entryOuter[j + 1]; ++p)
+        {
+            int r = entryRow[p];
+            if (marker[r] != j)
+            {
+                marker[r] = j;
+                s.push_back(r);
+            }
+        }
+        for (auto c : children[j])
+        {
+            for (auto r : structure[c])
+            {
+                if (marker[r] != j)
+                {
+                    marker[r] = j;
+                    s.push_back(r);
+                }
+            }
+        }
+        std::sort(s.begin(), s.end());
+        if (!s.empty())
+        {
+            parent[j] = s.front();
+            children[s.front()].push_back(j);
+        }
+    }
+
+    // ==== Fundamental supernodes ====
+    // Column j+1 continues the supernode of column j if it is the parent of j and the structures are equal.
+    supernodes.clear();
+    colToSupernode.resize(n);
+    for (int j = 0; j < n;)
+    {
+        int last = j + 1;
+        while (last < n && parent[last - 1] == last && structure[last - 1].size() == structure[last].size() + 1)
+        {
+            ++last;
+        }
+
+        Supernode sn;
+        sn.firstCol = j;
+        sn.lastCol  = last;
+        for (int c = j; c < last; ++c)
+        {
+            sn.rows.push_back(c);
+            colToSupernode[c] = supernodes.size();
+        }
+        sn.rows.insert(sn.rows.end(), structure[last - 1].begin(), structure[last - 1].end());
+        sn.L.resize(sn.rows.size() * blockSize, sn.cols() * blockSize);
+        supernodes.push_back(std::move(sn));
+        j = last;
+    }
+
+    relativeRow.resize(n);
+}
+
+template <typename _MatrixType>
+void RecursiveSupernodalLLT<_MatrixType>::factorize(const MatrixType& A)
+{
+    m_info = Success;
+
+    // Scatter A into the panels
+    for (auto& sn : supernodes)
+    {
+        sn.L.setZero();
+        for (int k = 0; k < (int)sn.rows.size(); ++k) relativeRow[sn.rows[k]] = k;
+        for (int c = sn.firstCol; c < sn.lastCol; ++c)
+        {
+            int localCol = (c - sn.firstCol) * blockSize;
+            for (int p = entryOuter[c]; p < entryOuter[c + 1]; ++p)
+            {
+                auto dst           = sn.L.template block<blockSize, blockSize>(relativeRow[entryRow[p]] * blockSize, localCol);
+                const Block& value = A.valuePtr()[entryValue[p]].get();
+                if (entryTransposed[p])
+                    dst = value.transpose();
+                else
+                    dst = value;
+            }
+        }
+    }
+
+    for (auto& sn : supernodes)
+    {
+        int C = sn.cols() * blockSize;
+        int R = sn.rows.size() * blockSize;
+
+        // Dense cholesky of the diagonal part
+        auto D = sn.L.topLeftCorner(C, C);
+        Eigen::LLT<Eigen::Ref<Panel>> llt(D);
+        if (llt.info() != Success)
+        {
+            m_info = NumericalIssue;
+            return;
+        }
+
+        if (R == C) continue;
+
+        // B = B * L_D^-T
+        auto B = sn.L.bottomRows(R - C);
+        D.template triangularView<Eigen::Lower>().transpose().template solveInPlace<Eigen::OnTheRight>(B);
+
+        // Lower triangle of B * B^T. This is subtracted from the supernodes of the remaining rows.
+        int nb = sn.rows.size() - sn.cols();
+        update.setZero(R - C, R - C);
+        update.template selfadjointView<Eigen::Lower>().rankUpdate(B);
+
+        const int* below = sn.rows.data() + sn.cols();
+        for (int b = 0; b < nb;)
+        {
+            // All consecutive target columns in the same supernode share the relative row indices
+            auto& target = supernodes[colToSupernode[below[b]]];
+            for (int k = 0; k < (int)target.rows.size(); ++k) relativeRow[target.rows[k]] = k;
+
+            for (; b < nb && below[b] < target.lastCol; ++b)
+            {
+                int localCol = (below[b] - target.firstCol) * blockSize;
+                for (int a = b; a < nb; ++a)
+                {
+                    target.L.template block<blockSize, blockSize>(relativeRow[below[a]] * blockSize, localCol) -=
+                        update.template block<blockSize, blockSize>(a * blockSize, b * blockSize);
+                }
+            }
+        }
+    }
+}
+
+template <typename _MatrixType>
+template <typename VectorType>
+void RecursiveSupernodalLLT<_MatrixType>::solve(const VectorType& b, VectorType& x) const
+{
+    eigen_assert(b.rows() == n);
+
+    // y = P * b
+    DenseVector y(n * blockSize);
+    for (int i = 0; i < n; ++i) y.template segment<blockSize>(i * blockSize) = b(m_Pinv.indices()[i]).get();
+
+    DenseVector tmp;
+
+    // Forward substitution L * y = b
+    for (auto& sn : supernodes)
+    {
+        int C  = sn.cols() * blockSize;
+        int R  = sn.rows.size() * blockSize;
+        auto D = sn.L.topLeftCorner(C, C);
+        auto y_s = y.segment(sn.firstCol * blockSize, C);
+        D.template triangularView<Eigen::Lower>().solveInPlace(y_s);
+
+        if (R == C) continue;
+        tmp = sn.L.bottomRows(R - C) * y_s;
+        for (int k = sn.cols(); k < (int)sn.rows.size(); ++k)
+        {
+            y.template segment<blockSize>(sn.rows[k] * blockSize) -=
+                tmp.template segment<blockSize>((k - sn.cols()) * blockSize);
+        }
+    }
+
+    // Backward substitution L^T * y = y
+    for (int s = supernodes.size() - 1; s >= 0; --s)
+    {
+        auto& sn = supernodes[s];
+        int C    = sn.cols() * blockSize;
+        int R    = sn.rows.size() * blockSize;
+        auto D   = sn.L.topLeftCorner(C, C);
+        auto y_s = y.segment(sn.firstCol * blockSize, C);
+
+        if (R != C)
+        {
+            tmp.resize(R - C);
+            for (int k = sn.cols(); k < (int)sn.rows.size(); ++k)
+            {
+                tmp.template segment<blockSize>((k - sn.cols()) * blockSize) =
+                    y.template segment<blockSize>(sn.rows[k] * blockSize);
+            }
+            y_s -= sn.L.bottomRows(R - C).transpose() * tmp;
+        }
+        D.transpose().template triangularView<Eigen::Upper>().solveInPlace(y_s);
+    }
+
+    // x = P^-1 * y
+    x.resize(n);
+    for (int i = 0; i < n; ++i) x(m_Pinv.indices()[i]).get() = y.template segment<blockSize>(i * blockSize);
+}
+
+}  // namespace Eigen::Recursive
@@ -86,5 +86,41 @@ inline void sparse_mv_omp(const SparseLhsType& lhs, const DenseRhsType& rhs, Den
 }
 
 
+/**
+ * Symmetric sparse matrix vector product res = A * rhs, where only the upper triangle of A is stored.
+ *
+ * The rows of A are distributed over the threads. The missing lower triangle is read from the
+ * transposed matrix lhsT (= A^T, see transposeStructureOnly_omp and transposeValueOnly_omp).
+ * This way every thread only writes to its own rows of res and no synchronization is required.
+ */
+template <typename SparseLhsType, typename DenseRhsType, typename DenseResType>
+inline void sparse_selfadjoint_mv_omp(const SparseLhsType& lhs, const SparseLhsType& lhsT, const DenseRhsType& rhs,
+                                      DenseResType& res)
+{
+    typedef typename internal::remove_all<SparseLhsType>::type Lhs;
+    typedef typename Eigen::internal::evaluator<Lhs>::InnerIterator LhsInnerIterator;
+
+    Index n = lhs.outerSize();
+
+#pragma omp for
+    for (Index i = 0; i < n; ++i)
+    {
+        auto& r = res.coeffRef(i).get();
+        r.setZero();
+        // upper part including the diagonal
+        for (LhsInnerIterator it(lhs, i); it; ++it)
+        {
+            r += it.value().get() * rhs.coeff(it.index()).get();
+        }
+        // strict lower part
+        for (LhsInnerIterator it(lhsT, i); it; ++it)
+        {
+            if (it.index() == i) continue;
+            r += it.value().get() * rhs.coeff(it.index()).get();
+        }
+    }
+}
+
+
 }  // namespace Recursive
 }  // namespace Eigen
@@ -31,6 +31,35 @@ struct LinearSolverOptions
     // -> Maybe in the future when I have implemented a supernodal recursive factorization
     //      I switch it back to false ;)
     bool cholmod = true;
+
+    // Fill reducing ordering of the recursive ldlt solver.
+    // The ordering is computed once on the block structure and reused for all following factorizations.
+    enum class Ordering : int
+    {
+        Natural          = 0,
+        AMD              = 1,
+        NestedDissection = 2
+    };
+    Ordering ordering = Ordering::AMD;
+
+    // Preconditioner of the iterative solver.
+    // ClusterJacobi inverts the dense submatrices of small clusters of connected blocks.
+    // It requires the explicit matrix. The implicit schur solver falls back to BlockJacobi.
+    enum class Preconditioner : int
+    {
+        BlockJacobi   = 0,
+        ClusterJacobi = 1
+    };
+    Preconditioner preconditioner = Preconditioner::BlockJacobi;
+    int clusterSize               = 4;
+
+    // Compute the relative tolerance of the iterative solver with an inexact newton forcing sequence
+    // (see InexactNewtonForcing). 'iterativeTolerance' is then used as lower bound.
+    bool inexactNewton = false;
+
+    // Use the supernodal cholesky factorization in the direct schur solver.
+    // Faster than the simplicial ldlt if the schur complement is dense-ish (high camera covisibility).
+    bool supernodal = false;
 };
 
 /**
@@ -59,8 +59,9 @@ class MixedSymmetricRecursiveSolver<
     using S1Type = Eigen::SparseMatrix<UBlock, Eigen::RowMajor>;
     using S2Type = Eigen::SparseMatrix<VBlock, Eigen::RowMajor>;
 
-    using LDLT         = Eigen::RecursiveSimplicialLDLT<S1Type, Eigen::Upper>;
-    using InnerSolver1 = MixedSymmetricRecursiveSolver<S1Type, XUType>;
+    using LDLT          = Eigen::RecursiveSimplicialLDLT<S1Type, Eigen::Upper>;
+    using SupernodalLLT = RecursiveSupernodalLLT<S1Type>;
+    using InnerSolver1  = MixedSymmetricRecursiveSolver<S1Type, XUType>;
 
 
     void resize(int n, int m)
@@ -81,12 +82,15 @@ class MixedSymmetricRecursiveSolver<
     void analyzePattern(const AType& A, const LinearSolverOptions& solverOptions)
     {
         resize(A.u.rows(), A.v.rows());
+        clusterAnalyzed = false;
+        forcing.reset();
 
         if (solverOptions.solverType == LinearSolverOptions::SolverType::Direct)
         {
             hasWT         = true;
             explizitSchur = true;
             ldlt          = nullptr;
+            supernodalLLT = nullptr;
         }
         else
         {
@@ -150,35 +154,42 @@ class MixedSymmetricRecursiveSolver<
 
         if (solverOptions.solverType == LinearSolverOptions::SolverType::Direct)
         {
-            // Direct recusive ldlt solver
-            if (!ldlt)
-            {
-                ldlt = std::make_unique<LDLT>();
-                ldlt->compute(S1);
-            }
+            factorizeDirect(solverOptions);
+            if (useLDLT)
+                da = ldlt->solve(ej);
             else
-            {
-                ldlt->factorize(S1);
-            }
-            da = ldlt->solve(ej);
+                supernodalLLT->solve(ej, da);
         }
         else
         {
-            P.compute(S1);
-
             da.setZero();
 
             // Iterative CG solver
             Eigen::Index iters = solverOptions.maxIterativeIterations;
-            double tol         = solverOptions.iterativeTolerance;
+            double tol         = iterativeTolerance(solverOptions);
             //            XUType tmp(n);
 
-            recursive_conjugate_gradient(
-                [&](const XUType& v, XUType& result) {
-                    // x = U * p - Y * WT * p
-                    result = S1.template selfadjointView<Eigen::Upper>() * v;
-                },
-                ej, da, P, iters, tol);
+            auto applyA = [&](const XUType& v, XUType& result) {
+                // x = U * p - Y * WT * p
+                result = S1.template selfadjointView<Eigen::Upper>() * v;
+            };
+
+            if (solverOptions.preconditioner == LinearSolverOptions::Preconditioner::ClusterJacobi)
+            {
+                if (!clusterAnalyzed)
+                {
+                    clusterP.setClusterSize(solverOptions.clusterSize);
+                    clusterP.analyzePattern(S1);
+                    clusterAnalyzed = true;
+                }
+                clusterP.factorize(S1);
+                recursive_conjugate_gradient(applyA, ej, da, clusterP, iters, tol);
+            }
+            else
+            {
+                P.compute(S1);
+                recursive_conjugate_gradient(applyA, ej, da, P, iters, tol);
+            }
         }
 
 
@@ -201,6 +212,52 @@ class MixedSymmetricRecursiveSolver<
    private:
     int n, m;
 
+    // Relative tolerance of the iterative solver. Either fixed or computed by the inexact newton forcing
+    // sequence from the norm of the reduced right hand side.
+    double iterativeTolerance(const LinearSolverOptions& solverOptions)
+    {
+        if (!solverOptions.inexactNewton) return solverOptions.iterativeTolerance;
+        return forcing.compute(std::sqrt(squaredNorm(ej)), solverOptions.iterativeTolerance);
+    }
+
+    // Factorizes S1 with the supernodal cholesky or the recursive ldlt. If the cholesky fails (S1 is not positive
+    // definite because of round off errors), the ldlt is used instead.
+    void factorizeDirect(const LinearSolverOptions& solverOptions)
+    {
+        useLDLT = !solverOptions.supernodal;
+        if (solverOptions.supernodal)
+        {
+            // Supernodal cholesky with dense panels
+            if (!supernodalLLT)
+            {
+                supernodalLLT = std::make_unique<SupernodalLLT>(solverOptions.ordering);
+                supernodalLLT->compute(S1);
+            }
+            else
+            {
+                supernodalLLT->factorize(S1);
+            }
+            useLDLT = supernodalLLT->info() != Eigen::Success;
+        }
+
+        if (useLDLT)
+        {
+            // Direct recusive ldlt solver
+            if (!ldlt)
+            {
+                ldlt = std::make_unique<LDLT>();
+                computeBlockOrdering(S1, solverOptions.ordering, ldlt->m_Pinv);
+                ldlt->compute(S1);
+            }
+            else
+            {
+                ldlt->factorize(S1);
+            }
+        }
+    }
+
+    InexactNewtonForcing forcing;
+
     // ==== Solver tmps ====
     XVType q;
     AVType Vinv;
@@ -212,10 +269,15 @@ class MixedSymmetricRecursiveSolver<
     AWTType WT;
 
     RecursiveDiagonalPreconditioner<UBlock> P;
+    RecursiveClusterJacobiPreconditioner<UBlock> clusterP;
+    bool clusterAnalyzed = false;
     S1Type S1;
     //    InnerSolver1 solver1;
 
     std::unique_ptr<LDLT> ldlt;
+    std::unique_ptr<SupernodalLLT> supernodalLLT;
+    // The last direct solve used the ldlt
+    bool useLDLT = false;
 
     bool patternAnalyzed = false;
     bool hasWT           = true;
@@ -268,8 +330,9 @@ class MixedSymmetricRecursiveSolver<
     using S1Type = Eigen::SparseMatrix<UBlock, Eigen::RowMajor>;
     using S2Type = Eigen::SparseMatrix<VBlock, Eigen::RowMajor>;
 
-    using LDLT         = Eigen::RecursiveSimplicialLDLT<S1Type, Eigen::Upper>;
-    using InnerSolver1 = MixedSymmetricRecursiveSolver<S1Type, XUType>;
+    using LDLT          = Eigen::RecursiveSimplicialLDLT<S1Type, Eigen::Upper>;
+    using SupernodalLLT = RecursiveSupernodalLLT<S1Type>;
+    using InnerSolver1  = MixedSymmetricRecursiveSolver<S1Type, XUType>;
 
 
     void resize(int n, int m)
@@ -291,12 +354,15 @@ class MixedSymmetricRecursiveSolver<
     void analyzePattern(const AType& A, const LinearSolverOptions& solverOptions)
     {
         resize(A.u.rows(), A.v.rows());
+        clusterAnalyzed = false;
+        forcing.reset();
 
         if (solverOptions.solverType == LinearSolverOptions::SolverType::Direct)
         {
             hasWT         = true;
             explizitSchur = true;
             ldlt          = nullptr;
+            supernodalLLT = nullptr;
         }
         else
         {
@@ -321,13 +387,9 @@ class MixedSymmetricRecursiveSolver<
     void solve(AType& A, XType& x, XType& b, const LinearSolverOptions& solverOptions = LinearSolverOptions())
     {
         // Some references for easier access
-        const AUType& U  = A.u;
-        const AVType& V  = A.v;
-        const AWType& W  = A.w;
-        XUType& da       = x.u;
-        XVType& db       = x.v;
-        const XUType& ea = b.u;
-        const XVType& eb = b.v;
+        const AUType& U = A.u;
+        const AVType& V = A.v;
+        const AWType& W = A.w;
 
 
         if (!patternAnalyzed) analyzePattern(A, solverOptions);
@@ -357,27 +419,27 @@ class MixedSymmetricRecursiveSolver<
             Sdiag.diagonal() = U.diagonal() - Sdiag.diagonal();
         }
 
-        // r = a - W * V^-1 * b
-        ej = ea + -(Y * eb);
-
 
         if (solverOptions.solverType == LinearSolverOptions::SolverType::Direct)
         {
-            // Direct recusive ldlt solver
-            if (!ldlt)
-            {
-                ldlt = std::make_unique<LDLT>();
-                ldlt->compute(S1);
-            }
-            else
-            {
-                ldlt->factorize(S1);
-            }
-            da = ldlt->solve(ej);
+            factorizeDirect(solverOptions);
         }
         else
         {
-            if (explizitSchur)
+            // The cluster preconditioner needs the off diagonal blocks of the explicit schur complement
+            useCluster =
+                explizitSchur && solverOptions.preconditioner == LinearSolverOptions::Preconditioner::ClusterJacobi;
+            if (useCluster)
+            {
+                if (!clusterAnalyzed)
+                {
+                    clusterP.setClusterSize(solverOptions.clusterSize);
+                    clusterP.analyzePattern(S1);
+                    clusterAnalyzed = true;
+                }
+                clusterP.factorize(S1);
+            }
+            else if (explizitSchur)
             {
                 P.compute(S1);
             }
@@ -385,55 +447,27 @@ class MixedSymmetricRecursiveSolver<
             {
                 P.compute(Sdiag);
             }
-            da.setZero();
-
-            // Iterative CG solver
-            Eigen::Index iters = solverOptions.maxIterativeIterations;
-            double tol         = solverOptions.iterativeTolerance;
-            //            XUType tmp(n);
-
-            recursive_conjugate_gradient(
-                [&](const XUType& v, XUType& result) {
-                    // x = U * p - Y * WT * p
-                    if (explizitSchur)
-                    {
-                        //                    if constexpr (denseSchur)
-                        //                        denseMV(S1, v, result);
-                        //                    else
-                        result = S1.template selfadjointView<Eigen::Upper>() * v;
-                        //                    std::cout << expand(result) << std::endl << std::endl;
-                    }
-                    else
-                    {
-                        if (hasWT)
-                        {
-                            tmp = Y * (WT * v);
-                        }
-                        else
-                        {
-                            multSparseRowTransposedVector(W, v, q);
-                            tmp = Y * q;
-                        }
-                        result = (U.diagonal().array() * v.array()) - tmp.array();
-                        //                    std::cout << expand(result) << std::endl << std::endl;
-                    }
-                },
-                ej, da, P, iters, tol);
         }
 
+        // r = a - W * V^-1 * b
+        ej               = b.u + -(Y * b.v);
+        currentTolerance = iterativeTolerance(solverOptions);
 
+        backSubstitution(A, x, b, solverOptions);
+    }
 
-        // finalize
-        if (hasWT)
-        {
-            q = WT * da;
-        }
-        else
-        {
-            multSparseRowTransposedVector(W, da, q);
-        }
-        q  = eb - q;
-        db = multDiagVector(Vinv, q);
+    /**
+     * Solves the system again for a different right hand side b.
+     * The schur complement and its factorization (or preconditioner) of the last call to solve() or
+     * solve_omp() are reused. The matrix A must not have changed in the meantime.
+     *
+     * This is used for iterative refinement of a low precision solution.
+     */
+    void resolve(AType& A, XType& x, XType& b, const LinearSolverOptions& solverOptions = LinearSolverOptions())
+    {
+        eigen_assert(patternAnalyzed);
+        ej = b.u + -(Y * b.v);
+        backSubstitution(A, x, b, solverOptions);
     }
 
 
@@ -442,20 +476,23 @@ class MixedSymmetricRecursiveSolver<
 #pragma omp single
         {
             resize(A.u.rows(), A.v.rows());
-
+            clusterAnalyzed = false;
+            s1Analyzed      = false;
+            forcing.reset();
 
             if (solverOptions.solverType == LinearSolverOptions::SolverType::Direct)
             {
-                std::terminate();
                 hasWT         = true;
                 explizitSchur = true;
+                ldlt          = nullptr;
+                supernodalLLT = nullptr;
             }
             else
             {
-                // TODO: add heurisitc here
                 hasWT         = true;
-                explizitSchur = true;
+                explizitSchur = solverOptions.buildExplizitSchur;
             }
+            useCluster = false;
 
             if (hasWT)
             {
@@ -481,6 +518,15 @@ class MixedSymmetricRecursiveSolver<
 
         if (!patternAnalyzed) analyzePattern_omp(A, solverOptions);
 
+        if (solverOptions.solverType == LinearSolverOptions::SolverType::Direct)
+        {
+            // The factorization is not parallelized
+#pragma omp single
+            {
+                solve(A, x, b, solverOptions);
+            }
+            return;
+        }
 
         transposeValueOnly_omp(A.w, WT, transposeTargets);
         // U schur (S1)
@@ -505,31 +551,71 @@ class MixedSymmetricRecursiveSolver<
         }
 
 
+#pragma omp single
         {
-            // A special implicit schur solver.
-            // We cannot use the recursive inner solver here.
-            // (Maybe a todo for the future)
-            //            da.setZero();
+            currentTolerance = iterativeTolerance(solverOptions);
         }
 
         Eigen::Index iters = solverOptions.maxIterativeIterations;
-        double tol         = solverOptions.iterativeTolerance;
-        P.compute(Sdiag);
+        double tol         = currentTolerance;
 
+        if (explizitSchur)
+        {
+            // S = U - W * V^-1 * WT
+            // The sparse product is computed by a single thread. The symmetric product S * v in the cg
+            // iterations is distributed over the rows with the help of the transposed matrix S^T.
+#pragma omp single
+            {
+                S1            = (Y * WT).template triangularView<Eigen::Upper>();
+                S1            = -S1;
+                S1.diagonal() = U.diagonal() + S1.diagonal();
+                if (!s1Analyzed)
+                {
+                    transposeStructureOnly_omp(S1, S1T, s1TransposeTargets);
+                    if (solverOptions.preconditioner == LinearSolverOptions::Preconditioner::ClusterJacobi)
+                    {
+                        clusterP.setClusterSize(solverOptions.clusterSize);
+                        clusterP.analyzePattern(S1);
+                        clusterAnalyzed = true;
+                    }
+                    s1Analyzed = true;
+                }
+                useCluster = clusterAnalyzed;
+            }
+            transposeValueOnly_omp(S1, S1T, s1TransposeTargets);
 
+            auto applyA = [&](const XUType& v, XUType& result) { sparse_selfadjoint_mv_omp(S1, S1T, v, result); };
+            if (clusterAnalyzed)
+            {
+                clusterP.factorize_omp(S1);
+                recursive_conjugate_gradient_OMP(applyA, ej, da, clusterP, iters, tol);
+            }
+            else
+            {
+                P.factorize_omp(S1);
+                recursive_conjugate_gradient_OMP(applyA, ej, da, P, iters, tol);
+            }
+        }
+        else
+        {
+            // A special implicit schur solver.
+            // We cannot use the recursive inner solver here.
+            // (Maybe a todo for the future)
+            P.factorize_omp(Sdiag);
 
-        recursive_conjugate_gradient_OMP(
-            [&](const XUType& v, XUType& result) {
-                // x = U * p - Y * WT * p
-                sparse_mv_omp(WT, v, q);
-                sparse_mv_omp(Y, q, tmp);
+            recursive_conjugate_gradient_OMP(
+                [&](const XUType& v, XUType& result) {
+                    // x = U * p - Y * WT * p
+                    sparse_mv_omp(WT, v, q);
+                    sparse_mv_omp(Y, q, tmp);
 #pragma omp for
-                for (int i = 0; i < v.rows(); ++i)
-                {
-                    result(i).get() = (U.diagonal()(i).get() * v(i).get()) - tmp(i).get();
-                }
-            },
-            ej, da, P, iters, tol);
+                    for (int i = 0; i < v.rows(); ++i)
+                    {
+                        result(i).get() = (U.diagonal()(i).get() * v(i).get()) - tmp(i).get();
+                    }
+                },
+                ej, da, P, iters, tol);
+        }
 
 
         sparse_mv_omp(WT, da, q);
@@ -547,6 +633,128 @@ class MixedSymmetricRecursiveSolver<
    private:
     int n, m;
 
+    // Relative tolerance of the iterative solver. Either fixed or computed by the inexact newton forcing
+    // sequence from the norm of the reduced right hand side.
+    double iterativeTolerance(const LinearSolverOptions& solverOptions)
+    {
+        if (!solverOptions.inexactNewton) return solverOptions.iterativeTolerance;
+        return forcing.compute(std::sqrt(squaredNorm(ej)), solverOptions.iterativeTolerance);
+    }
+
+    // Factorizes S1 with the supernodal cholesky or the recursive ldlt. If the cholesky fails (S1 is not positive
+    // definite because of round off errors), the ldlt is used instead.
+    void factorizeDirect(const LinearSolverOptions& solverOptions)
+    {
+        useLDLT = !solverOptions.supernodal;
+        if (solverOptions.supernodal)
+        {
+            // Supernodal cholesky with dense panels
+            if (!supernodalLLT)
+            {
+                supernodalLLT = std::make_unique<SupernodalLLT>(solverOptions.ordering);
+                supernodalLLT->compute(S1);
+            }
+            else
+            {
+                supernodalLLT->factorize(S1);
+            }
+            useLDLT = supernodalLLT->info() != Eigen::Success;
+        }
+
+        if (useLDLT)
+        {
+            // Direct recusive ldlt solver
+            if (!ldlt)
+            {
+                ldlt = std::make_unique<LDLT>();
+                computeBlockOrdering(S1, solverOptions.ordering, ldlt->m_Pinv);
+                ldlt->compute(S1);
+            }
+            else
+            {
+                ldlt->factorize(S1);
+            }
+        }
+    }
+
+    InexactNewtonForcing forcing;
+    double currentTolerance = 0;
+    bool useCluster         = false;
+
+    // Solves the reduced system S * da = ej with the current factorization and computes db.
+    void backSubstitution(AType& A, XType& x, XType& b, const LinearSolverOptions& solverOptions)
+    {
+        const AUType& U  = A.u;
+        const AWType& W  = A.w;
+        XUType& da       = x.u;
+        XVType& db       = x.v;
+        const XVType& eb = b.v;
+
+        if (solverOptions.solverType == LinearSolverOptions::SolverType::Direct)
+        {
+            if (useLDLT)
+            {
+                da = ldlt->solve(ej);
+            }
+            else
+            {
+                supernodalLLT->solve(ej, da);
+            }
+        }
+        else
+        {
+            da.setZero();
+
+            // Iterative CG solver
+            Eigen::Index iters = solverOptions.maxIterativeIterations;
+            double tol         = currentTolerance;
+            //            XUType tmp(n);
+
+            auto applyA = [&](const XUType& v, XUType& result) {
+                // x = U * p - Y * WT * p
+                if (explizitSchur)
+                {
+                    //                    if constexpr (denseSchur)
+                    //                        denseMV(S1, v, result);
+                    //                    else
+                    result = S1.template selfadjointView<Eigen::Upper>() * v;
+                    //                    std::cout << expand(result) << std::endl << std::endl;
+                }
+                else
+                {
+                    if (hasWT)
+                    {
+                        tmp = Y * (WT * v);
+                    }
+                    else
+                    {
+                        multSparseRowTransposedVector(W, v, q);
+                        tmp = Y * q;
+                    }
+                    result = (U.diagonal().array() * v.array()) - tmp.array();
+                    //                    std::cout << expand(result) << std::endl << std::endl;
+                }
+            };
+
+            if (useCluster)
+                recursive_conjugate_gradient(applyA, ej, da, clusterP, iters, tol);
+            else
+                recursive_conjugate_gradient(applyA, ej, da, P, iters, tol);
+        }
+
+        // finalize
+        if (hasWT)
+        {
+            q = WT * da;
+        }
+        else
+        {
+            multSparseRowTransposedVector(W, da, q);
+        }
+        q  = eb - q;
+        db = multDiagVector(Vinv, q);
+    }
+
     // ==== Solver tmps ====
     XVType q;
     AVType Vinv;
@@ -558,11 +766,21 @@ class MixedSymmetricRecursiveSolver<
     std::vector<int> transposeTargets;
     AWTType WT;
 
+    // Transposed schur complement for the multi threaded symmetric matrix vector product
+    bool s1Analyzed = false;
+    std::vector<int> s1TransposeTargets;
+    S1Type S1T;
+
     RecursiveDiagonalPreconditioner<UBlock> P;
+    RecursiveClusterJacobiPreconditioner<UBlock> clusterP;
+    bool clusterAnalyzed = false;
     S1Type S1;
     //    InnerSolver1 solver1;
 
     std::unique_ptr<LDLT> ldlt;
+    std::unique_ptr<SupernodalLLT> supernodalLLT;
+    // The last direct solve used the ldlt
+    bool useLDLT = false;
 
     bool patternAnalyzed = false;
     bool hasWT           = true;
@@ -40,7 +40,10 @@ class MixedSymmetricRecursiveSolver<Eigen::SparseMatrix<Eigen::Recursive::Matrix
 
     void Init()
     {
-        ldlt = nullptr;
+        ldlt            = nullptr;
+        patternAnalyzed = false;
+        clusterAnalyzed = false;
+        forcing.reset();
 #ifdef SOLVER_USE_CHOLMOD
         cholmodldlt = nullptr;
 #endif
@@ -48,7 +51,6 @@ class MixedSymmetricRecursiveSolver<Eigen::SparseMatrix<Eigen::Recursive::Matrix
 
     void solve(AType& A, XType& x, XType& b, const LinearSolverOptions& solverOptions = LinearSolverOptions())
     {
-        int n = A.rows();
         if (solverOptions.solverType == LinearSolverOptions::SolverType::Direct)
         {
 #ifdef SOLVER_USE_CHOLMOD
@@ -83,49 +85,12 @@ class MixedSymmetricRecursiveSolver<Eigen::SparseMatrix<Eigen::Recursive::Matrix
             {
                 if (!ldlt)
                 {
-#if 0
-                    {
-                        // Use cholmod to compute the ordering
-                        cholmod_common m_cholmod;
-                        cholmod_start(&m_cholmod);
-                        cholmod_defaults(&m_cholmod);
-
-                        cholmod_sparse cholmod_matrix;
-
-                        const auto& testasdf = reinterpret_cast<Eigen::SparseMatrix<double>&>(A);
-                        cholmod_matrix       = Eigen::viewAsCholmod(testasdf.selfadjointView<Eigen::Upper>());
-
-                        m_cholmod.supernodal         = CHOLMOD_SIMPLICIAL;
-                        m_cholmod.nmethods           = 1;
-                        m_cholmod.method[0].ordering = CHOLMOD_AMD;
-                        m_cholmod.postorder          = false;
-
-                        orderingFull.resize(A.rows());
-                        cholmod_amd(&cholmod_matrix, 0, 0, orderingFull.data(), &m_cholmod);
-
-
-                        permFull.resize(A.rows());
-                        for (int i = 0; i < A.rows(); ++i)
-                        {
-                            permFull.indices()[i] = orderingFull[i];
-                        }
-
-                        cholmod_finish(&m_cholmod);
-                        cholmod_free_work(&m_cholmod);
-                    }
-#endif
-
-                    // Create cholesky solver and do a full compute
+                    // Create cholesky solver and do a full compute.
+                    // The fill reducing ordering is computed once on the block structure and then reused by all
+                    // following factorizations.
                     ldlt = std::make_unique<LDLT>();
-#if 0
-                    ldlt->m_Pinv = permFull;
-                    ldlt->m_P    = permFull.inverse();
-                    ldlt->analyzePattern(A);
-                    ldlt->factorize(A);
-#else
-
+                    computeBlockOrdering(A, solverOptions.ordering, ldlt->m_Pinv);
                     ldlt->compute(A);
-#endif
                 }
                 else
                 {
@@ -139,23 +104,132 @@ class MixedSymmetricRecursiveSolver<Eigen::SparseMatrix<Eigen::Recursive::Matrix
         else
         {
             x.setZero();
-            RecursiveDiagonalPreconditioner<MatrixScalar<T>> P;
             Eigen::Index iters = solverOptions.maxIterativeIterations;
-            double tol         = solverOptions.iterativeTolerance;
+            double tol         = iterativeTolerance(b, solverOptions);
 
-            P.compute(A);
+            auto applyA = [&](const XType& v, XType& result) {
+                result = A.template selfadjointView<Eigen::Upper>() * v;
+            };
 
-            XType tmp(n);
-            recursive_conjugate_gradient(
-                [&](const XType& v, XType& result) { result = A.template selfadjointView<Eigen::Upper>() * v; }, b, x,
-                P, iters, tol);
+            if (solverOptions.preconditioner == LinearSolverOptions::Preconditioner::ClusterJacobi)
+            {
+                if (!clusterAnalyzed)
+                {
+                    clusterP.setClusterSize(solverOptions.clusterSize);
+                    clusterP.analyzePattern(A);
+                    clusterAnalyzed = true;
+                }
+                clusterP.factorize(A);
+                recursive_conjugate_gradient(applyA, b, x, clusterP, iters, tol);
+            }
+            else
+            {
+                RecursiveDiagonalPreconditioner<MatrixScalar<T>> P;
+                P.compute(A);
+                recursive_conjugate_gradient(applyA, b, x, P, iters, tol);
+            }
+        }
+    }
+
+    // Must be called by all threads. patternAnalyzed is only read inside the single region. Otherwise a late thread
+    // could skip the region (and its barrier) after another thread has already set it.
+    void analyzePattern_omp(const AType& A, const LinearSolverOptions& solverOptions)
+    {
+#pragma omp single
+        {
+            if (!patternAnalyzed)
+            {
+                n = A.rows();
+                if (solverOptions.solverType == LinearSolverOptions::SolverType::Iterative)
+                {
+                    // The transposed structure is used to compute the symmetric matrix vector product in parallel.
+                    transposeStructureOnly_omp(A, AT, transposeTargets);
+                    P.resize(n);
+                    if (solverOptions.preconditioner == LinearSolverOptions::Preconditioner::ClusterJacobi)
+                    {
+                        clusterP.setClusterSize(solverOptions.clusterSize);
+                        clusterP.analyzePattern(A);
+                        clusterAnalyzed = true;
+                    }
+                }
+                patternAnalyzed = true;
+            }
+        }
+    }
+
+    /**
+     * Multi threaded solve. Must be called by all threads of a parallel region.
+     *
+     * The iterative solver is fully parallelized. The direct factorization runs on a single thread
+     * of the team.
+     */
+    void solve_omp(AType& A, XType& x, XType& b, const LinearSolverOptions& solverOptions = LinearSolverOptions())
+    {
+        analyzePattern_omp(A, solverOptions);
+
+        if (solverOptions.solverType == LinearSolverOptions::SolverType::Direct)
+        {
+#pragma omp single
+            {
+                solve(A, x, b, solverOptions);
+            }
+        }
+        else
+        {
+            bool cluster = solverOptions.preconditioner == LinearSolverOptions::Preconditioner::ClusterJacobi;
+
+            transposeValueOnly_omp(A, AT, transposeTargets);
+            if (cluster)
+                clusterP.factorize_omp(A);
+            else
+                P.factorize_omp(A);
+
+#pragma omp for
+            for (int i = 0; i < n; ++i)
+            {
+                x(i).get().setZero();
+            }
+
+#pragma omp single
+            {
+                sharedTolerance = iterativeTolerance(b, solverOptions);
+            }
+
+            Eigen::Index iters = solverOptions.maxIterativeIterations;
+            double tol         = sharedTolerance;
+
+            auto applyA = [&](const XType& v, XType& result) { sparse_selfadjoint_mv_omp(A, AT, v, result); };
+            if (cluster)
+                recursive_conjugate_gradient_OMP(applyA, b, x, clusterP, iters, tol);
+            else
+                recursive_conjugate_gradient_OMP(applyA, b, x, P, iters, tol);
         }
     }
 
    private:
+    int n = 0;
+
+    // Relative tolerance of the iterative solver. Either fixed or computed by the inexact newton forcing
+    // sequence from the norm of the right hand side.
+    double iterativeTolerance(const XType& b, const LinearSolverOptions& solverOptions)
+    {
+        if (!solverOptions.inexactNewton) return solverOptions.iterativeTolerance;
+        return forcing.compute(std::sqrt(squaredNorm(b)), solverOptions.iterativeTolerance);
+    }
+
+    InexactNewtonForcing forcing;
+    double sharedTolerance = 0;
+
+    bool clusterAnalyzed = false;
+    RecursiveClusterJacobiPreconditioner<MatrixScalar<T>> clusterP;
+
+    // ==== Multi threaded iterative solver ====
+    bool patternAnalyzed = false;
+    AType AT;
+    std::vector<int> transposeTargets;
+    RecursiveDiagonalPreconditioner<MatrixScalar<T>> P;
+
     std::unique_ptr<LDLT> ldlt;
-    Eigen::PermutationMatrix<-1> permFull;
-    std::vector<int> orderingFull;
 #ifdef SOLVER_USE_CHOLMOD
     // Cholmod stuff
     std::unique_ptr<CholmodLDLT> cholmodldlt;
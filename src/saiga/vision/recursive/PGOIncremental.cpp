@@ -0,0 +1,353 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "PGOIncremental.h"
+
+#include "saiga/vision/kernels/PGO.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+namespace Saiga
+{
+void PGOIncremental::create(PoseGraph& graph)
+{
+    SAIGA_ASSERT(graph.fixScale, "PGOIncremental only supports SE3 pose graphs.");
+    this->graph = &graph;
+
+    n         = 0;
+    num_edges = 0;
+    x_lin.clear();
+    delta.clear();
+    vertexEdges.clear();
+    edgeLin.clear();
+
+    H_diag.clear();
+    H_rows.clear();
+    H_values.clear();
+    b.clear();
+    dirty.clear();
+    is_dirty.clear();
+
+    L_diag.clear();
+    L_rows.clear();
+    L_values.clear();
+    L_cols.clear();
+    parent.clear();
+    children.clear();
+    scatter.clear();
+}
+
+PGOIncremental::UpdateResult PGOIncremental::update()
+{
+    SAIGA_ASSERT(graph);
+    UpdateResult result;
+
+    // ==== Add new vertices ====
+    int new_n = graph->vertices.size();
+    SAIGA_ASSERT(new_n >= n, "Vertices must not be removed from the graph.");
+    result.new_vertices = new_n - n;
+
+    x_lin.resize(new_n);
+    delta.resize(new_n, Vec6::Zero());
+    vertexEdges.resize(new_n);
+    H_diag.resize(new_n);
+    H_rows.resize(new_n);
+    H_values.resize(new_n);
+    b.resize(new_n);
+    is_dirty.resize(new_n, false);
+    L_diag.resize(new_n);
+    L_rows.resize(new_n);
+    L_values.resize(new_n);
+    L_cols.resize(new_n);
+    parent.resize(new_n, -1);
+    children.resize(new_n);
+    scatter.resize(new_n, -1);
+
+    for (int i = n; i < new_n; ++i)
+    {
+        x_lin[i] = graph->vertices[i].Pose();
+        markDirty(i);
+    }
+    n = new_n;
+
+    // ==== Add new edges ====
+    int new_m = graph->edges.size();
+    SAIGA_ASSERT(new_m >= num_edges, "Edges must not be removed from the graph.");
+    result.new_edges = new_m - num_edges;
+
+    edgeLin.resize(new_m);
+    for (int e = num_edges; e < new_m; ++e)
+    {
+        auto& edge = graph->edges[e];
+        SAIGA_ASSERT(edge.from >= 0 && edge.from < n && edge.to >= 0 && edge.to < n && edge.from != edge.to);
+        vertexEdges[edge.from].push_back(e);
+        vertexEdges[edge.to].push_back(e);
+        linearizeEdge(e);
+    }
+    num_edges = new_m;
+
+    for (int it = 0; it < params.iterations; ++it)
+    {
+        relinearize(result);
+        result.refactorized_columns += refactorize();
+        solve();
+    }
+
+    // ==== Write back the current estimate ====
+    for (int i = 0; i < n; ++i)
+    {
+        auto& v = graph->vertices[i];
+        if (!v.constant) v.SetPose(estimate(i));
+    }
+
+    result.num_vertices = n;
+    if (params.compute_chi2) result.chi2 = graph->chi2();
+    return result;
+}
+
+void PGOIncremental::linearizeEdge(int e)
+{
+    auto& edge = graph->edges[e];
+    auto& l    = edgeLin[e];
+
+    l.residual = relPoseError(edge.GetSE3(), x_lin[edge.from], x_lin[edge.to], edge.weight, edge.weight, &l.J_from,
+                              &l.J_to);
+
+    if (graph->vertices[edge.from].constant) l.J_from.setZero();
+    if (graph->vertices[edge.to].constant) l.J_to.setZero();
+
+    markDirty(edge.from);
+    markDirty(edge.to);
+}
+
+void PGOIncremental::relinearize(UpdateResult& result)
+{
+    // Fluid relinearization: only vertices with a large delta are moved to their current estimate.
+    // All edges of these vertices must be linearized again.
+    std::vector<int> edges;
+    for (int i = 0; i < n; ++i)
+    {
+        if (graph->vertices[i].constant) continue;
+        if (delta[i].lpNorm<Eigen::Infinity>() <= params.relinearize_threshold) continue;
+
+        x_lin[i] = estimate(i);
+        delta[i].setZero();
+        edges.insert(edges.end(), vertexEdges[i].begin(), vertexEdges[i].end());
+        result.relinearized_vertices++;
+    }
+
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    for (auto e : edges) linearizeEdge(e);
+}
+
+void PGOIncremental::markDirty(int i)
+{
+    if (is_dirty[i]) return;
+    is_dirty[i] = true;
+    dirty.push_back(i);
+}
+
+void PGOIncremental::buildColumn(int j)
+{
+    // Column j of the lower triangular part of H = J^T J and the right hand side b = -J^T r
+    std::vector<std::pair<int, int>> blocks;
+    AlignedVector<Mat6> values;
+
+    Mat6 diag = Mat6::Zero();
+    Vec6 rhs  = Vec6::Zero();
+    for (auto e : vertexEdges[j])
+    {
+        auto& edge = graph->edges[e];
+        auto& l    = edgeLin[e];
+
+        bool is_from    = edge.from == j;
+        int other       = is_from ? edge.to : edge.from;
+        const Mat6& J_j = is_from ? l.J_from : l.J_to;
+        const Mat6& J_o = is_from ? l.J_to : l.J_from;
+
+        diag += J_j.transpose() * J_j;
+        rhs -= J_j.transpose() * l.residual;
+
+        if (other > j)
+        {
+            blocks.emplace_back(other, values.size());
+            values.push_back(J_o.transpose() * J_j);
+        }
+    }
+
+    if (graph->vertices[j].constant) diag.setIdentity();
+    diag.diagonal().array() += params.damping;
+    H_diag[j] = diag;
+    b[j]      = rhs;
+
+    // Sort by row and merge multiple edges between the same vertices
+    std::sort(blocks.begin(), blocks.end());
+    auto& rows = H_rows[j];
+    auto& vals = H_values[j];
+    rows.clear();
+    vals.clear();
+    for (auto [row, id] : blocks)
+    {
+        if (!rows.empty() && rows.back() == row)
+        {
+            vals.back() += values[id];
+        }
+        else
+        {
+            rows.push_back(row);
+            vals.push_back(values[id]);
+        }
+    }
+}
+
+int PGOIncremental::refactorize()
+{
+    for (auto j : dirty) buildColumn(j);
+
+    // All ancestors of a modified column in the elimination tree must be recomputed.
+    // The columns are processed in ascending order, so that all children of a column are up to date.
+    std::priority_queue<int, std::vector<int>, std::greater<int>> queue;
+    for (auto j : dirty) queue.push(j);
+
+    int count = 0;
+    while (!queue.empty())
+    {
+        int j = queue.top();
+        queue.pop();
+
+        int old_parent = parent[j];
+        factorizeColumn(j);
+        count++;
+
+        for (int p : {old_parent, parent[j]})
+        {
+            if (p != -1 && !is_dirty[p])
+            {
+                markDirty(p);
+                queue.push(p);
+            }
+        }
+    }
+
+    for (auto j : dirty) is_dirty[j] = false;
+    dirty.clear();
+    return count;
+}
+
+void PGOIncremental::factorizeColumn(int j)
+{
+    // ==== Symbolic ====
+    // struct(L(:,j)) = struct(H(:,j)) + struct(L(:,c)) of all children c in the elimination tree.
+    std::vector<int> rows = H_rows[j];
+    for (auto c : children[j])
+    {
+        for (auto r : L_rows[c])
+        {
+            if (r > j) rows.push_back(r);
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    if (rows != L_rows[j])
+    {
+        // The structure of H only grows, so no rows are removed here
+        auto& old_rows = L_rows[j];
+        std::vector<int> added;
+        std::set_difference(rows.begin(), rows.end(), old_rows.begin(), old_rows.end(), std::back_inserter(added));
+        for (auto r : added) L_cols[r].push_back(j);
+
+        int new_parent = rows.empty() ? -1 : rows.front();
+        if (new_parent != parent[j])
+        {
+            if (parent[j] != -1)
+            {
+                auto& c = children[parent[j]];
+                c.erase(std::find(c.begin(), c.end(), j));
+            }
+            if (new_parent != -1) children[new_parent].push_back(j);
+            parent[j] = new_parent;
+        }
+        L_rows[j] = rows;
+    }
+
+    // ==== Numeric ====
+    auto& L_rows_j = L_rows[j];
+    accumulator.resize(L_rows_j.size());
+    for (int q = 0; q < (int)L_rows_j.size(); ++q)
+    {
+        scatter[L_rows_j[q]] = q;
+        accumulator[q].setZero();
+    }
+    for (int q = 0; q < (int)H_rows[j].size(); ++q)
+    {
+        accumulator[scatter[H_rows[j][q]]] = H_values[j][q];
+    }
+
+    Mat6 D = H_diag[j];
+    for (auto k : L_cols[j])
+    {
+        auto& rows_k   = L_rows[k];
+        auto& values_k = L_values[k];
+        int p          = std::lower_bound(rows_k.begin(), rows_k.end(), j) - rows_k.begin();
+        SAIGA_ASSERT(p < (int)rows_k.size() && rows_k[p] == j);
+
+        const Mat6& L_jk = values_k[p];
+        D -= L_jk * L_jk.transpose();
+        for (int q = p + 1; q < (int)rows_k.size(); ++q)
+        {
+            accumulator[scatter[rows_k[q]]] -= values_k[q] * L_jk.transpose();
+        }
+    }
+
+    Eigen::LLT<Mat6> llt(D);
+    SAIGA_ASSERT(llt.info() == Eigen::Success, "PGOIncremental: Gauss-Newton system is not positive definite.");
+    L_diag[j] = llt.matrixL();
+
+    auto& L_values_j = L_values[j];
+    L_values_j.resize(L_rows_j.size());
+    for (int q = 0; q < (int)L_rows_j.size(); ++q)
+    {
+        // L_ij = A_ij * L_jj^-T
+        L_values_j[q] = L_diag[j].triangularView<Eigen::Lower>().solve(accumulator[q].transpose()).transpose();
+        scatter[L_rows_j[q]] = -1;
+    }
+}
+
+void PGOIncremental::solve()
+{
+    // Forward and backward substitution with the current factorization
+    AlignedVector<Vec6> y = b;
+    for (int j = 0; j < n; ++j)
+    {
+        y[j] = L_diag[j].triangularView<Eigen::Lower>().solve(y[j]);
+        for (int q = 0; q < (int)L_rows[j].size(); ++q)
+        {
+            y[L_rows[j][q]] -= L_values[j][q] * y[j];
+        }
+    }
+
+    for (int j = n - 1; j >= 0; --j)
+    {
+        Vec6 v = y[j];
+        for (int q = 0; q < (int)L_rows[j].size(); ++q)
+        {
+            v -= L_values[j][q].transpose() * delta[L_rows[j][q]];
+        }
+        delta[j] = L_diag[j].transpose().triangularView<Eigen::Upper>().solve(v);
+    }
+}
+
+SE3 PGOIncremental::estimate(int i) const
+{
+    if (graph->vertices[i].constant) return x_lin[i];
+    return Sophus::se3_expd(delta[i]) * x_lin[i];
+}
+
+}  // namespace Saiga
@@ -0,0 +1,145 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/vision/pgo/PGOBase.h"
+
+#include <vector>
+
+namespace Saiga
+{
+/**
+ * Incremental SE3 pose graph optimization for online loop closure (similar to iSAM/iSAM2).
+ *
+ * The factorization L*L^T of the Gauss-Newton system is kept between updates. Vertices are eliminated in their
+ * natural (chronological) order. If new edges arrive or vertices are relinearized, only the columns of L that are
+ * affected by the change are recomputed. These are the modified columns and their ancestors in the elimination tree
+ * (the path to the root in the Bayes tree). Appending a keyframe with odometry edges therefore touches only the last
+ * few columns, while a loop closure refactorizes the columns from the oldest vertex of the loop to the newest.
+ *
+ * Vertices are relinearized only if their delta exceeds a threshold (fluid relinearization).
+ *
+ * Usage:
+ *
+ *   PGOIncremental pgo;
+ *   pgo.create(graph);
+ *   while (running)
+ *   {
+ *       // Append vertices and edges to the graph
+ *       graph.vertices.push_back(...);
+ *       graph.edges.push_back(...);
+ *       pgo.update();
+ *       // graph.vertices now contains the current estimate
+ *   }
+ *
+ * Notes:
+ *   - Vertices and edges must only be appended to the graph. Existing edges must not be changed.
+ *   - Only SE3 pose graphs are supported (graph.fixScale == true).
+ *   - If the graph contains no constant vertex, the gauge freedom is fixed by params.damping.
+ */
+class SAIGA_VISION_API PGOIncremental : public PGOBase
+{
+   public:
+    using Mat6 = Eigen::Matrix<double, 6, 6>;
+
+    struct Params
+    {
+        // A vertex is relinearized if the max norm of its delta is larger than this value
+        double relinearize_threshold = 0.01;
+
+        // Number of relinearize/refactorize/solve steps per update.
+        int iterations = 1;
+
+        // Added to the diagonal of the Gauss-Newton matrix
+        double damping = 1e-6;
+
+        // Compute the chi2 of the graph after each update. O(num_edges).
+        bool compute_chi2 = false;
+    };
+
+    struct UpdateResult
+    {
+        int new_vertices = 0;
+        int new_edges    = 0;
+
+        // Accumulated over all iterations of this update
+        int relinearized_vertices = 0;
+        int refactorized_columns  = 0;
+
+        int num_vertices = 0;
+        double chi2      = 0;
+    };
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    PGOIncremental() : PGOBase("incremental PGO") {}
+    PGOIncremental(const Params& params) : PGOBase("incremental PGO"), params(params) {}
+    virtual ~PGOIncremental() {}
+
+    // Starts a new optimization on this graph. The graph must stay alive until the last update.
+    // The first update() processes the complete graph with a full factorization.
+    virtual void create(PoseGraph& graph) override;
+
+    // Adds the vertices and edges appended to the graph since the last update and updates the estimate.
+    // The current estimate is written to graph.vertices.
+    UpdateResult update();
+
+    Params params;
+
+   private:
+    PoseGraph* graph = nullptr;
+
+    // Number of vertices and edges of the graph that are part of the system
+    int n         = 0;
+    int num_edges = 0;
+
+    // ==== Linearization ====
+    AlignedVector<SE3> x_lin;
+    AlignedVector<Vec6> delta;
+    std::vector<std::vector<int>> vertexEdges;
+
+    struct EdgeLinearization
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        Mat6 J_from, J_to;
+        Vec6 residual;
+    };
+    AlignedVector<EdgeLinearization> edgeLin;
+
+    // ==== Gauss-Newton system (lower part) ====
+    // The columns in 'dirty' have been changed and must be refactorized.
+    AlignedVector<Mat6> H_diag;
+    std::vector<std::vector<int>> H_rows;
+    std::vector<AlignedVector<Mat6>> H_values;
+    AlignedVector<Vec6> b;
+    std::vector<int> dirty;
+    std::vector<char> is_dirty;
+
+    // ==== Factorization ====
+    // Column j of L: L_diag[j] is the cholesky factor of the diagonal block. The sub diagonal blocks are stored in
+    // L_values[j] with the (sorted) row indices L_rows[j]. L_cols[j] contains all columns k < j with L(j,k) != 0.
+    AlignedVector<Mat6> L_diag;
+    std::vector<std::vector<int>> L_rows;
+    std::vector<AlignedVector<Mat6>> L_values;
+    std::vector<std::vector<int>> L_cols;
+    std::vector<int> parent;
+    std::vector<std::vector<int>> children;
+
+    // Temporaries of the column factorization
+    std::vector<int> scatter;
+    AlignedVector<Mat6> accumulator;
+
+    void linearizeEdge(int e);
+    void relinearize(UpdateResult& result);
+    void markDirty(int i);
+    void buildColumn(int j);
+    int refactorize();
+    void factorizeColumn(int j);
+    void solve();
+    SE3 estimate(int i) const;
+};
+
+}  // namespace Saiga
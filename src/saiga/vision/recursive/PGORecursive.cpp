@@ -3,6 +3,7 @@
 #include "saiga/core/imgui/imgui.h"
 #include "saiga/core/time/timer.h"
 #include "saiga/core/util/Algorithm.h"
+#include "saiga/core/util/Thread/omp.h"
 #include "saiga/vision/kernels/PGO.h"
 #include "saiga/vision/kernels/Robust.h"
 #include "saiga/vision/util/HistogramImage.h"
@@ -86,6 +87,14 @@ void PGORec::init()
         edgeOffsets.emplace_back(offseti);
     }
 
+    // ===== Threading Tmps ======
+    SAIGA_ASSERT(threads > 0);
+    localChi2.resize(threads);
+    diagTemp.resize(threads);
+    resTemp.resize(threads);
+    for (auto& a : diagTemp) a.resize(n);
+    for (auto& a : resTemp) a.resize(n);
+
     solver.Init();
 
     // Create a sparsity histogram
@@ -109,40 +118,36 @@ double PGORec::computeQuadraticForm()
 {
     auto& scene = *_scene;
 
+    // This function can be called from inside a parallel region (see LMOptimizer::solveOMP).
+    // Outside of a parallel region, the work sharing constructs are executed by the calling thread only.
+    int tid         = OMP::getThreadNum();
+    int num_threads = OMP::getNumThreads();
+    SAIGA_ASSERT(num_threads <= threads);
 
-    b.setZero();
-
-    // set diagonal elements of S to zero
-    for (int i = 0; i < S.rows(); ++i)
-    {
-        S.valuePtr()[S.outerIndexPtr()[i]].get().setZero();
-    }
-
-    double chi2 = 0;
-    //#pragma omp parallel
-
-    //        auto b2 = b;
-    AlignedVector<PGOBlock> diagBlocks(n);
+    // every thread has to zero its own local copy
+    auto& diagBlocks = diagTemp[tid];
+    auto& resBlocks  = resTemp[tid];
     for (int i = 0; i < n; ++i)
     {
         diagBlocks[i].setZero();
+        resBlocks[i].setZero();
     }
+
     double chi2local = 0;
-    //#pragma omp for
-    for (size_t k = 0; k < scene.edges.size(); ++k)
+#pragma omp for
+    for (int k = 0; k < (int)scene.edges.size(); ++k)
     {
         auto& e       = scene.edges[k];
         auto& offsets = edgeOffsets[k];
         int i         = e.from;
         int j         = e.to;
 
+        // Each edge has its own off diagonal element, so this can be written directly
         auto& target_ij = S.valuePtr()[offsets].get();
-        //            auto& target_ii = S.valuePtr()[S.outerIndexPtr()[i]].get();
-        //            auto& target_jj = S.valuePtr()[S.outerIndexPtr()[j]].get();
         auto& target_ii = diagBlocks[i];
         auto& target_jj = diagBlocks[j];
-        auto& target_ir = b(i).get();
-        auto& target_jr = b(j).get();
+        auto& target_ir = resBlocks[i];
+        auto& target_jr = resBlocks[j];
 
         {
             Eigen::Matrix<double, 6, 6> Jrowi, Jrowj;
@@ -167,23 +172,28 @@ double PGORec::computeQuadraticForm()
             chi2local += c;
         }
     }
+    localChi2[tid] = chi2local;
 
-    //#pragma omp atomic
-    chi2 += chi2local;
-    //#pragma omp critical
+    // Sum up the thread local diagonal blocks
+#pragma omp for
+    for (int i = 0; i < n; ++i)
     {
-        //            b += b2;
+        auto& target_ii = S.valuePtr()[S.outerIndexPtr()[i]].get();
+        auto& target_ir = b(i).get();
+        target_ii       = diagTemp[0][i];
+        target_ir       = resTemp[0][i];
+        for (int t = 1; t < num_threads; ++t)
+        {
+            target_ii += diagTemp[t][i];
+            target_ir += resTemp[t][i];
+        }
     }
 
-    for (int i = 0; i < n; ++i)
+    double chi2 = 0;
+    for (int t = 0; t < num_threads; ++t)
     {
-        //#pragma omp critical
-        S.valuePtr()[S.outerIndexPtr()[i]].get() += diagBlocks[i];
+        chi2 += localChi2[t];
     }
-
-
-
-    //    if (optimizationOptions.debugOutput) std::cout << "chi2 " << chi2 << std::endl;
     return chi2;
 }
 
@@ -192,32 +202,30 @@ double PGORec::computeCost()
 {
     auto& scene = *_scene;
 
-    //    SAIGA_OPTIONAL_BLOCK_TIMER(optimizationOptions.debugOutput);
-    // using T          = BlockPGOScalar;
-    //    using KernelType = Saiga::Kernel::PGO<double>;
-
+    int tid         = OMP::getThreadNum();
+    int num_threads = OMP::getNumThreads();
 
-
-    double chi2 = 0;
-    for (size_t k = 0; k < scene.edges.size(); ++k)
+    double chi2local = 0;
+#pragma omp for
+    for (int k = 0; k < (int)scene.edges.size(); ++k)
     {
         auto& e = scene.edges[k];
         int i   = e.from;
         int j   = e.to;
 
+        Vec6 res = relPoseError(e.GetSE3(), x_u[i], x_u[j], e.weight, e.weight);
 
-        {
-            //            KernelType::PoseJacobiType Jrowi, Jrowj;
-            //            KernelType::ResidualType res;
-            //            KernelType::evaluateResidual(e.GetSE3(), x_u[i], x_u[j], res, e.weight);
-
-            //  Eigen::Matrix<double, 6, 6> Ji, Jj;
+        auto c = res.squaredNorm();
+        chi2local += c;
+    }
+    localChi2[tid] = chi2local;
 
-            Vec6 res = relPoseError(e.GetSE3(), x_u[i], x_u[j], e.weight, e.weight);
+#pragma omp barrier
 
-            auto c = res.squaredNorm();
-            chi2 += c;
-        }
+    double chi2 = 0;
+    for (int t = 0; t < num_threads; ++t)
+    {
+        chi2 += localChi2[t];
     }
     return chi2;
 }
@@ -225,6 +233,7 @@ double PGORec::computeCost()
 void PGORec::addLambda(double lambda)
 {
     // apply lm
+#pragma omp for
     for (int i = 0; i < n; ++i)
     {
         auto& d = S.valuePtr()[S.outerIndexPtr()[i]].get();
@@ -235,21 +244,14 @@ void PGORec::addLambda(double lambda)
 bool PGORec::addDelta()
 {
     auto& scene = *_scene;
-    oldx_u      = x_u;
 
+#pragma omp for
     for (int i = 0; i < n; ++i)
     {
+        oldx_u[i] = x_u[i];
         if (scene.vertices[i].constant) continue;
         auto t = delta_x(i).get();
-        //#ifdef PGO_SIM3
-        //        if (scene.fixScale) t[6] = 0;
-        //#endif
-
-        //        std::cout << t.transpose() << std::endl;
-        //        x_u[i] = PGOTransformation::exp(t) * x_u[i];
         x_u[i] = Sophus::se3_expd(t) * x_u[i];
-        //        Sophus::decoupled_inc(t, x_u[i]);
-        //        x_u[i] = x_u[i] * PGOTransformation::exp(t);
     }
     return true;
 }
@@ -266,22 +268,34 @@ void PGORec::solveLinearSystem()
     loptions.solverType = (optimizationOptions.solverType == OptimizationOptions::SolverType::Direct)
                               ? LinearSolverOptions::SolverType::Direct
                               : LinearSolverOptions::SolverType::Iterative;
+    loptions.ordering   = (LinearSolverOptions::Ordering)optimizationOptions.ordering;
+    loptions.preconditioner = (LinearSolverOptions::Preconditioner)optimizationOptions.preconditioner;
+    loptions.clusterSize    = optimizationOptions.clusterSize;
+    loptions.inexactNewton  = optimizationOptions.inexactNewton;
 
-
-    solver.solve(S, delta_x, b, loptions);
+    if (OMP::getNumThreads() == 1)
+    {
+        solver.solve(S, delta_x, b, loptions);
+    }
+    else
+    {
+        solver.solve_omp(S, delta_x, b, loptions);
+    }
 }
 
 void PGORec::revertDelta()
 {
-    x_u = oldx_u;
+#pragma omp for
+    for (int i = 0; i < n; ++i)
+    {
+        x_u[i] = oldx_u[i];
+    }
 }
 void PGORec::finalize()
 {
     auto& scene = *_scene;
 
-    //    int i = 0;
-    //    for (auto& e : scene.poses)
-    //    {
+#pragma omp for
     for (int i = 0; i < n; ++i)
     {
         auto& p = scene.vertices[i];
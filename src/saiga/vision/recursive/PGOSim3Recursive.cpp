@@ -10,6 +10,7 @@
 #include "saiga/core/imgui/imgui.h"
 #include "saiga/core/time/timer.h"
 #include "saiga/core/util/Algorithm.h"
+#include "saiga/core/util/Thread/omp.h"
 #include "saiga/vision/kernels/PGO.h"
 #include "saiga/vision/kernels/Robust.h"
 #include "saiga/vision/util/HistogramImage.h"
@@ -75,6 +76,7 @@ void PGOSim3Rec::init()
     }
 
     // Precompute the offset in the sparse matrix for every edge
+    edgeOffsets.clear();
     edgeOffsets.reserve(scene.edges.size());
     std::vector<int> localOffsets(n, 1);
     for (auto& e : scene.edges)
@@ -92,6 +94,16 @@ void PGOSim3Rec::init()
         edgeOffsets.emplace_back(offseti);
     }
 
+    // ===== Threading Tmps ======
+    SAIGA_ASSERT(threads > 0);
+    localChi2.resize(threads);
+    diagTemp.resize(threads);
+    resTemp.resize(threads);
+    for (auto& a : diagTemp) a.resize(n);
+    for (auto& a : resTemp) a.resize(n);
+
+    solver.Init();
+
     // Create a sparsity histogram
     if (false && optimizationOptions.debugOutput)
     {
@@ -113,44 +125,36 @@ double PGOSim3Rec::computeQuadraticForm()
 {
     auto& scene = *_scene;
 
-    //    SAIGA_BLOCK_TIMER();
-    //    SAIGA_OPTIONAL_BLOCK_TIMER(optimizationOptions.debugOutput);
-    // using T          = BlockPGOScalar;
-    //    using KernelType = Saiga::Kernel::PGOSim3<double>;
-
-    b.setZero();
-
-    // set diagonal elements of S to zero
-    for (int i = 0; i < n; ++i)
-    {
-        S.valuePtr()[S.outerIndexPtr()[i]].get().setZero();
-    }
-
-    double chi2 = 0;
-    //#pragma omp parallel
+    // This function can be called from inside a parallel region (see LMOptimizer::solveOMP).
+    // Outside of a parallel region, the work sharing constructs are executed by the calling thread only.
+    int tid         = OMP::getThreadNum();
+    int num_threads = OMP::getNumThreads();
+    SAIGA_ASSERT(num_threads <= threads);
 
-    //        auto b2 = b;
-    AlignedVector<PGOBlock> diagBlocks(n);
+    // every thread has to zero its own local copy
+    auto& diagBlocks = diagTemp[tid];
+    auto& resBlocks  = resTemp[tid];
     for (int i = 0; i < n; ++i)
     {
         diagBlocks[i].setZero();
+        resBlocks[i].setZero();
     }
+
     double chi2local = 0;
-    //#pragma omp for
-    for (size_t k = 0; k < scene.edges.size(); ++k)
+#pragma omp for
+    for (int k = 0; k < (int)scene.edges.size(); ++k)
     {
         auto& e       = scene.edges[k];
         auto& offsets = edgeOffsets[k];
         int i         = e.from;
         int j         = e.to;
 
+        // Each edge has its own off diagonal element, so this can be written directly
         auto& target_ij = S.valuePtr()[offsets].get();
-        //            auto& target_ii = S.valuePtr()[S.outerIndexPtr()[i]].get();
-        //            auto& target_jj = S.valuePtr()[S.outerIndexPtr()[j]].get();
         auto& target_ii = diagBlocks[i];
         auto& target_jj = diagBlocks[j];
-        auto& target_ir = b(i).get();
-        auto& target_jr = b(j).get();
+        auto& target_ir = resBlocks[i];
+        auto& target_jr = resBlocks[j];
 
         {
             Eigen::Matrix<double, 7, 7> Jrowi, Jrowj;
@@ -164,44 +168,39 @@ double PGOSim3Rec::computeQuadraticForm()
             // JtJ
             target_ij = Jrowi.transpose() * Jrowj;
 
-            auto ii = (Jrowi.transpose() * Jrowi).eval();
-            auto jj = (Jrowj.transpose() * Jrowj).eval();
-            //#pragma omp critical
-            {
-                target_ii += ii;
-                target_jj += jj;
-            }
-            auto ir = Jrowi.transpose() * res;
-            auto jr = Jrowj.transpose() * res;
-            //#pragma omp critical
-            {
-                // Jtb
-                target_ir -= ir;
-                target_jr -= jr;
-            }
+            target_ii += Jrowi.transpose() * Jrowi;
+            target_jj += Jrowj.transpose() * Jrowj;
 
+            // Jtb
+            target_ir -= Jrowi.transpose() * res;
+            target_jr -= Jrowj.transpose() * res;
 
 
             chi2local += c;
         }
     }
+    localChi2[tid] = chi2local;
 
-    //#pragma omp atomic
-    chi2 += chi2local;
-    //#pragma omp critical
+    // Sum up the thread local diagonal blocks
+#pragma omp for
+    for (int i = 0; i < n; ++i)
     {
-        //            b += b2;
+        auto& target_ii = S.valuePtr()[S.outerIndexPtr()[i]].get();
+        auto& target_ir = b(i).get();
+        target_ii       = diagTemp[0][i];
+        target_ir       = resTemp[0][i];
+        for (int t = 1; t < num_threads; ++t)
+        {
+            target_ii += diagTemp[t][i];
+            target_ir += resTemp[t][i];
+        }
     }
 
-    for (int i = 0; i < n; ++i)
+    double chi2 = 0;
+    for (int t = 0; t < num_threads; ++t)
     {
-        //#pragma omp critical
-        S.valuePtr()[S.outerIndexPtr()[i]].get() += diagBlocks[i];
+        chi2 += localChi2[t];
     }
-
-
-
-    //    if (optimizationOptions.debugOutput) std::cout << "chi2 " << chi2 << std::endl;
     return chi2;
 }
 
@@ -210,21 +209,30 @@ double PGOSim3Rec::computeCost()
 {
     auto& scene = *_scene;
 
+    int tid         = OMP::getThreadNum();
+    int num_threads = OMP::getNumThreads();
 
-    double chi2 = 0;
-    for (size_t k = 0; k < scene.edges.size(); ++k)
+    double chi2local = 0;
+#pragma omp for
+    for (int k = 0; k < (int)scene.edges.size(); ++k)
     {
         auto& e = scene.edges[k];
         int i   = e.from;
         int j   = e.to;
 
+        Vec7 res = relPoseError(e.T_i_j, x_u[i], x_u[j], e.weight, e.weight);
 
-        {
-            Vec7 res = relPoseError(e.T_i_j, x_u[i], x_u[j], e.weight, e.weight);
+        auto c = res.squaredNorm();
+        chi2local += c;
+    }
+    localChi2[tid] = chi2local;
 
-            auto c = res.squaredNorm();
-            chi2 += c;
-        }
+#pragma omp barrier
+
+    double chi2 = 0;
+    for (int t = 0; t < num_threads; ++t)
+    {
+        chi2 += localChi2[t];
     }
     return chi2;
 }
@@ -232,6 +240,7 @@ double PGOSim3Rec::computeCost()
 void PGOSim3Rec::addLambda(double lambda)
 {
     // apply lm
+#pragma omp for
     for (int i = 0; i < n; ++i)
     {
         auto& d = S.valuePtr()[S.outerIndexPtr()[i]].get();
@@ -242,10 +251,11 @@ void PGOSim3Rec::addLambda(double lambda)
 bool PGOSim3Rec::addDelta()
 {
     auto& scene = *_scene;
-    oldx_u      = x_u;
 
+#pragma omp for
     for (int i = 0; i < n; ++i)
     {
+        oldx_u[i] = x_u[i];
         if (scene.vertices[i].constant) continue;
         auto t = delta_x(i).get();
 
@@ -267,22 +277,34 @@ void PGOSim3Rec::solveLinearSystem()
     loptions.solverType = (optimizationOptions.solverType == OptimizationOptions::SolverType::Direct)
                               ? LinearSolverOptions::SolverType::Direct
                               : LinearSolverOptions::SolverType::Iterative;
+    loptions.ordering   = (LinearSolverOptions::Ordering)optimizationOptions.ordering;
+    loptions.preconditioner = (LinearSolverOptions::Preconditioner)optimizationOptions.preconditioner;
+    loptions.clusterSize    = optimizationOptions.clusterSize;
+    loptions.inexactNewton  = optimizationOptions.inexactNewton;
 
-
-    solver.solve(S, delta_x, b, loptions);
+    if (OMP::getNumThreads() == 1)
+    {
+        solver.solve(S, delta_x, b, loptions);
+    }
+    else
+    {
+        solver.solve_omp(S, delta_x, b, loptions);
+    }
 }
 
 void PGOSim3Rec::revertDelta()
 {
-    x_u = oldx_u;
+#pragma omp for
+    for (int i = 0; i < n; ++i)
+    {
+        x_u[i] = oldx_u[i];
+    }
 }
 void PGOSim3Rec::finalize()
 {
     auto& scene = *_scene;
 
-    //    int i = 0;
-    //    for (auto& e : scene.poses)
-    //    {
+#pragma omp for
     for (int i = 0; i < n; ++i)
     {
         auto& p = scene.vertices[i];
@@ -52,6 +52,13 @@ class SAIGA_VISION_API PGOSim3Rec : public PGOBase, public LMOptimizer
     std::vector<int> edgeOffsets;
     PoseGraph* _scene;
 
+    // ============= Multi Threading Stuff ===========
+    int threads = 1;
+    // each thread accumulates the diagonal blocks and the right hand side into its own vector
+    std::vector<AlignedVector<PGOBlock>> diagTemp;
+    std::vector<AlignedVector<PGOVector>> resTemp;
+    std::vector<double> localChi2;
+
     // ============== LM Functions ==============
 
     virtual void init() override;
@@ -62,6 +69,9 @@ class SAIGA_VISION_API PGOSim3Rec : public PGOBase, public LMOptimizer
     virtual void solveLinearSystem() override;
     virtual double computeCost() override;
     virtual void finalize() override;
+
+    virtual void setThreadCount(int n) override { threads = n; }
+    virtual bool supportOMP() override { return true; }
 };
 
 }  // namespace Saiga
@@ -9,6 +9,7 @@
 #include "saiga/core/imgui/imgui.h"
 #include "saiga/core/time/timer.h"
 #include "saiga/core/util/Algorithm.h"
+#include "saiga/core/util/Thread/omp.h"
 #include "saiga/vision/kernels/Robust.h"
 #include "saiga/vision/util/HistogramImage.h"
 #include "saiga/vision/util/LM.h"
@@ -72,6 +73,7 @@ void RecursiveArap::init()
     }
 
     // Precompute the offset in the sparse matrix for every edge
+    edgeOffsets.clear();
     edgeOffsets.reserve(scene.constraints.size());
     std::vector<int> localOffsets(n, 1);
     for (auto& e : scene.constraints)
@@ -105,32 +107,48 @@ void RecursiveArap::init()
         img.writeBinary("arap.png");
     }
 #endif
+
+    // ===== Threading Tmps ======
+    SAIGA_ASSERT(threads > 0);
+    localChi2.resize(threads);
+    diagTemp.resize(threads);
+    resTemp.resize(threads);
+    for (auto& a : diagTemp) a.resize(n);
+    for (auto& a : resTemp) a.resize(n);
+
+    solver.Init();
 }
 
 double RecursiveArap::computeQuadraticForm()
 {
     auto& scene = *arap;
 
+    // This function can be called from inside a parallel region (see LMOptimizer::solveOMP).
+    // Outside of a parallel region, the work sharing constructs are executed by the calling thread only.
+    int tid         = OMP::getThreadNum();
+    int num_threads = OMP::getNumThreads();
+    SAIGA_ASSERT(num_threads <= threads);
 
-    b.setZero();
-
-    // set diagonal elements of S to zero
+    // every thread has to zero its own local copy
+    auto& diagBlocks = diagTemp[tid];
+    auto& resBlocks  = resTemp[tid];
     for (int i = 0; i < n; ++i)
     {
-        S.valuePtr()[S.outerIndexPtr()[i]].get().setZero();
+        diagBlocks[i].setZero();
+        resBlocks[i].setZero();
     }
 
-
     double chi2 = 0;
 
     // Add targets
+#pragma omp for nowait
     for (int k = 0; k < (int)scene.target_indices.size(); ++k)
     {
         int i = scene.target_indices[k];
 
 
-        auto& target_ii = S.valuePtr()[S.outerIndexPtr()[i]].get();
-        auto& target_ir = b(i).get();
+        auto& target_ii = diagBlocks[i];
+        auto& target_ir = resBlocks[i];
 
         auto p = x_u[i];
         auto t = scene.target_positions[k];
@@ -153,7 +171,8 @@ double RecursiveArap::computeQuadraticForm()
     }
 
 
-    for (size_t k = 0; k < scene.constraints.size(); ++k)
+#pragma omp for
+    for (int k = 0; k < (int)scene.constraints.size(); ++k)
     {
         auto& e       = scene.constraints[k];
         auto& offsets = edgeOffsets[k];
@@ -162,11 +181,12 @@ double RecursiveArap::computeQuadraticForm()
 
         double w_Reg = sqrt(e.weight);
 
+        // Each constraint has its own off diagonal element, so this can be written directly
         auto& target_ij = S.valuePtr()[offsets].get();
-        auto& target_ii = S.valuePtr()[S.outerIndexPtr()[i]].get();
-        auto& target_jj = S.valuePtr()[S.outerIndexPtr()[j]].get();
-        auto& target_ir = b(i).get();
-        auto& target_jr = b(j).get();
+        auto& target_ii = diagBlocks[i];
+        auto& target_jj = diagBlocks[j];
+        auto& target_ir = resBlocks[i];
+        auto& target_jr = resBlocks[j];
 
 
         auto pHat = x_u[i];
@@ -225,13 +245,35 @@ double RecursiveArap::computeQuadraticForm()
             chi2 += c;
         }
     }
+    localChi2[tid] = chi2;
 
+    // Sum up the thread local diagonal blocks
+#pragma omp for
+    for (int i = 0; i < n; ++i)
+    {
+        auto& target_ii = S.valuePtr()[S.outerIndexPtr()[i]].get();
+        auto& target_ir = b(i).get();
+        target_ii       = diagTemp[0][i];
+        target_ir       = resTemp[0][i];
+        for (int t = 1; t < num_threads; ++t)
+        {
+            target_ii += diagTemp[t][i];
+            target_ir += resTemp[t][i];
+        }
+    }
+
+    chi2 = 0;
+    for (int t = 0; t < num_threads; ++t)
+    {
+        chi2 += localChi2[t];
+    }
     return chi2;
 }
 
 void RecursiveArap::addLambda(double lambda)
 {
     // apply lm
+#pragma omp for
     for (int i = 0; i < n; ++i)
     {
         auto& d = S.valuePtr()[S.outerIndexPtr()[i]].get();
@@ -241,16 +283,20 @@ void RecursiveArap::addLambda(double lambda)
 
 void RecursiveArap::revertDelta()
 {
-    x_u = oldx_u;
+#pragma omp for
+    for (int i = 0; i < n; ++i)
+    {
+        x_u[i] = oldx_u[i];
+    }
 }
 
 bool RecursiveArap::addDelta()
 {
-    oldx_u = x_u;
-
+#pragma omp for
     for (int i = 0; i < n; ++i)
     {
-        auto t = delta_x(i).get();
+        oldx_u[i] = x_u[i];
+        auto t    = delta_x(i).get();
         x_u[i] = x_u[i] * SE3::exp(t);
     }
     return true;
@@ -267,18 +313,33 @@ void RecursiveArap::solveLinearSystem()
     loptions.solverType = (optimizationOptions.solverType == OptimizationOptions::SolverType::Direct)
                               ? LinearSolverOptions::SolverType::Direct
                               : LinearSolverOptions::SolverType::Iterative;
+    loptions.ordering   = (LinearSolverOptions::Ordering)optimizationOptions.ordering;
+    loptions.preconditioner = (LinearSolverOptions::Preconditioner)optimizationOptions.preconditioner;
+    loptions.clusterSize    = optimizationOptions.clusterSize;
+    loptions.inexactNewton  = optimizationOptions.inexactNewton;
 
 
 
-    solver.solve(S, delta_x, b, loptions);
+    if (OMP::getNumThreads() == 1)
+    {
+        solver.solve(S, delta_x, b, loptions);
+    }
+    else
+    {
+        solver.solve_omp(S, delta_x, b, loptions);
+    }
 }
 
 double RecursiveArap::computeCost()
 {
     auto& scene = *arap;
 
+    int tid         = OMP::getThreadNum();
+    int num_threads = OMP::getNumThreads();
+
     double chi2 = 0;
 
+#pragma omp for nowait
     for (int k = 0; k < (int)scene.target_indices.size(); ++k)
     {
         int i    = scene.target_indices[k];
@@ -289,7 +350,8 @@ double RecursiveArap::computeCost()
         chi2 += c;
     }
 
-    for (size_t k = 0; k < scene.constraints.size(); ++k)
+#pragma omp for
+    for (int k = 0; k < (int)scene.constraints.size(); ++k)
     {
         auto& e = scene.constraints[k];
         int i   = e.ids.first;
@@ -311,6 +373,15 @@ double RecursiveArap::computeCost()
             chi2 += c;
         }
     }
+    localChi2[tid] = chi2;
+
+#pragma omp barrier
+
+    chi2 = 0;
+    for (int t = 0; t < num_threads; ++t)
+    {
+        chi2 += localChi2[t];
+    }
     return chi2;
 }
 
@@ -318,10 +389,10 @@ void RecursiveArap::finalize()
 {
     auto& scene = *arap;
 
-    int i = 0;
-    for (auto& e : scene.vertices)
+#pragma omp for
+    for (int i = 0; i < n; ++i)
     {
-        e = x_u[i++];
+        scene.vertices[i] = x_u[i];
     }
 }
 
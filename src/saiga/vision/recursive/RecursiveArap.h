@@ -42,6 +42,9 @@ class SAIGA_VISION_API RecursiveArap : public ArapBase, public LMOptimizer
     virtual double computeCost() override;
     virtual void finalize() override;
 
+    virtual void setThreadCount(int n) override { threads = n; }
+    virtual bool supportOMP() override { return true; }
+
    private:
     int n;
     PSType S;
@@ -50,6 +53,13 @@ class SAIGA_VISION_API RecursiveArap : public ArapBase, public LMOptimizer
     Eigen::Recursive::MixedSymmetricRecursiveSolver<PSType, PBType> solver;
     AlignedVector<SE3> x_u, oldx_u;
     std::vector<int> edgeOffsets;
+
+    // ============= Multi Threading Stuff ===========
+    int threads = 1;
+    // each thread accumulates the diagonal blocks and the right hand side into its own vector
+    std::vector<AlignedVector<PGOBlock>> diagTemp;
+    std::vector<AlignedVector<PGOVector>> resTemp;
+    std::vector<double> localChi2;
 };
 
 }  // namespace Saiga
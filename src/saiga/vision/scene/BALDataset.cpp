@@ -6,9 +6,9 @@
 
 #include "BALDataset.h"
 
+#include "saiga/core/util/TextParser.h"
 #include "saiga/core/util/assert.h"
 #include "saiga/core/util/file.h"
-#include "saiga/core/util/tostring.h"
 
 #include <fstream>
 
@@ -24,12 +24,22 @@ BALDataset::BALDataset(const std::string& file)
 {
     std::cout << "> Loading BALDataset " << file << std::endl;
 
-    auto data = File::loadFileStringArray(file);
+    File::MappedFile data(file);
+    SAIGA_ASSERT(data);
+    auto lines = File::lineOffsets(data.data(), data.size());
+    int n      = lines.size();
+
+    auto parser = [&](int line) {
+        SAIGA_ASSERT(line < n, "Unexpected end of BAL file.");
+        const char* end = line + 1 < n ? data.data() + lines[line + 1] : data.data() + data.size();
+        return TextParser(data.data() + lines[line], end);
+    };
 
     int num_cameras, num_points, num_observations;
 
-    std::stringstream in(data.front());
+    auto in = parser(0);
     in >> num_cameras >> num_points >> num_observations;
+    SAIGA_ASSERT(in);
 
     cameras.resize(num_cameras);
     observations.resize(num_observations);
@@ -41,9 +51,10 @@ BALDataset::BALDataset(const std::string& file)
 #pragma omp parallel for
     for (int i = 0; i < num_observations; ++i)
     {
-        std::stringstream in(data[start + i]);
+        auto in = parser(start + i);
         BALObservation o;
         in >> o.camera_index >> o.point_index >> o.point[0] >> o.point[1];
+        SAIGA_ASSERT(in);
         observations[i] = (o);
     }
 
@@ -55,18 +66,26 @@ BALDataset::BALDataset(const std::string& file)
         Vec3 r;
         Vec3 t;
 
+        // One value per line
+        auto value = [&](int k) {
+            double d;
+            auto in = parser(start + i * 9 + k);
+            in >> d;
+            SAIGA_ASSERT(in);
+            return d;
+        };
 
-        r(0) = Saiga::to_double(data[start + i * 9 + 0]);
-        r(1) = Saiga::to_double(data[start + i * 9 + 1]);
-        r(2) = Saiga::to_double(data[start + i * 9 + 2]);
+        r(0) = value(0);
+        r(1) = value(1);
+        r(2) = value(2);
 
-        t(0) = Saiga::to_double(data[start + i * 9 + 3]);
-        t(1) = Saiga::to_double(data[start + i * 9 + 4]);
-        t(2) = Saiga::to_double(data[start + i * 9 + 5]);
+        t(0) = value(3);
+        t(1) = value(4);
+        t(2) = value(5);
 
-        c.f  = Saiga::to_double(data[start + i * 9 + 6]);
-        c.k1 = Saiga::to_double(data[start + i * 9 + 7]);
-        c.k2 = Saiga::to_double(data[start + i * 9 + 8]);
+        c.f  = value(6);
+        c.k1 = value(7);
+        c.k2 = value(8);
 
         auto angle           = r.norm();
         Eigen::Vector3d axis = angle > 0.00001 ? r / angle : Eigen::Vector3d(0, 1, 0);
@@ -81,9 +100,12 @@ BALDataset::BALDataset(const std::string& file)
     {
         BALPoint p;
 
-        p.point(0) = Saiga::to_double(data[start + i * 3 + 0]);
-        p.point(1) = Saiga::to_double(data[start + i * 3 + 1]);
-        p.point(2) = Saiga::to_double(data[start + i * 3 + 2]);
+        for (int k = 0; k < 3; ++k)
+        {
+            auto in = parser(start + i * 3 + k);
+            in >> p.point(k);
+            SAIGA_ASSERT(in);
+        }
 
 
         points[i] = (p);
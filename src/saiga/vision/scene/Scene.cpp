@@ -6,6 +6,8 @@
 
 #include "Scene.h"
 
+#include "SceneObservations.h"
+
 #include "saiga/core/imgui/imgui.h"
 #include "saiga/core/util/assert.h"
 #include "saiga/vision/kernels/PGO.h"
@@ -102,6 +104,34 @@ double Scene::residualNorm2(const SceneImage& img, const StereoImagePoint& ip)
         return residual2(img, ip).squaredNorm();
 }
 
+double Scene::residualNorm2(const SceneObservations& obs, int o)
+{
+    const SceneImage& img = images[obs.imageId[o]];
+
+    Vec3 p = img.se3 * worldPoints[obs.pointId[o]].p;
+    auto z = p(2);
+
+    Vec2 p_norm = p.head<2>() / z;
+
+    if (!distortion.empty())
+    {
+        p_norm = distortNormalizedPoint(p_norm, distortion[img.intr]);
+    }
+
+    auto p_img = intrinsics[img.intr].normalizedToImage(p_norm);
+
+    auto w       = obs.weight[o] * scale();
+    double res_2 = ((obs.point[o] - p_img) * w).squaredNorm();
+
+    if (obs.IsStereoOrDepth(o))
+    {
+        auto disparity = p_img(0) - bf / z;
+        double res_d   = (obs.GetStereoPoint(o, bf) - disparity) * w;
+        res_2 += res_d * res_d;
+    }
+    return res_2;
+}
+
 double Scene::depth(const SceneImage& img, const StereoImagePoint& ip)
 {
     WorldPoint& wp = worldPoints[ip.wp];
@@ -270,6 +300,24 @@ void Scene::removeOutliers(float threshold)
     fixWorldPointReferences();
 }
 
+void Scene::removeOutliers(const SceneObservations& obs, float threshold)
+{
+    int pointsRemoved = 0;
+#pragma omp parallel for reduction(+ : pointsRemoved)
+    for (int o = 0; o < obs.size(); ++o)
+    {
+        if (obs.outlier[o]) continue;
+        double r = std::sqrt(residualNorm2(obs, o));
+        if (r > threshold)
+        {
+            // Every observation references a different image point -> no race
+            images[obs.imageId[o]].stereoPoints[obs.imagePointId[o]].wp = -1;
+            pointsRemoved++;
+        }
+    }
+    fixWorldPointReferences();
+}
+
 void Scene::removeWorldPoint(int id)
 {
     SAIGA_ASSERT(id >= 0 && id < (int)worldPoints.size());
@@ -427,6 +475,33 @@ double Scene::chi2(double huber)
     return error;
 }
 
+double Scene::chi2(const SceneObservations& obs, double huber)
+{
+    double error = 0;
+
+#pragma omp parallel for reduction(+ : error)
+    for (int o = 0; o < obs.size(); ++o)
+    {
+        if (obs.outlier[o]) continue;
+        double res_2 = residualNorm2(obs, o);
+
+        if (huber > 0)
+        {
+            auto rw = Kernel::HuberLoss<double>(huber, res_2);
+            res_2   = rw(0);
+        }
+        error += res_2;
+    }
+
+    for (auto& rpc : rel_pose_constraints)
+    {
+        auto& p1 = images[rpc.img1].se3;
+        auto& p2 = images[rpc.img2].se3;
+        error += rpc.Residual(p1, p2).squaredNorm();
+    }
+    return error;
+}
+
 
 double Scene::rms()
 {
@@ -479,36 +554,27 @@ void Scene::rmsPrint()
 
 double Scene::getSchurDensity()
 {
-    std::vector<std::vector<int>> schurStructure;
-
-    auto imgs = validImages();
-    long n    = images.size();
+    // The block (i,j) of S is non-zero if image i and j observe a common world point.
+    long n = images.size();
+    std::vector<int> marker(n, -1);
 
-    schurStructure.clear();
-    schurStructure.resize(n, std::vector<int>(n, -1));
-    for (auto& wp : worldPoints)
+    long schurEdges = 0;
+    for (int i = 0; i < n; ++i)
     {
-        for (auto& ref : wp.stereoreferences)
+        for (auto& ip : images[i].stereoPoints)
         {
-            for (auto& ref2 : wp.stereoreferences)
+            if (ip.wp == -1) continue;
+            for (auto& ref : worldPoints[ip.wp].stereoreferences)
             {
-                int i1 = imgs[ref.first];
-                int i2 = imgs[ref2.first];
-
-                schurStructure[i1][ref2.first] = ref2.first;
-                schurStructure[i2][ref.first]  = ref.first;
+                if (marker[ref.first] != i)
+                {
+                    marker[ref.first] = i;
+                    schurEdges++;
+                }
             }
         }
     }
 
-    // compact it
-    long schurEdges = 0;
-    for (auto& v : schurStructure)
-    {
-        v.erase(std::remove(v.begin(), v.end(), -1), v.end());
-        schurEdges += v.size();
-    }
-
     double density = double(schurEdges) / double(n * n);
     return density;
 }
@@ -16,6 +16,8 @@
 
 namespace Saiga
 {
+struct SceneObservations;
+
 struct SAIGA_VISION_API WorldPoint
 {
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -195,6 +197,9 @@ class SAIGA_VISION_API Scene
     Vec2 residual2(const SceneImage& img, const StereoImagePoint& ip);
     double depth(const SceneImage& img, const StereoImagePoint& ip);
 
+    // Squared residual of observation o in the flattened observation store.
+    double residualNorm2(const SceneObservations& obs, int o);
+
     // Apply a rigid transformation to the complete scene
     void transformScene(const SE3& transform);
     void rescale(double s = 1);
@@ -208,12 +213,15 @@ class SAIGA_VISION_API Scene
     explicit operator bool() const { return valid(); }
 
     double chi2(double huber = 0);
+    // Same as chi2() above, but streams through the flattened observations.
+    // 'obs' must be up to date (see SceneObservations).
+    double chi2(const SceneObservations& obs, double huber = 0);
     double rms();
     void rmsPrint();
 
     /**
-     * Compute the non-zero density of the schur complement S.
-     * This call is pretty expensive.
+     * Compute the non-zero (block) density of the schur complement S.
+     * Linear in the number of observations times the average number of observations per world point.
      */
     double getSchurDensity();
     double scale() { return globalScale; }
@@ -241,6 +249,9 @@ class SAIGA_VISION_API Scene
     Saiga::Statistics<double> depthStatistics();
     void removeOutliersFactor(float factor);
     void removeOutliers(float th);
+    // Same as removeOutliers(th), but streams through the flattened observations.
+    // 'obs' is outdated afterwards and has to be rebuilt.
+    void removeOutliers(const SceneObservations& obs, float th);
     // removes all references to this worldpoint
     void removeWorldPoint(int id);
     void removeCamera(int id);
@@ -257,7 +268,13 @@ class SAIGA_VISION_API Scene
     // returns true if the scene was changed by a user action
     bool imgui();
     void save(const std::string& file);
+    // Text and binary scene files are detected automatically.
     void load(const std::string& file);
+
+    // Compact binary format. Much faster to save and load than the text format, because the file is memory
+    // mapped and copied without any parsing. Relative pose constraints are not stored (same as the text format).
+    void saveBinary(const std::string& file);
+    void loadBinary(const std::string& file);
     double chi2Huber(double huber);
 };
 
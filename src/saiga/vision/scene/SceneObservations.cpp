@@ -0,0 +1,115 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "SceneObservations.h"
+
+#include "saiga/core/util/assert.h"
+
+namespace Saiga
+{
+void SceneObservations::build(const Scene& scene)
+{
+    std::vector<int> ids;
+    ids.reserve(scene.images.size());
+    for (int i = 0; i < (int)scene.images.size(); ++i)
+    {
+        if (scene.images[i]) ids.push_back(i);
+    }
+    build(scene, ids);
+}
+
+void SceneObservations::build(const Scene& scene, const std::vector<int>& sceneImageIds)
+{
+    images = sceneImageIds;
+    imageOffsets.resize(images.size() + 1);
+    imageOffsets[0] = 0;
+    for (int i = 0; i < (int)images.size(); ++i)
+    {
+        int count = 0;
+        for (auto& ip : scene.images[images[i]].stereoPoints)
+        {
+            if (ip.wp != -1) count++;
+        }
+        imageOffsets[i + 1] = imageOffsets[i] + count;
+    }
+
+    int n = imageOffsets.back();
+    point.resize(n);
+    depth.resize(n);
+    weight.resize(n);
+    outlier.resize(n);
+    imageId.resize(n);
+    pointId.resize(n);
+    imagePointId.resize(n);
+
+    for (int i = 0; i < (int)images.size(); ++i)
+    {
+        auto& img = scene.images[images[i]];
+        int o     = imageOffsets[i];
+        for (int j = 0; j < (int)img.stereoPoints.size(); ++j)
+        {
+            auto& ip = img.stereoPoints[j];
+            if (ip.wp == -1) continue;
+            point[o]        = ip.point;
+            depth[o]        = ip.depth;
+            weight[o]       = ip.weight;
+            outlier[o]      = ip.outlier;
+            imageId[o]      = images[i];
+            pointId[o]      = ip.wp;
+            imagePointId[o] = j;
+            ++o;
+        }
+    }
+
+    pointOffsets.clear();
+    pointObservations.clear();
+}
+
+void SceneObservations::updateValues(const Scene& scene)
+{
+    for (int o = 0; o < size(); ++o)
+    {
+        auto& ip = scene.images[imageId[o]].stereoPoints[imagePointId[o]];
+        SAIGA_ASSERT(ip.wp == pointId[o]);
+        point[o]   = ip.point;
+        depth[o]   = ip.depth;
+        weight[o]  = ip.weight;
+        outlier[o] = ip.outlier;
+    }
+}
+
+void SceneObservations::apply(Scene& scene) const
+{
+    for (int o = 0; o < size(); ++o)
+    {
+        auto& ip   = scene.images[imageId[o]].stereoPoints[imagePointId[o]];
+        ip.wp      = pointId[o];
+        ip.point   = point[o];
+        ip.depth   = depth[o];
+        ip.weight  = weight[o];
+        ip.outlier = outlier[o];
+    }
+}
+
+void SceneObservations::buildPointIndex(int numPoints)
+{
+    pointOffsets.assign(numPoints + 1, 0);
+    for (int o = 0; o < size(); ++o)
+    {
+        SAIGA_ASSERT(pointId[o] >= 0 && pointId[o] < numPoints);
+        pointOffsets[pointId[o] + 1]++;
+    }
+    for (int j = 0; j < numPoints; ++j) pointOffsets[j + 1] += pointOffsets[j];
+
+    pointObservations.resize(size());
+    std::vector<int> pos(pointOffsets.begin(), pointOffsets.end() - 1);
+    for (int o = 0; o < size(); ++o)
+    {
+        pointObservations[pos[pointId[o]]++] = o;
+    }
+}
+
+}  // namespace Saiga
@@ -0,0 +1,73 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/vision/scene/Scene.h"
+
+#include <vector>
+
+namespace Saiga
+{
+/**
+ * Flattened (structure of arrays) copy of all observations of a scene.
+ *
+ * The observations are grouped by image in CSR format. The observations of images[i] are
+ * o = imageOffsets[i] ... imageOffsets[i+1]-1. Optionally, an index grouped by world point can be built with
+ * buildPointIndex(). The point observations of world point j are then
+ * pointObservations[pointOffsets[j]] ... pointObservations[pointOffsets[j+1]-1].
+ *
+ * Compared to the nested SceneImage/StereoImagePoint structures, the hot loops of BA, Scene::chi2 and
+ * Scene::removeOutliers can stream through contiguous memory.
+ *
+ * All image points which reference a world point are stored, including outliers.
+ * The structure is not updated automatically. After changing image points or world point references of the scene
+ * build() must be called again. If only the values (point, depth, weight, outlier) changed, updateValues() is
+ * sufficient.
+ */
+struct SAIGA_VISION_API SceneObservations
+{
+    // ==== Per observation ====
+    AlignedVector<Vec2> point;
+    std::vector<double> depth;
+    std::vector<float> weight;
+    std::vector<char> outlier;
+    std::vector<int> imageId;
+    std::vector<int> pointId;
+    // Index into scene.images[imageId].stereoPoints
+    std::vector<int> imagePointId;
+
+    // ==== CSR by image ====
+    // Scene image id of every image in this structure
+    std::vector<int> images;
+    std::vector<int> imageOffsets;
+
+    // ==== CSR by world point (optional) ====
+    std::vector<int> pointOffsets;
+    std::vector<int> pointObservations;
+
+    // Builds the structure from all valid images.
+    void build(const Scene& scene);
+
+    // Builds the structure from the given images. The order of sceneImageIds is preserved.
+    void build(const Scene& scene, const std::vector<int>& sceneImageIds);
+
+    // Reloads the observation values from the scene. The structure must not have changed since build().
+    void updateValues(const Scene& scene);
+
+    // Writes the observation values back to the scene.
+    void apply(Scene& scene) const;
+
+    void buildPointIndex(int numPoints);
+
+    int size() const { return point.size(); }
+    int numImages() const { return images.size(); }
+
+    bool IsStereoOrDepth(int o) const { return depth[o] > 0; }
+    double GetStereoPoint(int o, double bf) const { return point[o](0) - bf / depth[o]; }
+};
+
+}  // namespace Saiga
@@ -5,12 +5,15 @@
  */
 
 #include "saiga/core/imgui/imgui.h"
+#include "saiga/core/util/TextParser.h"
 #include "saiga/core/util/assert.h"
+#include "saiga/core/util/file.h"
 #include "saiga/core/util/fileChecker.h"
 #include "saiga/vision/util/Random.h"
 
 #include "Scene.h"
 
+#include <cstring>
 #include <fstream>
 namespace Saiga
 {
@@ -119,80 +122,434 @@ void Scene::save(const std::string& file)
     }
 }
 
-void Scene::load(const std::string& file)
+namespace
 {
-    std::cout << "Loading scene from " << file << "." << std::endl;
+// ==== Binary scene format ====
+//
+// All sections are stored as flat arrays (structure of arrays) and are padded to 8 bytes.
+// Version 1:
+//   SceneBinaryHeader
+//   intrinsics   : double[num_intrinsics][5]
+//   distortion   : double[num_distortion][8]
+//   image pose   : double[num_images][7]
+//   velocity     : double[num_images][7]
+//   intr         : int32[num_images]
+//   constant     : uint8[num_images]
+//   obs offsets  : int64[num_images + 1]
+//   wp           : int32[num_observations]
+//   depth        : double[num_observations]
+//   point        : double[num_observations][2]
+//   weight       : float[num_observations]
+//   outlier      : uint8[num_observations]
+//   world points : double[num_worldPoints][3]
+//   constant     : uint8[num_worldPoints]
+struct SceneBinaryHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    int64_t num_intrinsics;
+    int64_t num_distortion;
+    int64_t num_images;
+    int64_t num_worldPoints;
+    int64_t num_observations;
+    double bf;
+    double globalScale;
+    double stereo_weight;
+};
+static_assert(sizeof(SceneBinaryHeader) == 80, "Unexpected header layout");
+
+constexpr char binaryMagic[8]    = {'S', 'A', 'I', 'G', 'A', 'S', 'C', 'N'};
+constexpr uint32_t binaryVersion = 1;
+
+bool isBinaryScene(const char* data, size_t size)
+{
+    return size >= sizeof(binaryMagic) && std::memcmp(data, binaryMagic, sizeof(binaryMagic)) == 0;
+}
 
-    (*this)       = Scene();
-    std::string f = SearchPathes::data(file);
-    if (f.empty())
+struct BinaryWriter
+{
+    std::ofstream& strm;
+    size_t offset = 0;
+
+    template <typename T>
+    void write(const std::vector<T>& v)
     {
-        std::cout << "could not find file " << file << std::endl;
-        std::cout << SearchPathes::data << std::endl;
-        return;
+        write(v.data(), v.size());
     }
 
-    std::ifstream strm(f);
-    SAIGA_ASSERT(strm.is_open());
+    template <typename T>
+    void write(const T* data, size_t n)
+    {
+        size_t bytes = n * sizeof(T);
+        strm.write((const char*)data, bytes);
+        offset += bytes;
+        static const char zeros[8] = {};
+        size_t padding             = (8 - offset % 8) % 8;
+        strm.write(zeros, padding);
+        offset += padding;
+    }
+};
 
+struct BinaryReader
+{
+    const char* data;
+    size_t size;
+    size_t offset = 0;
+
+    template <typename T>
+    void read(std::vector<T>& v, size_t n)
+    {
+        v.resize(n);
+        read(v.data(), n);
+    }
+
+    template <typename T>
+    void read(T* dst, size_t n)
+    {
+        size_t bytes = n * sizeof(T);
+        SAIGA_ASSERT(offset + bytes <= size, "Unexpected end of binary scene file.");
+        std::memcpy(dst, data + offset, bytes);
+        offset += bytes;
+        offset += (8 - offset % 8) % 8;
+    }
+};
+
+void loadSceneBinary(Scene& scene, const char* data, size_t size)
+{
+    BinaryReader reader = {data, size};
+
+    SceneBinaryHeader header;
+    SAIGA_ASSERT(size >= sizeof(header));
+    std::memcpy(&header, data, sizeof(header));
+    SAIGA_ASSERT(isBinaryScene(header.magic, sizeof(header.magic)));
+    SAIGA_ASSERT(header.version == binaryVersion, "Unsupported binary scene version.");
+    reader.offset = header.header_size;
+
+    scene.bf            = header.bf;
+    scene.globalScale   = header.globalScale;
+    scene.stereo_weight = header.stereo_weight;
+
+    int num_images = header.num_images;
+    int num_points = header.num_worldPoints;
+    size_t num_obs = header.num_observations;
 
-    auto consumeComment = [&]() {
-        while (true)
+    {
+        std::vector<double> coeffs;
+        reader.read(coeffs, header.num_intrinsics * 5);
+        scene.intrinsics.resize(header.num_intrinsics);
+        for (int i = 0; i < header.num_intrinsics; ++i) scene.intrinsics[i] = Vec5(Vec5::Map(coeffs.data() + i * 5));
+
+        reader.read(coeffs, header.num_distortion * 8);
+        scene.distortion.resize(header.num_distortion);
+        for (int i = 0; i < header.num_distortion; ++i)
+            scene.distortion[i] = Distortion(Eigen::Matrix<double, 8, 1>::Map(coeffs.data() + i * 8));
+    }
+
+    std::vector<double> pose, velocity;
+    std::vector<int32_t> intr;
+    std::vector<uint8_t> constant;
+    std::vector<int64_t> offsets;
+    reader.read(pose, num_images * 7);
+    reader.read(velocity, num_images * 7);
+    reader.read(intr, num_images);
+    reader.read(constant, num_images);
+    reader.read(offsets, num_images + 1);
+    SAIGA_ASSERT(offsets.front() == 0 && size_t(offsets.back()) == num_obs);
+
+    std::vector<int32_t> wp;
+    std::vector<double> depth, point;
+    std::vector<float> weight;
+    std::vector<uint8_t> outlier;
+    reader.read(wp, num_obs);
+    reader.read(depth, num_obs);
+    reader.read(point, num_obs * 2);
+    reader.read(weight, num_obs);
+    reader.read(outlier, num_obs);
+
+    std::vector<double> wp_position;
+    std::vector<uint8_t> wp_constant;
+    reader.read(wp_position, num_points * 3);
+    reader.read(wp_constant, num_points);
+
+    scene.images.resize(num_images);
+    scene.worldPoints.resize(num_points);
+
+#pragma omp parallel
+    {
+#pragma omp for
+        for (int i = 0; i < num_images; ++i)
         {
-            auto c = strm.peek();
-            if (c == '#')
+            auto& img = scene.images[i];
+            Eigen::Map<Sophus::Vector<double, SE3::num_parameters>>(img.se3.data()) =
+                Sophus::Vector<double, SE3::num_parameters>::Map(pose.data() + i * 7);
+            Eigen::Map<Sophus::Vector<double, SE3::num_parameters>>(img.velocity.data()) =
+                Sophus::Vector<double, SE3::num_parameters>::Map(velocity.data() + i * 7);
+            img.intr     = intr[i];
+            img.constant = constant[i];
+
+            img.stereoPoints.resize(offsets[i + 1] - offsets[i]);
+            for (int64_t o = offsets[i]; o < offsets[i + 1]; ++o)
             {
-                std::string s;
-                std::getline(strm, s);
-            }
-            else
-            {
-                break;
+                auto& ip   = img.stereoPoints[o - offsets[i]];
+                ip.wp      = wp[o];
+                ip.depth   = depth[o];
+                ip.point   = Vec2(point[o * 2], point[o * 2 + 1]);
+                ip.weight  = weight[o];
+                ip.outlier = outlier[o];
             }
         }
+
+#pragma omp for
+        for (int i = 0; i < num_points; ++i)
+        {
+            scene.worldPoints[i].p        = Vec3(Vec3::Map(wp_position.data() + i * 3));
+            scene.worldPoints[i].constant = wp_constant[i];
+        }
+    }
+}
+
+void loadSceneText(Scene& scene, const char* data, size_t size)
+{
+    auto lines = File::lineOffsets(data, size);
+    int n      = lines.size();
+
+    auto parser = [&](int line) {
+        SAIGA_ASSERT(line < n, "Unexpected end of scene file.");
+        const char* end = line + 1 < n ? data + lines[line + 1] : data + size;
+        return TextParser(data + lines[line], end);
     };
 
+    // The header is followed by one line per intrinsics and one header line per image with the number of
+    // observation lines that follow it. The start of each image is computed sequentially, the observations
+    // and world points are parsed in parallel.
+    int line = 0;
+    while (line < n && data[lines[line]] == '#') line++;
 
-    consumeComment();
     int num_intrinsics, num_images, num_worldPoints;
-    strm >> num_intrinsics >> num_images >> num_worldPoints >> bf >> globalScale;
-    intrinsics.resize(num_intrinsics);
-    images.resize(num_images);
-    worldPoints.resize(num_worldPoints);
-    for (auto& i : intrinsics)
+    {
+        auto p = parser(line++);
+        p >> num_intrinsics >> num_images >> num_worldPoints >> scene.bf >> scene.globalScale;
+        SAIGA_ASSERT(p);
+    }
+    scene.intrinsics.resize(num_intrinsics);
+    scene.images.resize(num_images);
+    scene.worldPoints.resize(num_worldPoints);
+
+    for (auto& i : scene.intrinsics)
     {
         Vec5 test;
-        strm >> test;
+        auto p = parser(line++);
+        p >> test;
+        SAIGA_ASSERT(p);
         i = test;
     }
 
-
-    for (auto& img : images)
+    std::vector<int> imageLines(num_images);
+    for (int i = 0; i < num_images; ++i)
     {
+        auto& img = scene.images[i];
         Sophus::Vector<double, SE3::num_parameters> pose;
         Sophus::Vector<double, SE3::num_parameters> velocity;
-        strm >> img.constant >> pose >> velocity;
+        int numpoints;
 
+        auto p = parser(line++);
+        p >> img.constant >> pose >> velocity >> img.intr >> numpoints;
+        SAIGA_ASSERT(p);
 
-        Eigen::Map<Sophus::Vector<double, SE3::num_parameters>> pose_map(img.se3.data());
-        pose_map = pose;
+        Eigen::Map<Sophus::Vector<double, SE3::num_parameters>>(img.se3.data())      = pose;
+        Eigen::Map<Sophus::Vector<double, SE3::num_parameters>>(img.velocity.data()) = velocity;
 
-        Eigen::Map<Sophus::Vector<double, SE3::num_parameters>> velocity_map(img.velocity.data());
-        velocity_map = velocity;
+        img.stereoPoints.resize(numpoints);
+        imageLines[i] = line;
+        line += numpoints;
+    }
+    SAIGA_ASSERT(line + num_worldPoints <= n, "Unexpected end of scene file.");
 
+#pragma omp parallel
+    {
+#pragma omp for schedule(dynamic, 16)
+        for (int i = 0; i < num_images; ++i)
+        {
+            auto& img = scene.images[i];
+            for (int j = 0; j < (int)img.stereoPoints.size(); ++j)
+            {
+                auto& ip = img.stereoPoints[j];
+                auto p   = parser(imageLines[i] + j);
+                p >> ip.wp >> ip.depth >> ip.point >> ip.weight;
+                SAIGA_ASSERT(p);
+            }
+        }
 
-        int numpoints;
-        strm >> img.intr >> numpoints;
-        img.stereoPoints.resize(numpoints);
-        for (auto& ip : img.stereoPoints)
+#pragma omp for
+        for (int i = 0; i < num_worldPoints; ++i)
         {
-            strm >> ip.wp >> ip.depth >> ip.point >> ip.weight;
+            auto p = parser(line + i);
+            p >> scene.worldPoints[i].p;
+            SAIGA_ASSERT(p);
         }
     }
+}
 
-    for (auto& wp : worldPoints)
+}  // namespace
+
+void Scene::saveBinary(const std::string& file)
+{
+    SAIGA_ASSERT(valid());
+
+    std::cout << "Saving binary scene to " << file << "." << std::endl;
+    std::ofstream strm(file, std::ios::binary);
+    SAIGA_ASSERT(strm.is_open());
+
+    int num_images = images.size();
+    int num_points = worldPoints.size();
+
+    std::vector<int64_t> offsets(num_images + 1, 0);
+    for (int i = 0; i < num_images; ++i) offsets[i + 1] = offsets[i] + images[i].stereoPoints.size();
+    size_t num_obs = offsets.back();
+
+    SceneBinaryHeader header;
+    std::memcpy(header.magic, binaryMagic, sizeof(binaryMagic));
+    header.version          = binaryVersion;
+    header.header_size      = sizeof(SceneBinaryHeader);
+    header.num_intrinsics   = intrinsics.size();
+    header.num_distortion   = distortion.size();
+    header.num_images       = num_images;
+    header.num_worldPoints  = num_points;
+    header.num_observations = num_obs;
+    header.bf               = bf;
+    header.globalScale      = globalScale;
+    header.stereo_weight    = stereo_weight;
+
+    BinaryWriter writer = {strm};
+    writer.write(&header, 1);
+
+    std::vector<double> coeffs;
+    for (auto& i : intrinsics)
+    {
+        Vec5 c = i.coeffs();
+        coeffs.insert(coeffs.end(), c.data(), c.data() + 5);
+    }
+    writer.write(coeffs);
+
+    coeffs.clear();
+    for (auto& d : distortion)
+    {
+        Eigen::Matrix<double, 8, 1> c = d.Coeffs();
+        coeffs.insert(coeffs.end(), c.data(), c.data() + 8);
+    }
+    writer.write(coeffs);
+
+    std::vector<double> pose(num_images * 7), velocity(num_images * 7);
+    std::vector<int32_t> intr(num_images);
+    std::vector<uint8_t> constant(num_images);
+
+    std::vector<int32_t> wp(num_obs);
+    std::vector<double> depth(num_obs), point(num_obs * 2);
+    std::vector<float> weight(num_obs);
+    std::vector<uint8_t> outlier(num_obs);
+
+    std::vector<double> wp_position(num_points * 3);
+    std::vector<uint8_t> wp_constant(num_points);
+
+#pragma omp parallel
+    {
+#pragma omp for
+        for (int i = 0; i < num_images; ++i)
+        {
+            auto& img = images[i];
+            for (int k = 0; k < 7; ++k)
+            {
+                pose[i * 7 + k]     = img.se3.data()[k];
+                velocity[i * 7 + k] = img.velocity.data()[k];
+            }
+            intr[i]     = img.intr;
+            constant[i] = img.constant;
+
+            for (int64_t o = offsets[i]; o < offsets[i + 1]; ++o)
+            {
+                auto& ip         = img.stereoPoints[o - offsets[i]];
+                wp[o]            = ip.wp;
+                depth[o]         = ip.depth;
+                point[o * 2]     = ip.point(0);
+                point[o * 2 + 1] = ip.point(1);
+                weight[o]        = ip.weight;
+                outlier[o]       = ip.outlier;
+            }
+        }
+
+#pragma omp for
+        for (int i = 0; i < num_points; ++i)
+        {
+            auto& p                = worldPoints[i].p;
+            wp_position[i * 3 + 0] = p(0);
+            wp_position[i * 3 + 1] = p(1);
+            wp_position[i * 3 + 2] = p(2);
+            wp_constant[i]         = worldPoints[i].constant;
+        }
+    }
+
+    writer.write(pose);
+    writer.write(velocity);
+    writer.write(intr);
+    writer.write(constant);
+    writer.write(offsets);
+
+    writer.write(wp);
+    writer.write(depth);
+    writer.write(point);
+    writer.write(weight);
+    writer.write(outlier);
+
+    writer.write(wp_position);
+    writer.write(wp_constant);
+    SAIGA_ASSERT(strm.good());
+}
+
+void Scene::loadBinary(const std::string& file)
+{
+    std::cout << "Loading binary scene from " << file << "." << std::endl;
+
+    (*this)       = Scene();
+    std::string f = SearchPathes::data(file);
+    if (f.empty())
+    {
+        std::cout << "could not find file " << file << std::endl;
+        std::cout << SearchPathes::data << std::endl;
+        return;
+    }
+
+    File::MappedFile mapped(f);
+    SAIGA_ASSERT(mapped);
+    loadSceneBinary(*this, mapped.data(), mapped.size());
+
+    fixWorldPointReferences();
+    SAIGA_ASSERT(valid());
+}
+
+void Scene::load(const std::string& file)
+{
+    std::cout << "Loading scene from " << file << "." << std::endl;
+
+    (*this)       = Scene();
+    std::string f = SearchPathes::data(file);
+    if (f.empty())
+    {
+        std::cout << "could not find file " << file << std::endl;
+        std::cout << SearchPathes::data << std::endl;
+        return;
+    }
+
+    File::MappedFile mapped(f);
+    SAIGA_ASSERT(mapped);
+
+    if (isBinaryScene(mapped.data(), mapped.size()))
+    {
+        loadSceneBinary(*this, mapped.data(), mapped.size());
+    }
+    else
     {
-        strm >> wp.p;
+        loadSceneText(*this, mapped.data(), mapped.size());
     }
 
     fixWorldPointReferences();
@@ -19,7 +19,9 @@
 
 #include "saiga/core/time/all.h"
 #include "saiga/core/util/BinaryFile.h"
+#include "saiga/core/util/file.h"
 #include "saiga/vision/features/Features.h"
+#include "saiga/vision/features/HammingMatcher.h"
 
 #include <algorithm>
 #include <array>
@@ -27,9 +29,13 @@
 #include <cmath>
 #include <cstdlib>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
 #include <numeric>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -191,12 +197,27 @@ class TemplatedVocabulary
      */
     TemplatedVocabulary(const std::string& filename) { loadRaw(filename); }
 
+    struct TrainingParameters
+    {
+        /// Sibling subtrees are trained as omp tasks and the assignment step is split into task chunks.
+        int num_threads = 1;
+
+        /// If > 0, the k-means tree is trained on a random subset of this size. The weights are still computed
+        /// from all features.
+        size_t max_training_features = 0;
+
+        /// Seed of the per-node random generators. With num_threads > 1 or seed >= 0, every node uses its own
+        /// generator, so the result does not depend on the number of threads. Otherwise rand() is used like in DBoW2.
+        int64_t seed = -1;
+    };
+
     /**
      * Creates a vocabulary from the training features with the already
      * defined parameters
      * @param training_features
      */
-    void create(const std::vector<std::vector<Descriptor>>& training_features);
+    void create(const std::vector<std::vector<Descriptor>>& training_features,
+                const TrainingParameters& params = TrainingParameters());
 
     /**
      * Creates a vocabulary from the training features, setting the branching
@@ -212,17 +233,29 @@ class TemplatedVocabulary
         create(training_features);
     }
 
+    /**
+     * Sets the idf weights of the words from a set of documents (images).
+     * Can be used to train the tree on a subset and compute the weights on the full data set.
+     * The documents are loaded one by one with load_document(i, descriptors), so the full training set does not
+     * have to be in memory. With num_threads > 1, load_document is called from multiple threads.
+     * @param num_documents
+     * @param load_document
+     * @param num_threads
+     */
+    void setNodeWeights(int num_documents, const std::function<void(int, std::vector<Descriptor>&)>& load_document,
+                        int num_threads = 1);
+
     /**
      * Returns the number of words in the vocabulary
      * @return number of words
      */
-    inline unsigned int size() const { return m_words.size(); }
+    inline unsigned int size() const { return m_mapped ? mappedHeader().num_words : m_words.size(); }
 
     /**
      * Returns whether the vocabulary is empty (i.e. it has not been trained)
      * @return true iff the vocabulary is empty
      */
-    inline bool empty() const { return m_words.empty(); }
+    inline bool empty() const { return size() == 0; }
 
     /**
      * Transforms a set of descriptores into a bow vector
@@ -291,14 +324,20 @@ class TemplatedVocabulary
      * @param wid word id
      * @return descriptor
      */
-    inline Descriptor getWord(WordId wid) const { return m_words[wid]->descriptor; }
+    inline Descriptor getWord(WordId wid) const
+    {
+        return m_mapped ? flatDescriptors()[mappedWords()[wid]] : m_words[wid]->descriptor;
+    }
 
     /**
      * Returns the weight of a word
      * @param wid word id
      * @return weight
      */
-    inline WordValue getWordWeight(WordId wid) const { return m_words[wid]->weight; }
+    inline WordValue getWordWeight(WordId wid) const
+    {
+        return m_mapped ? flatNodes()[mappedWords()[wid]].weight : m_words[wid]->weight;
+    }
 
     /**
      * Changes the scoring method
@@ -310,6 +349,19 @@ class TemplatedVocabulary
     void saveRaw(const std::string& file) const;
     void loadRaw(const std::string& file);
 
+    /**
+     * Compiled vocabulary format, which is used by transform without any deserialization.
+     * The file contains the breadth-first tree (see compile()) and is memory mapped read-only by loadCompiled.
+     * Multiple processes that load the same file share the pages in the page cache.
+     *
+     * After loadCompiled only transform, score, size, getWord and getWordWeight are available. The functions that
+     * navigate the original tree (getParentNode, getWordsFromNode, saveRaw, ...) require loadRaw.
+     *
+     * The file uses the native byte order.
+     */
+    void saveCompiled(const std::string& file) const;
+    void loadCompiled(const std::string& file);
+
 
 
    protected:
@@ -378,16 +430,29 @@ class TemplatedVocabulary
      * @param descriptors descriptors to run the kmeans on
      * @param current_level current level in the tree
      */
-    void HKmeansStep(NodeId parent_id, const std::vector<pDescriptor>& descriptors, int current_level);
+    void HKmeansStep(NodeId parent_id, const std::vector<pDescriptor>& descriptors, int current_level,
+                     std::mt19937_64* generator, bool parallel);
+
+    /**
+     * Index of the cluster with the smallest distance. On equal distance the first cluster is used.
+     */
+    static int nearestCluster(const Descriptor& descriptor, const std::vector<Descriptor>& clusters);
+
+    /**
+     * Renumbers the nodes in breadth-first order.
+     * Used after training with per-node generators, where the node ids depend on the task schedule.
+     */
+    void sortNodesBreadthFirst();
 
     /**
      * Creates k clusters from the given descriptors with some seeding algorithm.
      * @note In this class, kmeans++ is used, but this function should be
      *   overriden by inherited classes.
      */
-    void initiateClusters(const std::vector<pDescriptor>& descriptors, std::vector<Descriptor>& clusters) const
+    void initiateClusters(const std::vector<pDescriptor>& descriptors, std::vector<Descriptor>& clusters,
+                          std::mt19937_64* generator) const
     {
-        initiateClustersKMpp(descriptors, clusters);
+        initiateClustersKMpp(descriptors, clusters, generator);
     }
 
     /**
@@ -396,20 +461,27 @@ class TemplatedVocabulary
      * @param descriptors
      * @param clusters resulting clusters
      */
-    void initiateClustersKMpp(const std::vector<pDescriptor>& descriptors, std::vector<Descriptor>& clusters) const;
+    void initiateClustersKMpp(const std::vector<pDescriptor>& descriptors, std::vector<Descriptor>& clusters,
+                              std::mt19937_64* generator) const;
 
     /**
      * Create the words of the vocabulary once the tree has been built
      */
     void createWords();
 
+    /**
+     * Builds the read-only layout of the tree that is used by transform.
+     * Must be called after the nodes have been created or loaded.
+     */
+    void compile();
+
     /**
      * Sets the weights of the nodes of tree according to the given features.
      * Before calling this function, the nodes and the words must be already
      * created (by calling HKmeansStep and createWords)
      * @param features
      */
-    void setNodeWeights(const std::vector<std::vector<Descriptor>>& features);
+    void setNodeWeights(const std::vector<std::vector<Descriptor>>& features, int num_threads = 1);
 
     /**
      * Returns a random number in the range [min..max]
@@ -418,8 +490,9 @@ class TemplatedVocabulary
      * @return random T number in [min..max]
      */
     template <class T>
-    static T RandomValue(T min, T max)
+    static T RandomValue(T min, T max, std::mt19937_64* generator = nullptr)
     {
+        if (generator) return std::uniform_real_distribution<T>(min, max)(*generator);
         return ((T)rand() / (T)RAND_MAX) * (max - min) + min;
     }
 
@@ -429,8 +502,9 @@ class TemplatedVocabulary
      * @param max
      * @return random int in [min..max]
      */
-    static int RandomInt(int min, int max)
+    static int RandomInt(int min, int max, std::mt19937_64* generator = nullptr)
     {
+        if (generator) return std::uniform_int_distribution<int>(min, max)(*generator);
         int d = max - min + 1;
         return int(((double)rand() / ((double)RAND_MAX + 1.0)) * d) + min;
     }
@@ -445,10 +519,59 @@ class TemplatedVocabulary
     /// Tree nodes
     std::vector<Node> m_nodes;
 
+    /// Number of used nodes during training. m_nodes is allocated for the full tree before.
+    int m_num_nodes = 0;
+
     /// Words of the vocabulary (tree leaves)
     /// this condition holds: m_words[wid]->word_id == wid
     std::vector<Node*> m_words;
 
+    /// Compiled tree in breadth-first order. The children of a node are stored consecutively, so that their
+    /// descriptors can be compared with a single call to hammingDistances.
+    struct FlatNode
+    {
+        /// Index of the first child in m_flat_nodes
+        int first_child;
+        /// 0 if the node is a leaf
+        int num_children;
+        NodeId id;
+        WordId word_id;
+        WordValue weight;
+    };
+    std::vector<FlatNode> m_flat_nodes;
+    std::vector<Descriptor> m_flat_descriptors;
+
+    struct CompiledHeader
+    {
+        char magic[8];
+        int version;
+        int k, L;
+        int num_nodes;
+        int num_words;
+        int node_size;
+        // Byte offsets from the beginning of the file
+        int64_t descriptor_offset;
+        int64_t word_offset;
+    };
+    static constexpr int compiled_version = 1;
+
+    /// Memory mapped file of loadCompiled. If set, the m_flat_* arrays are empty.
+    std::shared_ptr<Saiga::File::MappedFile> m_mapped;
+
+    const CompiledHeader& mappedHeader() const { return *(const CompiledHeader*)m_mapped->data(); }
+    const int* mappedWords() const { return (const int*)(m_mapped->data() + mappedHeader().word_offset); }
+
+    const FlatNode* flatNodes() const
+    {
+        return m_mapped ? (const FlatNode*)(m_mapped->data() + sizeof(CompiledHeader)) : m_flat_nodes.data();
+    }
+    const Descriptor* flatDescriptors() const
+    {
+        return m_mapped ? (const Descriptor*)(m_mapped->data() + mappedHeader().descriptor_offset)
+                        : m_flat_descriptors.data();
+    }
+    int numFlatNodes() const { return m_mapped ? mappedHeader().num_nodes : m_flat_nodes.size(); }
+
 
     mutable std::vector<std::pair<WordId, WordValue>> tmp_bow_data;
     mutable std::vector<std::pair<NodeId, int>> tmp_feature_data;
@@ -458,32 +581,61 @@ class TemplatedVocabulary
 // --------------------------------------------------------------------------
 
 template <class Descriptor>
-void TemplatedVocabulary<Descriptor>::create(const std::vector<std::vector<Descriptor>>& training_features)
+void TemplatedVocabulary<Descriptor>::create(const std::vector<std::vector<Descriptor>>& training_features,
+                                             const TrainingParameters& params)
 {
+    SAIGA_ASSERT(params.num_threads > 0);
     m_nodes.clear();
     m_words.clear();
 
     // expected_nodes = Sum_{i=0..L} ( k^i )
     int expected_nodes = (int)((std::pow((double)m_k, (double)m_L + 1) - 1) / (m_k - 1));
 
-    m_nodes.reserve(expected_nodes);  // avoid allocations when creating the tree
+    // The tree can not have more nodes, so the nodes can be created from multiple tasks without reallocation
+    m_nodes.resize(expected_nodes);
 
 
     std::vector<pDescriptor> features;
     getFeatures(training_features, features);
 
+    bool per_node_generators = params.num_threads > 1 || params.seed >= 0;
+    bool subsample           = params.max_training_features > 0 && features.size() > params.max_training_features;
+
+    // Without per-node generators and subsampling, the sequence of rand() is the same as in DBoW2
+    std::mt19937_64 generator;
+    if (per_node_generators || subsample) generator.seed(params.seed >= 0 ? params.seed : rand());
+
+    if (subsample)
+    {
+        std::shuffle(features.begin(), features.end(), generator);
+        features.resize(params.max_training_features);
+    }
 
     // create root
-    m_nodes.push_back(Node(0));  // root
+    m_nodes[0]  = Node(0);  // root
+    m_num_nodes = 1;
 
     // create the tree
-    HKmeansStep(0, features, 1);
+#pragma omp parallel num_threads(params.num_threads)
+    {
+#pragma omp single
+        {
+            HKmeansStep(0, features, 1, per_node_generators ? &generator : nullptr, params.num_threads > 1);
+        }
+    }
+    m_nodes.resize(m_num_nodes);
+
+    // the node ids depend on the task schedule
+    if (per_node_generators) sortNodesBreadthFirst();
 
     // create the words
     createWords();
 
+    // setNodeWeights uses transform, which requires the compiled tree
+    compile();
+
     // and set the weight of each node of the tree
-    setNodeWeights(training_features);
+    setNodeWeights(training_features, params.num_threads);
 }
 
 // --------------------------------------------------------------------------
@@ -508,12 +660,41 @@ void TemplatedVocabulary<Descriptor>::getFeatures(const std::vector<std::vector<
 
 // --------------------------------------------------------------------------
 
+template <class Descriptor>
+int TemplatedVocabulary<Descriptor>::nearestCluster(const Descriptor& descriptor,
+                                                    const std::vector<Descriptor>& clusters)
+{
+    std::array<int, 32> distances;
+
+    int best   = 0;
+    int best_d = std::numeric_limits<int>::max();
+    for (int begin = 0; begin < (int)clusters.size(); begin += distances.size())
+    {
+        int n = std::min<int>(clusters.size() - begin, distances.size());
+        Saiga::hammingDistances(descriptor, clusters.data() + begin, n, distances.data());
+        for (int c = 0; c < n; ++c)
+        {
+            if (distances[c] < best_d)
+            {
+                best_d = distances[c];
+                best   = begin + c;
+            }
+        }
+    }
+    return best;
+}
+
+// --------------------------------------------------------------------------
+
 template <class Descriptor>
 void TemplatedVocabulary<Descriptor>::HKmeansStep(NodeId parent_id, const std::vector<pDescriptor>& descriptors,
-                                                  int current_level)
+                                                  int current_level, std::mt19937_64* generator, bool parallel)
 {
     if (descriptors.empty()) return;
 
+    // Only large nodes are worth splitting into tasks
+    const int min_task_size = 2048;
+
     // features associated to each cluster
     std::vector<Descriptor> clusters;
     std::vector<std::vector<unsigned int>> groups;  // groups[i] = [j1, j2, ...]
@@ -522,11 +703,6 @@ void TemplatedVocabulary<Descriptor>::HKmeansStep(NodeId parent_id, const std::v
     clusters.reserve(m_k);
     groups.reserve(m_k);
 
-    // const int msizes[] = { m_k, descriptors.size() };
-    // cv::SparseMat assoc(2, msizes, CV_8U);
-    // cv::SparseMat last_assoc(2, msizes, CV_8U);
-    //// assoc.row(cluster_idx).col(descriptor_idx) = 1 iif associated
-
     if ((int)descriptors.size() <= m_k)
     {
         // trivial case: one cluster per feature
@@ -535,12 +711,7 @@ void TemplatedVocabulary<Descriptor>::HKmeansStep(NodeId parent_id, const std::v
         for (unsigned int i = 0; i < descriptors.size(); i++)
         {
             groups[i].push_back(i);
-
-#ifdef USE_CV_FORB
-            clusters.push_back(descriptors[i]->clone());
-#else
             clusters.push_back(*descriptors[i]);
-#endif
         }
     }
     else
@@ -553,6 +724,9 @@ void TemplatedVocabulary<Descriptor>::HKmeansStep(NodeId parent_id, const std::v
         // to check if clusters move after iterations
         std::vector<int> last_association, current_association;
 
+        int N                    = descriptors.size();
+        bool parallel_assignment = parallel && N >= min_task_size;
+
         while (goon)
         {
             // 1. Calculate clusters
@@ -560,71 +734,43 @@ void TemplatedVocabulary<Descriptor>::HKmeansStep(NodeId parent_id, const std::v
             if (first_time)
             {
                 // random sample
-                initiateClusters(descriptors, clusters);
+                initiateClusters(descriptors, clusters, generator);
             }
             else
             {
-                // calculate cluster centres
-
-                for (unsigned int c = 0; c < clusters.size(); ++c)
+                // calculate cluster centres (bit-wise majority vote)
+#ifndef WIN32
+#    pragma omp taskloop grainsize(1) shared(clusters, groups, descriptors) if (parallel_assignment)
+#endif
+                for (int c = 0; c < (int)clusters.size(); ++c)
                 {
-                    std::vector<pDescriptor> cluster_descriptors;
-                    cluster_descriptors.reserve(groups[c].size());
-
-                    /*
-                    for(unsigned int d = 0; d < descriptors.size(); ++d)
-                    {
-                      if( assoc.find<unsigned char>(c, d) )
-                      {
-                        cluster_descriptors.push_back(descriptors[d]);
-                      }
-                    }
-                    */
-
-                    std::vector<unsigned int>::const_iterator vit;
-                    for (vit = groups[c].begin(); vit != groups[c].end(); ++vit)
+                    if (groups[c].empty())
                     {
-                        cluster_descriptors.push_back(descriptors[*vit]);
+                        clusters[c] = {};
+                        continue;
                     }
-
-
-                    Saiga::MeanMatcher<Descriptor> mm;
-                    clusters[c] = mm.MeanDescriptorp(cluster_descriptors);
-                    //                    clusters[c] = F::meanValue(cluster_descriptors);
+                    Saiga::DescriptorBitCounter counter;
+                    for (auto i : groups[c]) counter.add(*descriptors[i]);
+                    clusters[c] = counter.majority();
                 }
-
             }  // if(!first_time)
 
             // 2. Associate features with clusters
+            current_association.resize(N);
+#ifndef WIN32
+#    pragma omp taskloop grainsize(min_task_size / 2) shared(current_association, clusters, descriptors) \
+        if (parallel_assignment)
+#endif
+            for (int i = 0; i < N; ++i)
+            {
+                current_association[i] = nearestCluster(*descriptors[i], clusters);
+            }
 
-            // calculate distances to cluster centers
             groups.clear();
             groups.resize(clusters.size(), std::vector<unsigned int>());
-            current_association.resize(descriptors.size());
-
-            // assoc.clear();
-
-            typename std::vector<pDescriptor>::const_iterator fit;
-            // unsigned int d = 0;
-            for (fit = descriptors.begin(); fit != descriptors.end(); ++fit)  //, ++d)
+            for (int i = 0; i < N; ++i)
             {
-                auto best_dist        = Saiga::distance(*(*fit), clusters[0]);
-                unsigned int icluster = 0;
-
-                for (unsigned int c = 1; c < clusters.size(); ++c)
-                {
-                    auto dist = Saiga::distance(*(*fit), clusters[c]);
-                    if (dist < best_dist)
-                    {
-                        best_dist = dist;
-                        icluster  = c;
-                    }
-                }
-
-                // assoc.ref<unsigned char>(icluster, d) = 1;
-
-                groups[icluster].push_back(fit - descriptors.begin());
-                current_association[fit - descriptors.begin()] = icluster;
+                groups[current_association[i]].push_back(i);
             }
 
             // kmeans++ ensures all the clusters has any feature associated with them
@@ -636,24 +782,13 @@ void TemplatedVocabulary<Descriptor>::HKmeansStep(NodeId parent_id, const std::v
             }
             else
             {
-                // goon = !eqUChar(last_assoc, assoc);
-
-                goon = false;
-                for (unsigned int i = 0; i < current_association.size(); i++)
-                {
-                    if (current_association[i] != last_association[i])
-                    {
-                        goon = true;
-                        break;
-                    }
-                }
+                goon = current_association != last_association;
             }
 
             if (goon)
             {
                 // copy last feature-cluster association
                 last_association = current_association;
-                // last_assoc = assoc.clone();
             }
 
         }  // while(goon)
@@ -661,12 +796,20 @@ void TemplatedVocabulary<Descriptor>::HKmeansStep(NodeId parent_id, const std::v
     }  // if must run kmeans
 
     // create nodes
+    int first_child;
+#pragma omp atomic capture
+    {
+        first_child = m_num_nodes;
+        m_num_nodes += (int)clusters.size();
+    }
+    SAIGA_ASSERT(m_num_nodes <= (int)m_nodes.size());
+
     for (unsigned int i = 0; i < clusters.size(); ++i)
     {
-        NodeId id = m_nodes.size();
-        m_nodes.push_back(Node(id));
-        m_nodes.back().descriptor = clusters[i];
-        m_nodes.back().parent     = parent_id;
+        NodeId id              = first_child + i;
+        m_nodes[id]            = Node(id);
+        m_nodes[id].descriptor = clusters[i];
+        m_nodes[id].parent     = parent_id;
         m_nodes[parent_id].children.push_back(id);
     }
 
@@ -674,33 +817,72 @@ void TemplatedVocabulary<Descriptor>::HKmeansStep(NodeId parent_id, const std::v
     if (current_level < m_L)
     {
         // iterate again with the resulting clusters
-        const std::vector<NodeId>& children_ids = m_nodes[parent_id].children;
         for (unsigned int i = 0; i < clusters.size(); ++i)
         {
-            NodeId id = children_ids[i];
+            // drawn in a fixed order, so that the result does not depend on the task schedule
+            uint64_t child_seed = generator ? (*generator)() : 0;
+            if (groups[i].size() <= 1) continue;
 
-            std::vector<pDescriptor> child_features;
-            child_features.reserve(groups[i].size());
-
-            std::vector<unsigned int>::const_iterator vit;
-            for (vit = groups[i].begin(); vit != groups[i].end(); ++vit)
+            NodeId id = first_child + i;
+#ifndef WIN32
+#    pragma omp task default(shared) firstprivate(i, id, child_seed) if (parallel && (int)groups[i].size() >= min_task_size)
+#endif
             {
-                child_features.push_back(descriptors[*vit]);
-            }
+                std::vector<pDescriptor> child_features;
+                child_features.reserve(groups[i].size());
+                for (auto j : groups[i])
+                {
+                    child_features.push_back(descriptors[j]);
+                }
 
-            if (child_features.size() > 1)
-            {
-                HKmeansStep(id, child_features, current_level + 1);
+                std::mt19937_64 child_generator(child_seed);
+                HKmeansStep(id, child_features, current_level + 1, generator ? &child_generator : nullptr, parallel);
             }
         }
+#ifndef WIN32
+#    pragma omp taskwait
+#endif
     }
 }
 
 // --------------------------------------------------------------------------
 
+template <class Descriptor>
+void TemplatedVocabulary<Descriptor>::sortNodesBreadthFirst()
+{
+    std::vector<NodeId> new_id(m_nodes.size(), -1);
+    std::vector<NodeId> order;
+    order.reserve(m_nodes.size());
+    order.push_back(0);
+    new_id[0] = 0;
+    for (int i = 0; i < (int)order.size(); ++i)
+    {
+        for (auto c : m_nodes[order[i]].children)
+        {
+            new_id[c] = order.size();
+            order.push_back(c);
+        }
+    }
+    SAIGA_ASSERT(order.size() == m_nodes.size());
+
+    std::vector<Node> nodes(m_nodes.size());
+    for (int i = 0; i < (int)order.size(); ++i)
+    {
+        Node& n = nodes[i];
+        n       = std::move(m_nodes[order[i]]);
+        n.id    = i;
+        if (i != 0) n.parent = new_id[n.parent];
+        for (auto& c : n.children) c = new_id[c];
+    }
+    m_nodes = std::move(nodes);
+}
+
+// --------------------------------------------------------------------------
+
 template <class Descriptor>
 void TemplatedVocabulary<Descriptor>::initiateClustersKMpp(const std::vector<pDescriptor>& pfeatures,
-                                                           std::vector<Descriptor>& clusters) const
+                                                           std::vector<Descriptor>& clusters,
+                                                           std::mt19937_64* generator) const
 {
     // Implements kmeans++ seeding algorithm
     // Algorithm:
@@ -719,7 +901,7 @@ void TemplatedVocabulary<Descriptor>::initiateClustersKMpp(const std::vector<pDe
 
     // 1.
 
-    int ifeature = RandomInt(0, pfeatures.size() - 1);
+    int ifeature = RandomInt(0, pfeatures.size() - 1, generator);
 
 // create first cluster
 #ifdef USE_CV_FORB
@@ -758,7 +940,7 @@ void TemplatedVocabulary<Descriptor>::initiateClustersKMpp(const std::vector<pDe
             double cut_d;
             do
             {
-                cut_d = RandomValue<double>(0, dist_sum);
+                cut_d = RandomValue<double>(0, dist_sum, generator);
             } while (cut_d == 0.0);
 
             double d_up_now = 0;
@@ -814,10 +996,54 @@ void TemplatedVocabulary<Descriptor>::createWords()
 // --------------------------------------------------------------------------
 
 template <class Descriptor>
-void TemplatedVocabulary<Descriptor>::setNodeWeights(const std::vector<std::vector<Descriptor>>& training_features)
+void TemplatedVocabulary<Descriptor>::compile()
+{
+    m_mapped = nullptr;
+    m_flat_nodes.clear();
+    m_flat_descriptors.clear();
+    if (m_nodes.empty()) return;
+
+    m_flat_nodes.reserve(m_nodes.size());
+    m_flat_descriptors.reserve(m_nodes.size());
+
+    // the root
+    m_flat_nodes.push_back({0, 0, 0, m_nodes[0].word_id, m_nodes[0].weight});
+    m_flat_descriptors.push_back(m_nodes[0].descriptor);
+
+    // m_flat_nodes is also the queue of the breadth-first traversal
+    for (int i = 0; i < (int)m_flat_nodes.size(); ++i)
+    {
+        auto& children = m_nodes[m_flat_nodes[i].id].children;
+
+        m_flat_nodes[i].first_child  = m_flat_nodes.size();
+        m_flat_nodes[i].num_children = children.size();
+        for (auto c : children)
+        {
+            auto& child = m_nodes[c];
+            m_flat_nodes.push_back({0, 0, c, child.word_id, child.weight});
+            m_flat_descriptors.push_back(child.descriptor);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+
+template <class Descriptor>
+void TemplatedVocabulary<Descriptor>::setNodeWeights(const std::vector<std::vector<Descriptor>>& training_features,
+                                                     int num_threads)
+{
+    setNodeWeights(
+        training_features.size(),
+        [&](int i, std::vector<Descriptor>& descriptors) { descriptors = training_features[i]; }, num_threads);
+}
+
+template <class Descriptor>
+void TemplatedVocabulary<Descriptor>::setNodeWeights(
+    int num_documents, const std::function<void(int, std::vector<Descriptor>&)>& load_document, int num_threads)
 {
+    SAIGA_ASSERT(num_threads > 0);
     const unsigned int NWords = m_words.size();
-    const unsigned int NDocs  = training_features.size();
+    const unsigned int NDocs  = num_documents;
 
 
     // IDF and TF-IDF: we calculte the idf path now
@@ -826,24 +1052,29 @@ void TemplatedVocabulary<Descriptor>::setNodeWeights(const std::vector<std::vect
     // The complete tf-idf score is calculated in ::transform
 
     std::vector<unsigned int> Ni(NWords, 0);
-    std::vector<bool> counted(NWords, false);
 
-    typename std::vector<std::vector<Descriptor>>::const_iterator mit;
-    typename std::vector<Descriptor>::const_iterator fit;
-
-    for (mit = training_features.begin(); mit != training_features.end(); ++mit)
+#pragma omp parallel num_threads(num_threads)
     {
-        fill(counted.begin(), counted.end(), false);
+        std::vector<Descriptor> descriptors;
+        std::vector<WordId> words;
 
-        for (fit = mit->begin(); fit < mit->end(); ++fit)
+#pragma omp for schedule(dynamic)
+        for (int d = 0; d < num_documents; ++d)
         {
-            WordId word_id = std::get<0>(transform(*fit, 0));
+            load_document(d, descriptors);
 
+            words.clear();
+            for (auto& f : descriptors)
+            {
+                words.push_back(std::get<0>(transform(f, 0)));
+            }
+            std::sort(words.begin(), words.end());
+            words.erase(std::unique(words.begin(), words.end()), words.end());
 
-            if (!counted[word_id])
+            for (auto word_id : words)
             {
+#pragma omp atomic
                 Ni[word_id]++;
-                counted[word_id] = true;
             }
         }
     }
@@ -856,6 +1087,9 @@ void TemplatedVocabulary<Descriptor>::setNodeWeights(const std::vector<std::vect
             m_words[i]->weight = log((double)NDocs / (double)Ni[i]);
         }  // else // This cannot occur if using kmeans++
     }
+
+    // copy the new weights to the compiled tree
+    compile();
 }
 
 
@@ -938,44 +1172,51 @@ template <class Descriptor>
 std::tuple<WordId, WordValue, NodeId> TemplatedVocabulary<Descriptor>::transform(const Descriptor& feature,
                                                                                  int levelsup) const
 {
-    // propagate the feature down the tree
-    //    std::vector<NodeId> nodes;
-    //    typename std::vector<NodeId>::const_iterator nit;
+    SAIGA_ASSERT(numFlatNodes() > 0, "The vocabulary is empty.");
+    const FlatNode* flat_nodes         = flatNodes();
+    const Descriptor* flat_descriptors = flatDescriptors();
 
     // level at which the node must be stored in nid, if given
     const int nid_level = m_L - levelsup;
 
     NodeId nid = 0;
 
-    NodeId final_id   = 0;  // root
+    int current       = 0;  // root
     int current_level = 0;
 
+    std::array<int, 32> distances;
+
     do
     {
         ++current_level;
-        auto& nodes = m_nodes[final_id].children;
-        final_id    = nodes[0];
+        auto& node = flat_nodes[current];
 
-        auto best_d = Saiga::distance(feature, m_nodes[final_id].descriptor);
-
-        for (auto nit = nodes.begin() + 1; nit != nodes.end(); ++nit)
+        // The children are scored in chunks with the SIMD kernel.
+        // On equal distance the first child wins.
+        int best   = node.first_child;
+        int best_d = std::numeric_limits<int>::max();
+        for (int begin = 0; begin < node.num_children; begin += distances.size())
         {
-            NodeId id = *nit;
-            auto d    = Saiga::distance(feature, m_nodes[id].descriptor);
-            if (d < best_d)
+            int n = std::min<int>(node.num_children - begin, distances.size());
+            Saiga::hammingDistances(feature, flat_descriptors + node.first_child + begin, n, distances.data());
+            for (int c = 0; c < n; ++c)
             {
-                best_d   = d;
-                final_id = id;
+                if (distances[c] < best_d)
+                {
+                    best_d = distances[c];
+                    best   = node.first_child + begin + c;
+                }
             }
         }
+        current = best;
 
-        if (current_level == nid_level) nid = final_id;
+        if (current_level == nid_level) nid = flat_nodes[current].id;
 
-    } while (!m_nodes[final_id].isLeaf());
+    } while (flat_nodes[current].num_children > 0);
 
     // turn node id into word id
-    WordId word_id   = m_nodes[final_id].word_id;
-    WordValue weight = m_nodes[final_id].weight;
+    WordId word_id   = flat_nodes[current].word_id;
+    WordValue weight = flat_nodes[current].weight;
 
     return {word_id, weight, nid};
 }
@@ -1068,6 +1309,8 @@ void TemplatedVocabulary<Descriptor>::loadRaw(const std::string& file)
     {
         m_words[i] = &m_nodes[words[i].second];
     }
+
+    compile();
 }
 
 
@@ -1094,6 +1337,279 @@ void TemplatedVocabulary<Descriptor>::saveRaw(const std::string& file) const
 
 
 
+template <class Descriptor>
+void TemplatedVocabulary<Descriptor>::saveCompiled(const std::string& file) const
+{
+    SAIGA_ASSERT(!m_mapped && !m_flat_nodes.empty(), "saveCompiled requires a vocabulary from create or loadRaw.");
+
+    // flat index of each word
+    std::vector<int> words(m_words.size(), -1);
+    for (int i = 0; i < (int)m_flat_nodes.size(); ++i)
+    {
+        if (m_flat_nodes[i].num_children == 0 && i != 0) words[m_flat_nodes[i].word_id] = i;
+    }
+
+    // The descriptors are 32 byte aligned for SIMD loads
+    auto align = [](int64_t offset) { return (offset + 31) / 32 * 32; };
+
+    CompiledHeader header;
+    std::fill(std::begin(header.magic), std::end(header.magic), 0);
+    std::copy_n("MBOW2CV", 7, header.magic);
+    header.version           = compiled_version;
+    header.k                 = m_k;
+    header.L                 = m_L;
+    header.num_nodes         = m_flat_nodes.size();
+    header.num_words         = words.size();
+    header.node_size         = sizeof(FlatNode);
+    header.descriptor_offset = align(sizeof(CompiledHeader) + m_flat_nodes.size() * sizeof(FlatNode));
+    header.word_offset       = header.descriptor_offset + m_flat_descriptors.size() * sizeof(Descriptor);
+
+    std::ofstream strm(file, std::ios_base::out | std::ios_base::binary);
+    if (!strm.is_open())
+    {
+        throw std::runtime_error("Could not open Voc file.");
+    }
+    std::vector<char> padding(header.descriptor_offset - sizeof(CompiledHeader) - m_flat_nodes.size() * sizeof(FlatNode),
+                              0);
+    strm.write((const char*)&header, sizeof(CompiledHeader));
+    strm.write((const char*)m_flat_nodes.data(), m_flat_nodes.size() * sizeof(FlatNode));
+    strm.write(padding.data(), padding.size());
+    strm.write((const char*)m_flat_descriptors.data(), m_flat_descriptors.size() * sizeof(Descriptor));
+    strm.write((const char*)words.data(), words.size() * sizeof(int));
+}
+
+template <class Descriptor>
+void TemplatedVocabulary<Descriptor>::loadCompiled(const std::string& file)
+{
+    // No read-ahead of the whole file, only the visited nodes are paged in
+    auto mapped = std::make_shared<Saiga::File::MappedFile>(file, false);
+    if (!mapped->valid() || mapped->size() < sizeof(CompiledHeader))
+    {
+        throw std::runtime_error("Could not load Voc file.");
+    }
+
+    auto& header = *(const CompiledHeader*)mapped->data();
+    if (std::string(header.magic) != "MBOW2CV" || header.version != compiled_version ||
+        header.node_size != sizeof(FlatNode) ||
+        (size_t)header.word_offset + header.num_words * sizeof(int) != mapped->size())
+    {
+        throw std::runtime_error("Invalid compiled Voc file.");
+    }
+
+    m_nodes.clear();
+    m_words.clear();
+    m_flat_nodes.clear();
+    m_flat_descriptors.clear();
+    m_k      = header.k;
+    m_L      = header.L;
+    m_mapped = mapped;
+}
+
+// --------------------------------------------------------------------------
+
+/**
+ * Inverted file database of bow vectors (for example of keyframes).
+ * For each word a list of the entries that contain it is stored. A query therefore only touches the entries that
+ * share at least one word with the query vector. The cost does not depend on the total number of entries.
+ *
+ * The score is the same as FeatureVector::score. For L1-normalized vectors it is sum_i min(v_i, w_i) in [0,1].
+ *
+ * The query words are processed by decreasing value. As soon as the remaining query mass is smaller than the k-th
+ * best partial score (or min_score), no new entries are added to the accumulator. Entries that have not been touched
+ * until then can not be in the result, so the result is still exact.
+ *
+ * Entries can be assigned to an island (for example a group of covisible keyframes). With group_islands the
+ * scores of all entries of an island are summed up and only the best entry of each island is returned.
+ *
+ * Queries use a shared accumulator and are not thread safe.
+ */
+class Database
+{
+   public:
+    using EntryId = int;
+
+    struct Result
+    {
+        EntryId id;
+        WordValue score;
+    };
+
+    // Returns the id of the new entry. Ids are not reused after remove.
+    EntryId add(const BowVector& v, int island = -1)
+    {
+        EntryId id = m_entries.size();
+        m_entries.push_back(v);
+        m_islands.push_back(island);
+        m_alive.push_back(true);
+        m_num_alive++;
+        m_accumulator.push_back(0);
+
+        for (auto& [word, value] : v)
+        {
+            if (word >= (int)m_inverted.size()) m_inverted.resize(word + 1);
+            m_inverted[word].push_back({id, value});
+        }
+        return id;
+    }
+
+    void remove(EntryId id)
+    {
+        SAIGA_ASSERT(id >= 0 && id < (int)m_entries.size() && m_alive[id], "Invalid entry id.");
+        for (auto& [word, value] : m_entries[id])
+        {
+            auto& list = m_inverted[word];
+            list.erase(std::find_if(list.begin(), list.end(), [id = id](const auto& p) { return p.id == id; }));
+        }
+        m_entries[id].clear();
+        m_alive[id] = false;
+        m_num_alive--;
+    }
+
+    void clear()
+    {
+        m_inverted.clear();
+        m_entries.clear();
+        m_islands.clear();
+        m_alive.clear();
+        m_accumulator.clear();
+        m_num_alive = 0;
+    }
+
+    // Number of entries (excluding removed ones)
+    int size() const { return m_num_alive; }
+
+    const BowVector& entry(EntryId id) const { return m_entries[id]; }
+
+    /**
+     * The best k entries with score >= min_score, sorted by decreasing score.
+     * With group_islands, the entries of an island are merged (see above). Early termination is only used
+     * without grouping, because the island score depends on all entries of the island.
+     */
+    std::vector<Result> query(const BowVector& v, int k, WordValue min_score = 0, bool group_islands = false) const
+    {
+        SAIGA_ASSERT(k > 0);
+
+        // query words by decreasing value
+        m_query_words.assign(v.begin(), v.end());
+        std::sort(m_query_words.begin(), m_query_words.end(),
+                  [](const auto& a, const auto& b) { return a.second > b.second; });
+
+        WordValue remaining = 0;
+        for (auto& w : m_query_words) remaining += w.second;
+
+        bool admit_new       = true;
+        WordValue next_check = remaining;
+
+        m_touched.clear();
+        for (auto& [word, value] : m_query_words)
+        {
+            remaining -= value;
+            if (word < 0 || word >= (int)m_inverted.size()) continue;
+
+            for (auto& p : m_inverted[word])
+            {
+                // min > 0 for all words in a bow vector, so 0 means not touched yet
+                WordValue& acc = m_accumulator[p.id];
+                if (acc == 0)
+                {
+                    if (!admit_new) continue;
+                    m_touched.push_back(p.id);
+                }
+                acc += std::min(value, p.value);
+            }
+
+            if (admit_new && !group_islands)
+            {
+                if (remaining < min_score)
+                {
+                    admit_new = false;
+                }
+                else if ((int)m_touched.size() >= k && remaining < next_check)
+                {
+                    // The k-th best partial score is a lower bound of the final k-th best score.
+                    // Recomputed only after the remaining mass decreased by 10% to keep the overhead small.
+                    next_check = remaining * WordValue(0.9);
+                    m_scores.clear();
+                    for (auto id : m_touched) m_scores.push_back(m_accumulator[id]);
+                    std::nth_element(m_scores.begin(), m_scores.begin() + (k - 1), m_scores.end(),
+                                     std::greater<WordValue>());
+                    if (remaining < m_scores[k - 1]) admit_new = false;
+                }
+            }
+        }
+
+        std::vector<Result> result;
+        if (group_islands)
+        {
+            // island -> (summed score, best entry)
+            std::map<int, std::pair<WordValue, Result>> islands;
+            for (auto id : m_touched)
+            {
+                WordValue score = m_accumulator[id];
+                if (score < min_score) continue;
+
+                // entries without an island are their own group
+                int island = m_islands[id] >= 0 ? m_islands[id] : -id - 1;
+                auto it    = islands.find(island);
+                if (it == islands.end())
+                {
+                    islands[island] = {score, {id, score}};
+                }
+                else
+                {
+                    it->second.first += score;
+                    auto& best = it->second.second;
+                    if (score > best.score || (score == best.score && id < best.id)) best = {id, score};
+                }
+            }
+            for (auto& [island, group] : islands) result.push_back({group.second.id, group.first});
+        }
+        else
+        {
+            for (auto id : m_touched)
+            {
+                if (m_accumulator[id] >= min_score) result.push_back({id, m_accumulator[id]});
+            }
+        }
+
+        for (auto id : m_touched) m_accumulator[id] = 0;
+
+        auto cmp = [](const Result& a, const Result& b) {
+            return a.score > b.score || (a.score == b.score && a.id < b.id);
+        };
+        if ((int)result.size() > k)
+        {
+            std::partial_sort(result.begin(), result.begin() + k, result.end(), cmp);
+            result.resize(k);
+        }
+        else
+        {
+            std::sort(result.begin(), result.end(), cmp);
+        }
+        return result;
+    }
+
+   private:
+    struct Posting
+    {
+        EntryId id;
+        WordValue value;
+    };
+
+    // m_inverted[word] = all entries that contain this word
+    std::vector<std::vector<Posting>> m_inverted;
+
+    std::vector<BowVector> m_entries;
+    std::vector<int> m_islands;
+    std::vector<char> m_alive;
+    int m_num_alive = 0;
+
+    mutable std::vector<WordValue> m_accumulator;
+    mutable std::vector<EntryId> m_touched;
+    mutable std::vector<WordValue> m_scores;
+    mutable std::vector<std::pair<WordId, WordValue>> m_query_words;
+};
+
 // --------------------------------------------------------------------------
 
 /**
@@ -197,14 +197,18 @@ struct FeatureGrid2
         return grid(id.second, id.first);
     }
 
+    const std::pair<int, int>& cell(CellId id) const { return grid(id.second, id.first); }
 
 
-    auto cellIt(CellId id)
+    auto cellIt(CellId id) const
     {
         auto c = cell(id);
         return Range(c.first, c.second);
     }
 
+    // The cells of one row are stored consecutively. Returns the keypoint range of the cells [x_min, x_max] in row y.
+    auto rowIt(int y, int x_min, int x_max) const { return Range(cell({x_min, y}).first, cell({x_max, y}).second); }
+
     // Just use the eigen matrix here to get nice accessors
     // and bounds checking in debug mode.
     Eigen::Matrix<std::pair<int, int>, -1, -1, Eigen::RowMajor> grid;
@@ -16,9 +16,9 @@ namespace Saiga
 {
 std::ostream& operator<<(std::ostream& strm, const OptimizationResults& op)
 {
-    strm << "[" << op.name << "] " << op.cost_initial << " -> " << op.cost_final
-         << " | Timings (ms): Total=" << op.total_time << " Lin=" << op.linear_solver_time << " JtJ=" << op.jtj_time
-         << "";
+    strm << "[" << op.name << "] " << op.cost_initial << " -> " << op.cost_final << " | Iterations: " << op.iterations
+         << " | Timings (ms): Total=" << op.total_time << " Init=" << op.init_time << " Lin=" << op.linear_solver_time
+         << " JtJ=" << op.jtj_time << " Cost=" << op.cost_time;
     if (!op.success) strm << " FAILED!";
     return strm;
 }
@@ -36,6 +36,20 @@ void OptimizationOptions::imgui()
     {
         ImGui::InputInt("maxIterativeIterations", &maxIterativeIterations);
         ImGui::InputDouble("iterativeTolerance", &iterativeTolerance);
+
+        int currentPreconditioner                 = (int)preconditioner;
+        static const char* preconditionerItems[2] = {"BlockJacobi", "ClusterJacobi"};
+        ImGui::Combo("Preconditioner", &currentPreconditioner, preconditionerItems, 2);
+        preconditioner = (Preconditioner)currentPreconditioner;
+        if (preconditioner == Preconditioner::ClusterJacobi) ImGui::InputInt("clusterSize", &clusterSize);
+        ImGui::Checkbox("inexactNewton", &inexactNewton);
+    }
+    else
+    {
+        int currentOrdering                 = (int)ordering;
+        static const char* orderingItems[3] = {"Natural", "AMD", "NestedDissection"};
+        ImGui::Combo("Ordering", &currentOrdering, orderingItems, 3);
+        ordering = (Ordering)currentOrdering;
     }
 
     ImGui::Checkbox("debugOutput", &debugOutput);
@@ -53,10 +67,13 @@ std::ostream& operator<<(std::ostream& strm, const OptimizationOptions& op)
         strm << " solverType: CG Schur" << std::endl;
         strm << " maxIterativeIterations: " << op.maxIterativeIterations << std::endl;
         strm << " iterativeTolerance: " << op.iterativeTolerance << std::endl;
+        strm << " preconditioner: " << (int)op.preconditioner << std::endl;
+        strm << " inexactNewton: " << op.inexactNewton << std::endl;
     }
     else
     {
         strm << " solverType: LDLT Schur" << std::endl;
+        strm << " ordering: " << (int)op.ordering << std::endl;
     }
     return strm;
 }
@@ -85,12 +102,14 @@ OptimizationResults LMOptimizer::solve()
     {
         double chi2;
         double jtime = 0;
+        double ctime = 0;
         {
             Saiga::ScopedTimer<double> timer(jtime);
 
             chi2 = computeQuadraticForm();
         }
         result.jtj_time += jtime;
+        result.iterations = i + 1;
 
 
 
@@ -165,7 +184,12 @@ OptimizationResults LMOptimizer::solve()
         }
 
 
-        double newChi2 = computeCost();
+        double newChi2;
+        {
+            Saiga::ScopedTimer<double> timer(ctime);
+            newChi2 = computeCost();
+        }
+        result.cost_time += ctime;
 
         if (std::isfinite(newChi2) && newChi2 < current_chi2)
         {
@@ -216,9 +240,14 @@ OptimizationResults LMOptimizer::initAndSolve()
 
     {
         Saiga::ScopedTimer<double> timer(result.total_time);
-        init();
+        double init_time;
+        {
+            Saiga::ScopedTimer<double> init_timer(init_time);
+            init();
+        }
 
-        result = solve();
+        result           = solve();
+        result.init_time = init_time;
     }
     return result;
 }
@@ -244,7 +273,16 @@ OptimizationResults LMOptimizer::solveOMP()
         {
             double chi2;
 
-            chi2 = computeQuadraticForm();
+            double jtime = 0;
+            {
+                auto timer = (tid == 0) ? std::make_shared<Saiga::ScopedTimer<double>>(jtime) : nullptr;
+                chi2       = computeQuadraticForm();
+            }
+            if (tid == 0)
+            {
+                result.jtj_time += jtime;
+                result.iterations = i + 1;
+            }
 
             //            continue;
 
@@ -269,16 +307,22 @@ OptimizationResults LMOptimizer::solveOMP()
             }
             result.cost_final = chi2;
 
-            double ltime;
+            double ltime = 0;
             {
                 auto timer = (tid == 0) ? std::make_shared<Saiga::ScopedTimer<double>>(ltime) : nullptr;
                 solveLinearSystem();
             }
-            result.linear_solver_time += ltime;
+            if (tid == 0) result.linear_solver_time += ltime;
 
             addDelta();
 
-            double newChi2 = computeCost();
+            double newChi2;
+            double ctime = 0;
+            {
+                auto timer = (tid == 0) ? std::make_shared<Saiga::ScopedTimer<double>>(ctime) : nullptr;
+                newChi2    = computeCost();
+            }
+            if (tid == 0) result.cost_time += ctime;
 
 
 #pragma omp single
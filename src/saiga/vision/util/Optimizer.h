@@ -18,11 +18,16 @@ struct SAIGA_VISION_API OptimizationResults
     double cost_initial = 0;
     double cost_final   = 0;
 
+    // Accumulated over all iterations in milliseconds.
+    // jtj_time: computeQuadraticForm, cost_time: computeCost
     double init_time          = 0;
     double linear_solver_time = 0;
     double jtj_time           = 0;
+    double cost_time          = 0;
     double total_time         = 0;
 
+    int iterations = 0;
+
     bool success = false;
 };
 
@@ -43,6 +48,29 @@ struct SAIGA_VISION_API OptimizationOptions
     double iterativeTolerance  = 1e-5;
     bool buildExplizitSchur    = false;
 
+    // Fill reducing ordering of the direct solver.
+    // Must match Eigen::Recursive::LinearSolverOptions::Ordering.
+    enum class Ordering : int
+    {
+        Natural          = 0,
+        AMD              = 1,
+        NestedDissection = 2
+    };
+    Ordering ordering = Ordering::AMD;
+
+    // Preconditioner of the iterative solver.
+    // Must match Eigen::Recursive::LinearSolverOptions::Preconditioner.
+    enum class Preconditioner : int
+    {
+        BlockJacobi   = 0,
+        ClusterJacobi = 1
+    };
+    Preconditioner preconditioner = Preconditioner::BlockJacobi;
+    int clusterSize               = 4;
+
+    // Adapt the cg tolerance to the current residual (inexact newton).
+    bool inexactNewton = false;
+
     // early termiante if the chi2 delta is smaller than this value
     double minChi2Delta  = 1e-5;
     double initialLambda = 1.00e-04;
@@ -83,6 +111,7 @@ class SAIGA_VISION_API LMOptimizer : public Optimizer
     // only works if the problem supports omp
     OptimizationResults solveOMP();
     void initOMP();
+    virtual bool supportOMP() { return false; }
 
     //    virtual OptimizationResults solve() = 0;
    protected:
@@ -96,7 +125,6 @@ class SAIGA_VISION_API LMOptimizer : public Optimizer
     virtual void finalize()               = 0;
 
     virtual void setThreadCount(int n) {}
-    virtual bool supportOMP() { return false; }
 
     double lambda;
     double v = 2;
@@ -0,0 +1,203 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#include "OptimizerBenchmark.h"
+
+#include "saiga/core/util/MemoryUsage.h"
+#include "saiga/core/util/file.h"
+#include "saiga/core/util/json11.hpp"
+#include "saiga/core/util/statistics.h"
+#include "saiga/core/util/table.h"
+
+#include <fstream>
+#include <map>
+
+namespace Saiga
+{
+OptimizationOptions OptimizerBenchmarkParams::optimizationOptions() const
+{
+    // minChi2Delta = 0: always run all iterations, so that the timings of different solvers are comparable
+    OptimizationOptions options;
+    options.maxIterations          = max_iterations;
+    options.solverType             = (OptimizationOptions::SolverType)solver_type;
+    options.maxIterativeIterations = max_iterative_iterations;
+    options.iterativeTolerance     = iterative_tolerance;
+    options.numThreads             = threads;
+    options.debugOutput            = false;
+    options.minChi2Delta           = 0;
+    return options;
+}
+
+const OptimizerBenchmarkRecord& OptimizerBenchmark::run(const std::string& problem, const std::string& dataset,
+                                                        const std::string& solver, int repetitions,
+                                                        const std::function<OptimizationResults()>& f, int threads)
+{
+    SAIGA_ASSERT(repetitions > 0);
+
+    std::vector<double> total, init, jtj, linear, cost;
+    OptimizationResults result;
+    for (int i = 0; i < repetitions; ++i)
+    {
+        result = f();
+        total.push_back(result.total_time);
+        init.push_back(result.init_time);
+        jtj.push_back(result.jtj_time);
+        linear.push_back(result.linear_solver_time);
+        cost.push_back(result.cost_time);
+    }
+
+    OptimizerBenchmarkRecord r;
+    r.problem             = problem;
+    r.dataset             = dataset;
+    r.solver              = solver;
+    r.threads             = threads;
+    r.iterations          = result.iterations;
+    r.chi2_initial        = result.cost_initial;
+    r.chi2_final          = result.cost_final;
+    r.time_total          = Statistics(total).median;
+    r.time_init           = Statistics(init).median;
+    r.time_quadratic_form = Statistics(jtj).median;
+    r.time_linear_solver  = Statistics(linear).median;
+    r.time_cost           = Statistics(cost).median;
+    r.peak_memory         = GetMemoryInfo().max_memory_used;
+
+    std::cout << "[Benchmark] " << r.key() << " " << r.chi2_initial << " -> " << r.chi2_final << " | "
+              << r.time_total << " ms" << std::endl;
+
+    records.push_back(r);
+    return records.back();
+}
+
+void OptimizerBenchmark::writeJson(const std::string& file) const
+{
+    json11::Json::array entries;
+    for (auto& r : records)
+    {
+        entries.push_back(json11::Json::object{
+            {"problem", r.problem},
+            {"dataset", r.dataset},
+            {"solver", r.solver},
+            {"threads", r.threads},
+            {"iterations", r.iterations},
+            {"chi2_initial", r.chi2_initial},
+            {"chi2_final", r.chi2_final},
+            {"time_total", r.time_total},
+            {"time_init", r.time_init},
+            {"time_quadratic_form", r.time_quadratic_form},
+            {"time_linear_solver", r.time_linear_solver},
+            {"time_cost", r.time_cost},
+            {"peak_memory", double(r.peak_memory)},
+        });
+    }
+
+    std::ofstream strm(file);
+    SAIGA_ASSERT(strm.is_open(), file);
+    strm << json11::Json(json11::Json::object{{"records", entries}}).dump() << std::endl;
+}
+
+void OptimizerBenchmark::writeCsv(const std::string& file) const
+{
+    std::ofstream strm(file);
+    SAIGA_ASSERT(strm.is_open(), file);
+    strm.precision(10);
+    strm << "problem,dataset,solver,threads,iterations,chi2_initial,chi2_final,time_total,time_init,"
+            "time_quadratic_form,time_linear_solver,time_cost,peak_memory"
+         << std::endl;
+    for (auto& r : records)
+    {
+        strm << r.problem << "," << r.dataset << "," << r.solver << "," << r.threads << "," << r.iterations << ","
+             << r.chi2_initial << "," << r.chi2_final << "," << r.time_total << "," << r.time_init << ","
+             << r.time_quadratic_form << "," << r.time_linear_solver << "," << r.time_cost << "," << r.peak_memory
+             << std::endl;
+    }
+}
+
+std::vector<OptimizerBenchmarkRecord> OptimizerBenchmark::readJson(const std::string& file)
+{
+    std::vector<OptimizerBenchmarkRecord> result;
+
+    auto data = File::loadFileBinary(file);
+    if (data.empty())
+    {
+        std::cout << "Could not load benchmark baseline " << file << std::endl;
+        return result;
+    }
+
+    std::string err;
+    auto json = json11::Json::parse(std::string(data.begin(), data.end()), err);
+    if (!err.empty())
+    {
+        std::cout << "Invalid benchmark baseline " << file << ": " << err << std::endl;
+        return result;
+    }
+
+    for (auto& e : json["records"].array_items())
+    {
+        OptimizerBenchmarkRecord r;
+        r.problem             = e["problem"].string_value();
+        r.dataset             = e["dataset"].string_value();
+        r.solver              = e["solver"].string_value();
+        r.threads             = e["threads"].int_value();
+        r.iterations          = e["iterations"].int_value();
+        r.chi2_initial        = e["chi2_initial"].number_value();
+        r.chi2_final          = e["chi2_final"].number_value();
+        r.time_total          = e["time_total"].number_value();
+        r.time_init           = e["time_init"].number_value();
+        r.time_quadratic_form = e["time_quadratic_form"].number_value();
+        r.time_linear_solver  = e["time_linear_solver"].number_value();
+        r.time_cost           = e["time_cost"].number_value();
+        r.peak_memory         = e["peak_memory"].number_value();
+        result.push_back(r);
+    }
+    return result;
+}
+
+int OptimizerBenchmark::compare(const std::vector<OptimizerBenchmarkRecord>& baseline, double time_tolerance,
+                                double chi2_tolerance, std::ostream& strm) const
+{
+    std::map<std::string, const OptimizerBenchmarkRecord*> base;
+    for (auto& r : baseline) base[r.key()] = &r;
+
+    int regressions = 0;
+
+    Table table({40, 14, 14, 10, 14, 14, 12}, strm);
+    table << "Name"
+          << "Base (ms)"
+          << "Time (ms)"
+          << "Speedup"
+          << "Base chi2"
+          << "chi2"
+          << "Status";
+
+    for (auto& r : records)
+    {
+        auto it = base.find(r.key());
+        if (it == base.end())
+        {
+            table << r.key() << "-" << r.time_total << "-"
+                  << "-" << r.chi2_final << "new";
+            continue;
+        }
+        auto& b = *it->second;
+
+        bool slower = r.time_total > b.time_total * (1 + time_tolerance);
+        bool worse  = r.chi2_final > b.chi2_final * (1 + chi2_tolerance) + 1e-20;
+
+        std::string status = "ok";
+        if (slower) status = "SLOWER";
+        if (worse) status = "WORSE";
+        if (slower && worse) status = "SLOWER+WORSE";
+        regressions += slower || worse;
+
+        table << r.key() << b.time_total << r.time_total << b.time_total / r.time_total << b.chi2_final
+              << r.chi2_final << status;
+    }
+
+    strm << "Regressions: " << regressions << "/" << records.size() << std::endl;
+    return regressions;
+}
+
+}  // namespace Saiga
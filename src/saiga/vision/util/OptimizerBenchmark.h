@@ -0,0 +1,139 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+#pragma once
+
+#include "saiga/core/util/ini/Params.h"
+#include "saiga/vision/util/Optimizer.h"
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace Saiga
+{
+/**
+ * Configuration of a benchmark run. Stored in an ini file, so that a run can be reproduced exactly.
+ *
+ * Datasets are given as a list of file names. Synthetic problems are created if the list is empty.
+ */
+struct SAIGA_VISION_API OptimizerBenchmarkParams : public ParamsBase
+{
+    SAIGA_PARAM_STRUCT_FUNCTIONS(OptimizerBenchmarkParams);
+    virtual void Params(Saiga::SimpleIni* ini, CLI::App* app) override
+    {
+        SAIGA_PARAM_LIST_COMMENT(problems, ' ', "# Any of: ba pgo arap imu");
+        SAIGA_PARAM_LIST_COMMENT(solvers, ' ', "# Any of: recursive ceres g2o");
+        SAIGA_PARAM_LIST_COMMENT(ba_datasets, ' ', "# .scene or BAL .txt files");
+        SAIGA_PARAM_LIST_COMMENT(arap_datasets, ' ', "# .ply meshes");
+
+        SAIGA_PARAM(repetitions);
+        SAIGA_PARAM(seed);
+        SAIGA_PARAM(threads);
+        SAIGA_PARAM(max_iterations);
+        SAIGA_PARAM_COMMENT(solver_type, "# 0 Iterative, 1 Direct");
+        SAIGA_PARAM(max_iterative_iterations);
+        SAIGA_PARAM(iterative_tolerance);
+
+        SAIGA_PARAM(output_json);
+        SAIGA_PARAM(output_csv);
+        SAIGA_PARAM_COMMENT(baseline, "# A json file of a previous run. Empty to disable the comparison.");
+        SAIGA_PARAM_COMMENT(time_tolerance, "# Relative slowdown which is reported as regression");
+        SAIGA_PARAM_COMMENT(chi2_tolerance, "# Relative increase of the final error which is reported as regression");
+    }
+
+    std::vector<std::string> problems      = {"ba", "pgo", "arap", "imu"};
+    std::vector<std::string> solvers       = {"recursive", "ceres", "g2o"};
+    std::vector<std::string> ba_datasets   = {};
+    std::vector<std::string> arap_datasets = {};
+
+    int repetitions              = 5;
+    long seed                    = 93865023985;
+    int threads                  = 1;
+    int max_iterations           = 5;
+    int solver_type              = 1;
+    int max_iterative_iterations = 50;
+    double iterative_tolerance   = 1e-10;
+    std::string output_json      = "optimizer_benchmark.json";
+    std::string output_csv       = "optimizer_benchmark.csv";
+    std::string baseline         = "";
+    double time_tolerance        = 0.1;
+    double chi2_tolerance        = 1e-3;
+
+    OptimizationOptions optimizationOptions() const;
+};
+
+/**
+ * One benchmark entry. All timings are medians over the repetitions in milliseconds.
+ */
+struct SAIGA_VISION_API OptimizerBenchmarkRecord
+{
+    std::string problem;
+    std::string dataset;
+    std::string solver;
+
+    int threads    = 1;
+    int iterations = 0;
+
+    double chi2_initial = 0;
+    double chi2_final   = 0;
+
+    double time_total          = 0;
+    double time_init           = 0;
+    double time_quadratic_form = 0;
+    double time_linear_solver  = 0;
+    double time_cost           = 0;
+
+    // Peak resident set size of the process after the run in bytes.
+    size_t peak_memory = 0;
+
+    std::string key() const { return problem + "/" + dataset + "/" + solver + "/" + std::to_string(threads); }
+};
+
+/**
+ * Collects the results of optimizer runs and writes them as json and csv.
+ * A previous json output can be loaded as baseline to detect performance regressions.
+ *
+ * Usage:
+ *
+ *   OptimizerBenchmark benchmark;
+ *   benchmark.run("ba", "tum_office.scene", "recursive", 5, [&]() {
+ *       Scene cpy = scene;
+ *       BARec ba;
+ *       ba.optimizationOptions = options;
+ *       ba.create(cpy);
+ *       return ba.initAndSolve();
+ *   });
+ *   benchmark.writeJson("benchmark.json");
+ *   int regressions = benchmark.compare(OptimizerBenchmark::readJson("baseline.json"));
+ */
+class SAIGA_VISION_API OptimizerBenchmark
+{
+   public:
+    // Executes 'f' 'repetitions' times and adds a record with the median timings.
+    // 'f' must create a fresh copy of the problem each time.
+    const OptimizerBenchmarkRecord& run(const std::string& problem, const std::string& dataset,
+                                        const std::string& solver, int repetitions,
+                                        const std::function<OptimizationResults()>& f, int threads = 1);
+
+    void writeJson(const std::string& file) const;
+    void writeCsv(const std::string& file) const;
+    static std::vector<OptimizerBenchmarkRecord> readJson(const std::string& file);
+
+    /**
+     * Compares all records to the baseline entries with the same key.
+     * A record is a regression if the total time increased by more than time_tolerance (relative) or the final
+     * error increased by more than chi2_tolerance (relative).
+     * Prints a table and returns the number of regressions.
+     */
+    int compare(const std::vector<OptimizerBenchmarkRecord>& baseline, double time_tolerance = 0.1,
+                double chi2_tolerance = 1e-3, std::ostream& strm = std::cout) const;
+
+    std::vector<OptimizerBenchmarkRecord> records;
+};
+
+}  // namespace Saiga
@@ -9,6 +9,8 @@
 #include "saiga/core/util/Thread/omp.h"
 #include "saiga/vision/VisionTypes.h"
 
+#include <algorithm>
+
 
 namespace Saiga
 {
@@ -34,9 +36,83 @@ struct RansacParameters
     // Number of omp threads in that group
     // Note:
     int threads = 1;
+
+    // Adaptive termination.
+    // If > 0, the number of iterations is reduced to the number required to find an all-inlier sample with this
+    // probability. The inlier ratio of the current best model is used as estimate. Typical value: 0.999
+    double confidence = 0;
+
+    // T(d,d) pre-test. A hypothesis is only scored if 'preTestPoints' random points are all inliers.
+    // 0 disables the test.
+    int preTestPoints = 0;
+
+    // Sequential probability ratio test (Matas and Chum, "Randomized RANSAC with Sequential Probability Ratio Test").
+    // Scoring of a hypothesis is stopped as soon as it is likely to be bad. A bad hypothesis is expected to
+    // have an inlier ratio of 'sprtDelta'. 'sprtModelCost' is the time to compute one model measured in number of
+    // residual evaluations.
+    bool sprt            = false;
+    double sprtDelta     = 0.05;
+    double sprtModelCost = 200;
+
+    // PROSAC (Chum and Matas, "Matching with PROSAC - Progressive Sample Consensus").
+    // The samples are first drawn from the best points and then progressively from the complete set.
+    // The input points must be sorted by quality (for example the matching distance), the best point first.
+    bool prosac = false;
+
+    // LO-RANSAC (Chum et al., "Locally Optimized RANSAC").
+    // Every new best model is improved by an inner RANSAC on its inliers. The inner models are computed from
+    // 'localOptimizationSampleSize' inliers with computeModelNonMinimal(). Afterwards the model is refit to all of its
+    // inliers. 0 disables the local optimization.
+    int localOptimization           = 0;
+    int localOptimizationSampleSize = 16;
 };
 
+// Number of iterations required to draw at least one all-inlier sample with the given probability
+inline int RansacIterationsFromInlierRatio(double inlierRatio, double confidence, int sampleSize, int maxIterations)
+{
+    double p = std::pow(inlierRatio, sampleSize);
+    if (p >= 1) return 1;
+    if (p <= 0) return maxIterations;
+    double k = std::log(1 - confidence) / std::log1p(-p);
+    return std::max(1, int(std::min<double>(std::ceil(k), maxIterations)));
+}
+
+struct RansacStatistics
+{
+    // Number of hypotheses that were generated
+    int iterations = 0;
+
+    // Hypotheses that were rejected before all points were scored. (pre-test, SPRT, or they could not win anymore)
+    int early_rejected = 0;
+
+    // Number of local optimization steps
+    int local_optimizations = 0;
 
+    // Total number of computed residuals
+    long residual_evaluations = 0;
+};
+
+/**
+ * Ransac base class using CRTP. The derived class must implement
+ *
+ *   bool computeModel(const Subset& set, Model& model);
+ *   double computeResidual(const Model& model, int i);
+ *
+ * and call compute(N) from all threads of an omp parallel region with params.threads threads.
+ * Afterwards the result is stored in bestModel, bestInlierMask and bestNumInliers.
+ *
+ * The hypotheses are scored into thread local buffers, which are allocated in init(). The memory is therefore
+ * independent of the number of iterations. Scoring of a hypothesis is stopped as soon as it cannot beat the current
+ * best model.
+ *
+ * Optionally, the derived class can implement
+ *
+ *   // Computes the residuals of the points [begin, end) in one pass.
+ *   void computeResiduals(const Model& model, int begin, int end, double* residuals);
+ *
+ *   // Least squares model from more than ModelSize points. Used by the local optimization.
+ *   bool computeModelNonMinimal(ArrayView<const int> indices, Model& model);
+ */
 template <typename Derived, typename Model, int ModelSize>
 class RansacBase
 {
@@ -45,27 +121,27 @@ class RansacBase
     {
         params = _params;
         SAIGA_ASSERT(params.maxIterations > 0);
+        SAIGA_ASSERT(params.preTestPoints >= 0);
+        SAIGA_ASSERT(params.sprtDelta > 0 && params.sprtDelta < 1);
         SAIGA_ASSERT(OMP::getNumThreads() == 1);
 
-        numInliers.resize(params.maxIterations);
-        models.resize(params.maxIterations);
-
-        residuals.resize(params.maxIterations);
-        for (auto&& r : residuals) r.reserve(params.reserveN);
-
-        inliers.resize(params.maxIterations);
-        for (auto&& r : inliers) r.reserve(params.reserveN);
+        bestInlierMask.reserve(params.reserveN);
+        prosacGrowth.reserve(params.reserveN + 1);
 
         SAIGA_ASSERT(params.threads >= 1);
-        generators.resize(params.threads);
-        threadLocalBestModel.resize(params.threads);
+        threadData.resize(params.threads);
         for (int i = 0; i < params.threads; ++i)
         {
-            generators[i].seed(ransacRandomSeed + 6643838879UL * i);
+            auto& td = threadData[i]();
+            td.generator.seed(ransacRandomSeed + 6643838879UL * i);
+            td.mask.reserve(params.reserveN);
+            td.bestMask.reserve(params.reserveN);
+            if (params.localOptimization > 0) td.indices.reserve(params.reserveN);
         }
     }
 
     const RansacParameters& Params() const { return params; }
+    const RansacStatistics& Stats() const { return stats; }
 
    protected:
     // indices of subset
@@ -75,99 +151,352 @@ class RansacBase
     RansacBase(const RansacParameters& _params) { init(_params); }
 
 
-
+    // Must be called by all threads of the parallel region.
+    // Returns the number of inliers of the best model.
     int compute(int _N)
     {
         SAIGA_ASSERT(params.maxIterations > 0);
         SAIGA_ASSERT(OMP::getNumThreads() == params.threads);
 
-        int tid = OMP::getThreadNum();
-        // compute random sample subsets
-        std::uniform_int_distribution<int> dis(0, _N - 1);
-        auto& gen = generators[tid];
+        int tid  = OMP::getThreadNum();
+        auto& td = threadData[tid]();
 
+        td.mask.resize(_N);
+        td.bestMask.resize(_N);
+        td.bestCount = 0;
+        td.stats     = RansacStatistics();
 
-        auto& bestModel = threadLocalBestModel[tid]();
-        bestModel       = {0, 0};
-
+#pragma omp single
+        {
+            N               = _N;
+            nextIteration   = 0;
+            iterationLimit  = N >= ModelSize ? params.maxIterations : 0;
+            globalBestCount = 0;
+            if (params.prosac) computeProsacGrowth();
+        }
 
-#pragma omp for
-        for (int it = 0; it < params.maxIterations; ++it)
+        while (true)
         {
-            auto& model     = models[it];
-            auto& inlier    = inliers[it];
-            auto& residual  = residuals[it];
-            auto& numInlier = numInliers[it];
+            // The iterations are distributed dynamically, because the limit can be reduced by any thread.
+            int it, limit;
+#pragma omp atomic capture
+            it = nextIteration++;
+#pragma omp atomic read
+            limit = iterationLimit;
+            if (it >= limit) break;
 
-            numInlier = 0;
-            residual.resize(_N);
-            inlier.resize(_N);
+            td.stats.iterations++;
 
-            Subset set;
-            for (auto j : Range(0, ModelSize))
+            Subset set = params.prosac ? sampleProsac(it, td.generator) : sampleUniform(N, td.generator);
+            if (!derived().computeModel(set, td.model)) continue;
+
+            if (!preTest(td))
             {
-                auto idx = dis(gen);
-                set[j]   = idx;
+                td.stats.early_rejected++;
+                continue;
             }
 
-            if (!derived().computeModel(set, model)) continue;
+            int best;
+#pragma omp atomic read
+            best = globalBestCount;
+            best = std::max(best, td.bestCount);
 
-            for (int j = 0; j < _N; ++j)
+            int count = score(td, best);
+            if (count <= td.bestCount)
             {
-                residual[j] = derived().computeResidual(model, j);
-
-                bool inl  = residual[j] < params.residualThreshold;
-                inlier[j] = inl;
-                numInlier += inl;
+                continue;
             }
 
-            if (numInlier > bestModel.first)
-            {
-                bestModel.first  = numInlier;
-                bestModel.second = it;
-            }
+            td.bestCount = count;
+            td.bestModel = td.model;
+            std::swap(td.mask, td.bestMask);
+            if (params.localOptimization > 0) localOptimization(td);
+            updateGlobalBest(td.bestCount);
         }
 
+#pragma omp barrier
+
 #pragma omp single
         {
-            N             = _N;
-            bestIdx       = 0;
-            int bestCount = 0;
+            stats          = RansacStatistics();
+            int bestThread = 0;
             for (int th = 0; th < params.threads; ++th)
             {
-                auto&& thbestModel = threadLocalBestModel[th]();
-                auto inl           = thbestModel.first;
-                auto it            = thbestModel.second;
-                //                std::cout << "th best " << th << " " << it << " " << inl << std::endl;
-                if (inl > bestCount)
-                {
-                    bestCount = inl;
-                    bestIdx   = it;
-                }
+                auto& other = threadData[th]();
+                if (other.bestCount > threadData[bestThread]().bestCount) bestThread = th;
+                stats.iterations += other.stats.iterations;
+                stats.early_rejected += other.stats.early_rejected;
+                stats.local_optimizations += other.stats.local_optimizations;
+                stats.residual_evaluations += other.stats.residual_evaluations;
             }
+
+            auto& best     = threadData[bestThread]();
+            bestNumInliers = best.bestCount;
+            bestModel      = best.bestModel;
+            bestInlierMask.assign(best.bestMask.begin(), best.bestMask.end());
+            if (bestNumInliers == 0) std::fill(bestInlierMask.begin(), bestInlierMask.end(), 0);
         }
-        return bestIdx;
+        return bestNumInliers;
     }
 
 
     // total number of sample points
     int N;
     RansacParameters params;
-    AlignedVector<std::vector<double>> residuals;
-    AlignedVector<std::vector<char>> inliers;
-    AlignedVector<int> numInliers;
-    AlignedVector<Model> models;
+    RansacStatistics stats;
 
-    // make sure we don't run into false sharing
-    AlignedVector<AlignedStruct<std::pair<int, int>, SAIGA_CACHE_LINE_SIZE>> threadLocalBestModel;
+    // The result of the last compute()
+    Model bestModel;
+    std::vector<char> bestInlierMask;
+    int bestNumInliers = 0;
 
-    // each thread has one generator
-    std::vector<std::mt19937> generators;
+    // Default implementation of the batched residual computation
+    void computeResiduals(const Model& model, int begin, int end, double* residuals)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            residuals[i - begin] = derived().computeResidual(model, i);
+        }
+    }
 
-    int bestIdx;
+    // Default: no local optimization
+    bool computeModelNonMinimal(ArrayView<const int> indices, Model& model) { return false; }
 
    private:
+    // Number of residuals that are computed in one batch
+    static constexpr int residual_block_size = 128;
+
+    struct ThreadData
+    {
+        // each thread has one generator
+        std::mt19937 generator;
+
+        // Inlier masks of the current hypothesis and the best model of this thread
+        std::vector<char> mask;
+        std::vector<char> bestMask;
+
+        Model model;
+        Model bestModel;
+        int bestCount = 0;
+
+        std::array<double, residual_block_size> residuals;
+
+        // Inlier indices of the local optimization
+        std::vector<int> indices;
+
+        RansacStatistics stats;
+    };
+
+    // make sure we don't run into false sharing
+    AlignedVector<AlignedStruct<ThreadData, SAIGA_CACHE_LINE_SIZE>> threadData;
+
+    // Shared between the threads of compute()
+    int nextIteration   = 0;
+    int iterationLimit  = 0;
+    int globalBestCount = 0;
+
+    // T'_n of the PROSAC paper. Sample 'it' is drawn from the first n points with prosacGrowth[n] >= it+1.
+    std::vector<int> prosacGrowth;
+
     Derived& derived() { return *static_cast<Derived*>(this); }
+
+    // Draws ModelSize distinct indices from [0, range) into set[start, ModelSize)
+    static void sampleDistinct(Subset& set, int start, int range, std::mt19937& gen)
+    {
+        std::uniform_int_distribution<int> dis(0, range - 1);
+        for (int j = start; j < ModelSize; ++j)
+        {
+            int idx;
+            do
+            {
+                idx = dis(gen);
+            } while (std::find(set.begin(), set.begin() + j, idx) != set.begin() + j);
+            set[j] = idx;
+        }
+    }
+
+    static Subset sampleUniform(int range, std::mt19937& gen)
+    {
+        Subset set;
+        sampleDistinct(set, 0, range, gen);
+        return set;
+    }
+
+    void computeProsacGrowth()
+    {
+        // Not enough points for a single sample. compute() does not run any iteration in this case.
+        if (N < ModelSize) return;
+
+        // Number of samples T_n drawn from the first n points, if T_N = maxIterations samples are drawn in total.
+        prosacGrowth.resize(N + 1);
+        double T_n = params.maxIterations;
+        for (int i = 0; i < ModelSize; ++i)
+        {
+            T_n *= double(ModelSize - i) / double(N - i);
+        }
+
+        int T_prime             = 1;
+        prosacGrowth[ModelSize] = T_prime;
+        for (int n = ModelSize; n < N; ++n)
+        {
+            double T_next = T_n * double(n + 1) / double(n + 1 - ModelSize);
+            T_prime += std::max(1, int(std::ceil(T_next - T_n)));
+            prosacGrowth[n + 1] = T_prime;
+            T_n                 = T_next;
+        }
+    }
+
+    Subset sampleProsac(int it, std::mt19937& gen)
+    {
+        int t  = it + 1;
+        auto n = std::lower_bound(prosacGrowth.begin() + ModelSize, prosacGrowth.end(), t) - prosacGrowth.begin();
+        if (n > N)
+        {
+            // All points are used
+            return sampleUniform(N, gen);
+        }
+
+        // The newest point of the current set and ModelSize-1 points of the previous set
+        Subset set;
+        set[0] = n - 1;
+        sampleDistinct(set, 1, n - 1, gen);
+        return set;
+    }
+
+    bool preTest(ThreadData& td)
+    {
+        if (params.preTestPoints == 0) return true;
+        std::uniform_int_distribution<int> dis(0, N - 1);
+        for (int i = 0; i < params.preTestPoints; ++i)
+        {
+            td.stats.residual_evaluations++;
+            if (!(derived().computeResidual(td.model, dis(td.generator)) < params.residualThreshold)) return false;
+        }
+        return true;
+    }
+
+    // Returns the number of inliers of td.model or -1 if the scoring was stopped early.
+    int score(ThreadData& td, int best, bool allow_sprt = true)
+    {
+        // The SPRT requires that good models have a higher inlier ratio than bad models
+        double epsilon = double(best) / N;
+        double delta   = params.sprtDelta;
+        bool use_sprt  = allow_sprt && params.sprt && epsilon > delta;
+
+        double log_inlier = 0, log_outlier = 0, log_A = 0;
+        if (use_sprt)
+        {
+            log_inlier  = std::log(delta / epsilon);
+            log_outlier = std::log((1 - delta) / (1 - epsilon));
+
+            // Decision threshold A from equation (11) of the paper
+            double C = (1 - delta) * log_outlier + delta * log_inlier;
+            double K = params.sprtModelCost * C;
+            double A = K + 1;
+            for (int i = 0; i < 10; ++i) A = K + 1 + std::log(A);
+            log_A = std::log(A);
+        }
+
+        auto& mask        = td.mask;
+        int count         = 0;
+        double log_lambda = 0;
+        for (int block_start = 0; block_start < N; block_start += residual_block_size)
+        {
+            int block_end = std::min(N, block_start + residual_block_size);
+            derived().computeResiduals(td.model, block_start, block_end, td.residuals.data());
+
+            for (int j = block_start; j < block_end; ++j)
+            {
+                bool inl = td.residuals[j - block_start] < params.residualThreshold;
+                mask[j]  = inl;
+                count += inl;
+
+                // This hypothesis can not beat the current best model or it is likely to be bad (SPRT)
+                bool reject = !inl && count + (N - j - 1) <= best;
+                if (use_sprt)
+                {
+                    log_lambda += inl ? log_inlier : log_outlier;
+                    reject |= log_lambda > log_A;
+                }
+
+                if (reject)
+                {
+                    td.stats.residual_evaluations += block_end;
+                    td.stats.early_rejected++;
+                    return -1;
+                }
+            }
+        }
+        td.stats.residual_evaluations += N;
+        return count;
+    }
+
+    // Inner RANSAC on the inliers of the current best model of this thread followed by a least squares fit to all
+    // inliers. The SPRT is not used here, because the local models are expected to be good.
+    void localOptimization(ThreadData& td)
+    {
+        td.stats.local_optimizations++;
+
+        auto collectInliers = [&]() {
+            td.indices.clear();
+            for (int i = 0; i < N; ++i)
+            {
+                if (td.bestMask[i]) td.indices.push_back(i);
+            }
+        };
+
+        for (int it = 0; it <= params.localOptimization; ++it)
+        {
+            collectInliers();
+            int n = td.indices.size();
+            if (n <= ModelSize) break;
+
+            // The last iteration uses all inliers
+            if (it < params.localOptimization)
+            {
+                n = std::min(n, params.localOptimizationSampleSize);
+                for (int i = 0; i < n; ++i)
+                {
+                    std::uniform_int_distribution<int> dis(i, td.indices.size() - 1);
+                    std::swap(td.indices[i], td.indices[dis(td.generator)]);
+                }
+            }
+
+            if (!derived().computeModelNonMinimal(ArrayView<const int>(td.indices.data(), n), td.model)) continue;
+
+            int count = score(td, td.bestCount, false);
+            if (count > td.bestCount)
+            {
+                td.bestCount = count;
+                td.bestModel = td.model;
+                std::swap(td.mask, td.bestMask);
+            }
+        }
+    }
+
+    void updateGlobalBest(int count)
+    {
+#pragma omp critical(saiga_ransac_best)
+        {
+            int current;
+#pragma omp atomic read
+            current = globalBestCount;
+            if (count > current)
+            {
+#pragma omp atomic write
+                globalBestCount = count;
+
+                if (params.confidence > 0)
+                {
+                    int required = RansacIterationsFromInlierRatio(double(count) / N, params.confidence, ModelSize,
+                                                                   params.maxIterations);
+                    int limit    = std::min(iterationLimit, required);
+#pragma omp atomic write
+                    iterationLimit = limit;
+                }
+            }
+        }
+    }
 };
 
 inline int RansacIterationsFromProbability(int input_N, double probability, int minInliers, int maxIterations)
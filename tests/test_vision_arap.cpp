@@ -0,0 +1,93 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+#include "saiga/config.h"
+#include "saiga/core/Core.h"
+#include "saiga/vision/arap/ArapProblem.h"
+#include "saiga/vision/recursive/RecursiveArap.h"
+
+#include "gtest/gtest.h"
+
+#include "compare_numbers.h"
+
+namespace Saiga
+{
+// A regular grid in the xz-plane with two corners moved upwards.
+static ArapProblem GridProblem(int w, int h)
+{
+    ArapProblem problem;
+    problem.n = w * h;
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            problem.vertices.emplace_back(Quat::Identity(), Vec3(x, 0, y));
+        }
+    }
+
+    auto add = [&](int i, int j) {
+        Vec3 e_ij = problem.vertices[i].translation() - problem.vertices[j].translation();
+        problem.constraints.push_back({{i, j}, e_ij, problem.wReg});
+    };
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            int i = y * w + x;
+            if (x + 1 < w) add(i, i + 1);
+            if (y + 1 < h) add(i, i + w);
+            if (x + 1 < w && y + 1 < h) add(i, i + w + 1);
+        }
+    }
+    std::sort(problem.constraints.begin(), problem.constraints.end());
+
+    for (int id : {0, w * h - 1})
+    {
+        problem.target_indices.push_back(id);
+        problem.target_positions.push_back(problem.vertices[id].translation() + Vec3(0, 1, 0));
+    }
+    return problem;
+}
+
+TEST(Arap, OMP)
+{
+    auto problem = GridProblem(20, 15);
+
+    for (auto solver_type : {OptimizationOptions::SolverType::Direct, OptimizationOptions::SolverType::Iterative})
+    {
+        OptimizationOptions options;
+        options.maxIterations          = 10;
+        options.maxIterativeIterations = 1000;
+        options.iterativeTolerance     = 1e-20;
+        options.solverType             = solver_type;
+
+        ArapProblem serial = problem;
+        {
+            RecursiveArap arap;
+            arap.optimizationOptions = options;
+            arap.create(serial);
+            arap.initAndSolve();
+        }
+
+        ArapProblem parallel = problem;
+        {
+            RecursiveArap arap;
+            arap.optimizationOptions            = options;
+            arap.optimizationOptions.numThreads = 4;
+            arap.create(parallel);
+            arap.initOMP();
+            arap.solveOMP();
+        }
+
+        EXPECT_LT(serial.chi2(), problem.chi2());
+        ExpectCloseRelative(serial.chi2(), parallel.chi2(), 1e-5);
+        for (int i = 0; i < (int)problem.vertices.size(); ++i)
+        {
+            ExpectCloseRelative(serial.vertices[i].translation(), parallel.vertices[i].translation(), 1e-5, false);
+        }
+    }
+}
+
+}  // namespace Saiga
@@ -252,6 +252,151 @@ TEST(BoW, Full)
     testVocMatching(features, orbVoc2);
 }
 
+TEST(BoW, SaveLoad)
+{
+    std::vector<std::vector<Descriptor>> features;
+    loadFeatures(features);
+
+    srand(23053250);
+    OrbVocabulary2 voc(9, 3);
+    voc.create(features);
+    voc.saveRaw("bow_test.minibow");
+
+    OrbVocabulary2 loaded;
+    loaded.loadRaw("bow_test.minibow");
+    EXPECT_EQ(loaded.size(), voc.size());
+
+    MiniBow2::BowVector bv, bv2;
+    MiniBow2::FeatureVector fv, fv2;
+    voc.transform(features.front(), bv, fv, 2);
+    loaded.transform(features.front(), bv2, fv2, 2, 4);
+    EXPECT_EQ(bv, bv2);
+    EXPECT_EQ(fv, fv2);
+
+    // Memory mapped compiled vocabulary
+    voc.saveCompiled("bow_test.minibowc");
+    OrbVocabulary2 mapped;
+    mapped.loadCompiled("bow_test.minibowc");
+    EXPECT_EQ(mapped.size(), voc.size());
+    for (int i = 0; i < (int)voc.size(); ++i)
+    {
+        EXPECT_EQ(mapped.getWord(i), voc.getWord(i));
+        EXPECT_EQ(mapped.getWordWeight(i), voc.getWordWeight(i));
+    }
+    mapped.transform(features.front(), bv2, fv2, 2, 4);
+    EXPECT_EQ(bv, bv2);
+    EXPECT_EQ(fv, fv2);
+}
+
+TEST(BoW, ParallelTraining)
+{
+    std::vector<std::vector<Descriptor>> features;
+    loadFeatures(features);
+
+    // With a fixed seed the vocabulary does not depend on the number of threads
+    OrbVocabulary2::TrainingParameters params;
+    params.seed = 3465;
+
+    std::vector<MiniBow2::BowVector> bvs;
+    for (int threads : {1, 2, 4})
+    {
+        params.num_threads = threads;
+        OrbVocabulary2 voc(9, 3);
+        voc.create(features, params);
+        EXPECT_EQ(voc.size(), 729);
+
+        MiniBow2::BowVector bv;
+        MiniBow2::FeatureVector fv;
+        voc.transform(features.front(), bv, fv, 2);
+        bvs.push_back(bv);
+    }
+    EXPECT_EQ(bvs[0], bvs[1]);
+    EXPECT_EQ(bvs[0], bvs[2]);
+
+    // Tree from a subset, weights from all features
+    params.max_training_features = 1000;
+    OrbVocabulary2 voc(9, 3);
+    voc.create(features, params);
+    EXPECT_GT(voc.size(), 0);
+    EXPECT_LE(voc.size(), 729);
+    for (int i = 0; i < (int)voc.size(); ++i)
+    {
+        EXPECT_GE(voc.getWordWeight(i), 0);
+    }
+}
+
+TEST(BoW, Database)
+{
+    std::vector<std::vector<Descriptor>> features;
+    loadFeatures(features);
+
+    srand(23053250);
+    OrbVocabulary2 voc(9, 3);
+    voc.create(features);
+
+    // Random keyframes with 200 features each
+    const int N = 100;
+    std::vector<MiniBow2::BowVector> bows(N);
+    for (auto& bv : bows)
+    {
+        std::vector<Descriptor> desc(200);
+        for (auto& des : desc)
+        {
+            for (auto& d : des) d = Random::urand64();
+        }
+        MiniBow2::FeatureVector fv;
+        voc.transform(desc, bv, fv, 2);
+    }
+
+    MiniBow2::Database db;
+    for (int i = 0; i < N; ++i)
+    {
+        EXPECT_EQ(db.add(bows[i], i / 10), i);
+    }
+    db.remove(3);
+    EXPECT_EQ(db.size(), N - 1);
+
+    auto brute_force = [&](const MiniBow2::BowVector& query) {
+        std::vector<std::pair<float, int>> scores;
+        for (int i = 0; i < N; ++i)
+        {
+            if (i == 3) continue;
+            scores.push_back({voc.score(query, bows[i]), i});
+        }
+        std::sort(scores.begin(), scores.end(), std::greater<std::pair<float, int>>());
+        return scores;
+    };
+
+    for (int q = 0; q < N; q += 7)
+    {
+        auto ref    = brute_force(bows[q]);
+        auto result = db.query(bows[q], 5);
+        ASSERT_EQ(result.size(), 5);
+        for (int i = 0; i < 5; ++i)
+        {
+            EXPECT_NEAR(result[i].score, ref[i].first, 1e-5);
+        }
+        if (q != 3)
+        {
+            EXPECT_EQ(result[0].id, q);
+            EXPECT_NEAR(result[0].score, 1, 1e-5);
+        }
+
+        // Islands: the score is the sum of all entries of the island
+        auto islands = db.query(bows[q], 100, 0, true);
+        EXPECT_EQ(islands.size(), N / 10);
+        for (auto r : islands)
+        {
+            float sum = 0;
+            for (auto& [score, id] : ref)
+            {
+                if (id / 10 == r.id / 10) sum += score;
+            }
+            EXPECT_NEAR(r.score, sum, 1e-4);
+        }
+    }
+}
+
 TEST(BoW, Orb)
 {
     OrbVocabulary2 orbVoc2;
@@ -12,7 +12,9 @@
 #include "saiga/vision/recursive/BAPointOnly.h"
 #include "saiga/vision/recursive/BARecursive.h"
 #include "saiga/vision/recursive/BARecursiveRel.h"
+#include "saiga/vision/scene/SceneObservations.h"
 #include "saiga/vision/scene/SynteticScene.h"
+#include "saiga/vision/util/OptimizerBenchmark.h"
 //#include "saiga/vision/scene/SynteticScene.h"
 
 
@@ -51,6 +53,17 @@ class BundleAdjustmentTest
         return cpy;
     }
 
+    Scene solveRecFloat(const BAOptions& options)
+    {
+        Scene cpy = scene;
+        BARecf ba;
+        ba.optimizationOptions = opoptions;
+        ba.baOptions           = options;
+        ba.create(cpy);
+        ba.initAndSolve();
+        return cpy;
+    }
+
     Scene solveRecRel(const BAOptions& options)
     {
         Scene cpy = scene;
@@ -230,6 +243,116 @@ TEST(Scene, LoadStore)
     }
 }
 
+TEST(Scene, LoadStoreBinary)
+{
+    Scene scene = SynteticScene::CircleSphere(2500, 65, 250);
+    scene.addImagePointNoise(1.0);
+    scene.images[3].stereoPoints[5].outlier = true;
+    scene.worldPoints[7].constant           = true;
+    scene.saveBinary("test.scene.bin");
+    scene.save("test.scene");
+
+    Scene binary, detected, text;
+    binary.loadBinary("test.scene.bin");
+    detected.load("test.scene.bin");
+    text.load("test.scene");
+
+    for (Scene* s : {&binary, &detected, &text})
+    {
+        ASSERT_EQ(scene.images.size(), s->images.size());
+        ASSERT_EQ(scene.worldPoints.size(), s->worldPoints.size());
+        EXPECT_EQ(scene.intrinsics.size(), s->intrinsics.size());
+        EXPECT_EQ(scene.bf, s->bf);
+        EXPECT_EQ(scene.globalScale, s->globalScale);
+
+        for (int i = 0; i < (int)scene.worldPoints.size(); ++i)
+        {
+            EXPECT_EQ(scene.worldPoints[i].p, s->worldPoints[i].p);
+            EXPECT_EQ(scene.worldPoints[i].stereoreferences.size(), s->worldPoints[i].stereoreferences.size());
+        }
+
+        for (int i = 0; i < (int)scene.images.size(); ++i)
+        {
+            EXPECT_EQ(scene.images[i].se3.params(), s->images[i].se3.params());
+            EXPECT_EQ(scene.images[i].intr, s->images[i].intr);
+            ASSERT_EQ(scene.images[i].stereoPoints.size(), s->images[i].stereoPoints.size());
+            for (int j = 0; j < (int)scene.images[i].stereoPoints.size(); ++j)
+            {
+                EXPECT_EQ(scene.images[i].stereoPoints[j].wp, s->images[i].stereoPoints[j].wp);
+                EXPECT_EQ(scene.images[i].stereoPoints[j].point, s->images[i].stereoPoints[j].point);
+                EXPECT_EQ(scene.images[i].stereoPoints[j].depth, s->images[i].stereoPoints[j].depth);
+            }
+        }
+    }
+
+    // The text format does not store outliers and constant points
+    EXPECT_TRUE(binary.images[3].stereoPoints[5].outlier);
+    EXPECT_TRUE(binary.worldPoints[7].constant);
+    EXPECT_EQ(scene.chi2(), binary.chi2());
+}
+
+TEST(Scene, Observations)
+{
+    Scene scene = SynteticScene::CircleSphere(2500, 65, 250);
+    scene.addImagePointNoise(1.0);
+    scene.images[3].stereoPoints[5].outlier = true;
+
+    SceneObservations obs;
+    obs.build(scene);
+    obs.buildPointIndex(scene.worldPoints.size());
+
+    // CSR by image
+    ASSERT_EQ(obs.imageOffsets.size(), obs.images.size() + 1);
+    EXPECT_EQ(obs.imageOffsets.back(), obs.size());
+    for (int i = 0; i < obs.numImages(); ++i)
+    {
+        for (int o = obs.imageOffsets[i]; o < obs.imageOffsets[i + 1]; ++o)
+        {
+            EXPECT_EQ(obs.imageId[o], obs.images[i]);
+            auto& ip = scene.images[obs.images[i]].stereoPoints[obs.imagePointId[o]];
+            EXPECT_EQ(ip.wp, obs.pointId[o]);
+            EXPECT_EQ(ip.point, obs.point[o]);
+            EXPECT_EQ(ip.outlier, (bool)obs.outlier[o]);
+        }
+    }
+
+    // CSR by point
+    for (int j = 0; j < (int)scene.worldPoints.size(); ++j)
+    {
+        EXPECT_EQ(obs.pointOffsets[j + 1] - obs.pointOffsets[j], scene.worldPoints[j].stereoreferences.size());
+        for (int k = obs.pointOffsets[j]; k < obs.pointOffsets[j + 1]; ++k)
+        {
+            EXPECT_EQ(obs.pointId[obs.pointObservations[k]], j);
+        }
+    }
+
+    ExpectCloseRelative(scene.chi2(), scene.chi2(obs), 1e-10);
+    ExpectCloseRelative(scene.chi2(1), scene.chi2(obs, 1), 1e-10);
+
+    // Write changed values to a copy and read them back
+    Scene cpy = scene;
+    for (auto& w : obs.weight) w = 0.5;
+    obs.apply(cpy);
+    SceneObservations obs2;
+    obs2.build(cpy);
+    EXPECT_EQ(obs.weight, obs2.weight);
+    EXPECT_EQ(obs.pointId, obs2.pointId);
+    obs.updateValues(scene);
+    ExpectCloseRelative(scene.chi2(), scene.chi2(obs), 1e-10);
+
+    Scene ref = scene;
+    ref.removeOutliers(2);
+    scene.removeOutliers(obs, 2);
+    for (int i = 0; i < (int)scene.images.size(); ++i)
+    {
+        for (int j = 0; j < (int)scene.images[i].stereoPoints.size(); ++j)
+        {
+            EXPECT_EQ(scene.images[i].stereoPoints[j].wp, ref.images[i].stereoPoints[j].wp);
+        }
+    }
+    ExpectCloseRelative(ref.chi2(), scene.chi2(), 1e-10);
+}
+
 
 TEST(BundleAdjustment, Empty)
 {
@@ -297,6 +420,100 @@ TEST(BundleAdjustment, DefaultParallel)
 }
 
 
+TEST(BundleAdjustment, DirectSupernodal)
+{
+    BundleAdjustmentTest test;
+    test.opoptions.solverType = OptimizationOptions::SolverType::Direct;
+
+    // Never use the supernodal factorization
+    BAOptions options;
+    options.supernodalDensity = 2;
+    auto ref = test.solveRec(options);
+
+    // Always use the supernodal factorization
+    options.supernodalDensity = -1;
+    auto res = test.solveRec(options);
+
+    ExpectClose(ref.chi2(), res.chi2(), 1e-5);
+}
+
+TEST(BundleAdjustment, SinglePrecision)
+{
+    for (auto solverType : {OptimizationOptions::SolverType::Iterative, OptimizationOptions::SolverType::Direct})
+    {
+        BundleAdjustmentTest test;
+        test.opoptions.solverType = solverType;
+
+        BAOptions options;
+        auto ref = test.solveRec(options);
+        auto res = test.solveRecFloat(options);
+        ExpectCloseRelative(ref.chi2(), res.chi2(), 1e-5);
+
+        options.solver_threads = 4;
+        res                    = test.solveRecFloat(options);
+        ExpectCloseRelative(ref.chi2(), res.chi2(), 1e-5);
+    }
+}
+
+
+TEST(BundleAdjustment, SlidingWindow)
+{
+    BundleAdjustmentTest test;
+    test.opoptions.solverType = OptimizationOptions::SolverType::Direct;
+    // Fixes the gauge. Otherwise the poses of the prior factors can drift away from the (stale) scene poses of
+    // the marginalized images.
+    test.scene.images[0].constant = true;
+
+    BAOptions options;
+    auto ref = test.solveRec(options);
+
+    // A window with all images is identical to the full problem
+    Scene scene = test.scene;
+    BARec ba;
+    ba.optimizationOptions = test.opoptions;
+    ba.baOptions           = options;
+    ba.create(scene);
+    for (int i = 0; i < (int)scene.images.size(); ++i) ba.addWindowImage(i);
+    ba.solveWindow();
+    ExpectCloseRelative(ref.chi2(), scene.chi2(), 1e-5);
+
+    // Solving again reuses the structure
+    ba.solveWindow();
+    ExpectCloseRelative(ref.chi2(), scene.chi2(), 1e-5);
+
+    // Marginalizing images at the optimum must not move the solution
+    double chi2 = scene.chi2();
+    ba.removeWindowImage(0);
+    ba.removeWindowImage(1);
+    EXPECT_EQ(ba.windowImages().size(), scene.images.size() - 2);
+    EXPECT_EQ(ba.numPriorFactors(), 2);
+    ba.solveWindow();
+    ExpectCloseRelative(chi2, scene.chi2(), 1e-5);
+
+    // The prior factors keep the correlations between the points of the marginalized images. Therefore the
+    // window converges back to the optimum of the full problem after the points have been moved. Only the points
+    // of the window are moved, because all other points are fixed.
+    std::vector<bool> moved(scene.worldPoints.size(), false);
+    for (auto i : ba.windowImages())
+    {
+        for (auto& ip : scene.images[i].stereoPoints)
+        {
+            if (ip.wp == -1 || moved[ip.wp]) continue;
+            scene.worldPoints[ip.wp].p += Random::MatrixGauss<Vec3>(0, 0.01);
+            moved[ip.wp] = true;
+        }
+    }
+    EXPECT_GT(scene.chi2(), chi2 * 1.5);
+    ba.solveWindow();
+    ExpectCloseRelative(chi2, scene.chi2(), 1e-3);
+
+    // Adding a marginalized image again replaces its prior factor by the observations
+    ba.addWindowImage(1);
+    EXPECT_EQ(ba.numPriorFactors(), 1);
+    ba.solveWindow();
+    ExpectCloseRelative(chi2, scene.chi2(), 1e-3);
+}
+
 TEST(BundleAdjustment, DefaultDepth)
 {
     for (int i = 0; i < 5; ++i)
@@ -449,4 +666,44 @@ TEST(BundleAdjustment, SLAM_LBA)
     //    test.BenchmarkRecursive("Huber", local_op_options, local_ba_options);
 }
 
+
+TEST(BundleAdjustment, Benchmark)
+{
+    Scene scene = SynteticScene::CircleSphere(500, 10, 100);
+    scene.addWorldPointNoise(0.01);
+    scene.addImagePointNoise(1.0);
+
+    OptimizerBenchmarkParams params;
+    params.max_iterations = 3;
+
+    OptimizerBenchmark benchmark;
+    auto& r = benchmark.run("ba", "synthetic", "recursive", 3, [&]() {
+        Scene cpy = scene;
+        BARec ba;
+        ba.optimizationOptions = params.optimizationOptions();
+        ba.create(cpy);
+        return ba.initAndSolve();
+    });
+    EXPECT_EQ(r.iterations, 3);
+    EXPECT_LT(r.chi2_final, r.chi2_initial);
+    EXPECT_GT(r.time_quadratic_form, 0);
+    EXPECT_GT(r.time_linear_solver, 0);
+    EXPECT_GT(r.time_cost, 0);
+    EXPECT_LE(r.time_quadratic_form + r.time_linear_solver + r.time_cost, r.time_total);
+
+    benchmark.writeJson("benchmark.json");
+    auto baseline = OptimizerBenchmark::readJson("benchmark.json");
+    ASSERT_EQ(baseline.size(), 1);
+    EXPECT_EQ(baseline[0].key(), r.key());
+    EXPECT_EQ(baseline[0].chi2_final, r.chi2_final);
+    EXPECT_EQ(benchmark.compare(baseline), 0);
+
+    // Twice as fast, or a lower error in the baseline are regressions
+    baseline[0].time_total *= 0.5;
+    EXPECT_EQ(benchmark.compare(baseline), 1);
+    baseline[0].time_total = r.time_total;
+    baseline[0].chi2_final *= 0.5;
+    EXPECT_EQ(benchmark.compare(baseline), 1);
+}
+
 }  // namespace Saiga
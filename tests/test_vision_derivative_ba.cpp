@@ -6,6 +6,7 @@
 
 
 #include "saiga/vision/kernels/BA.h"
+#include "saiga/vision/kernels/BABatched.h"
 #include "saiga/vision/util/Random.h"
 
 #include "gtest/gtest.h"
@@ -319,5 +320,85 @@ TEST(NumericDerivative, BundleAdjustmentDistortion)
     ExpectCloseRelative(J_dist_ref, J_dist_3, 1e-5);
     ExpectCloseRelative(J_K_ref, J_K_3, 1e-5);
 }
+
+TEST(NumericDerivative, BundleAdjustmentBatched)
+{
+    Random::setSeed(49367346);
+    SE3 pose_c_w = Random::randomSE3();
+    StereoCamera4 intr;
+    intr.coeffs(Vec6::Random());
+    intr.fx = std::abs(intr.fx) + 1;
+    intr.fy = std::abs(intr.fy) + 1;
+
+    // 13 observations -> one full and one partial batch
+    BABatch<double, 8> batch;
+    BABatch<float, 8> batchf;
+    for (int b = 0; b < 2; ++b)
+    {
+        batch.clear();
+        batchf.clear();
+        int count = b == 0 ? 8 : 5;
+
+        AlignedVector<Vec3> wps;
+        AlignedVector<Vec2> observations;
+        std::vector<double> stereo_points;
+        for (int i = 0; i < count; ++i)
+        {
+            Vec3 wp          = pose_c_w.inverse() * (Vec3::Random() + Vec3(0, 0, 3));
+            Vec2 observation = intr.project(pose_c_w * wp) + Vec2::Random() * 0.5;
+            double stereo    = i % 2 == 0 ? -1 : observation(0) - intr.bf / 3 + Random::sampleDouble(-0.5, 0.5);
+            batch.add(observation, stereo, wp, 2, stereo > 0 ? 1.5 : 0, 0.5);
+            batchf.add(observation.cast<float>(), stereo, wp.cast<float>(), 2, stereo > 0 ? 1.5 : 0, 0.5);
+            wps.push_back(wp);
+            observations.push_back(observation);
+            stereo_points.push_back(stereo);
+        }
+
+        BundleAdjustmentBatch(intr, pose_c_w, batch);
+        BundleAdjustmentBatch(intr.cast<float>(), pose_c_w.cast<float>(), batchf);
+
+        for (int i = 0; i < count; ++i)
+        {
+            Matrix<double, 3, 6> J_pose  = Matrix<double, 3, 6>::Zero();
+            Matrix<double, 3, 3> J_point = Matrix<double, 3, 3>::Zero();
+            Vec3 res                     = Vec3::Zero();
+            if (stereo_points[i] > 0)
+            {
+                res = BundleAdjustmentStereo(intr, observations[i], stereo_points[i], pose_c_w, wps[i], 2, 1.5,
+                                             &J_pose, &J_point)
+                          .first;
+            }
+            else
+            {
+                Matrix<double, 2, 6> J_pose_mono;
+                Matrix<double, 2, 3> J_point_mono;
+                res.head<2>() = BundleAdjustment<double>(intr, observations[i], pose_c_w, wps[i], 2, &J_pose_mono,
+                                                         &J_point_mono)
+                                    .first;
+                J_pose.topRows<2>()  = J_pose_mono;
+                J_point.topRows<2>() = J_point_mono;
+            }
+            auto rw = Kernel::HuberLoss<double>(0.5, res.squaredNorm());
+
+            ExpectCloseRelative(res, batch.Residual(i), 1e-10);
+            ExpectCloseRelative(J_pose, batch.JPose(i), 1e-10);
+            ExpectCloseRelative(J_point, batch.JPoint(i), 1e-10);
+            ExpectCloseRelative(rw(0), batch.chi2(i), 1e-10);
+            ExpectCloseRelative(rw(1), batch.loss_weight(i), 1e-10);
+
+            ExpectCloseRelative(res, batchf.Residual(i).cast<double>(), 1e-3);
+            ExpectCloseRelative(J_pose, batchf.JPose(i).cast<double>(), 1e-3);
+            ExpectCloseRelative(J_point, batchf.JPoint(i).cast<double>(), 1e-3);
+        }
+
+        // Unused lanes don't contribute
+        for (int i = count; i < 8; ++i)
+        {
+            EXPECT_EQ(batch.chi2(i), 0);
+            EXPECT_EQ(batch.loss_weight(i), 0);
+        }
+    }
+}
+
 #endif
 }  // namespace Saiga
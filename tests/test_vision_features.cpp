@@ -0,0 +1,414 @@
+﻿/**
+ * Copyright (c) 2021 Darius Rückert
+ * Licensed under the MIT License.
+ * See LICENSE file for more information.
+ */
+
+
+
+#include "saiga/core/image/templatedImage.h"
+#include "saiga/core/math/random.h"
+#include "saiga/vision/features/FastDetector.h"
+#include "saiga/vision/features/FeatureDistribution.h"
+#include "saiga/vision/features/GuidedMatcher.h"
+#include "saiga/vision/features/ORBExtractor.h"
+#include "saiga/vision/features/OrbDescriptors.h"
+
+#include "gtest/gtest.h"
+
+#include "compare_numbers.h"
+namespace Saiga
+{
+// Random rectangles with noise
+static TemplatedImage<unsigned char> TestImage(int h, int w)
+{
+    TemplatedImage<unsigned char> img(h, w);
+    img.getImageView().set(100);
+    for (int r = 0; r < (h * w) / 200; ++r)
+    {
+        int x0 = Random::uniformInt(0, w - 1);
+        int y0 = Random::uniformInt(0, h - 1);
+        int x1 = std::min(w, x0 + Random::uniformInt(2, 20));
+        int y1 = std::min(h, y0 + Random::uniformInt(2, 20));
+        int v  = Random::uniformInt(0, 255);
+        for (int y = y0; y < y1; ++y)
+        {
+            for (int x = x0; x < x1; ++x) img(y, x) = v;
+        }
+    }
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x) img(y, x) = std::clamp(img(y, x) + Random::uniformInt(-3, 3), 0, 255);
+    }
+    return img;
+}
+
+// Direct implementation of the definition
+static bool IsCorner(ImageView<unsigned char> img, int x, int y, int t, int arc_length)
+{
+    const int cx[16] = {0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3, -3, -3, -2, -1};
+    const int cy[16] = {-3, -3, -2, -1, 0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3};
+    int p            = img(y, x);
+    for (int start = 0; start < 16; ++start)
+    {
+        bool bright = true, dark = true;
+        for (int k = 0; k < arc_length; ++k)
+        {
+            int c = img(y + cy[(start + k) % 16], x + cx[(start + k) % 16]);
+            bright &= c > p + t;
+            dark &= c < p - t;
+        }
+        if (bright || dark) return true;
+    }
+    return false;
+}
+
+TEST(FastDetector, Score)
+{
+    auto img = TestImage(40, 70);
+    for (int arc_length : {9, 12})
+    {
+        FastDetector fast(arc_length);
+        for (int y = 3; y < img.rows - 3; ++y)
+        {
+            for (int x = 3; x < img.cols - 3; ++x)
+            {
+                int score = fast.Score(img, x, y);
+                for (int t : {0, 5, 20, 50})
+                {
+                    EXPECT_EQ(score >= t, IsCorner(img, x, y, t, arc_length));
+                }
+            }
+        }
+    }
+}
+
+TEST(FastDetector, Detect)
+{
+    auto img = TestImage(240, 320);
+    for (int arc_length : {9, 12})
+    {
+        for (int threshold : {0, 7, 20})
+        {
+            FastDetector fast(arc_length, false);
+            FastDetector fast_nms(arc_length, true);
+
+            // Reference without SIMD
+            std::vector<FastDetector::KeypointType> ref, ref_nms;
+            for (int y = 3; y < img.rows - 3; ++y)
+            {
+                for (int x = 3; x < img.cols - 3; ++x)
+                {
+                    int s = fast.Score(img, x, y);
+                    if (s < threshold) continue;
+                    ref.emplace_back(x, y, 7, -1, s);
+
+                    bool is_max = true;
+                    for (int dy = -1; dy <= 1; ++dy)
+                    {
+                        for (int dx = -1; dx <= 1; ++dx)
+                        {
+                            int nx = x + dx, ny = y + dy;
+                            if ((dx == 0 && dy == 0) || nx < 3 || ny < 3 || nx >= img.cols - 3 || ny >= img.rows - 3)
+                                continue;
+                            if (fast.Score(img, nx, ny) >= threshold && fast.Score(img, nx, ny) >= s) is_max = false;
+                        }
+                    }
+                    if (is_max) ref_nms.emplace_back(x, y, 7, -1, s);
+                }
+            }
+            EXPECT_GT(ref_nms.size(), 0);
+
+            std::vector<FastDetector::KeypointType> keypoints;
+            fast.Detect(img, threshold, keypoints);
+            EXPECT_EQ(keypoints, ref);
+
+            for (int threads : {1, 4})
+            {
+                fast_nms.Detect(img, threshold, keypoints, threads);
+                EXPECT_EQ(keypoints, ref_nms);
+            }
+        }
+    }
+}
+
+TEST(FastDetector, MultipleThresholds)
+{
+    auto img = TestImage(240, 320);
+    FastDetector fast;
+
+    // The corners of a higher threshold are a subset of a single scan with the lower threshold
+    std::vector<FastDetector::KeypointType> low, high;
+    fast.Detect(img, 5, low);
+    fast.Detect(img, 20, high);
+
+    std::vector<FastDetector::KeypointType> filtered;
+    for (auto& kp : low)
+    {
+        if (kp.response >= 20) filtered.push_back(kp);
+    }
+    EXPECT_EQ(filtered, high);
+    EXPECT_GT(low.size(), high.size());
+}
+
+TEST(ORB, BatchedAngleAndDescriptor)
+{
+    auto img = TestImage(120, 160);
+    ORB orb;
+
+    // Integer positions, including the image borders
+    std::vector<KeyPoint<float>> keypoints;
+    for (int i = 0; i < 500; ++i)
+    {
+        KeyPoint<float> kp;
+        kp.point = vec2(Random::uniformInt(19, img.cols - 20), Random::uniformInt(19, img.rows - 20));
+        keypoints.push_back(kp);
+    }
+    keypoints.push_back(KeyPoint<float>(19, 19));
+    keypoints.push_back(KeyPoint<float>(img.cols - 20, img.rows - 20));
+    keypoints.push_back(KeyPoint<float>(19, img.rows - 20));
+
+    orb.ComputeAngles(img, keypoints, 4);
+    for (auto& kp : keypoints)
+    {
+        EXPECT_EQ(kp.angle, orb.ComputeAngle(img, kp.point));
+    }
+
+    // Angles close to the precomputed rotations
+    const float bin_size = 360.f / ORB::num_angle_bins;
+    std::vector<float> bin_angles;
+    for (auto& kp : keypoints)
+    {
+        int bin = Random::uniformInt(0, ORB::num_angle_bins - 1);
+        bin_angles.push_back(bin * bin_size);
+        kp.angle = bin * bin_size + Random::sampleDouble(-0.4, 0.4) * bin_size;
+        if (kp.angle < 0) kp.angle += 360;
+    }
+
+    std::vector<DescriptorORB> descriptors(keypoints.size());
+    orb.ComputeDescriptors(img, keypoints, descriptors, 4);
+    // Only rotated pattern points that are (almost) half way between two pixels can be rounded differently.
+    int num_equal = 0;
+    for (int i = 0; i < (int)keypoints.size(); ++i)
+    {
+        int dis = distance(descriptors[i], orb.ComputeDescriptor(img, keypoints[i].point, bin_angles[i]));
+        EXPECT_LE(dis, 8);
+        num_equal += dis == 0;
+    }
+    EXPECT_GT(num_equal, keypoints.size() * 0.8);
+}
+
+TEST(QuadtreeFeatureDistributor, Distribute)
+{
+    QuadtreeFeatureDistributor distributor;
+    QuadtreeFeatureDistributor::Buffer buffer;
+
+    auto random_keypoints = [](int n, vec2 min_position, vec2 max_position) {
+        std::vector<KeyPoint<float>> keypoints;
+        for (int i = 0; i < n; ++i)
+        {
+            vec2 p(Random::sampleDouble(min_position.x(), max_position.x()),
+                   Random::sampleDouble(min_position.y(), max_position.y()));
+            keypoints.emplace_back(p, 7, -1, Random::sampleDouble(0, 100));
+        }
+        return keypoints;
+    };
+
+    // Less keypoints than requested
+    auto keypoints = random_keypoints(100, vec2(0, 0), vec2(640, 480));
+    EXPECT_EQ(distributor.Distribute(keypoints, vec2(0, 0), vec2(640, 480), 200, buffer), 100);
+
+    // Uniform keypoints: the selection is a subset in the original order and covers the whole image
+    keypoints     = random_keypoints(10000, vec2(0, 0), vec2(640, 480));
+    auto original = keypoints;
+    int n         = distributor.Distribute(keypoints, vec2(0, 0), vec2(640, 480), 500, buffer);
+    EXPECT_EQ(n, 500);
+
+    int j = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        while (j < (int)original.size() && !(original[j] == keypoints[i])) ++j;
+        EXPECT_LT(j, original.size());
+    }
+
+    std::array<int, 16> blocks = {};
+    for (int i = 0; i < n; ++i)
+    {
+        blocks[int(keypoints[i].point.y() / 120) * 4 + int(keypoints[i].point.x() / 160)]++;
+    }
+    for (auto b : blocks) EXPECT_GT(b, 15);
+
+    // The same result with a copy
+    keypoints   = original;
+    auto result = distributor.Distribute(keypoints, vec2(0, 0), vec2(640, 480), 500);
+    EXPECT_EQ(result, std::vector<KeyPoint<float>>(keypoints.begin(), keypoints.begin() + n));
+
+    // All keypoints in a small region: the grid is refined
+    keypoints = random_keypoints(2000, vec2(100, 100), vec2(110, 110));
+    n         = distributor.Distribute(keypoints, vec2(0, 0), vec2(640, 480), 300, buffer);
+    EXPECT_EQ(n, 300);
+
+    // Many keypoints at the same position: the ones with the highest response are used
+    keypoints = random_keypoints(50, vec2(0, 0), vec2(640, 480));
+    for (int i = 0; i < 100; ++i) keypoints.emplace_back(vec2(10, 10), 7, -1, 200 + i);
+    n = distributor.Distribute(keypoints, vec2(0, 0), vec2(640, 480), 100, buffer);
+    EXPECT_EQ(n, 100);
+    for (int i = 0; i < n; ++i)
+    {
+        if (keypoints[i].point == vec2(10, 10)) EXPECT_GE(keypoints[i].response, 250);
+    }
+}
+
+TEST(GuidedMatcher, Match)
+{
+    ScalePyramid pyramid(8, 1.2, 1000);
+
+    FeatureGridBounds2<float, 20> bounds;
+    bounds.bmin        = vec2(0, 0);
+    bounds.bmax        = vec2(640, 480);
+    bounds.cellSize    = vec2(20, 20);
+    bounds.cellSizeInv = bounds.cellSize.array().inverse();
+    bounds.Cols        = 32;
+    bounds.Rows        = 24;
+
+    auto random_descriptor = []() {
+        DescriptorORB d;
+        for (auto& v : d) v = Random::urand64();
+        return d;
+    };
+
+    int N = 2000;
+    std::vector<KeyPoint<float>> keypoints;
+    std::vector<DescriptorORB> descriptors;
+    for (int i = 0; i < N; ++i)
+    {
+        vec2 p(Random::sampleDouble(0, 640), Random::sampleDouble(0, 480));
+        keypoints.emplace_back(p, 7, Random::sampleDouble(0, 360), 0, Random::uniformInt(0, 7));
+        descriptors.push_back(random_descriptor());
+    }
+
+    FeatureGrid2 grid;
+    auto permutation = grid.create(bounds, keypoints);
+    {
+        auto keypoints2   = keypoints;
+        auto descriptors2 = descriptors;
+        for (int i = 0; i < N; ++i)
+        {
+            keypoints2[permutation[i]]   = keypoints[i];
+            descriptors2[permutation[i]] = descriptors[i];
+        }
+        keypoints.swap(keypoints2);
+        descriptors.swap(descriptors2);
+    }
+
+    // Prediction of keypoint i with a few flipped bits and a constant rotation of 40 degrees
+    auto predict = [&](int i) {
+        GuidedMatcher::Prediction p;
+        p.point      = keypoints[i].point + vec2(Random::sampleDouble(-2, 2), Random::sampleDouble(-2, 2));
+        p.radius     = 8;
+        p.descriptor = descriptors[i];
+        for (int k = 0; k < 10; ++k) p.descriptor[Random::uniformInt(0, 3)] ^= 1ull << Random::uniformInt(0, 63);
+        p.angle = keypoints[i].angle + 40;
+        if (p.angle >= 360) p.angle -= 360;
+        p.reference_distance = 10;
+        p.reference_level    = keypoints[i].octave;
+        p.distance           = 10;
+        return p;
+    };
+
+    std::vector<GuidedMatcher::Prediction> predictions;
+    std::vector<int> expected;
+    for (int i = 0; i < N; i += 4)
+    {
+        predictions.push_back(predict(i));
+        expected.push_back(i);
+    }
+
+    // No corresponding keypoint
+    for (int i = 0; i < 100; ++i)
+    {
+        auto p       = predict(Random::uniformInt(0, N - 1));
+        p.descriptor = random_descriptor();
+        predictions.push_back(p);
+        expected.push_back(-1);
+    }
+
+    // Wrong rotation (less than 10% of the largest bin)
+    for (int i = 2; i < 100; i += 4)
+    {
+        auto p  = predict(i);
+        p.angle = std::fmod(p.angle + 180, 360.f);
+        predictions.push_back(p);
+        expected.push_back(-1);
+    }
+
+    // Inconsistent scale
+    for (int i = 3; i < 200; i += 4)
+    {
+        auto p            = predict(i);
+        p.reference_level = (keypoints[i].octave + 4) % 8;
+        predictions.push_back(p);
+        expected.push_back(-1);
+    }
+
+    // Outside of the grid
+    predictions.push_back(predict(1));
+    predictions.back().point = vec2(-100, 50);
+    expected.push_back(-1);
+
+    GuidedMatcher matcher(pyramid);
+    for (int threads : {1, 4})
+    {
+        int n = matcher.Match(bounds, grid, keypoints, descriptors, predictions, threads);
+        EXPECT_EQ(n, matcher.matches.size());
+
+        std::vector<int> result(predictions.size(), -1);
+        for (auto& m : matcher.matches)
+        {
+            result[m.prediction] = m.keypoint;
+            EXPECT_EQ(m.distance, distance(predictions[m.prediction].descriptor, descriptors[m.keypoint]));
+        }
+        EXPECT_EQ(result, expected);
+    }
+}
+
+#ifdef SAIGA_USE_OPENCV
+TEST(ORBExtractor, DetectBatch)
+{
+    // Different sizes and an empty image. The batch size does not divide the number of images.
+    std::vector<TemplatedImage<unsigned char>> images;
+    images.push_back(TestImage(120, 160));
+    images.push_back(TestImage(200, 150));
+    images.emplace_back();
+    images.push_back(TestImage(97, 131));
+    images.push_back(TestImage(120, 160));
+    std::vector<ImageView<unsigned char>> views;
+    for (auto& img : images) views.push_back(img.getImageView());
+
+    std::vector<std::vector<KeyPoint<float>>> expected_keypoints(images.size());
+    std::vector<std::vector<DescriptorORB>> expected_descriptors(images.size());
+    {
+        ORBExtractor extractor(500, 1.2, 4, 20, 7, 4);
+        for (int i = 0; i < (int)images.size(); ++i)
+        {
+            extractor.Detect(views[i], expected_keypoints[i], expected_descriptors[i]);
+        }
+    }
+    EXPECT_GT(expected_keypoints[0].size(), 0);
+    EXPECT_TRUE(expected_keypoints[2].empty());
+
+    ORBExtractor extractor(500, 1.2, 4, 20, 7, 4);
+    int next_image = 0;
+    extractor.DetectBatch(
+        views,
+        [&](int image_id, std::vector<KeyPoint<float>>& keypoints, std::vector<DescriptorORB>& descriptors) {
+            EXPECT_EQ(image_id, next_image++);
+            EXPECT_EQ(keypoints, expected_keypoints[image_id]);
+            EXPECT_EQ(descriptors, expected_descriptors[image_id]);
+        },
+        3);
+    EXPECT_EQ(next_image, images.size());
+}
+#endif
+
+}  // namespace Saiga
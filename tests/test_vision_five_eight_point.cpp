@@ -15,6 +15,7 @@
 #include "saiga/vision/features/Features.h"
 #include "saiga/vision/reconstruction/EightPoint.h"
 #include "saiga/vision/reconstruction/FivePoint.h"
+#include "saiga/vision/reconstruction/Homography.h"
 #include "saiga/vision/reconstruction/TwoViewReconstruction.h"
 #include "saiga/vision/scene/Scene.h"
 #include "saiga/vision/scene/SynteticScene.h"
@@ -265,4 +266,153 @@ TEST(EpipolarGeometry, Benchmark)
     }
 }
 
+TEST(EpipolarGeometry, RansacEarlyTermination)
+{
+    Random::setSeed(4967203);
+    Mat3 H;
+    H << 1.1, 0.05, 3, 0.02, 0.9, -2, 1e-4, 2e-4, 1;
+
+    // The first 70% are inliers, so that the points are ordered by quality for PROSAC.
+    int N           = 1000;
+    int num_inliers = N * 7 / 10;
+    std::vector<Vec2> points1, points2;
+    for (int i = 0; i < N; ++i)
+    {
+        Vec2 p1(Random::sampleDouble(0, 640), Random::sampleDouble(0, 480));
+        Vec2 p2;
+        if (i < num_inliers)
+        {
+            p2 = (H * p1.homogeneous()).hnormalized() + Vec2(Random::gaussRand(0, 0.3), Random::gaussRand(0, 0.3));
+        }
+        else
+        {
+            p2 = Vec2(Random::sampleDouble(0, 640), Random::sampleDouble(0, 480));
+        }
+        points1.push_back(p1);
+        points2.push_back(p2);
+    }
+
+    RansacParameters params;
+    params.maxIterations     = 500;
+    params.residualThreshold = 2.0 * 2.0;
+    params.reserveN          = N;
+    params.threads           = 4;
+
+    auto run = [&](const RansacParameters& params) {
+        HomographyRansac hr(params);
+        Mat3 result;
+        int inliers = hr.solve(points1, points2, result);
+        std::cout << "Ransac inliers " << inliers << " iterations " << hr.Stats().iterations << " rejected "
+                  << hr.Stats().early_rejected << " residuals " << hr.Stats().residual_evaluations << std::endl;
+        EXPECT_GT(inliers, num_inliers * 0.95);
+        EXPECT_LE(inliers, num_inliers + N / 100);
+        return hr.Stats();
+    };
+
+    auto full = run(params);
+    EXPECT_EQ(full.iterations, params.maxIterations);
+    EXPECT_LT(full.residual_evaluations, long(N) * params.maxIterations);
+
+    auto adaptive_params       = params;
+    adaptive_params.confidence = 0.999;
+    auto adaptive              = run(adaptive_params);
+    EXPECT_LT(adaptive.iterations, full.iterations);
+
+    auto sprt_params          = adaptive_params;
+    sprt_params.sprt          = true;
+    sprt_params.preTestPoints = 1;
+    auto sprt                 = run(sprt_params);
+    EXPECT_LT(sprt.residual_evaluations, full.residual_evaluations);
+
+    auto prosac_params   = adaptive_params;
+    prosac_params.prosac = true;
+    run(prosac_params);
+}
+
+TEST(EpipolarGeometry, RansacTooFewPoints)
+{
+    // Less points than a single sample needs. No model is computed.
+    RansacParameters params;
+    params.maxIterations     = 100;
+    params.residualThreshold = 2.0 * 2.0;
+    params.reserveN          = 4;
+    params.threads           = 4;
+    params.prosac            = true;
+
+    for (int N = 0; N < 4; ++N)
+    {
+        std::vector<Vec2> points1, points2;
+        for (int i = 0; i < N; ++i)
+        {
+            points1.push_back(Vec2(Random::sampleDouble(0, 640), Random::sampleDouble(0, 480)));
+            points2.push_back(points1.back());
+        }
+
+        HomographyRansac hr(params);
+        Mat3 result;
+        EXPECT_EQ(hr.solve(points1, points2, result), 0);
+        EXPECT_EQ(hr.Stats().iterations, 0);
+    }
+}
+
+TEST(EpipolarGeometry, RansacLocalOptimization)
+{
+    Random::setSeed(7240165);
+    FiveEightPointTest test;
+
+    // Add noise and outliers
+    auto points2 = test.normalized_points2;
+    for (int i = 0; i < test.N; ++i)
+    {
+        points2[i] += Vec2(Random::gaussRand(0, 0.5 / 500), Random::gaussRand(0, 0.5 / 500));
+        if (i % 3 == 0) points2[i] += Vec2::Random() * 0.1;
+    }
+
+    RansacParameters params;
+    params.maxIterations     = 50;
+    double epipolarTheshold  = 1.5 / 500;
+    params.residualThreshold = epipolarTheshold * epipolarTheshold;
+    params.reserveN          = test.N;
+    params.threads           = 1;
+
+    FivePointRansac fpr(params);
+
+    // Batched and single residuals must be identical
+    {
+        Mat3 E = EssentialMatrix(SE3(), test.reference_T);
+        std::vector<double> residuals(test.N);
+        fpr.points1 = test.normalized_points1;
+        fpr.points2 = points2;
+        fpr.computeResiduals({E, test.reference_T}, 0, test.N, residuals.data());
+        for (int i = 0; i < test.N; ++i)
+        {
+            ExpectClose(residuals[i], fpr.computeResidual({E, test.reference_T}, i), 1e-15);
+        }
+    }
+
+    auto run = [&](const RansacParameters& params) {
+        FivePointRansac fpr(params);
+        Mat3 E;
+        SE3 T;
+        std::vector<int> inliers;
+        std::vector<char> mask;
+        int num_inliers;
+#pragma omp parallel num_threads(params.threads)
+        {
+            num_inliers = fpr.solve(test.normalized_points1, points2, E, T, inliers, mask);
+        }
+        std::cout << "Ransac inliers " << num_inliers << " local optimizations " << fpr.Stats().local_optimizations
+                  << std::endl;
+        return num_inliers;
+    };
+
+    int without_lo = run(params);
+
+    params.localOptimization = 10;
+    int with_lo              = run(params);
+
+    EXPECT_GE(with_lo, without_lo);
+    EXPECT_GT(with_lo, test.N * 0.5);
+}
+
 }  // namespace Saiga
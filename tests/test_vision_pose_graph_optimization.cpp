@@ -8,6 +8,7 @@
 #include "saiga/core/time/all.h"
 #include "saiga/core/util/fileChecker.h"
 #include "saiga/vision/ceres/CeresPGO.h"
+#include "saiga/vision/recursive/PGOIncremental.h"
 #include "saiga/vision/recursive/PGORecursive.h"
 #include "saiga/vision/recursive/PGOSim3Recursive.h"
 #include "saiga/vision/scene/SynteticPoseGraph.h"
@@ -50,6 +51,42 @@ class PoseGraphOptimizationTest
         return cpy;
     }
 
+    PoseGraph solveRecOMP(int threads)
+    {
+        PoseGraph cpy = scene;
+
+        std::unique_ptr<LMOptimizer> ba;
+        if (cpy.fixScale)
+        {
+            auto rec = std::make_unique<PGORec>();
+            rec->create(cpy);
+            ba = std::move(rec);
+        }
+        else
+        {
+            auto rec = std::make_unique<PGOSim3Rec>();
+            rec->create(cpy);
+            ba = std::move(rec);
+        }
+        ba->optimizationOptions            = opoptions;
+        ba->optimizationOptions.numThreads = threads;
+        ba->initOMP();
+        ba->solveOMP();
+        return cpy;
+    }
+
+    void testOMP(OptimizationOptions::SolverType solver_type)
+    {
+        opoptions.solverType = solver_type;
+
+        auto scene1 = solveRec();
+        auto scene2 = solveRecOMP(4);
+
+        std::cout << scene.chi2() << " -> (Saiga) " << scene1.chi2() << " (Saiga OMP) " << scene2.chi2() << std::endl;
+
+        ExpectClose(scene1.chi2(), scene2.chi2(), 1e-5);
+    }
+
     PoseGraph solveCeres()
     {
         PoseGraph cpy = scene;
@@ -159,4 +196,84 @@ TEST(PoseGraphOptimization, LoopClosingSim3)
     }
 }
 
+TEST(PoseGraphOptimization, LoopClosingOMP)
+{
+    for (auto solver_type : {OptimizationOptions::SolverType::Direct, OptimizationOptions::SolverType::Iterative})
+    {
+        PoseGraphOptimizationTest test;
+        test.buildScene(false);
+        test.testOMP(solver_type);
+
+        PoseGraphOptimizationTest test_sim3;
+        test_sim3.buildScene(true);
+        test_sim3.testOMP(solver_type);
+    }
+}
+
+TEST(PoseGraphOptimization, Incremental)
+{
+    PoseGraph scene = SyntheticPoseGraph::CircleWithDrift(5, 250, 6, 0.01, 0);
+    scene.addNoise(0.01);
+
+    OptimizationOptions opoptions;
+    opoptions.debugOutput   = false;
+    opoptions.maxIterations = 20;
+    opoptions.solverType    = OptimizationOptions::SolverType::Direct;
+
+    PoseGraph ref = scene;
+    PGORec rec;
+    rec.optimizationOptions = opoptions;
+    rec.create(ref);
+    rec.initAndSolve();
+
+    // Complete graph in a single update
+    {
+        PoseGraph cpy = scene;
+        PGOIncremental::Params params;
+        params.iterations = 10;
+        PGOIncremental pgo(params);
+        pgo.create(cpy);
+        auto result = pgo.update();
+        EXPECT_EQ(result.new_vertices, scene.vertices.size());
+        EXPECT_EQ(result.new_edges, scene.edges.size());
+
+        std::cout << scene.chi2() << " -> (Saiga) " << ref.chi2() << " (Incremental) " << cpy.chi2() << std::endl;
+        ExpectCloseRelative(ref.chi2(), cpy.chi2(), 1e-3);
+    }
+
+    // Vertices and edges are added one keyframe at a time. The last vertex closes the loop.
+    {
+        PoseGraph cpy;
+        cpy.fixScale = true;
+        PGOIncremental pgo;
+        pgo.create(cpy);
+
+        int e                = 0;
+        int max_refactorized = 0;
+        for (int i = 0; i < (int)scene.vertices.size(); ++i)
+        {
+            cpy.vertices.push_back(scene.vertices[i]);
+            for (auto& edge : scene.edges)
+            {
+                if (std::max(edge.from, edge.to) == i) cpy.edges.push_back(edge);
+            }
+            auto result = pgo.update();
+            EXPECT_EQ(result.num_vertices, i + 1);
+            if (i + 1 < (int)scene.vertices.size())
+            {
+                max_refactorized = std::max(max_refactorized, result.refactorized_columns);
+            }
+            e += result.new_edges;
+        }
+        EXPECT_EQ(e, scene.edges.size());
+
+        // Odometry updates only touch the last few columns of the factorization
+        EXPECT_LT(max_refactorized, 30);
+
+        for (int i = 0; i < 10; ++i) pgo.update();
+        std::cout << scene.chi2() << " -> (Saiga) " << ref.chi2() << " (Incremental) " << cpy.chi2() << std::endl;
+        ExpectCloseRelative(ref.chi2(), cpy.chi2(), 1e-3);
+    }
+}
+
 }  // namespace Saiga
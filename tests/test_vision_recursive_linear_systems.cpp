@@ -123,6 +123,245 @@ TEST(RecursiveLinearSolver, SparseBlock)
     }
 }
 
+TEST(RecursiveLinearSolver, BlockOrdering)
+{
+    Random::setSeed(3457347);
+    srand(745764);
+    // A grid structured sparse block matrix (similar to ARAP on a regular mesh).
+    // The recursive ldlt must give the same result for all fill reducing orderings.
+
+    using T              = double;
+    const int block_size = 3;
+    int w                = 12;
+    int h                = 9;
+    int n                = w * h;
+
+    using Block  = Eigen::Matrix<T, block_size, block_size>;
+    using Vector = Eigen::Matrix<T, block_size, 1>;
+    using AType  = Eigen::SparseMatrix<Eigen::Recursive::MatrixScalar<Block>, Eigen::RowMajor>;
+    using BType  = Eigen::Matrix<Eigen::Recursive::MatrixScalar<Vector>, -1, 1>;
+
+    AType A(n, n);
+    BType b(n);
+
+    typedef Eigen::Triplet<Block> Trip;
+    std::vector<Trip> tripletList;
+
+    for (int i = 0; i < n; ++i)
+    {
+        Block diag = Block::Random();
+        diag       = diag.selfadjointView<Eigen::Upper>();
+        diag.diagonal() += Vector::Ones() * 20;
+        tripletList.push_back(Trip(i, i, diag));
+        b(i) = Vector::Random();
+    }
+
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            int i = y * w + x;
+            if (x + 1 < w) tripletList.push_back(Trip(i, i + 1, Block::Random()));
+            if (y + 1 < h) tripletList.push_back(Trip(i, i + w, Block::Random()));
+        }
+    }
+    A.setFromTriplets(tripletList.begin(), tripletList.end());
+
+    using Ordering  = Eigen::Recursive::LinearSolverOptions::Ordering;
+    int naturalFill = 0;
+    for (auto ordering : {Ordering::Natural, Ordering::AMD, Ordering::NestedDissection})
+    {
+        Eigen::RecursiveSimplicialLDLT<AType, Eigen::Upper> rec_ldlt;
+        Eigen::Recursive::computeBlockOrdering(A, ordering, rec_ldlt.m_Pinv);
+
+        // Must be a valid permutation
+        ASSERT_EQ(rec_ldlt.m_Pinv.size(), n);
+        std::vector<int> count(n, 0);
+        for (int i = 0; i < n; ++i) count[rec_ldlt.m_Pinv.indices()[i]]++;
+        for (int i = 0; i < n; ++i) EXPECT_EQ(count[i], 1);
+
+        rec_ldlt.compute(A);
+        BType x        = rec_ldlt.solve(b);
+        BType residual = A.template selfadjointView<Eigen::Upper>() * x - b;
+        EXPECT_LE(expand(residual).squaredNorm(), 1e-10);
+
+        // The fill reducing orderings must produce a sparser factor than the banded natural ordering
+        int fill = rec_ldlt.matrixL().nestedExpression().nonZeros();
+        if (ordering == Ordering::Natural)
+            naturalFill = fill;
+        else
+            EXPECT_LT(fill, naturalFill);
+
+        // Refactorization reuses the ordering
+        rec_ldlt.factorize(A);
+        x        = rec_ldlt.solve(b);
+        residual = A.template selfadjointView<Eigen::Upper>() * x - b;
+        EXPECT_LE(expand(residual).squaredNorm(), 1e-10);
+    }
+}
+
+TEST(RecursiveLinearSolver, SupernodalLLT)
+{
+    Random::setSeed(5476547);
+    srand(3457);
+    // A dense-ish sparse block matrix similar to the schur complement of a BA problem.
+
+    using T              = double;
+    const int block_size = 6;
+    int n                = 40;
+    double density       = 0.3;
+
+    using Block  = Eigen::Matrix<T, block_size, block_size, Eigen::RowMajor>;
+    using Vector = Eigen::Matrix<T, block_size, 1>;
+    using AType  = Eigen::SparseMatrix<Eigen::Recursive::MatrixScalar<Block>, Eigen::RowMajor>;
+    using BType  = Eigen::Matrix<Eigen::Recursive::MatrixScalar<Vector>, -1, 1>;
+
+    AType A(n, n);
+    BType b(n);
+
+    typedef Eigen::Triplet<Block> Trip;
+    std::vector<Trip> tripletList;
+
+    for (int i = 0; i < n; ++i)
+    {
+        Block diag = Block::Random();
+        diag       = (diag * diag.transpose()).eval();
+        diag.diagonal() += Vector::Ones() * (n * density * block_size + 10);
+        tripletList.push_back(Trip(i, i, diag));
+        b(i) = Vector::Random();
+
+        for (int j = i + 1; j < n; ++j)
+        {
+            if (Random::sampleBool(density)) tripletList.push_back(Trip(i, j, Block::Random()));
+        }
+    }
+    A.setFromTriplets(tripletList.begin(), tripletList.end());
+
+    Eigen::Matrix<double, -1, -1> A_ex = expand(A).selfadjointView<Eigen::Upper>();
+    Eigen::Matrix<double, -1, 1> b_ex  = expand(b);
+    Eigen::Matrix<double, -1, 1> x_ref = A_ex.llt().solve(b_ex);
+
+    using Ordering = Eigen::Recursive::LinearSolverOptions::Ordering;
+    for (auto ordering : {Ordering::Natural, Ordering::AMD, Ordering::NestedDissection})
+    {
+        Eigen::Recursive::RecursiveSupernodalLLT<AType> llt(ordering);
+        llt.compute(A);
+        EXPECT_EQ(llt.info(), Eigen::Success);
+        EXPECT_LT(llt.numSupernodes(), n);
+
+        BType x;
+        llt.solve(b, x);
+        ExpectCloseRelative(expand(x), x_ref, 1e-8, false);
+
+        // Refactorize with new values and the same structure
+        for (int k = 0; k < A.nonZeros(); ++k) A.valuePtr()[k].get() *= 2;
+        llt.factorize(A);
+        llt.solve(b, x);
+        ExpectCloseRelative(expand(x), x_ref * 0.5, 1e-8, false);
+        for (int k = 0; k < A.nonZeros(); ++k) A.valuePtr()[k].get() *= 0.5;
+    }
+}
+
+TEST(RecursiveLinearSolver, ClusterJacobiCG)
+{
+    Random::setSeed(96786);
+    srand(234623);
+    // Strongly coupled grid system. The cluster jacobi preconditioner captures the coupling between
+    // neighbors and must converge at least as fast as the block jacobi preconditioner.
+
+    using T              = double;
+    const int block_size = 3;
+    int w                = 16;
+    int h                = 12;
+    int n                = w * h;
+
+    using Block  = Eigen::Matrix<T, block_size, block_size, Eigen::RowMajor>;
+    using Vector = Eigen::Matrix<T, block_size, 1>;
+    using AType  = Eigen::SparseMatrix<Eigen::Recursive::MatrixScalar<Block>, Eigen::RowMajor>;
+    using BType  = Eigen::Matrix<Eigen::Recursive::MatrixScalar<Vector>, -1, 1>;
+
+    AType A(n, n);
+    BType b(n);
+
+    typedef Eigen::Triplet<Block> Trip;
+    std::vector<Trip> tripletList;
+
+    for (int i = 0; i < n; ++i)
+    {
+        Block diag = Block::Random();
+        diag       = diag.selfadjointView<Eigen::Upper>();
+        diag.diagonal() += Vector::Ones() * 13;
+        tripletList.push_back(Trip(i, i, diag));
+        b(i) = Vector::Random();
+    }
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            int i = y * w + x;
+            if (x + 1 < w) tripletList.push_back(Trip(i, i + 1, Block::Random()));
+            if (y + 1 < h) tripletList.push_back(Trip(i, i + w, Block::Random()));
+        }
+    }
+    A.setFromTriplets(tripletList.begin(), tripletList.end());
+
+    auto applyA = [&](const BType& v, BType& result) { result = A.template selfadjointView<Eigen::Upper>() * v; };
+
+    Eigen::Recursive::RecursiveDiagonalPreconditioner<Eigen::Recursive::MatrixScalar<Block>> P;
+    P.compute(A);
+    BType x1(n);
+    x1.setZero();
+    Eigen::Index iters1 = 200;
+    double tol1         = 1e-10;
+    Eigen::Recursive::recursive_conjugate_gradient(applyA, b, x1, P, iters1, tol1);
+
+    Eigen::Recursive::RecursiveClusterJacobiPreconditioner<Eigen::Recursive::MatrixScalar<Block>> clusterP(4);
+    clusterP.compute(A);
+    EXPECT_LT(clusterP.numClusters(), n);
+    BType x2(n);
+    x2.setZero();
+    Eigen::Index iters2 = 200;
+    double tol2         = 1e-10;
+    Eigen::Recursive::recursive_conjugate_gradient(applyA, b, x2, clusterP, iters2, tol2);
+
+    EXPECT_LE(iters2, iters1);
+    BType residual = A.template selfadjointView<Eigen::Upper>() * x2 - b;
+    EXPECT_LE(expand(residual).squaredNorm(), 1e-10);
+    ExpectCloseRelative(expand(x1), expand(x2), 1e-5, false);
+
+    // The multi threaded cg with the row partitioned symmetric matrix vector product
+    AType AT;
+    std::vector<int> transposeTargets;
+    Eigen::Recursive::transposeStructureOnly_omp(A, AT, transposeTargets);
+    BType x3(n);
+    x3.setZero();
+#pragma omp parallel num_threads(4)
+    {
+        Eigen::Recursive::transposeValueOnly_omp(A, AT, transposeTargets);
+        clusterP.factorize_omp(A);
+        Eigen::Index iters3 = 200;
+        double tol3         = 1e-10;
+        Eigen::Recursive::recursive_conjugate_gradient_OMP(
+            [&](const BType& v, BType& result) { Eigen::Recursive::sparse_selfadjoint_mv_omp(A, AT, v, result); },
+            b, x3, clusterP, iters3, tol3);
+    }
+    ExpectCloseRelative(expand(x2), expand(x3), 1e-5, false);
+
+    // Inexact newton forcing sequence
+    Eigen::Recursive::InexactNewtonForcing forcing;
+    forcing.reset();
+    double eta = forcing.compute(1, 1e-5);
+    EXPECT_EQ(eta, forcing.maxTolerance);
+    // Fast decrease of the residual -> tight tolerance, but never below the lower bound
+    eta = forcing.compute(1e-2, 1e-5);
+    EXPECT_LT(eta, forcing.maxTolerance);
+    EXPECT_GE(eta, 1e-5);
+    eta = forcing.compute(1e-6, 1e-5);
+    EXPECT_EQ(eta, 1e-5);
+    // Rejected step: same right hand side -> same tolerance
+    EXPECT_EQ(forcing.compute(1e-6, 1e-5), eta);
+}
+
 TEST(RecursiveLinearSolver, BA)
 {
     // Symmetric positive BA like matrix.
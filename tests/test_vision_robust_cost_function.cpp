@@ -54,4 +54,25 @@ TEST(Robust, Cauchy)
     }
 }
 
+TEST(Robust, CauchyBatched)
+{
+    using Lane = Eigen::Array<double, 4, 1>;
+    Lane threshold(10, 10, 10, 0);
+    Lane res_2(0, 0.5, 300, 0);
+    Lane loss, weight;
+    Kernel::CauchyLoss(threshold, res_2, loss, weight);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        auto rw = Kernel::CauchyLoss<double>(threshold(i), res_2(i));
+        EXPECT_NEAR(loss(i), rw(0), 1e-10);
+        EXPECT_NEAR(weight(i), rw(1), 1e-10);
+    }
+
+    // A zero residual has the weight 1 and not 0/0
+    EXPECT_EQ(loss(0), 0);
+    EXPECT_EQ(weight(0), 1);
+    EXPECT_EQ(weight(3), 1);
+}
+
 }  // namespace Saiga
@@ -145,6 +145,26 @@ TEST(TSDF, InsertRemoveBlock)
     }
 }
 
+TEST(TSDF, SaveWithHole)
+{
+    SparseTSDF tsdf(1, 1000, 1000);
+    tsdf.InsertBlock({0, 0, 0});
+    tsdf.InsertBlock({2, 1, -1});
+    tsdf.EraseBlockWithHole({2, 1, -1}, tsdf.H({2, 1, -1}));
+
+    // The hole and the new block have the same index
+    tsdf.InsertBlock({2, 1, -1})->data[1][2][3].distance = 5;
+    EXPECT_EQ(tsdf.current_blocks, 3);
+
+    tsdf.Save("tsdf_hole.dat");
+    SparseTSDF loaded;
+    loaded.Load("tsdf_hole.dat");
+    EXPECT_EQ(loaded.current_blocks, 2);
+    EXPECT_TRUE(loaded.GetBlock({0, 0, 0}));
+    ASSERT_TRUE(loaded.GetBlock({2, 1, -1}));
+    EXPECT_EQ(loaded.GetBlock({2, 1, -1})->data[1][2][3].distance, 5);
+}
+
 TEST(TSDF, Crop)
 {
     Random::setSeed(394765346);
@@ -176,6 +196,52 @@ TEST(TSDF, Crop)
     }
 }
 
+TEST(TSDF, ConcurrentInsert)
+{
+    const int n = 16;
+    SparseTSDF tsdf(1, 16, 16);
+    tsdf.Reserve(n * n * n);
+
+    auto* first = tsdf.InsertBlock({0, 0, 0});
+
+    // Each block is inserted twice and looked up by different threads
+#pragma omp parallel for num_threads(4)
+    for (int k = 0; k < 2 * n * n * n; ++k)
+    {
+        ivec3 id(k % n, (k / n) % n, (k / (n * n)) % n);
+        auto* b = tsdf.InsertBlockConcurrent(id);
+        EXPECT_EQ(b->index, id);
+        EXPECT_EQ(tsdf.GetBlock(id), b);
+    }
+    EXPECT_EQ(tsdf.current_blocks, n * n * n);
+
+    // The blocks are never moved
+    EXPECT_EQ(tsdf.GetBlock({0, 0, 0}), first);
+
+    EXPECT_EQ(tsdf.EraseBlocks([](const SparseTSDF::VoxelBlock& b) { return b.index.x() % 2 == 0; }), n * n * n / 2);
+    EXPECT_EQ(tsdf.current_blocks, n * n * n / 2);
+
+    for (int z = 0; z < n; ++z)
+    {
+        for (int y = 0; y < n; ++y)
+        {
+            for (int x = 0; x < n; ++x)
+            {
+                auto* b = tsdf.GetBlock({x, y, z});
+                if (x % 2 == 0)
+                {
+                    EXPECT_FALSE(b);
+                }
+                else
+                {
+                    ASSERT_TRUE(b);
+                    EXPECT_EQ(b->index, ivec3(x, y, z));
+                }
+            }
+        }
+    }
+}
+
 
 TEST(TSDF, VirtualVoxelIndex)
 {
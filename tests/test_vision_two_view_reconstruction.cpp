@@ -13,6 +13,8 @@
 #include "saiga/core/util/fileChecker.h"
 #include "saiga/vision/VisionIncludes.h"
 #include "saiga/vision/features/Features.h"
+#include "saiga/vision/features/HammingMatcher.h"
+#include "saiga/vision/features/MultiIndexHashing.h"
 #include "saiga/vision/reconstruction/EightPoint.h"
 #include "saiga/vision/reconstruction/FivePoint.h"
 #include "saiga/vision/reconstruction/TwoViewReconstruction.h"
@@ -108,6 +110,127 @@ TEST(TwoViewReconstruction, BruteForceMatcherOMP)
     EXPECT_EQ(matcher.matches.size(), test->points1.size());
 }
 
+TEST(TwoViewReconstruction, HammingMatcher)
+{
+    // Batched distances (with a tail that is not a multiple of the SIMD width)
+    std::vector<DescriptorORB> random_desc(1003);
+    for (auto& d : random_desc)
+    {
+        for (auto& w : d) w = (uint64_t(Random::rand()) << 32) ^ Random::rand();
+    }
+    std::vector<int> distances(random_desc.size());
+    hammingDistances(random_desc[0], random_desc.data(), random_desc.size(), distances.data());
+    for (int i = 0; i < (int)random_desc.size(); ++i)
+    {
+        EXPECT_EQ(distances[i], distance(random_desc[0], random_desc[i]));
+    }
+
+    BruteForceMatcher<DescriptorORB> reference;
+    reference.matchKnn2(test->des1, test->des2);
+    reference.filterMatches(100, 0.8);
+
+    for (bool cross_check : {false, true})
+    {
+        HammingMatcher matcher;
+        matcher.matchKnn2(test->des1, test->des2, 4, cross_check);
+        ASSERT_EQ(matcher.knn2.size(), test->des1.size());
+        for (int i = 0; i < (int)test->des1.size(); ++i)
+        {
+            for (int k = 0; k < 2; ++k)
+            {
+                EXPECT_EQ(matcher.knn2[i].distance[k], reference.knn2(i, k).first);
+                EXPECT_EQ(matcher.knn2[i].index[k], reference.knn2(i, k).second);
+            }
+        }
+
+        matcher.filterMatches(100, 0.8, cross_check);
+        if (cross_check)
+        {
+            EXPECT_LE(matcher.matches.size(), reference.matches.size());
+            EXPECT_GT(matcher.matches.size(), reference.matches.size() / 2);
+            for (auto m : matcher.matches)
+            {
+                EXPECT_NE(std::find(reference.matches.begin(), reference.matches.end(), m), reference.matches.end());
+            }
+        }
+        else
+        {
+            EXPECT_EQ(matcher.matches, reference.matches);
+        }
+    }
+
+    // A nested parallel region starts fewer threads than requested
+    {
+        HammingMatcher matcher, nested;
+        matcher.matchKnn2(test->des1, test->des2, 4, true);
+#pragma omp parallel num_threads(2)
+        {
+#pragma omp single
+            nested.matchKnn2(test->des1, test->des2, 4, true);
+        }
+        EXPECT_EQ(nested.reverse_best, matcher.reverse_best);
+    }
+}
+
+TEST(TwoViewReconstruction, MultiIndexHashing)
+{
+    BruteForceMatcher<DescriptorORB> reference;
+    reference.matchKnn2(test->des1, test->des2);
+
+    MultiIndexHashing index;
+    index.build(test->des2, 4);
+    EXPECT_EQ(index.size(), test->des2.size());
+
+    // Exact search
+    std::vector<std::vector<MultiIndexHashing::Result>> knn;
+    index.knn(test->des1, 2, knn, 4);
+    ASSERT_EQ(knn.size(), test->des1.size());
+    for (int i = 0; i < (int)test->des1.size(); ++i)
+    {
+        ASSERT_EQ(knn[i].size(), 2);
+        EXPECT_EQ(knn[i][0].first, reference.knn2(i, 0).first);
+        EXPECT_EQ(knn[i][1].first, reference.knn2(i, 1).first);
+    }
+
+    int radius = 40;
+    std::vector<std::vector<MultiIndexHashing::Result>> neighbours;
+    index.radiusSearch(test->des1, radius, neighbours, 4);
+    for (int i = 0; i < (int)test->des1.size(); i += 10)
+    {
+        std::vector<MultiIndexHashing::Result> expected;
+        for (int j = 0; j < (int)test->des2.size(); ++j)
+        {
+            int dis = distance(test->des1[i], test->des2[j]);
+            if (dis <= radius) expected.push_back({dis, j});
+        }
+        std::sort(expected.begin(), expected.end());
+        EXPECT_EQ(neighbours[i], expected);
+    }
+
+    // Approximate search only finds neighbours with a matching substring
+    int found = 0;
+    index.knn(test->des1, 1, knn, 4, 0);
+    for (int i = 0; i < (int)test->des1.size(); ++i)
+    {
+        if (knn[i].empty()) continue;
+        EXPECT_GE(knn[i][0].first, reference.knn2(i, 0).first);
+        found += knn[i][0].first == reference.knn2(i, 0).first;
+    }
+    EXPECT_GT(found, 0);
+
+    // Removed descriptors are not returned anymore
+    auto nn = index.knn(test->des2[5], 1);
+    EXPECT_EQ(nn.front(), MultiIndexHashing::Result(0, 5));
+    index.remove(5);
+    EXPECT_EQ(index.size(), test->des2.size() - 1);
+    nn = index.knn(test->des2[5], 1);
+    EXPECT_GT(nn.front().first, 0);
+
+    int id = index.insert(test->des2[5]);
+    EXPECT_EQ(id, test->des2.size());
+    nn = index.knn(test->des2[5], 1);
+    EXPECT_EQ(nn.front(), MultiIndexHashing::Result(0, id));
+}
 
 TEST(TwoViewReconstruction, EssentialMatrix)
 {